@@ -0,0 +1,84 @@
+#!/bin/bash
+
+# Batch throughput with and without NUMA-aware thread placement
+# Runs the transcoder in --batch mode over the same inputs twice: with threads
+# floating (default) and with --affinity (workers pinned to the cores local to
+# their GPU, API/control threads on separate cores). Reports files/sec for
+# each run. Uses INPUT_DIR when set, otherwise generates 1080p H.264 test
+# segments with ffmpeg. Fails when a run leaves files unprocessed, when the
+# pinned run did not read the topology or pin every worker, or when pinning
+# costs more than TOLERANCE percent of the floating throughput.
+#
+# Usage: ./scripts/bench_affinity.sh [segments] [workers]
+#   segments  generated test segments (default 200, ignored with INPUT_DIR)
+#   workers   transcoder workers (default 14)
+#   TOLERANCE=5  throughput pinned threads may lose to floating ones, percent
+#
+# Environment: TRANSCODER (binary, default ./transcoder), INPUT_DIR,
+#              BACKEND (nvenc or software, default nvenc)
+
+SEGMENTS="${1:-200}"
+WORKERS="${2:-14}"
+TOLERANCE="${TOLERANCE:-5}"
+BACKEND="${BACKEND:-nvenc}"
+
+. "$(dirname "$0")/lib.sh"
+setup_work_dir affinity_bench
+
+# One batch run; sets RATE (files/sec) and PROCESSED
+run() {
+    rm -rf "${WORK_DIR}/out" && mkdir -p "${WORK_DIR}/out"
+    local start end
+    start=$(date +%s.%N)
+    "$TRANSCODER" --batch --encoder-backend "$BACKEND" --workers "$WORKERS" \
+        --config "${WORK_DIR}/config.json" "$@" 2> "${WORK_DIR}/run.log"
+    end=$(date +%s.%N)
+    cat "${WORK_DIR}/run.log" >> "$LOG_FILE"
+    PROCESSED=$(grep -o 'Files Processed: [0-9]*' "${WORK_DIR}/run.log" | grep -o '[0-9]*$')
+    [[ "${PROCESSED:-0}" -eq "$EXPECTED" ]] || fail "${PROCESSED:-0} of $EXPECTED files processed"
+    RATE=$(echo "scale=2; $PROCESSED / ($end - $start)" | bc)
+}
+
+if [[ -z "$INPUT_DIR" ]]; then
+    INPUT_DIR="${WORK_DIR}/in"
+    mkdir -p "$INPUT_DIR"
+    log "Generating $SEGMENTS test segments (10s, 1920x1080 H.264)"
+    ffmpeg -hide_banner -loglevel error -f lavfi -i "testsrc2=size=1920x1080:rate=25:duration=10" \
+        -c:v libx264 -preset veryfast -g 25 -pix_fmt yuv420p -f mpegts \
+        "${INPUT_DIR}/seg_1.ts" || fail "could not generate test segment"
+    for i in $(seq 2 "$SEGMENTS"); do
+        cp "${INPUT_DIR}/seg_1.ts" "${INPUT_DIR}/seg_${i}.ts"
+    done
+fi
+
+EXPECTED=$(find "$INPUT_DIR" -maxdepth 1 -name '*.ts' ! -name '*_h264.ts' | wc -l)
+[[ "$EXPECTED" -gt 0 ]] || fail "no .ts files in $INPUT_DIR"
+
+cat > "${WORK_DIR}/config.json" << EOF
+{
+  "inputDir": "${INPUT_DIR}",
+  "outputDir": "${WORK_DIR}/out"
+}
+EOF
+
+log "Floating threads ($BACKEND, $WORKERS workers)"
+run
+FLOAT_RATE=$RATE
+
+log "NUMA-aware placement (--affinity)"
+run --affinity
+PINNED_RATE=$RATE
+grep '^\[Affinity\]' "${WORK_DIR}/run.log"
+grep -q '^\[Affinity\] .* NUMA node(s)' "${WORK_DIR}/run.log" || fail "--affinity did not read the CPU topology"
+grep -q 'Could not pin' "${WORK_DIR}/run.log" && fail "a worker could not be pinned"
+
+echo
+echo -e "${GREEN}Results${NC} ($PROCESSED files, $BACKEND, $WORKERS workers)"
+echo "  Floating:  ${FLOAT_RATE} files/sec"
+echo "  Pinned:    ${PINNED_RATE} files/sec"
+echo "  Change:    $(echo "scale=1; 100 * ($PINNED_RATE - $FLOAT_RATE) / $FLOAT_RATE" | bc)%"
+
+[[ $(echo "$PINNED_RATE * 100 >= $FLOAT_RATE * (100 - $TOLERANCE)" | bc) -eq 1 ]] ||
+    fail "pinned threads more than ${TOLERANCE}% slower than floating ones"
+
+echo -e "\n${GREEN}[PASS]${NC} every file processed both ways, pinned within ${TOLERANCE}% of floating or better"
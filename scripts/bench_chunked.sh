@@ -0,0 +1,83 @@
+#!/bin/bash
+
+# Long-input latency: one worker per file vs. GOP-parallel chunks (no GPU required)
+# Generates one long 1080p H.264 recording with ffmpeg, then transcodes it on
+# the software backend twice: with chunking off (a single worker) and with
+# chunking on (parts spread over all workers, stitched into one output).
+# Reports the wall time of each run and checks the stitched output's frame
+# count against the unsplit one.
+#
+# Usage: ./scripts/bench_chunked.sh [minutes] [workers]
+#   minutes  length of the test recording (default 5)
+#   workers  transcoder workers (default 4)
+
+MINUTES="${1:-5}"
+WORKERS="${2:-4}"
+
+. "$(dirname "$0")/lib.sh"
+setup_work_dir chunked_bench
+
+frames() {
+    ffprobe -v error -select_streams v:0 -count_packets -show_entries stream=nb_read_packets \
+        -of csv=p=0 "$1"
+}
+
+# Transcode the recording once; sets ELAPSED to the wall time in seconds
+run() {
+    local chunk_mb="$1"
+    rm -rf "${WORK_DIR}/out" && mkdir -p "${WORK_DIR}/out"
+    "$TRANSCODER" --encoder-backend software --workers "$WORKERS" \
+        --chunk-mb "$chunk_mb" --config "${WORK_DIR}/config.json" 2>> "$LOG_FILE" &
+    DAEMON_PID=$!
+    wait_api /health
+
+    local start end job_id
+    start=$(date +%s.%N)
+    job_id=$(json_field "$(curl -s -X POST "$API/enqueue" -H 'Content-Type: application/json' \
+        -d '{"inputPath":"recording.ts","consolidate":false}')" jobId)
+    [[ -n "$job_id" ]] || fail "enqueue rejected"
+    wait_job "$job_id" 3600
+    end=$(date +%s.%N)
+    stop_daemon
+    [[ "$JOB_STATE" == "done" ]] || fail "job $job_id $JOB_STATE (chunkMb $chunk_mb)"
+    ELAPSED=$(echo "$end - $start" | bc)
+}
+
+mkdir -p "${WORK_DIR}/in"
+log "Generating a ${MINUTES}-minute 1080p recording"
+ffmpeg -hide_banner -loglevel error -f lavfi \
+    -i "testsrc2=size=1920x1080:rate=25:duration=$((MINUTES * 60))" \
+    -c:v libx264 -preset veryfast -g 50 -b:v 4M -pix_fmt yuv420p -f mpegts \
+    "${WORK_DIR}/in/recording.ts" || fail "could not generate the recording"
+SIZE_MB=$(( $(stat -c %s "${WORK_DIR}/in/recording.ts") >> 20 ))
+CHUNK_MB=$(( SIZE_MB / WORKERS ))
+[[ "$CHUNK_MB" -ge 1 ]] || fail "recording too small to split (${SIZE_MB} MB)"
+
+cat > "${WORK_DIR}/config.json" << EOF
+{
+  "inputDir": "${WORK_DIR}/in",
+  "outputDir": "${WORK_DIR}/out",
+  "codecProfiles": [{ "name": "h264", "codec": "h264", "softwarePreset": "veryfast" }]
+}
+EOF
+
+log "Single worker (chunking off)"
+run 0
+SINGLE=$ELAPSED
+SINGLE_FRAMES=$(frames "${WORK_DIR}"/out/recording_h264.ts)
+
+log "Chunked (~${CHUNK_MB} MB parts over $WORKERS workers)"
+run "$CHUNK_MB"
+CHUNKED=$ELAPSED
+CHUNKED_FRAMES=$(frames "${WORK_DIR}"/out/recording_h264.ts)
+
+echo
+echo -e "${GREEN}Results${NC} (${SIZE_MB} MB input, $WORKERS workers)"
+echo "  Single worker:  ${SINGLE}s  (${SINGLE_FRAMES} frames)"
+echo "  Chunked:        ${CHUNKED}s  (${CHUNKED_FRAMES} frames)"
+echo "  Speedup:        $(echo "scale=2; $SINGLE / $CHUNKED" | bc)x"
+
+[[ "$SINGLE_FRAMES" -eq "$CHUNKED_FRAMES" ]] || fail "stitched output has $CHUNKED_FRAMES frames, expected $SINGLE_FRAMES"
+ls "${WORK_DIR}"/out/*.part* > /dev/null 2>&1 && fail "part files left behind"
+
+echo -e "\n${GREEN}[PASS]${NC} stitched output matches the single-worker frame count"
@@ -0,0 +1,222 @@
+#!/usr/bin/env python3
+"""
+Enqueue path benchmark: POST /enqueue + curl webhook vs. the local socket
+
+Starts the transcoder in --no-gpu mode (workers acknowledge immediately, so
+the numbers measure the submission and notification path, not transcoding),
+then submits the same dummy segments twice:
+
+  http   one POST /enqueue per segment with a callbackUrl pointing at a
+         webhook receiver in this script
+  local  pipelined ENQUEUE frames on the Unix socket with the notify flag;
+         acks and completion frames come back on the same connection
+
+Reports enqueue latency (request sent -> ack), completion latency (request
+sent -> completion received) and throughput for each path.
+
+Usage: ./scripts/bench_local_enqueue.py [jobs] [window]
+  jobs     segments per run (default 2000)
+  window   local socket requests in flight (default 64)
+
+Environment: TRANSCODER (binary, default ./transcoder), TRANSCODER_ARGS,
+             TRANSCODER_API_PORT (default 8080)
+"""
+
+import http.server
+import json
+import os
+import shlex
+import socket
+import struct
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+import urllib.request
+
+JOBS = int(sys.argv[1]) if len(sys.argv) > 1 else 2000
+WINDOW = int(sys.argv[2]) if len(sys.argv) > 2 else 64
+TRANSCODER = os.environ.get("TRANSCODER", "./transcoder")
+API_PORT = int(os.environ.get("TRANSCODER_API_PORT", "8080"))
+WEBHOOK_PORT = API_PORT + 11
+
+# Wire format (see "Local Socket Protocol" in transcoder.c)
+HEADER = struct.Struct("=IBBH")
+ENQUEUE = struct.Struct("=IIBBBBHHHH")
+ACK = struct.Struct("=IhHI32s")
+COMPLETION = struct.Struct("=IBBHIIHH")
+FRAME_ENQUEUE, FRAME_ACK, FRAME_COMPLETION = 1, 2, 3
+ENQUEUE_NOTIFY, ENQUEUE_NO_CONSOLIDATE = 1, 2
+FORMAT_DEFAULT = 0xFF
+ACK_QUEUED, ACK_GROUPED = 0, 1
+
+
+def percentile(values, p):
+    if not values:
+        return 0.0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+
+def report(name, elapsed, enqueue_ms, completion_ms, rejected):
+    print(f"  {name:<6} {len(completion_ms) / elapsed:9.0f} jobs/s"
+          f"   enqueue p50 {percentile(enqueue_ms, 50):7.3f}ms p99 {percentile(enqueue_ms, 99):7.3f}ms"
+          f"   completion p50 {percentile(completion_ms, 50):7.3f}ms p99 {percentile(completion_ms, 99):7.3f}ms"
+          f"   rejected {rejected}")
+
+
+def wait_for(predicate, timeout):
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        if predicate():
+            return True
+        time.sleep(0.05)
+    return False
+
+
+def run_http(files):
+    sent = {}
+    done = {}
+    lock = threading.Lock()
+
+    class Webhook(http.server.BaseHTTPRequestHandler):
+        def do_POST(self):
+            body = self.rfile.read(int(self.headers.get("Content-Length", 0)))
+            now = time.perf_counter()
+            self.send_response(200)
+            self.end_headers()
+            with lock:
+                done[json.loads(body)["inputFile"]] = now
+
+        def log_message(self, *args):
+            pass
+
+    server = http.server.ThreadingHTTPServer(("127.0.0.1", WEBHOOK_PORT), Webhook)
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+
+    enqueue_ms = []
+    rejected = 0
+    callback = f"http://127.0.0.1:{WEBHOOK_PORT}/done"
+    start = time.perf_counter()
+    for path in files:
+        body = json.dumps({"inputPath": path, "callbackUrl": callback, "consolidate": False}).encode()
+        request = urllib.request.Request(f"http://127.0.0.1:{API_PORT}/enqueue", data=body,
+                                         headers={"Content-Type": "application/json"})
+        t0 = time.perf_counter()
+        try:
+            urllib.request.urlopen(request).read()
+        except urllib.error.HTTPError:
+            rejected += 1
+            continue
+        enqueue_ms.append((time.perf_counter() - t0) * 1000)
+        sent[path] = t0
+
+    wait_for(lambda: len(done) >= len(sent), 60)
+    elapsed = time.perf_counter() - start
+    server.shutdown()
+
+    completion_ms = [(done[p] - sent[p]) * 1000 for p in sent if p in done]
+    report("http", elapsed, enqueue_ms, completion_ms, rejected)
+
+
+def run_local(files, socket_path):
+    sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    sock.connect(socket_path)
+
+    sent = {}
+    acked = {}
+    done = {}
+    rejected = [0]
+    in_flight = threading.Semaphore(WINDOW)
+
+    def reader():
+        buf = b""
+        while len(done) + rejected[0] < len(files):
+            chunk = sock.recv(65536)
+            if not chunk:
+                return
+            buf += chunk
+            now = time.perf_counter()
+            while len(buf) >= HEADER.size:
+                length, ftype, _, count = HEADER.unpack_from(buf)
+                if len(buf) < HEADER.size + length:
+                    break
+                payload = buf[HEADER.size:HEADER.size + length]
+                buf = buf[HEADER.size + length:]
+                if ftype == FRAME_ACK:
+                    for i in range(count):
+                        tag, status, _, _, _ = ACK.unpack_from(payload, i * ACK.size)
+                        acked[tag] = now
+                        in_flight.release()
+                        if status not in (ACK_QUEUED, ACK_GROUPED):
+                            rejected[0] += 1
+                elif ftype == FRAME_COMPLETION:
+                    tag = COMPLETION.unpack_from(payload)[0]
+                    done[tag] = now
+
+    thread = threading.Thread(target=reader, daemon=True)
+    thread.start()
+
+    start = time.perf_counter()
+    for tag, path in enumerate(files):
+        raw = path.encode()
+        frame = ENQUEUE.pack(tag, 0, 0, FORMAT_DEFAULT, ENQUEUE_NOTIFY | ENQUEUE_NO_CONSOLIDATE, 0,
+                             len(raw), 0, 0, 0) + raw
+        in_flight.acquire()
+        sent[tag] = time.perf_counter()
+        sock.sendall(HEADER.pack(len(frame), FRAME_ENQUEUE, 0, 0) + frame)
+
+    thread.join(60)
+    elapsed = time.perf_counter() - start
+    sock.close()
+
+    enqueue_ms = [(acked[t] - sent[t]) * 1000 for t in sent if t in acked]
+    completion_ms = [(done[t] - sent[t]) * 1000 for t in sent if t in done]
+    report("local", elapsed, enqueue_ms, completion_ms, rejected[0])
+
+
+def main():
+    if not os.access(TRANSCODER, os.X_OK):
+        sys.exit(f"[ERROR] {TRANSCODER} not found - run make first")
+
+    with tempfile.TemporaryDirectory(prefix="bench_local.") as work_dir:
+        files = []
+        for i in range(JOBS):
+            path = os.path.join(work_dir, f"seg_{i}.ts")
+            open(path, "w").close()
+            files.append(path)
+
+        socket_path = os.path.join(work_dir, "transcoder.sock")
+        log = open(os.path.join(work_dir, "transcoder.log"), "w")
+        daemon = subprocess.Popen(
+            [TRANSCODER, "--no-gpu", "--local-socket", socket_path,
+             "--queue-capacity", str(max(JOBS * 2, 1000)),
+             # Both runs submit the same files; measure them as new jobs
+             "--coalesce", "off",
+             # The segments are empty files
+             "--no-ts-check"] +
+            shlex.split(os.environ.get("TRANSCODER_ARGS", "")),
+            # Paths are enqueued absolute, so they must lie under inputDir
+            env=dict(os.environ, TRANSCODER_INPUT_DIR=work_dir),
+            stderr=log)
+        try:
+            if not wait_for(lambda: os.path.exists(socket_path), 10):
+                sys.exit("[ERROR] transcoder did not open the local socket")
+
+            print(f"Enqueue path benchmark: {JOBS} jobs, local window {WINDOW}")
+            run_http(files)
+            run_local(files, socket_path)
+
+            metrics = urllib.request.urlopen(f"http://127.0.0.1:{API_PORT}/metrics").read().decode()
+            print()
+            for line in metrics.splitlines():
+                if line.startswith("transcoder_local_"):
+                    print(" ", line)
+        finally:
+            daemon.terminate()
+            daemon.wait()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,89 @@
+#!/bin/bash
+
+# Scheduling benchmark on simulated devices (no GPU required)
+# Starts the transcoder with --simulate-devices, enqueues dummy segments through
+# the API and reports throughput plus the per-device metrics.
+#
+# Usage: ./scripts/bench_simulated_devices.sh [device_spec] [jobs]
+#   device_spec  latency_ms[:failure_rate[:fail_after[:corrupt_rate]]] per device, comma separated
+#                (default "40,40" = two identical devices)
+#   jobs         number of segments to enqueue (default 500)
+#
+# Examples:
+#   ./scripts/bench_simulated_devices.sh "40,120"          # one slow device
+#   ./scripts/bench_simulated_devices.sh "40,40:0:100"     # device 1 dies after 100 jobs
+#   TRANSCODER_ARGS="--adaptive --adaptive-interval 2" \
+#       ./scripts/bench_simulated_devices.sh "40,120" 2000  # adaptive worker count
+
+DEVICE_SPEC="${1:-40,40}"
+JOBS="${2:-500}"
+TRANSCODER="${TRANSCODER:-./transcoder}"
+API="http://localhost:8080"
+WORK_DIR="$(mktemp -d /tmp/bench_sim.XXXXXX)"
+LOG_FILE="${WORK_DIR}/transcoder.log"
+
+GREEN='\033[0;32m'
+BLUE='\033[0;34m'
+RED='\033[0;31m'
+NC='\033[0m'
+
+log() {
+    echo -e "${BLUE}[$(date '+%H:%M:%S')]${NC} $1"
+}
+
+cleanup() {
+    if [[ -n "$DAEMON_PID" ]]; then
+        kill -TERM "$DAEMON_PID" 2>/dev/null
+        wait "$DAEMON_PID" 2>/dev/null
+    fi
+    rm -rf "$WORK_DIR"
+}
+trap cleanup EXIT
+
+if [[ ! -x "$TRANSCODER" ]]; then
+    echo -e "${RED}[ERROR]${NC} $TRANSCODER not found - run make first" >&2
+    exit 1
+fi
+
+# Empty dummy segments: the daemon runs with --no-ts-check
+log "Creating $JOBS dummy segments in $WORK_DIR"
+for i in $(seq 1 "$JOBS"); do
+    : > "${WORK_DIR}/seg_${i}.ts"
+done
+
+log "Starting transcoder with simulated devices: $DEVICE_SPEC"
+# shellcheck disable=SC2086
+TRANSCODER_INPUT_DIR="$WORK_DIR" "$TRANSCODER" --simulate-devices "$DEVICE_SPEC" --no-ts-check $TRANSCODER_ARGS 2> "$LOG_FILE" &
+DAEMON_PID=$!
+
+for _ in $(seq 1 50); do
+    curl -sf "$API/health" > /dev/null && break
+    sleep 0.2
+done
+
+START=$(date +%s.%N)
+for i in $(seq 1 "$JOBS"); do
+    curl -s -X POST "$API/enqueue" -H 'Content-Type: application/json' \
+        -d "{\"inputPath\":\"${WORK_DIR}/seg_${i}.ts\"}" > /dev/null
+done
+
+while true; do
+    HEALTH=$(curl -s "$API/health")
+    DONE=$(echo "$HEALTH" | grep -o '"processed":[ ]*[0-9]*' | grep -o '[0-9]*$')
+    FAILED=$(echo "$HEALTH" | grep -o '"failed":[ ]*[0-9]*' | grep -o '[0-9]*$')
+    [[ $((DONE + FAILED)) -ge $JOBS ]] && break
+    sleep 0.5
+done
+END=$(date +%s.%N)
+
+ELAPSED=$(echo "$END - $START" | bc)
+RATE=$(echo "scale=1; $JOBS / $ELAPSED" | bc)
+
+echo
+echo -e "${GREEN}Results${NC}"
+echo "  Devices:    $DEVICE_SPEC"
+echo "  Jobs:       $JOBS (processed $DONE, failed $FAILED)"
+echo "  Elapsed:    ${ELAPSED}s"
+echo "  Throughput: ${RATE} files/sec"
+echo
+curl -s "$API/metrics" | grep -E '^transcoder_(device|adaptive)_'
@@ -0,0 +1,119 @@
+#!/bin/bash
+
+# Queue order benchmark: arrival order vs. shortest expected job first (no GPU required)
+# Generates short and long 720p H.264 segments for one camera with ffmpeg, then
+# runs the transcoder on the software backend with a single worker twice: with
+# queueOrder "deadline" (archive jobs in arrival order) and "sjf". Each run
+# first trains the cost model on a few segments, then enqueues a burst of long
+# and short segments at once and reports their mean enqueue-to-completion
+# latency and the model's predicted vs. actual processing time. Fails only if
+# sjf is more than TOLERANCE percent slower than arrival order: which job the
+# idle worker picks first is a race, so small differences are noise.
+#
+# Usage: ./scripts/bench_sjf.sh [long] [short]
+#   long   long segments in the burst (default 3)
+#   short  short segments per long one (default 4)
+#   TOLERANCE=10  mean latency sjf may exceed arrival order by, percent
+
+LONG_JOBS="${1:-3}"
+SHORT_PER_LONG="${2:-4}"
+TOLERANCE="${TOLERANCE:-10}"
+
+. "$(dirname "$0")/lib.sh"
+setup_work_dir sjf_bench
+
+enqueue() {
+    local response
+    response=$(curl -s -X POST "$API/enqueue" -H 'Content-Type: application/json' \
+        -d "{\"inputPath\":\"$1\",\"priority\":\"archive\",\"consolidate\":false,\"coalesce\":\"off\"}")
+    echo "$response" | grep -q '"queued"' || fail "enqueue of $1 rejected: $response"
+}
+
+wait_done() {
+    for _ in $(seq 1 1200); do
+        [[ "$(metric transcoder_class_latency_seconds_count 'class="archive"')" -ge "$1" ]] && return
+        sleep 0.5
+    done
+    fail "jobs did not finish"
+}
+
+# One run in the given queue order; sets MEAN (seconds) and ERROR (mean |error| %)
+run() {
+    rm -rf "${WORK_DIR}/out" && mkdir -p "${WORK_DIR}/out"
+    "$TRANSCODER" --encoder-backend software --workers 1 \
+        --queue-order "$1" --config "${WORK_DIR}/config.json" 2>> "$LOG_FILE" &
+    DAEMON_PID=$!
+    wait_api /health
+
+    # Train the model on both sizes
+    for i in 1 2; do
+        enqueue cam01/short_1.ts
+        enqueue cam01/long_1.ts
+    done
+    wait_done 4
+    local count0 sum0
+    count0=$(metric transcoder_class_latency_seconds_count 'class="archive"')
+    sum0=$(metric transcoder_class_latency_seconds_sum 'class="archive"')
+
+    # Burst: long segments first, each followed by short ones
+    local total=0
+    for i in $(seq 1 "$LONG_JOBS"); do
+        enqueue "cam01/long_${i}.ts"
+        for j in $(seq 1 "$SHORT_PER_LONG"); do
+            enqueue "cam01/short_$(( (i - 1) * SHORT_PER_LONG + j )).ts"
+        done
+        total=$((total + 1 + SHORT_PER_LONG))
+    done
+    wait_done $((count0 + total))
+
+    local count1 sum1
+    count1=$(metric transcoder_class_latency_seconds_count 'class="archive"')
+    sum1=$(metric transcoder_class_latency_seconds_sum 'class="archive"')
+    MEAN=$(echo "scale=2; ($sum1 - $sum0) / ($count1 - $count0)" | bc)
+    ERROR=$(echo "scale=1; 100 * $(metric transcoder_cost_model_abs_error_seconds_total) / \
+        $(metric transcoder_cost_model_actual_seconds_total)" | bc)
+    echo
+    curl -s "$API/metrics" | grep -E '^transcoder_cost_model_'
+    echo
+    stop_daemon
+}
+
+SHORT_JOBS=$((LONG_JOBS * SHORT_PER_LONG))
+mkdir -p "${WORK_DIR}/in/cam01"
+log "Generating $LONG_JOBS long (60s) and $SHORT_JOBS short (4s) 720p segments"
+for i in $(seq 1 "$LONG_JOBS"); do
+    ffmpeg -hide_banner -loglevel error -f lavfi -i "testsrc2=size=1280x720:rate=25:duration=60" \
+        -c:v libx264 -preset veryfast -g 50 -pix_fmt yuv420p -f mpegts \
+        "${WORK_DIR}/in/cam01/long_${i}.ts" || fail "could not generate a long segment"
+done
+for i in $(seq 1 "$SHORT_JOBS"); do
+    ffmpeg -hide_banner -loglevel error -f lavfi -i "testsrc2=size=1280x720:rate=25:duration=4" \
+        -c:v libx264 -preset veryfast -g 50 -pix_fmt yuv420p -f mpegts \
+        "${WORK_DIR}/in/cam01/short_${i}.ts" || fail "could not generate a short segment"
+done
+
+cat > "${WORK_DIR}/config.json" << EOF
+{
+  "inputDir": "${WORK_DIR}/in",
+  "outputDir": "${WORK_DIR}/out",
+  "codecProfiles": [{ "name": "h264", "codec": "h264", "softwarePreset": "veryfast" }]
+}
+EOF
+
+log "Arrival order (queueOrder deadline)"
+run deadline
+FIFO_MEAN=$MEAN
+
+log "Shortest expected job first (queueOrder sjf)"
+run sjf
+SJF_MEAN=$MEAN
+
+echo -e "${GREEN}Results${NC} ($LONG_JOBS long + $SHORT_JOBS short segments, 1 worker)"
+echo "  Arrival order:  mean latency ${FIFO_MEAN}s"
+echo "  SJF:            mean latency ${SJF_MEAN}s  (model error ${ERROR}% of actual time)"
+echo "  Change:         $(echo "scale=1; 100 * ($SJF_MEAN - $FIFO_MEAN) / $FIFO_MEAN" | bc)%"
+
+[[ $(echo "$SJF_MEAN * 100 <= $FIFO_MEAN * (100 + $TOLERANCE)" | bc) -eq 1 ]] ||
+    fail "sjf raised the mean latency by more than ${TOLERANCE}%"
+
+echo -e "\n${GREEN}[PASS]${NC} shortest-expected-job-first within ${TOLERANCE}% of arrival order or better"
@@ -0,0 +1,94 @@
+#!/bin/bash
+
+# Restart downtime: serial vs. parallel pipeline warm-up
+# Starts the transcoder twice with the same worker count: with
+# startupParallel 1 (one pipeline built at a time per device, as before) and
+# with the given per-device parallelism. For each run reports the time from
+# launch until /ready answers 200 (first warm pipeline, jobs accepted) and
+# until every pipeline is warm, then checks that a segment enqueued right
+# after /ready completes.
+#
+# Usage: ./scripts/bench_startup.sh [workers] [parallel]
+#   workers   transcoder workers (default 14)
+#   parallel  pipelines built concurrently per device (default 4)
+#
+# Environment: TRANSCODER (binary, default ./transcoder),
+#              BACKEND (nvenc or software, default software)
+
+WORKERS="${1:-14}"
+PARALLEL="${2:-4}"
+BACKEND="${BACKEND:-software}"
+
+. "$(dirname "$0")/lib.sh"
+setup_work_dir startup_bench
+
+# One start-up; sets READY and ALL_WARM (seconds since launch)
+run() {
+    rm -rf "${WORK_DIR}/out" && mkdir -p "${WORK_DIR}/out"
+    local start now
+    start=$(date +%s.%N)
+    "$TRANSCODER" --encoder-backend "$BACKEND" --workers "$WORKERS" \
+        --startup-parallel "$1" --config "${WORK_DIR}/config.json" 2>> "$LOG_FILE" &
+    DAEMON_PID=$!
+
+    READY=""
+    for _ in $(seq 1 1200); do
+        if curl -sf "$API/ready" > /dev/null; then
+            now=$(date +%s.%N)
+            READY=$(echo "$now - $start" | bc)
+            break
+        fi
+        sleep 0.05
+    done
+    [[ -n "$READY" ]] || fail "/ready never returned 200 (startupParallel $1)"
+
+    local job_id
+    job_id=$(json_field "$(curl -s -X POST "$API/enqueue" -H 'Content-Type: application/json' \
+        -d '{"inputPath":"seg.ts","consolidate":false}')" jobId)
+    [[ -n "$job_id" ]] || fail "enqueue rejected after /ready"
+
+    ALL_WARM=""
+    for _ in $(seq 1 1200); do
+        ALL_WARM=$(metric transcoder_startup_all_warm_seconds)
+        [[ -n "$ALL_WARM" ]] && break
+        sleep 0.1
+    done
+    [[ -n "$ALL_WARM" ]] || fail "pipelines never all warm (startupParallel $1)"
+
+    wait_job "$job_id"
+    [[ "$JOB_STATE" == "done" ]] || fail "job enqueued after /ready ended $JOB_STATE"
+
+    echo
+    curl -s "$API/metrics" | grep -E '^transcoder_(startup_|pipelines_warm)'
+    echo
+    stop_daemon
+}
+
+mkdir -p "${WORK_DIR}/in"
+log "Generating a test segment"
+ffmpeg -hide_banner -loglevel error -f lavfi -i "testsrc2=size=1920x1080:rate=25:duration=4" \
+    -c:v libx264 -preset veryfast -g 25 -pix_fmt yuv420p -f mpegts \
+    "${WORK_DIR}/in/seg.ts" || fail "could not generate test segment"
+
+cat > "${WORK_DIR}/config.json" << EOF_CONFIG
+{
+  "inputDir": "${WORK_DIR}/in",
+  "outputDir": "${WORK_DIR}/out"
+}
+EOF_CONFIG
+
+log "Serial warm-up (startupParallel 1, $BACKEND, $WORKERS workers)"
+run 1
+SERIAL_READY=$READY
+SERIAL_ALL=$ALL_WARM
+
+log "Parallel warm-up (startupParallel $PARALLEL)"
+run "$PARALLEL"
+PARALLEL_READY=$READY
+PARALLEL_ALL=$ALL_WARM
+
+echo -e "${GREEN}Results${NC} ($BACKEND, $WORKERS workers)"
+echo "  Serial:    ready after ${SERIAL_READY}s, all warm after ${SERIAL_ALL}s"
+echo "  Parallel:  ready after ${PARALLEL_READY}s, all warm after ${PARALLEL_ALL}s"
+
+echo -e "\n${GREEN}[PASS]${NC} jobs accepted once the first pipeline was warm"
@@ -0,0 +1,93 @@
+#!/bin/bash
+
+# Shared setup for the test and benchmark scripts. Source it, then create the
+# work directory:
+#
+#   . "$(dirname "$0")/lib.sh"
+#   setup_work_dir <name>
+#
+# TRANSCODER is the binary (default ./transcoder) and API its HTTP address.
+# setup_work_dir creates WORK_DIR (/tmp/<name>.XXXXXX) with LOG_FILE in it
+# and checks the binary. On exit the daemon started as DAEMON_PID is stopped,
+# the script's on_exit function runs if it has one, and WORK_DIR is removed
+# unless fail set KEEP_WORK_DIR.
+
+TRANSCODER="$(realpath "${TRANSCODER:-./transcoder}")"
+API="http://localhost:8080"
+
+GREEN='\033[0;32m'
+BLUE='\033[0;34m'
+RED='\033[0;31m'
+NC='\033[0m'
+
+log() {
+    echo -e "${BLUE}[$(date '+%H:%M:%S')]${NC} $1"
+}
+
+fail() {
+    echo -e "${RED}[FAIL]${NC} $1" >&2
+    echo "Transcoder log: $LOG_FILE" >&2
+    KEEP_WORK_DIR=1
+    exit 1
+}
+
+stop_daemon() {
+    if [[ -n "$DAEMON_PID" ]]; then
+        kill -TERM "$DAEMON_PID" 2>/dev/null
+        wait "$DAEMON_PID" 2>/dev/null
+        DAEMON_PID=""
+    fi
+}
+
+cleanup() {
+    stop_daemon
+    declare -F on_exit > /dev/null && on_exit
+    [[ -z "$KEEP_WORK_DIR" ]] && rm -rf "$WORK_DIR"
+}
+
+setup_work_dir() {
+    WORK_DIR="$(mktemp -d "/tmp/$1.XXXXXX")" || exit 1
+    LOG_FILE="${WORK_DIR}/transcoder.log"
+    trap cleanup EXIT
+    [[ -x "$TRANSCODER" ]] || fail "$TRANSCODER not found - run make first"
+}
+
+# wait_api [endpoint] [seconds]: poll until the endpoint (default /ready)
+# answers 2xx, for at most the given time (default 30s)
+wait_api() {
+    local endpoint="${1:-/ready}"
+    for _ in $(seq 1 $(( ${2:-30} * 5 ))); do
+        curl -sf "$API$endpoint" > /dev/null && return
+        sleep 0.2
+    done
+    fail "transcoder did not answer $endpoint"
+}
+
+# json_field <json> <name>: first string or number field of that name
+json_field() {
+    echo "$1" | grep -o "\"$2\":[^,}]*" | head -1 | cut -d: -f2- | tr -d ' \t"'
+}
+
+# wait_job <job id> [seconds]: poll GET /jobs/{id} until the job is done or
+# failed, for at most the given time (default 120s). Sets JOB_STATUS (the
+# record) and JOB_STATE.
+wait_job() {
+    for _ in $(seq 1 $(( ${2:-120} * 5 ))); do
+        JOB_STATUS=$(curl -s "$API/jobs/$1")
+        JOB_STATE=$(json_field "$JOB_STATUS" state)
+        [[ "$JOB_STATE" == "done" || "$JOB_STATE" == "failed" ]] && return
+        sleep 0.2
+    done
+}
+
+# metric <name> [label="value"]: value of a metric, summed over its series
+# (only those carrying the label when one is given). Prints nothing when no
+# series matches.
+metric() {
+    curl -s "$API/metrics" | awk -v name="$1" -v label="$2" '
+        ($1 == name || index($1, name "{") == 1) && (label == "" || index($1, label)) {
+            sum += $2
+            n++
+        }
+        END { if (n) print (sum == int(sum) ? sprintf("%d", sum) : sprintf("%.6f", sum)) }'
+}
@@ -0,0 +1,117 @@
+#!/bin/bash
+
+# RabbitMQ consumer check against a throwaway local broker (no GPU required)
+# Starts rabbitmq:3.13-management in Docker and the transcoder in --no-gpu mode
+# consuming segment.raw.ready. It publishes dummy RawSegmentReadyMessages, then
+# checks that every message was acked and that one segment.transcoded.ready
+# result was published for each.
+#
+# Usage: ./scripts/test_amqp_consumer.sh [messages] [prefetch]
+#   messages  RawSegmentReadyMessages to publish (default 200)
+#   prefetch  consumer prefetch window (default 32)
+
+MESSAGES="${1:-200}"
+PREFETCH="${2:-32}"
+TRANSCODER="${TRANSCODER:-./transcoder}"
+BROKER="transcoder-amqp-test"
+MGMT="http://localhost:15672/api"
+AUTH="guest:guest"
+API="http://localhost:8080"
+WORK_DIR="$(mktemp -d /tmp/amqp_test.XXXXXX)"
+LOG_FILE="${WORK_DIR}/transcoder.log"
+
+GREEN='\033[0;32m'
+BLUE='\033[0;34m'
+RED='\033[0;31m'
+NC='\033[0m'
+
+log() {
+    echo -e "${BLUE}[$(date '+%H:%M:%S')]${NC} $1"
+}
+
+fail() {
+    echo -e "${RED}[FAIL]${NC} $1" >&2
+    echo "Transcoder log: $LOG_FILE" >&2
+    KEEP_WORK_DIR=1
+    exit 1
+}
+
+cleanup() {
+    if [[ -n "$DAEMON_PID" ]]; then
+        kill -TERM "$DAEMON_PID" 2>/dev/null
+        wait "$DAEMON_PID" 2>/dev/null
+    fi
+    docker rm -f "$BROKER" > /dev/null 2>&1
+    [[ -z "$KEEP_WORK_DIR" ]] && rm -rf "$WORK_DIR"
+}
+trap cleanup EXIT
+
+queue_field() {
+    curl -s -u "$AUTH" "$MGMT/queues/%2f/$1" | grep -o "\"$2\":[0-9]*" | head -1 | grep -o '[0-9]*$'
+}
+
+if [[ ! -x "$TRANSCODER" ]]; then
+    fail "$TRANSCODER not found - run make first"
+fi
+
+log "Starting broker container $BROKER"
+docker run -d --rm --name "$BROKER" -p 5672:5672 -p 15672:15672 rabbitmq:3.13-management > /dev/null ||
+    fail "could not start rabbitmq container"
+for _ in $(seq 1 60); do
+    curl -sf -u "$AUTH" "$MGMT/overview" > /dev/null && break
+    sleep 1
+done
+
+# The published segments are empty files: skip the MPEG-TS input check
+log "Starting transcoder (--no-gpu, prefetch $PREFETCH)"
+TRANSCODER_INPUT_DIR="$WORK_DIR" "$TRANSCODER" --no-gpu --no-ts-check --amqp-host localhost --amqp-prefetch "$PREFETCH" 2> "$LOG_FILE" &
+DAEMON_PID=$!
+
+for _ in $(seq 1 30); do
+    curl -s "$API/metrics" | grep -q '^transcoder_amqp_connected 1' && break
+    sleep 0.5
+done
+curl -s "$API/metrics" | grep -q '^transcoder_amqp_connected 1' || fail "transcoder did not connect to the broker"
+
+log "Publishing $MESSAGES messages to segment.raw.ready"
+START=$(date +%s.%N)
+for i in $(seq 1 "$MESSAGES"); do
+    : > "${WORK_DIR}/seg_${i}.ts"
+    PAYLOAD="{\\\"RecordingJobId\\\":\\\"job-1\\\",\\\"RecordingId\\\":\\\"rec-1\\\",\\\"FileName\\\":\\\"seg_${i}.ts\\\",\\\"FilePath\\\":\\\"${WORK_DIR}/seg_${i}.ts\\\",\\\"SegmentDuration\\\":10}"
+    curl -s -u "$AUTH" -H 'Content-Type: application/json' -X POST \
+        "$MGMT/exchanges/%2f/amq.default/publish" \
+        -d "{\"properties\":{\"delivery_mode\":2},\"routing_key\":\"segment.raw.ready\",\"payload\":\"$PAYLOAD\",\"payload_encoding\":\"string\"}" \
+        > /dev/null
+done
+
+log "Waiting for results"
+for _ in $(seq 1 120); do
+    RESULTS=$(queue_field segment.transcoded.ready messages)
+    [[ "${RESULTS:-0}" -ge "$MESSAGES" ]] && break
+    sleep 0.5
+done
+END=$(date +%s.%N)
+
+sleep 2  # Let the broker's queue statistics catch up
+RESULTS=$(queue_field segment.transcoded.ready messages)
+LEFT=$(queue_field segment.raw.ready messages)
+ELAPSED=$(echo "$END - $START" | bc)
+
+echo
+echo -e "${GREEN}Results${NC}"
+echo "  Published:        $MESSAGES"
+echo "  Results:          ${RESULTS:-0}"
+echo "  Left unacked:     ${LEFT:-?}"
+echo "  Elapsed:          ${ELAPSED}s"
+echo
+curl -s "$API/metrics" | grep -E '^transcoder_amqp_'
+
+[[ "${RESULTS:-0}" -eq "$MESSAGES" ]] || fail "expected $MESSAGES results, got ${RESULTS:-0}"
+[[ "${LEFT:-1}" -eq 0 ]] || fail "$LEFT source messages were not acked"
+
+SAMPLE=$(curl -s -u "$AUTH" -H 'Content-Type: application/json' -X POST \
+    "$MGMT/queues/%2f/segment.transcoded.ready/get" \
+    -d '{"count":1,"ackmode":"ack_requeue_true","encoding":"auto"}')
+echo "$SAMPLE" | grep -q 'SourceFilePath' || fail "result message is missing SourceFilePath"
+
+echo -e "\n${GREEN}[PASS]${NC} every message acked after its result was confirmed"
@@ -0,0 +1,122 @@
+#!/bin/bash
+
+# Duplicate enqueue coalescing on the software backend (no GPU required)
+# Generates one 720p H.264 segment with ffmpeg, starts the transcoder with a
+# single worker and a webhook receiver, then enqueues the segment several
+# times while it is transcoding. Checks that the duplicates join the running
+# job, that a resubmission after it finished is answered from the cache, that
+# "coalesce":"off" and a rewritten input start new jobs, and that every
+# request's callbackUrl received a completion. Prints the
+# transcoder_coalesce* metrics at the end.
+#
+# Usage: ./scripts/test_coalesce.sh [duplicates]
+#   duplicates  extra enqueues of the running segment (default 3)
+
+DUPLICATES="${1:-3}"
+HOOK_PORT=8099
+
+. "$(dirname "$0")/lib.sh"
+setup_work_dir coalesce_test
+HOOK_FILE="${WORK_DIR}/callbacks.jsonl"
+
+on_exit() {
+    if [[ -n "$HOOK_PID" ]]; then
+        kill -TERM "$HOOK_PID" 2>/dev/null
+        wait "$HOOK_PID" 2>/dev/null
+    fi
+}
+
+# enqueue <extra JSON fields>; sets STATUS and JOB_ID from the response
+enqueue() {
+    local response
+    response=$(curl -s -X POST "$API/enqueue" -H 'Content-Type: application/json' \
+        -d "{\"inputPath\":\"seg.ts\",\"consolidate\":false,\"callbackUrl\":\"http://127.0.0.1:${HOOK_PORT}/\"$1}")
+    STATUS=$(json_field "$response" status)
+    JOB_ID=$(json_field "$response" jobId)
+    [[ -n "$JOB_ID" ]] || fail "enqueue rejected: $response"
+}
+
+wait_done() {
+    wait_job "$1"
+    [[ "$JOB_STATE" == "done" ]] || fail "job $1 ${JOB_STATE:-did not finish}"
+}
+
+mkdir -p "${WORK_DIR}/in" "${WORK_DIR}/out"
+log "Generating a 30s 720p segment"
+ffmpeg -hide_banner -loglevel error -f lavfi -i "testsrc2=size=1280x720:rate=25:duration=30" \
+    -c:v libx264 -preset veryfast -g 50 -pix_fmt yuv420p -f mpegts \
+    "${WORK_DIR}/in/seg.ts" || fail "could not generate segment"
+
+python3 -c "
+import http.server, sys
+class Hook(http.server.BaseHTTPRequestHandler):
+    def do_POST(self):
+        body = self.rfile.read(int(self.headers.get('Content-Length', 0)))
+        with open(sys.argv[1], 'ab') as f:
+            f.write(body.replace(b'\n', b' ') + b'\n')
+        self.send_response(200)
+        self.end_headers()
+    def log_message(self, *args):
+        pass
+http.server.HTTPServer(('127.0.0.1', $HOOK_PORT), Hook).serve_forever()" "$HOOK_FILE" &
+HOOK_PID=$!
+
+cat > "${WORK_DIR}/config.json" << EOF
+{
+  "workers": 1,
+  "inputDir": "${WORK_DIR}/in",
+  "outputDir": "${WORK_DIR}/out",
+  "encoderBackend": "software",
+  "codecProfiles": [{ "name": "h264", "codec": "h264", "softwarePreset": "veryfast" }],
+  "coalesce": { "key": "path", "cacheSeconds": 300 }
+}
+EOF
+
+log "Starting transcoder (software backend, 1 worker)"
+"$TRANSCODER" --config "${WORK_DIR}/config.json" 2> "$LOG_FILE" &
+DAEMON_PID=$!
+wait_api /health
+
+log "Enqueueing seg.ts and $DUPLICATES duplicates while it runs"
+enqueue ""
+[[ "$STATUS" == "queued" ]] || fail "first enqueue: status $STATUS"
+FIRST=$JOB_ID
+for _ in $(seq 1 "$DUPLICATES"); do
+    enqueue ""
+    [[ "$STATUS" == "coalesced" && "$JOB_ID" == "$FIRST" ]] || fail "duplicate: status $STATUS, job $JOB_ID"
+done
+
+enqueue ",\"coalesce\":\"off\""
+[[ "$STATUS" == "queued" && "$JOB_ID" != "$FIRST" ]] || fail "coalesce off did not start a new job"
+UNCOALESCED=$JOB_ID
+
+wait_done "$FIRST"
+sleep 0.5  # the result is cached just after the job record turns done
+log "Resubmitting after completion"
+enqueue ""
+[[ "$STATUS" == "completed" && "$JOB_ID" == "$FIRST" ]] || fail "resubmission: status $STATUS, job $JOB_ID"
+
+touch "${WORK_DIR}/in/seg.ts"
+enqueue ""
+[[ "$STATUS" == "queued" && "$JOB_ID" != "$FIRST" ]] || fail "rewritten input was not requeued"
+REWRITTEN=$JOB_ID
+
+wait_done "$UNCOALESCED"
+wait_done "$REWRITTEN"
+sleep 1
+
+# One callback per request: the first job, its duplicates and the cached
+# answer, plus the two jobs that ran on their own
+EXPECTED=$((DUPLICATES + 4))
+CALLBACKS=$(wc -l < "$HOOK_FILE" 2>/dev/null || echo 0)
+[[ "$CALLBACKS" -eq "$EXPECTED" ]] || fail "expected $EXPECTED callbacks, received $CALLBACKS"
+[[ $(grep -c "\"coalescedWith\":[[:space:]]*\"$FIRST\"" "$HOOK_FILE") -eq $((DUPLICATES + 1)) ]] ||
+    fail "duplicates were not told which job they joined"
+
+[[ "$(metric transcoder_coalesced_total 'result="attached"')" -eq "$DUPLICATES" ]] || fail "attached count"
+[[ "$(metric transcoder_coalesced_total 'result="cached"')" -eq 1 ]] || fail "cached count"
+
+echo
+curl -s "$API/metrics" | grep -E '^transcoder_coalesce'
+
+echo -e "\n${GREEN}[PASS]${NC} duplicate enqueues shared one transcode and every caller was notified"
@@ -0,0 +1,139 @@
+#!/bin/bash
+
+# Per-camera segment consolidation on the software backend (no GPU required)
+# Generates 2s 720p segments for two cameras with ffmpeg and sets their mtimes
+# as a recorder would (a segment's mtime is when it ended). camera1 sends three
+# consecutive segments out of order: they must be merged into one output in
+# recording order, with a .idx.json sidecar whose entries follow that order at
+# increasing byte offsets, and one "completed" callback for the group.
+# camera2 sends two consecutive segments and then one after a gap: the gap
+# closes the first group at once, and the segment after it is dispatched on
+# its own by the idle flush.
+#
+# Usage: ./scripts/test_consolidate.sh
+
+SEGMENT_SECONDS=2
+PER_FILE=3
+HOOK_PORT=8098
+
+. "$(dirname "$0")/lib.sh"
+setup_work_dir consolidate_test
+HOOK_FILE="${WORK_DIR}/callbacks.jsonl"
+
+on_exit() {
+    if [[ -n "$HOOK_PID" ]]; then
+        kill -TERM "$HOOK_PID" 2>/dev/null
+        wait "$HOOK_PID" 2>/dev/null
+    fi
+}
+
+# segment <name> <end offset in seconds>
+segment() {
+    ffmpeg -hide_banner -loglevel error -f lavfi \
+        -i "testsrc2=size=1280x720:rate=25:duration=${SEGMENT_SECONDS}" \
+        -c:v libx264 -preset veryfast -g 25 -pix_fmt yuv420p -f mpegts \
+        "${WORK_DIR}/in/$1.ts" || fail "could not generate $1"
+    touch -d "@$((BASE + $2))" "${WORK_DIR}/in/$1.ts"
+}
+
+# enqueue <camera> <name>
+enqueue() {
+    local response
+    response=$(curl -s -X POST "$API/enqueue" -H 'Content-Type: application/json' \
+        -d "{\"inputPath\":\"$2.ts\",\"cameraId\":\"$1\",\"callbackUrl\":\"http://127.0.0.1:${HOOK_PORT}/\"}")
+    [[ "$(json_field "$response" status)" == "grouped" ]] || fail "$2 was not grouped: $response"
+}
+
+# wait_callbacks <count> <seconds>
+wait_callbacks() {
+    for _ in $(seq 1 $(( $2 * 5 ))); do
+        [[ $(wc -l < "$HOOK_FILE" 2>/dev/null || echo 0) -ge $1 ]] && return
+        sleep 0.2
+    done
+    fail "expected $1 callbacks, received $(wc -l < "$HOOK_FILE" 2>/dev/null || echo 0)"
+}
+
+# callback <outputFile>: the callback for that output
+callback() {
+    grep "\"outputFile\":\"$1\"" "$HOOK_FILE"
+}
+
+mkdir -p "${WORK_DIR}/in" "${WORK_DIR}/out"
+log "Generating segments for camera1 and camera2"
+BASE=$(( $(date +%s) - 60 ))
+segment cam1_a 2
+segment cam1_b 4
+segment cam1_c 6
+segment cam2_a 2
+segment cam2_b 4
+segment cam2_d 8
+
+python3 -c "
+import http.server, sys
+class Hook(http.server.BaseHTTPRequestHandler):
+    def do_POST(self):
+        body = self.rfile.read(int(self.headers.get('Content-Length', 0)))
+        with open(sys.argv[1], 'ab') as f:
+            f.write(body.replace(b'\n', b' ') + b'\n')
+        self.send_response(200)
+        self.end_headers()
+    def log_message(self, *args):
+        pass
+http.server.HTTPServer(('127.0.0.1', $HOOK_PORT), Hook).serve_forever()" "$HOOK_FILE" &
+HOOK_PID=$!
+
+cat > "${WORK_DIR}/config.json" << EOF
+{
+  "workers": 1,
+  "inputDir": "${WORK_DIR}/in",
+  "outputDir": "${WORK_DIR}/out",
+  "encoderBackend": "software",
+  "codecProfiles": [{ "name": "h264", "codec": "h264", "softwarePreset": "veryfast" }],
+  "consolidateSeconds": $((SEGMENT_SECONDS * PER_FILE)),
+  "segmentSeconds": ${SEGMENT_SECONDS}
+}
+EOF
+
+log "Starting transcoder (software backend, ${PER_FILE} segments per output)"
+"$TRANSCODER" --config "${WORK_DIR}/config.json" 2> "$LOG_FILE" &
+DAEMON_PID=$!
+wait_api /health
+
+log "camera1: enqueueing three consecutive segments out of order"
+enqueue camera1 cam1_c
+enqueue camera1 cam1_a
+enqueue camera1 cam1_b
+
+log "camera2: two consecutive segments, then one after a gap"
+enqueue camera2 cam2_a
+enqueue camera2 cam2_b
+enqueue camera2 cam2_d
+grep -q "cam2_d.ts does not continue camera2" "$LOG_FILE" || fail "the gap did not close camera2's group"
+grep -q "Dispatched camera2: 2 segments" "$LOG_FILE" || fail "camera2's closed group was not dispatched"
+
+wait_callbacks 2 120
+OUT1="cam1_a_x3_h264.ts"
+OUT2="cam2_a_x2_h264.ts"
+OUT3="cam2_d_x1_h264.ts"
+[[ -f "${WORK_DIR}/out/$OUT1" ]] || fail "$OUT1 missing"
+[[ -f "${WORK_DIR}/out/$OUT2" ]] || fail "$OUT2 missing"
+callback "$OUT1" | grep -q '"segmentCount":3' || fail "no group completion for $OUT1"
+callback "$OUT2" | grep -q '"segmentCount":2' || fail "no group completion for $OUT2"
+
+python3 - "${WORK_DIR}/out/${OUT1%.ts}.idx.json" << 'EOF' || fail "sidecar index of $OUT1 is out of order"
+import json, sys
+entries = json.load(open(sys.argv[1]))["segments"]
+names = [e["inputFile"] for e in entries]
+offsets = [e["byteOffset"] for e in entries]
+print("  Sidecar:", ", ".join("%s@%d" % (n, o) for n, o in zip(names, offsets)))
+assert names == ["cam1_a.ts", "cam1_b.ts", "cam1_c.ts"], names
+assert offsets == sorted(offsets) and len(set(offsets)) == 3, offsets
+EOF
+
+log "Waiting for the idle flush of camera2's last segment"
+wait_callbacks 3 30
+[[ -f "${WORK_DIR}/out/$OUT3" ]] || fail "$OUT3 missing"
+callback "$OUT3" | grep -q '"segmentCount":1' || fail "no group completion for $OUT3"
+[[ $(wc -l < "$HOOK_FILE") -eq 3 ]] || fail "expected one callback per group"
+
+echo -e "\n${GREEN}[PASS]${NC} segments merged in recording order, split on gaps and flushed when idle"
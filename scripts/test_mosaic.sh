@@ -0,0 +1,74 @@
+#!/bin/bash
+
+# Multiview mosaic of a 2x2 camera wall (NVDEC/NVENC, needs a GPU)
+# Generates four 1080p camera segments, the last of which started recording
+# two seconds after the others (its mtime is moved forward), composites them
+# through POST /mosaic and checks the output with ffprobe: the wall has the
+# encoder's dimensions, lasts as long as the late camera's end on the common
+# wall clock, and is named after the wallId.
+#
+# Usage: ./scripts/test_mosaic.sh [seconds]
+#   seconds  duration of each camera segment (default 4)
+
+SECONDS_PER_SEGMENT="${1:-4}"
+LATE_SECONDS=2
+WIDTH=1280
+HEIGHT=720
+
+. "$(dirname "$0")/lib.sh"
+setup_work_dir mosaic_test
+
+mkdir -p "${WORK_DIR}/in" "${WORK_DIR}/out"
+log "Generating four ${SECONDS_PER_SEGMENT}s 1080p camera segments"
+NOW=$(date +%s)
+for i in 1 2 3 4; do
+    ffmpeg -hide_banner -loglevel error -f lavfi \
+        -i "testsrc2=size=1920x1080:rate=25:duration=${SECONDS_PER_SEGMENT}" \
+        -c:v libx264 -preset veryfast -g 25 -pix_fmt yuv420p -f mpegts \
+        "${WORK_DIR}/in/cam${i}.ts" || fail "could not generate test segment"
+    # The recorder closes a segment when it ends: cam4 started later
+    END=$NOW
+    [[ $i -eq 4 ]] && END=$((NOW + LATE_SECONDS))
+    touch -d "@${END}" "${WORK_DIR}/in/cam${i}.ts"
+done
+
+cat > "${WORK_DIR}/config.json" << EOF
+{
+  "inputDir": "${WORK_DIR}/in",
+  "outputDir": "${WORK_DIR}/out",
+  "encoder": { "width": ${WIDTH}, "height": ${HEIGHT} }
+}
+EOF
+
+log "Starting transcoder"
+"$TRANSCODER" --config "${WORK_DIR}/config.json" 2> "$LOG_FILE" &
+DAEMON_PID=$!
+wait_api /ready 30
+
+RESPONSE=$(curl -s -X POST "$API/mosaic" -H 'Content-Type: application/json' \
+    -d "{\"wallId\":\"lobby\",\"layout\":\"2x2\",\"inputs\":[\"${WORK_DIR}/in/cam1.ts\",\"cam2.ts\",\"cam3.ts\",\"cam4.ts\"]}")
+JOB_ID=$(json_field "$RESPONSE" jobId)
+[[ -n "$JOB_ID" ]] || fail "mosaic rejected: $RESPONSE"
+wait_job "$JOB_ID"
+[[ "$JOB_STATE" == "done" ]] || fail "mosaic job $JOB_ID $JOB_STATE"
+
+NAME=$(json_field "$JOB_STATUS" outputFile)
+OUTPUT="${WORK_DIR}/out/${NAME}"
+[[ -f "$OUTPUT" ]] || fail "output $OUTPUT missing"
+[[ "$NAME" == mosaic_lobby_2x2_* ]] || fail "output name $NAME does not carry the wallId"
+
+SIZE=$(ffprobe -v error -select_streams v:0 -show_entries stream=width,height -of csv=p=0 "$OUTPUT")
+DURATION=$(ffprobe -v error -show_entries format=duration -of csv=p=0 "$OUTPUT")
+EXPECTED=$((SECONDS_PER_SEGMENT + LATE_SECONDS))
+
+echo
+echo "  Output:   $NAME"
+echo "  Size:     $SIZE (expected ${WIDTH},${HEIGHT})"
+echo "  Duration: ${DURATION}s (expected ${EXPECTED}s: cam4 ends ${LATE_SECONDS}s after the others)"
+echo
+
+[[ "$SIZE" == "${WIDTH},${HEIGHT}" ]] || fail "wall is $SIZE, expected ${WIDTH}x${HEIGHT}"
+[[ $(echo "d = $DURATION - $EXPECTED; d < 0.2 && d > -0.2" | bc) -eq 1 ]] ||
+    fail "wall lasts ${DURATION}s, expected ${EXPECTED}s"
+
+echo -e "${GREEN}[PASS]${NC} 2x2 wall composited on a common clock"
@@ -0,0 +1,73 @@
+#!/bin/bash
+
+# Output verification on the software backend (no GPU required)
+# Generates a test segment with ffmpeg, transcodes it and compares the
+# verification block of the job status (collected while muxing, plus the TS
+# structure check of the written file) with what ffprobe reads from the
+# output: frame and keyframe counts, PTS span and file size.
+#
+# Usage: ./scripts/test_output_verify.sh [seconds]
+#   seconds  duration of the test segment (default 6)
+
+SECONDS_PER_SEGMENT="${1:-6}"
+
+. "$(dirname "$0")/lib.sh"
+setup_work_dir output_verify_test
+
+# field <json> <name>: value of a number or string field
+field() {
+    echo "$1" | python3 -c "import json, sys; print(json.load(sys.stdin)['verification']['$2'])"
+}
+
+mkdir -p "${WORK_DIR}/in" "${WORK_DIR}/out"
+log "Generating a ${SECONDS_PER_SEGMENT}s 720p segment"
+ffmpeg -hide_banner -loglevel error -f lavfi -i "testsrc2=size=1280x720:rate=25:duration=${SECONDS_PER_SEGMENT}" \
+    -c:v libx264 -preset veryfast -g 25 -pix_fmt yuv420p -f mpegts \
+    "${WORK_DIR}/in/seg.ts" || fail "could not generate test segment"
+
+cat > "${WORK_DIR}/config.json" << EOF2
+{
+  "inputDir": "${WORK_DIR}/in",
+  "outputDir": "${WORK_DIR}/out",
+  "encoderBackend": "software",
+  "codecProfiles": [{ "name": "h264", "codec": "h264", "softwarePreset": "veryfast" }]
+}
+EOF2
+
+log "Starting transcoder (software backend)"
+"$TRANSCODER" --config "${WORK_DIR}/config.json" 2> "$LOG_FILE" &
+DAEMON_PID=$!
+wait_api /health
+
+JOB_ID=$(json_field "$(curl -s -X POST "$API/enqueue" -H 'Content-Type: application/json' \
+    -d '{"inputPath":"seg.ts","consolidate":false}')" jobId)
+[[ -n "$JOB_ID" ]] || fail "enqueue rejected"
+wait_job "$JOB_ID"
+[[ "$JOB_STATE" == "done" ]] || fail "job $JOB_ID $JOB_STATE"
+STATUS=$JOB_STATUS
+
+OUTPUT="${WORK_DIR}/out/$(json_field "$STATUS" outputFile)"
+log "Probing $OUTPUT for comparison"
+PROBE=$(ffprobe -v error -select_streams v:0 -show_entries packet=pts_time,flags -of csv=p=0 "$OUTPUT")
+PROBE_FRAMES=$(echo "$PROBE" | wc -l)
+PROBE_KEYS=$(echo "$PROBE" | grep -c ',K')
+PROBE_FIRST=$(echo "$PROBE" | cut -d, -f1 | sort -g | head -1)
+PROBE_LAST=$(echo "$PROBE" | cut -d, -f1 | sort -g | tail -1)
+
+echo
+echo "$STATUS" | python3 -c "import json, sys; print(json.dumps(json.load(sys.stdin)['verification'], indent=2))"
+echo "  ffprobe: frames $PROBE_FRAMES, keyframes $PROBE_KEYS, pts $PROBE_FIRST..$PROBE_LAST"
+echo
+
+[[ "$(field "$STATUS" tsCheck)" == "ok" ]] || fail "TS check of the output: $(field "$STATUS" tsCheck)"
+[[ "$(field "$STATUS" frames)" -eq "$PROBE_FRAMES" ]] || fail "frame count differs from ffprobe"
+[[ "$(field "$STATUS" keyframes)" -eq "$PROBE_KEYS" ]] || fail "keyframe count differs from ffprobe"
+[[ "$(field "$STATUS" fileBytes)" -eq "$(stat -c %s "$OUTPUT")" ]] || fail "file size differs"
+# The TS muxer offsets timestamps by its mux delay, so compare the spans
+SPAN=$(echo "$(field "$STATUS" lastPts) - $(field "$STATUS" firstPts)" | bc)
+PROBE_SPAN=$(echo "$PROBE_LAST - $PROBE_FIRST" | bc)
+[[ $(echo "$SPAN - $PROBE_SPAN < 0.001 && $PROBE_SPAN - $SPAN < 0.001" | bc) -eq 1 ]] ||
+    fail "PTS span ${SPAN}s differs from ffprobe (${PROBE_SPAN}s)"
+curl -s "$API/metrics" | grep -E '^transcoder_output_'
+
+echo -e "\n${GREEN}[PASS]${NC} verification collected while muxing matches ffprobe"
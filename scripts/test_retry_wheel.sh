@@ -0,0 +1,180 @@
+#!/bin/bash
+
+# Retry wheel and quarantine on simulated devices (no GPU required)
+# Failures are injected through --simulate-devices, one daemon run per case:
+#   backoff     a device that always fails: one job is retried maxRetries times
+#               with exponential backoff, then given up on without quarantine
+#   cascade     a backoff past the first wheel level (6.4s) still comes due
+#   deferred    with a one-slot queue kept full, due retries are re-armed
+#               instead of blocking, and every job still completes
+#   quarantine  inputs failed as corrupt are quarantined on the first attempt,
+#               listed by GET /quarantine and released by DELETE
+#
+# Usage: ./scripts/test_retry_wheel.sh
+
+. "$(dirname "$0")/lib.sh"
+setup_work_dir retry_wheel_test
+mkdir -p "${WORK_DIR}/in" "${WORK_DIR}/out"
+for i in $(seq 1 200); do
+    : > "${WORK_DIR}/in/seg_${i}.ts"
+done
+
+# start <device spec> [transcoder args...]: retry settings come from the
+# environment of the caller
+start() {
+    stop_daemon
+    echo "=== $* ===" >> "$LOG_FILE"
+    TRANSCODER_INPUT_DIR="${WORK_DIR}/in" TRANSCODER_OUTPUT_DIR="${WORK_DIR}/out" \
+        "$TRANSCODER" --simulate-devices "$@" --no-ts-check 2>> "$LOG_FILE" &
+    DAEMON_PID=$!
+    wait_api /ready 20
+    RUN_START=$(wc -l < "$LOG_FILE")
+}
+
+# run_log: the log lines of the current run
+run_log() {
+    tail -n +"$RUN_START" "$LOG_FILE"
+}
+
+# enqueue <segment number>: prints the job id (nothing if refused)
+enqueue() {
+    local response
+    response=$(curl -s -X POST "$API/enqueue" -H 'Content-Type: application/json' \
+        -d "{\"inputPath\":\"seg_$1.ts\",\"coalesce\":\"off\"}")
+    json_field "$response" jobId
+}
+
+# expect_metric <name> [label] <value>
+expect_metric() {
+    local value
+    if [[ $# -eq 3 ]]; then
+        value=$(metric "$1" "$2")
+        [[ "$value" == "$3" ]] || fail "$1{$2} is ${value:-missing}, expected $3"
+    else
+        value=$(metric "$1")
+        [[ "$value" == "$2" ]] || fail "$1 is ${value:-missing}, expected $2"
+    fi
+}
+
+now_ms() {
+    echo $(( $(date +%s%N) / 1000000 ))
+}
+
+log "backoff: one job on a device that always fails, 3 retries from 400ms"
+export TRANSCODER_MAX_RETRIES=3 TRANSCODER_RETRY_BASE_MS=400 TRANSCODER_RETRY_MAX_MS=1600
+start 50:1.0 --workers 1
+T0=$(now_ms)
+JOB=$(enqueue 1)
+[[ -n "$JOB" ]] || fail "seg_1.ts was not accepted"
+wait_job "$JOB" 30
+ELAPSED=$(( $(now_ms) - T0 ))
+[[ "$JOB_STATE" == "failed" ]] || fail "job ended as ${JOB_STATE:-unknown}, expected failed"
+[[ "$(json_field "$JOB_STATUS" attempts)" == "4" ]] || fail "expected 4 attempts: $JOB_STATUS"
+
+# Equal jitter: retry n waits between half and all of base * 2^(n-1)
+DELAYS=$(run_log | sed -n 's/.*retry \([0-9]*\)\/3 in \([0-9]*\)ms.*/\1 \2/p')
+[[ $(echo "$DELAYS" | wc -l) -eq 3 ]] || fail "expected 3 scheduled retries, got: $DELAYS"
+TOTAL=0
+while read -r attempt delay; do
+    full=$(( 400 << (attempt - 1) ))
+    log "  retry $attempt after ${delay}ms (window $((full / 2))-${full}ms)"
+    (( delay >= full / 2 && delay <= full )) || fail "retry $attempt delay ${delay}ms outside the backoff window"
+    TOTAL=$(( TOTAL + delay ))
+done <<< "$DELAYS"
+# Due ticks are rounded up, but the wheel's clock may lag by up to a tick per retry
+(( ELAPSED >= TOTAL - 300 )) || fail "job failed after ${ELAPSED}ms, before its ${TOTAL}ms of backoff"
+[[ $(run_log | grep -c "Re-enqueued seg_1.ts") -eq 3 ]] || fail "expected 3 re-enqueues"
+run_log | grep -q "Giving up on seg_1.ts after 4 attempts" || fail "no give-up after the last retry"
+expect_metric transcoder_failures_total 'kind="device"' 4
+expect_metric transcoder_retries_total 3
+expect_metric transcoder_retry_exhausted_total 1
+expect_metric transcoder_retry_queue_depth 0
+expect_metric transcoder_quarantined_total 0
+
+log "cascade: a 7-14s backoff is parked past the first wheel level"
+export TRANSCODER_MAX_RETRIES=1 TRANSCODER_RETRY_BASE_MS=14000 TRANSCODER_RETRY_MAX_MS=14000
+start 50:1.0 --workers 1
+JOB=$(enqueue 2)
+[[ -n "$JOB" ]] || fail "seg_2.ts was not accepted"
+for _ in $(seq 1 50); do
+    DELAY=$(run_log | sed -n 's/.*retry 1\/1 in \([0-9]*\)ms.*/\1/p')
+    [[ -n "$DELAY" ]] && break
+    sleep 0.1
+done
+T0=$(now_ms)
+[[ -n "$DELAY" ]] || fail "the first failure was not scheduled for a retry"
+(( DELAY > 6400 )) || fail "backoff of ${DELAY}ms fits the first level"
+expect_metric transcoder_retry_queue_depth 1
+for _ in $(seq 1 200); do
+    run_log | grep -q "Re-enqueued seg_2.ts" && break
+    sleep 0.1
+done
+WAITED=$(( $(now_ms) - T0 ))
+run_log | grep -q "Re-enqueued seg_2.ts" || fail "the retry never came due (cascade lost it)"
+log "  retry came due after ${WAITED}ms (scheduled in ${DELAY}ms)"
+(( WAITED >= DELAY - 300 && WAITED <= DELAY + 1500 )) || fail "retry came due after ${WAITED}ms, scheduled in ${DELAY}ms"
+wait_job "$JOB" 10
+[[ "$JOB_STATE" == "failed" ]] || fail "job ended as ${JOB_STATE:-unknown}, expected failed"
+expect_metric transcoder_retry_exhausted_total 1
+
+log "deferred: a one-slot queue kept full while device 0 fails every job"
+# Device 0 fails fast, device 1 is slow but reliable; one session each, so the
+# queue stays full and retries from device 0 come due with nowhere to go.
+# Device 0 is quarantined after its 5th consecutive failure; 5 retries are
+# enough for every job to reach device 1.
+export TRANSCODER_MAX_RETRIES=5 TRANSCODER_RETRY_BASE_MS=300 TRANSCODER_RETRY_MAX_MS=300
+start 300:1.0,1500 --workers 2 --device-sessions 1 --queue-capacity 1
+JOBS=()
+SEG=3
+END=$(( $(date +%s) + 8 ))
+while [[ $(date +%s) -lt $END ]]; do
+    JOB=$(enqueue "$SEG")
+    if [[ -n "$JOB" ]]; then
+        JOBS+=("$JOB")
+        SEG=$((SEG + 1))
+    fi
+    sleep 0.05
+done
+log "  ${#JOBS[@]} jobs accepted, waiting for them to finish"
+for JOB in "${JOBS[@]}"; do
+    wait_job "$JOB" 60
+    [[ "$JOB_STATE" == "done" ]] || fail "job $JOB ended as ${JOB_STATE:-unknown}: $JOB_STATUS"
+done
+DEFERRED=$(metric transcoder_retry_deferred_total)
+log "  $(metric transcoder_retries_total) retries, ${DEFERRED} re-armed on a full queue"
+(( DEFERRED > 0 )) || fail "no due retry found the queue full"
+[[ $(metric transcoder_retries_total) == $(metric transcoder_failures_total 'kind="device"') ]] ||
+    fail "not every device failure was retried"
+expect_metric transcoder_retry_exhausted_total 0
+expect_metric transcoder_retry_queue_depth 0
+
+log "quarantine: a device that fails every input as corrupt"
+export TRANSCODER_MAX_RETRIES=3 TRANSCODER_RETRY_BASE_MS=400 TRANSCODER_RETRY_MAX_MS=1600
+start 50:0:0:1.0 --workers 1
+for i in 198 199 200; do
+    JOB=$(enqueue "$i")
+    [[ -n "$JOB" ]] || fail "seg_${i}.ts was not accepted"
+    wait_job "$JOB" 10
+    [[ "$JOB_STATE" == "failed" ]] || fail "seg_${i}.ts ended as ${JOB_STATE:-unknown}, expected failed"
+done
+expect_metric transcoder_failures_total 'kind="permanent"' 3
+expect_metric transcoder_retries_total 0
+expect_metric transcoder_quarantined_total 3
+[[ $(wc -l < "${WORK_DIR}/out/quarantine.jsonl") -eq 3 ]] || fail "quarantine.jsonl does not hold 3 entries"
+
+curl -s "$API/quarantine" | python3 -c '
+import json, sys
+q = json.load(sys.stdin)
+files = sorted(e["inputFile"] for e in q["entries"])
+assert q["total"] == 3 and files == ["seg_198.ts", "seg_199.ts", "seg_200.ts"], q
+for e in q["entries"]:
+    assert e["reason"] == "simulated corrupt input" and e["attempts"] == 1, e
+' || fail "GET /quarantine does not list the corrupt inputs"
+
+STATUS=$(curl -s -o /dev/null -w '%{http_code}' -X DELETE "$API/quarantine/seg_199.ts")
+[[ "$STATUS" == "200" ]] || fail "DELETE /quarantine/seg_199.ts answered $STATUS"
+[[ "$(json_field "$(curl -s "$API/quarantine")" total)" == "2" ]] || fail "release did not shrink the quarantine"
+STATUS=$(curl -s -o /dev/null -w '%{http_code}' -X DELETE "$API/quarantine/seg_199.ts")
+[[ "$STATUS" == "404" ]] || fail "second DELETE of seg_199.ts answered $STATUS, expected 404"
+
+echo -e "\n${GREEN}[PASS]${NC} retries back off and cascade, a full queue defers them, corrupt inputs are quarantined"
@@ -0,0 +1,104 @@
+#!/bin/bash
+
+# S3 output sink against a throwaway local MinIO (no GPU required)
+# Starts minio/minio in Docker, creates a bucket and runs the transcoder on
+# the software backend with "s3" pointing at it (5 MB parts, one part kept in
+# memory so a longer output overflows to the spool). Transcodes a short
+# segment (single PUT) and a long one (multipart upload), downloads both
+# objects and checks their frame counts with ffprobe, that nothing was
+# written to outputDir, and prints the transcoder_s3_* metrics.
+#
+# Usage: ./scripts/test_s3_sink.sh [seconds]
+#   seconds  duration of the long segment (default 90)
+
+LONG_SECONDS="${1:-90}"
+MINIO="transcoder-s3-test"
+S3="http://localhost:9000"
+AUTH="minioadmin:minioadmin"
+BUCKET="transcoded"
+
+. "$(dirname "$0")/lib.sh"
+setup_work_dir s3_sink_test
+
+on_exit() {
+    docker rm -f "$MINIO" > /dev/null 2>&1
+}
+
+s3() {
+    curl -sf --aws-sigv4 "aws:amz:us-east-1:s3" --user "$AUTH" "$@"
+}
+
+# transcode <input>: enqueue, wait, download the object; sets FRAMES and KEY
+transcode() {
+    local job_id
+    job_id=$(json_field "$(curl -s -X POST "$API/enqueue" -H 'Content-Type: application/json' \
+        -d "{\"inputPath\":\"$1\",\"consolidate\":false}")" jobId)
+    [[ -n "$job_id" ]] || fail "enqueue of $1 rejected"
+    wait_job "$job_id" 600
+    [[ "$JOB_STATE" == "done" ]] || fail "$1: job $JOB_STATE: $JOB_STATUS"
+    FRAMES=$(json_field "$JOB_STATUS" frameCount)
+    KEY=$(json_field "$JOB_STATUS" outputFile)
+    s3 -o "${WORK_DIR}/${KEY//\//_}" "$S3/$BUCKET/$KEY" || fail "object $KEY not in the bucket"
+}
+
+probe_frames() {
+    ffprobe -v error -select_streams v:0 -count_packets -show_entries stream=nb_read_packets \
+        -of csv=p=0 "$1"
+}
+
+log "Starting MinIO container $MINIO"
+docker run -d --rm --name "$MINIO" -p 9000:9000 -e MINIO_ROOT_USER=minioadmin \
+    -e MINIO_ROOT_PASSWORD=minioadmin minio/minio server /data > /dev/null || fail "could not start minio container"
+for _ in $(seq 1 60); do
+    curl -sf "$S3/minio/health/live" > /dev/null && break
+    sleep 1
+done
+s3 -X PUT "$S3/$BUCKET" > /dev/null || fail "could not create bucket $BUCKET"
+
+mkdir -p "${WORK_DIR}/in" "${WORK_DIR}/out"
+log "Generating a 4s and a ${LONG_SECONDS}s 1080p segment"
+for spec in short:4 long:"$LONG_SECONDS"; do
+    ffmpeg -hide_banner -loglevel error -f lavfi -i "testsrc2=size=1920x1080:rate=25:duration=${spec#*:}" \
+        -c:v libx264 -preset veryfast -g 25 -b:v 6M -pix_fmt yuv420p -f mpegts \
+        "${WORK_DIR}/in/${spec%%:*}.ts" || fail "could not generate test segment"
+done
+
+cat > "${WORK_DIR}/config.json" << EOF2
+{
+  "inputDir": "${WORK_DIR}/in",
+  "outputDir": "${WORK_DIR}/out",
+  "encoderBackend": "software",
+  "codecProfiles": [{ "name": "h264", "codec": "h264", "bitrate": 4000000, "softwarePreset": "ultrafast" }],
+  "s3": {
+    "endpoint": "$S3",
+    "bucket": "$BUCKET",
+    "accessKey": "minioadmin",
+    "secretKey": "minioadmin",
+    "partMb": 5,
+    "bufferParts": 1
+  }
+}
+EOF2
+
+log "Starting transcoder (software backend, S3 output)"
+"$TRANSCODER" --config "${WORK_DIR}/config.json" 2> "$LOG_FILE" &
+DAEMON_PID=$!
+wait_api /health
+
+for input in short.ts long.ts; do
+    transcode "$input"
+    OBJECT="${WORK_DIR}/${KEY//\//_}"
+    PROBED=$(probe_frames "$OBJECT")
+    printf "  %-9s -> s3://%s/%s  %s bytes, %s frames (ffprobe %s)\n" "$input" "$BUCKET" "$KEY" \
+        "$(stat -c %s "$OBJECT")" "$FRAMES" "$PROBED"
+    [[ "$PROBED" -eq "$FRAMES" ]] || fail "$KEY has $PROBED frames, job reported $FRAMES"
+done
+
+[[ -z "$(ls -A "${WORK_DIR}/out")" ]] || fail "outputs were written to outputDir: $(ls -A "${WORK_DIR}/out")"
+
+echo
+curl -s "$API/metrics" | grep -E '^transcoder_s3_'
+[[ "$(metric transcoder_s3_parts_total)" -gt 2 ]] ||
+    fail "the long output was not uploaded in parts"
+
+echo -e "\n${GREEN}[PASS]${NC} outputs streamed to S3 without touching outputDir"
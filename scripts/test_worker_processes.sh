@@ -0,0 +1,111 @@
+#!/bin/bash
+
+# Pipelines in worker processes vs. worker threads on simulated devices (no GPU required)
+# Runs the same burst of dummy segments through the daemon twice: with the
+# pipelines in its own threads and with --worker-processes (one child per
+# device). During the second run one child is killed with SIGSEGV mid-burst.
+# Checks that every job still completes, that the jobs the child was running
+# were retried, that the supervisor restarted the child and counted the
+# crash, and that the process run (crash included) is at most MAX_SLOWDOWN
+# percent slower than the thread run.
+#
+# Usage: ./scripts/test_worker_processes.sh [jobs] [workers]
+#   jobs     segments per run (default 400)
+#   workers  pipelines (default 8)
+#   MAX_SLOWDOWN=25  tolerated throughput loss of worker processes, percent
+
+JOBS="${1:-400}"
+WORKERS="${2:-8}"
+MAX_SLOWDOWN="${MAX_SLOWDOWN:-25}"
+DEVICE_SPEC="${DEVICE_SPEC:-20,20}"
+NB_DEVICES=$(echo "$DEVICE_SPEC" | tr ',' '\n' | wc -l)
+
+. "$(dirname "$0")/lib.sh"
+setup_work_dir worker_processes_test
+
+# processed + failed so far; sets DONE and FAILED
+progress() {
+    local health
+    health=$(curl -s "$API/health")
+    DONE=$(echo "$health" | grep -o '"processed":[ ]*[0-9]*' | grep -o '[0-9]*$')
+    FAILED=$(echo "$health" | grep -o '"failed":[ ]*[0-9]*' | grep -o '[0-9]*$')
+}
+
+# One run; extra arguments go to the transcoder. With CRASH set, one worker
+# process is sent SIGSEGV once a quarter of the jobs are done. Sets RATE.
+run() {
+    TRANSCODER_INPUT_DIR="$WORK_DIR" TRANSCODER_RETRY_BASE_MS=200 "$TRANSCODER" --simulate-devices "$DEVICE_SPEC" --workers "$WORKERS" --no-ts-check "$@" \
+        2>> "$LOG_FILE" &
+    DAEMON_PID=$!
+    wait_api /ready 20
+
+    local start end
+    KILLED=""
+    start=$(date +%s.%N)
+    for i in $(seq 1 "$JOBS"); do
+        curl -s -X POST "$API/enqueue" -H 'Content-Type: application/json' \
+            -d "{\"inputPath\":\"${WORK_DIR}/seg_${i}.ts\",\"coalesce\":\"off\"}" > /dev/null
+    done
+
+    for _ in $(seq 1 1200); do
+        progress
+        if [[ -n "$CRASH" && -z "$KILLED" && "${DONE:-0}" -ge $((JOBS / 4)) ]]; then
+            KILLED=$(pgrep -P "$DAEMON_PID" | head -1)
+            [[ -n "$KILLED" ]] || fail "no worker process found"
+            log "Sending SIGSEGV to worker process $KILLED"
+            kill -SEGV "$KILLED"
+        fi
+        [[ $((DONE + FAILED)) -ge $JOBS ]] && break
+        sleep 0.25
+    done
+    end=$(date +%s.%N)
+
+    [[ $((DONE + FAILED)) -ge $JOBS ]] || fail "jobs did not finish ($DONE processed, $FAILED failed)"
+    [[ "$FAILED" -eq 0 ]] || fail "$FAILED jobs failed"
+    RATE=$(echo "scale=1; $JOBS / ($end - $start)" | bc)
+}
+
+# Empty dummy segments: the daemon runs with --no-ts-check
+log "Creating $JOBS dummy segments"
+for i in $(seq 1 "$JOBS"); do
+    : > "${WORK_DIR}/seg_${i}.ts"
+done
+
+log "Pipelines in worker threads ($WORKERS workers, devices $DEVICE_SPEC)"
+run
+THREAD_RATE=$RATE
+stop_daemon
+
+log "Pipelines in worker processes, one killed mid-burst"
+CRASH=1 run --worker-processes
+PROCESS_RATE=$RATE
+
+[[ "$(metric transcoder_worker_process_crashes_total)" -ge 1 ]] || fail "crash not counted"
+for _ in $(seq 1 50); do
+    [[ "$(metric transcoder_worker_processes)" -eq "$NB_DEVICES" ]] && break
+    sleep 0.2
+done
+[[ "$(metric transcoder_worker_processes)" -eq "$NB_DEVICES" ]] || fail "crashed worker process was not restarted"
+[[ "$(metric transcoder_worker_process_restarts_total)" -ge 1 ]] || fail "restart not counted"
+pgrep -P "$DAEMON_PID" | grep -qx "$KILLED" && fail "worker process $KILLED still listed after SIGSEGV"
+
+# The child had pipelines busy when it died: those jobs went back through the
+# retry wheel (and all completed, checked by run)
+LOST=$(metric transcoder_worker_process_jobs_lost_total)
+RETRIES=$(metric transcoder_retries_total)
+[[ "$LOST" -ge 1 ]] || fail "no job was in flight in the killed worker process"
+[[ "$RETRIES" -ge "$LOST" ]] || fail "$LOST jobs lost but only $RETRIES retried"
+
+echo
+curl -s "$API/metrics" | grep -E '^transcoder_worker_process'
+stop_daemon
+
+echo
+echo -e "${GREEN}Results${NC} ($JOBS jobs, $WORKERS pipelines, devices $DEVICE_SPEC)"
+echo "  Worker threads:    ${THREAD_RATE} files/sec"
+echo "  Worker processes:  ${PROCESS_RATE} files/sec (one crash, $LOST jobs retried)"
+
+[[ $(echo "$PROCESS_RATE * 100 >= $THREAD_RATE * (100 - $MAX_SLOWDOWN)" | bc) -eq 1 ]] ||
+    fail "worker processes more than ${MAX_SLOWDOWN}% slower than threads"
+
+echo -e "\n${GREEN}[PASS]${NC} every job completed across a worker process crash, within ${MAX_SLOWDOWN}% of thread throughput"
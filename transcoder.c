@@ -8,6 +8,7 @@
  *   NO CPU fallback - GPU mandatory
  */
 
+#define _GNU_SOURCE             // struct ucred (local socket peer credentials)
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -21,6 +22,8 @@
 #include <libavutil/imgutils.h>
 #include <libavutil/hwcontext.h>
 #include <libavutil/hwcontext_cuda.h>
+#include <libavutil/adler32.h>
+#include <libavutil/sha.h>
 #include <libavfilter/avfilter.h>
 #include <libavfilter/buffersink.h>
 #include <libavfilter/buffersrc.h>
@@ -30,33 +33,405 @@
 #include <curl/curl.h>
 #include <signal.h>
 #include <time.h>
-
-// Configuration based on validated optimal settings
-#define MAX_WORKERS 14          // 2x RTX 5090: 7 workers per GPU
-#define MAX_QUEUE_SIZE 2000     // Handle 1080+ files without starvation
+#include <errno.h>
+#include <stdarg.h>
+#include <math.h>
+#include <ctype.h>
+#include <limits.h>
+#include <arpa/inet.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <rabbitmq-c/amqp.h>
+#include <rabbitmq-c/tcp_socket.h>
+
+// Defaults based on validated optimal settings
+// (overridable via --config file, TRANSCODER_* environment and admin API)
+#define DEFAULT_WORKERS 14      // 2x RTX 5090: 7 workers per GPU
+#define DEFAULT_QUEUE_SIZE 2000 // Handle 1080+ files without starvation
+#define MAX_WORKERS_LIMIT 64    // Upper bound for runtime pool resizing
+#define MAX_QUEUE_LIMIT 100000  // Upper bound for runtime queue resizing
 #define MAX_PROCESSED 2000      // Circular buffer for processed files
-#define INPUT_DIR "/workspace/transcode-test-5090/tsfiles"
-#define OUTPUT_DIR "/workspace/transcode-test-5090/output"
-#define API_PORT 8080           // HTTP API port
+#define DEFAULT_INPUT_DIR "/workspace/transcode-test-5090/tsfiles"
+#define DEFAULT_OUTPUT_DIR "/workspace/transcode-test-5090/output"
+#define DEFAULT_API_PORT 8080   // HTTP API port
+#define MAX_GROUP_SEGMENTS 64   // Upper bound on segments merged into one output
+#define DEFAULT_SEGMENT_SECONDS 10  // Recorder segment length
+#define HLS_PLAYLIST_WINDOW 360 // Media segments listed per camera playlist (1h of 10s segments)
+#define HLS_DIR "hls"           // CMAF output subdirectory of output_dir
+#define MAX_DEVICES 8           // GPUs (or simulated devices) managed
+#define DEVICE_ERROR_THRESHOLD 5        // Consecutive failures before a device is quarantined
+#define DEVICE_COOLDOWN_SECONDS 60      // Quarantine length before a device is retried
+#define DEVICE_MIN_SAMPLES 20           // Files per device before throughput is trusted
+#define DEFAULT_STARTUP_PARALLEL 2      // Pipelines built concurrently per device at start-up
+#define DEVICE_REBALANCE_MARGIN 1.5     // Move only if the other device is this much cheaper
+#define DEVICE_REBALANCE_INTERVAL 30    // Seconds between migrations (avoids herding)
+#define ADAPTIVE_DEFAULT_INTERVAL 10    // Seconds per controller sample
+#define ADAPTIVE_GAIN_THRESHOLD 0.05    // Throughput change treated as signal, not noise
+#define ADAPTIVE_LATENCY_FACTOR 2.0     // Latency over baseline x this triggers a backoff
+#define ADAPTIVE_BACKOFF 0.75           // Multiplicative decrease on backoff
+#define ADAPTIVE_PROBE_INTERVALS 6      // Plateau samples before probing upward again
+#define ADMISSION_RESERVE_PERCENT 5     // Queue slots kept free for consolidated groups
+#define DRAIN_SAMPLE_MS 1000            // Minimum window for a drain-rate sample
+#define RETRY_AFTER_DEFAULT 5           // Seconds, when no drain rate is known yet
+#define RETRY_AFTER_MAX 300             // Cap on computed Retry-After
+#define MAX_CLIENT_BUCKETS 256          // Per-client token buckets tracked
+#define DEFAULT_SLO_LIVE_MS 5000        // Latency target for live-view jobs
+#define DEFAULT_SLO_EXPORT_MS 60000     // Latency target for incident exports
+#define JOB_ID_SIZE 32
+#define JOB_INDEX_BUCKETS 4096          // Hash buckets of the job index
+#define JOB_INDEX_STRIPES 64            // Bucket locks (bucket % stripes)
+#define JOB_RETENTION_SECONDS 600       // Finished jobs stay queryable this long
+#define JOB_LIST_LIMIT 1000             // Max records returned by GET /jobs
+#define COALESCE_KEY_SIZE 65            // Hex SHA-256 of the coalescing identity
+#define COALESCE_BUCKETS 1024           // Hash buckets of the coalescing table
+#define COALESCE_MAX_WAITERS 32         // Duplicates attached to one job before they run separately
+#define COALESCE_HASH_SAMPLE (1 << 20)  // "content" keys hash this much of each end of the input
+#define DEFAULT_COALESCE_CACHE_SECONDS 300  // Completed jobs answer duplicates this long
+#define DEFAULT_MAX_RETRIES 3           // Attempts after the first for transient failures
+#define DEFAULT_RETRY_BASE_MS 2000      // Backoff before the first retry
+#define DEFAULT_RETRY_MAX_MS 120000     // Backoff cap
+#define RETRY_WHEEL_TICK_MS 100         // Timer wheel resolution
+#define RETRY_WHEEL_BITS 6              // 64 slots per level
+#define RETRY_WHEEL_LEVELS 3            // Horizons: 6.4s, 6.8min, 7.3h
+#define RETRY_QUEUE_FULL_DELAY_MS 1000  // Re-arm delay when the queue is full
+#define MAX_QUARANTINE 1000             // Quarantine entries kept in memory
+#define DEFAULT_QUARANTINE_TTL_HOURS 168  // Quarantined inputs are retried after a week
+#define LOCAL_MAX_CONNS 64              // Local socket producer connections
+#define LOCAL_MAX_FRAME 8192            // Largest request frame accepted
+#define LOCAL_READ_BUFFER 65536         // Per-connection receive buffer
+#define LOCAL_MAX_ACKS 256              // Acks per batched ACK frame
+#define LOCAL_SEND_TIMEOUT_MS 1000      // Completion writes to a stalled client
+#define DEFAULT_AMQP_PORT 5672
+#define DEFAULT_AMQP_PREFETCH 32        // Unacked deliveries in flight
+#define AMQP_MAX_PREFETCH 1024
+#define AMQP_CONSUME_CHANNEL 1
+#define AMQP_PUBLISH_CHANNEL 2          // Confirm mode
+#define AMQP_HEARTBEAT_SECONDS 30
+#define AMQP_POLL_MS 50                 // Consume timeout between completion flushes
+#define AMQP_RECONNECT_SECONDS 5
+#define AMQP_STOP_TIMEOUT_MS 10000      // Shutdown wait for outstanding confirms
+#define MAX_PROBE_CACHE 256             // Cameras whose stream parameters are cached
+#define PROBE_CACHE_MAX_STREAMS 8       // Streams per cached layout (video + audio/data PIDs)
+#define PROBE_MAX_SPS 256               // Largest SPS NAL kept for validation
+#define PROBE_VALIDATE_PACKETS 32       // Packets read looking for the first SPS
+#define SOURCE_FPS 25                   // Camera frame rate (decoder/encoder time base)
+#define DEFAULT_TIMELAPSE_FPS 1         // Time-lapse rendition rate when a job asks for one
+#define TIMELAPSE_MIN_BITRATE 100000    // Floor for the scaled-down time-lapse bitrate
+#define MOSAIC_MAX_GRID 4               // Up to 4x4 tiles per wall
+#define MOSAIC_MAX_INPUTS (MOSAIC_MAX_GRID * MOSAIC_MAX_GRID)
+#define MAX_CODEC_PROFILES 8            // Output codec catalogue entries
+#define MAX_CHUNKS 32                   // Parts a long input can be split into
+#define DEFAULT_MAX_CHUNKS 8
+#define CHUNKED_PENDING 1               // process_chunked(): other workers still hold parts
+#define MAX_COST_MODEL_KEYS 512         // Camera/profile pairs with their own cost model
+#define COST_MODEL_DECAY 0.95           // Weight kept by older samples per new one (~20-job memory)
+#define COST_MODEL_MIN_SAMPLES 3        // Samples before a key's own model is trusted
+#define DEFAULT_SJF_AGING 4             // sjf order: queue wait a job may incur per ms of its cost
+#define MAX_NUMA_NODES 8
+#define DEFAULT_SERVICE_CPUS 2          // Cores kept for API, callback and control threads
+#define SYSFS_NODE_DIR "/sys/devices/system/node"
+#define SYSFS_PCI_DIR "/sys/bus/pci/devices"
+#define MPOL_PREFERRED_NODE 1           // set_mempolicy(2) MPOL_PREFERRED (no libnuma dependency)
+#define TS_PACKET_SIZE 188
+#define TS_SYNC_BYTE 0x47
+#define TS_MAX_PTS_JUMP (10 * 90000)    // Larger gaps between video PES are discontinuities
+#define DEFAULT_TS_MAX_CC_PERCENT 1     // Continuity errors tolerated (camera network hiccups)
+#define S3_MIN_PART_MB 5                // S3 minimum for every part but the last
+#define S3_MAX_PARTS 10000
+#define DEFAULT_S3_PART_MB 8
+#define DEFAULT_S3_BUFFER_PARTS 4       // In-memory parts per output before spooling to disk
+#define MAX_S3_BUFFER_PARTS 16
+#define S3_PART_ATTEMPTS 3
+#define WORKER_RING_SIZE 128            // Job ring cells shared with worker processes (power of two >= MAX_WORKERS_LIMIT)
+#define WORKER_SHM_FD 3                 // Shared-memory fd as seen by a worker process
+#define WORKER_RESULT_JSON_SIZE 32768   // Group segment index / mosaic description returned by a worker process
+#define WORKER_POLL_MS 100              // Supervisor wait slice (cancel mirroring, stage updates)
+#define WORKER_LOST_POLLS 10            // Slices a claimed job may stay unstarted before it counts as lost
+#define WORKER_RESTART_MIN_MS 500       // Restart delay after a crash, doubled while the process keeps crashing
+#define WORKER_RESTART_MAX_MS 30000
+#define WORKER_STABLE_SECONDS 30        // Uptime after which the restart delay is reset
+#define S3_AVIO_BUFFER_SIZE 65536
+
+// avio write callbacks take a const buffer from libavformat 61 (FFmpeg 7) on
+#if LIBAVFORMAT_VERSION_MAJOR >= 61
+#define AVIO_WRITE_BUF const uint8_t
+#else
+#define AVIO_WRITE_BUF uint8_t
+#endif
+
+// Output container written by the muxer
+typedef enum {
+    OUTPUT_FORMAT_TS = 0,       // Single MPEG-TS file per job (legacy)
+    OUTPUT_FORMAT_CMAF,         // fMP4 media segment + per-camera init/m3u8
+} OutputFormat;
+
+// One source segment of a consolidation group
+typedef struct {
+    char filename[512];
+    char metadata_json[2048];
+    char job_id[JOB_ID_SIZE];
+    int64_t end_ms;             // Input mtime (the recorder closes a segment when it ends), 0 = unknown
+} GroupSegment;
+
+// Consecutive segments of one camera merged into a single output file, in
+// recording order. Heap-allocated by the consolidator and owned by the job
+// once queued.
+typedef struct ConsolidationGroup {
+    char camera_id[256];
+    char callback_url[512];     // Part of the group key, like the three below
+    OutputFormat output_format;
+    int codec_profile;
+    int nb_segments;
+    GroupSegment segments[MAX_GROUP_SEGMENTS];
+    time_t opened_at;
+    time_t last_append;
+    struct ConsolidationGroup *next;
+} ConsolidationGroup;
+
+// Scheduling class; higher values are served first. Zero-initialized jobs
+// (scanner, consolidated groups) are bulk archive work.
+typedef enum {
+    PRIORITY_ARCHIVE = 0,
+    PRIORITY_EXPORT,
+    PRIORITY_LIVE,
+    PRIORITY_NB_CLASSES
+} JobPriority;
+
+// What happens to a job whose deadline passed while it was queued
+typedef enum {
+    EXPIRE_SHED = 0,            // Drop it and send an "expired" callback
+    EXPIRE_DOWNGRADE,           // Keep it as archive work without a deadline
+} ExpirePolicy;
+
+// How duplicate enqueues of one input are recognised ("coalesce")
+typedef enum {
+    COALESCE_DEFAULT = 0,       // Request did not choose: config coalesce.key
+    COALESCE_OFF,
+    COALESCE_PATH,              // Same canonical input path
+    COALESCE_CONTENT,           // Same input bytes (SHA-256 of the file)
+    COALESCE_NB_MODES
+} CoalesceMode;
+
+static const char *coalesce_mode_names[COALESCE_NB_MODES] = { "default", "off", "path", "content" };
+
+// Low-frame-rate archive rendition of a segment (time-lapse mode)
+typedef struct {
+    int fps;                    // Output frames per second of source time (0 = full rate)
+    int keyframes_only;         // Decode keyframes only, drop everything in between
+    int width;                  // Output size (0 = encoder.width/height)
+    int height;
+    int bitrate;                // 0 = encoder.bitrate scaled to the reduced rate
+} TimelapseSpec;
+
+// Output codecs of the codec profile catalogue
+typedef enum {
+    CODEC_H264 = 0,
+    CODEC_HEVC,
+    CODEC_AV1,
+    CODEC_NB
+} OutputCodec;
+
+static const char *codec_names[CODEC_NB] = { "h264", "hevc", "av1" };
+static const char *nvenc_encoder_names[CODEC_NB] = { "h264_nvenc", "hevc_nvenc", "av1_nvenc" };
+static const char *software_encoder_names[CODEC_NB] = { "libx264", "libx265", "libsvtav1" };
+
+// Catalogue entry jobs select with "codecProfile". Unset fields inherit the
+// encoder.* settings when the config is validated.
+typedef struct {
+    char name[32];
+    OutputCodec codec;
+    int bitrate;
+    int cq;                     // NVENC constant quality; CRF on the software backend
+    char preset[16];            // NVENC preset (p1..p7)
+    char software_preset[16];   // libx264/libx265 preset name or SVT-AV1 preset number
+    char profile[16];
+} CodecProfile;
+
+// Multiview wall: time-aligned segments of several cameras composited into a
+// cols x rows grid and encoded once. Heap-allocated by POST /mosaic and owned
+// by the job once queued.
+typedef struct {
+    int cols;
+    int rows;
+    int nb_inputs;              // Tiles in row-major order; missing cells stay black
+    char inputs[MOSAIC_MAX_INPUTS][512];
+    int software_scale;         // hwdownload + swscale + xstack instead of scale_cuda/overlay_cuda
+} MosaicJob;
 
 // Job information including callback details
 typedef struct {
+    char job_id[JOB_ID_SIZE];   // Job index key (empty for batch-mode jobs)
     char filename[512];
     char callback_url[512];
     char metadata_json[2048];
+    char camera_id[256];        // Grouping / playlist key
+    OutputFormat output_format;
+    ConsolidationGroup *group;  // Non-NULL for consolidated multi-segment jobs
+    TimelapseSpec timelapse;    // fps > 0: time-lapse archive rendition
+    MosaicJob *mosaic;          // Non-NULL for multiview grid jobs
+    int codec_profile;          // Index into config.codec_profiles (0 = default)
+    struct ChunkedJob *chunked; // Non-NULL for a long input split across workers
+    // Scheduling
+    JobPriority priority;
+    long long deadline_ms;      // Monotonic ms the result is due by (0 = none)
+    ExpirePolicy on_expire;
+    int attempts;               // Failed attempts so far (transient retries)
+    long long enqueued_ms;      // Set by the queue on push
+    long long input_bytes;      // Input size the cost model predicts from (set on push)
+    int predicted_ms;           // Expected processing time (0 = no model yet)
+    int expired;                // Deadline passed while queued (shed by queue_pop)
+    int deadline_missed;        // Downgraded after its deadline passed
+    // Duplicate detection
+    CoalesceMode coalesce;
+    char coalesce_key[COALESCE_KEY_SIZE];  // Set by submit_job (empty = not coalesced)
 } TranscodeJob;
 
-// Queue system for task distribution
+// Heap entry: scheduling key plus the job's storage slot, so reordering the
+// heap never copies whole jobs
+typedef struct {
+    int priority;
+    long long sort_deadline_ms; // Explicit deadline, else enqueue time + class SLO (sjf: or + aged cost)
+    long seq;                   // Arrival order tie-break
+    int slot;                   // Index into TaskQueue.jobs
+} QueueEntry;
+
+// Queue system for task distribution: priority classes, EDF within a class
 typedef struct {
-    TranscodeJob jobs[MAX_QUEUE_SIZE];
-    int front;
-    int rear;
+    TranscodeJob *jobs;     // Job storage, 'slots' entries
+    QueueEntry *heap;       // Min-heap of 'count' entries in scheduling order
+    int *free_slots;        // Stack of unused storage slots
+    int slots;
+    int capacity;           // Admission limit (runtime adjustable, <= slots)
     int count;
+    int class_count[PRIORITY_NB_CLASSES];
+    long seq;
+    int closed;             // No more jobs will arrive; workers exit once empty
+    long popped;            // Jobs handed to workers since start
+    double drain_rate;      // Jobs/sec leaving the queue (EWMA)
+    long drain_popped;      // 'popped' at the last drain sample
+    struct timespec drain_sampled_at;
     pthread_mutex_t mutex;
     pthread_cond_t not_empty;
     pthread_cond_t not_full;
 } TaskQueue;
 
+// Runtime configuration: defaults < config file < environment < command line
+typedef struct {
+    int workers;
+    int queue_capacity;
+    char input_dir[512];
+    char output_dir[512];
+    int api_port;
+    int workers_per_device;     // NVENC session cap per device (0 = unlimited)
+    int startup_parallel;       // Pipelines built concurrently per device
+    // Encoder
+    int out_width;
+    int out_height;
+    int bitrate;
+    char preset[16];
+    char rc[16];
+    int cq;
+    char profile[16];
+    // Modes
+    int consolidate_seconds;
+    int segment_seconds;
+    char output_format[16];
+    char simulate_devices[256];
+    char local_socket[108];     // Unix socket path for the binary protocol ("" = off)
+    int probe_cache;            // Reuse per-camera stream parameters instead of probing
+    int chunk_mb;               // Split inputs of at least 2x this size across workers (0 = off)
+    int max_chunks;
+    int ts_check;               // Validate MPEG-TS inputs before they are queued
+    int ts_max_cc_percent;      // Continuity errors (% of packets) still accepted
+    int ts_check_outputs;       // Check the structure of written TS outputs
+    char coalesce_key[16];      // Duplicate enqueues merged by "path", "content" or "off"
+    int coalesce_cache_seconds; // Completed jobs answer duplicates this long
+    int affinity;               // Pin threads by NUMA topology (sysfs)
+    int service_cpus;           // Cores reserved for non-worker threads
+    int worker_processes;       // Run pipelines in supervised child processes
+    int workers_per_process;    // Pipelines per child (0 = one child per device)
+    // S3-compatible object storage for TS outputs ("" endpoint = local files)
+    char s3_endpoint[256];      // http(s)://host:port, path-style requests
+    char s3_bucket[128];
+    char s3_region[64];
+    char s3_access_key[128];
+    char s3_secret_key[128];
+    char s3_prefix[256];        // Prepended to the output name to form the key
+    int s3_part_mb;
+    int s3_buffer_parts;
+    char s3_spool_dir[512];     // Overflow of slow uploads ("" = output_dir)
+    // Time-lapse archive rendition
+    TimelapseSpec timelapse;    // Defaults for jobs asking for "timelapse"
+    int timelapse_after_days;   // Batch mode: older inputs get the rendition (0 = off)
+    char mosaic_scaler[16];     // Default composition path for /mosaic: "cuda" or "software"
+    // Output codec catalogue; entry 0 is the default for jobs that name none
+    char encoder_backend[16];   // "nvenc" or "software" (libx264/libx265/libsvtav1, no GPU)
+    CodecProfile codec_profiles[MAX_CODEC_PROFILES];
+    int nb_codec_profiles;
+    char default_codec_profile[32];     // "" = first catalogue entry
+    // RabbitMQ consumer ("" host = off)
+    char amqp_host[128];
+    int amqp_port;
+    char amqp_user[64];
+    char amqp_password[128];
+    char amqp_vhost[64];
+    char amqp_consume_queue[128];
+    char amqp_publish_queue[128];
+    int amqp_prefetch;
+    // Admission control
+    int client_rate;            // Enqueues/sec per client (0 = no per-client limit)
+    int client_burst;
+    // Scheduling
+    int slo_ms[PRIORITY_NB_CLASSES];    // Per-class latency target (0 = none)
+    char queue_order[16];       // Within a class: "deadline" (EDF, then FIFO) or "sjf"
+    int sjf_aging;              // sjf: ms of queue wait per predicted ms before a job is first in line
+    // Retries
+    int max_retries;
+    int retry_base_ms;
+    int retry_max_ms;
+    int quarantine_ttl_hours;   // 0 = quarantined inputs stay skipped until removed
+    // Adaptive concurrency
+    int adaptive;
+    int adaptive_min;
+    int adaptive_max;           // 0 = use 'workers'
+    int adaptive_interval;
+} TranscoderConfig;
+
+// Worker pool slot; slot index doubles as worker id
+typedef struct {
+    pthread_t thread;
+    int started;                // Thread created and not yet joined
+    int running;                // Worker loop active (cleared by the worker on exit)
+    int restarting;             // Claimed by a resize that is reaping the previous thread
+    volatile int retire;        // Asked to exit after its current job
+    volatile int parked;        // Idle by controller decision; pipeline kept warm
+    int warm;                   // Pipeline built and bound to a device
+} WorkerSlot;
+
+typedef struct {
+    WorkerSlot slots[MAX_WORKERS_LIMIT];
+    int target;                 // Desired number of running workers
+    int active;                 // Workers allowed to take jobs (<= target)
+    int adaptive;               // 'active' is managed by the adaptive controller
+    int warm;                   // Slots with a warm pipeline
+    long long started_ms;       // First resize (monotonic), for start-up timings
+    long long first_warm_ms;    // Time to the first warm pipeline (-1 = not yet)
+    long long all_warm_ms;      // Time until every slot was warm (-1 = not yet)
+    pthread_mutex_t mutex;
+    pthread_cond_t unpark;
+} WorkerPool;
+
 // Processed files tracking (circular buffer)
 typedef struct {
     char files[MAX_PROCESSED][256];
@@ -64,6 +439,76 @@ typedef struct {
     pthread_mutex_t mutex;
 } ProcessedFiles;
 
+// Sidecar index entry: where one source segment starts inside the merged output
+typedef struct {
+    int64_t byte_offset;    // Output byte position of the segment's first packet
+    int64_t pts_start;      // In output stream time_base
+    int64_t pts_end;
+    int frame_start;        // Encoder frame number of the segment's first frame
+    int frames;
+} SegmentIndexEntry;
+
+typedef struct {
+    SegmentIndexEntry entries[MAX_GROUP_SEGMENTS];
+    int nb_entries;
+    int pending;            // Entry waiting for its first muxed keyframe (-1 = none)
+} SegmentIndex;
+
+// Why a job failed: transient failures are retried with backoff, permanent
+// ones (corrupt or unsupported input) go to the quarantine list.
+// Device failures (decoder, encoder, CUDA) are retried like transient ones
+// and are the only failures that count against the device's health.
+typedef enum {
+    FAILURE_NONE = 0,
+    FAILURE_TRANSIENT,
+    FAILURE_PERMANENT,
+    FAILURE_DEVICE,
+    FAILURE_NB_KINDS
+} FailureKind;
+
+static const char *failure_kind_names[] = { "none", "transient", "permanent", "device" };
+
+// Long input split at keyframes into byte ranges that several workers
+// transcode in parallel. Heap-allocated by the worker that picks the job up
+// and shared with the helper jobs it queues; whichever participant finishes
+// the last part stitches the output and sends the single callback.
+typedef struct ChunkedJob {
+    pthread_mutex_t mutex;
+    int refs;                   // Picking worker + queued helper jobs
+    int nb_chunks;
+    int next_chunk;             // Next part to claim
+    int remaining;              // Parts not finished (or written off) yet
+    int64_t input_size;
+    int frames[MAX_CHUNKS];     // Frames encoded per part
+    volatile int *cancel;       // Cancellation flag of the original job
+    FailureKind failure;        // First part failure, reported by the finisher
+    char failure_reason[160];
+} ChunkedJob;
+
+// Packets and frames reused by every file a worker transcodes. Allocated
+// once with the persistent pipeline so the per-frame loop only refs/unrefs.
+typedef struct {
+    AVPacket *packet;            // Demuxed input packet
+    AVPacket *enc_packet;        // Encoder output
+    AVFrame *decoded_frame;      // NVDEC output (CUDA)
+    AVFrame *filtered_frame;     // scale_cuda output (CUDA)
+} FramePool;
+
+// What was muxed into the current output, collected packet by packet so a
+// finished job can be described without probing the file again
+typedef struct {
+    int packets;                // Video packets (= frames) handed to the muxer
+    int keyframes;
+    int64_t first_pts;          // Lowest / highest PTS written (time_base)
+    int64_t last_pts;
+    AVRational time_base;
+    int64_t payload_bytes;      // Encoded payload, before container overhead
+    uint32_t adler32;           // Rolling checksum of that payload in mux order
+    int64_t file_bytes;         // Size of the finished file
+    int ts_verdict;             // TsVerdict of the written file, -1 = not checked
+    long ts_video_pes;          // Video PES found by that check
+} OutputVerification;
+
 // Transcode context per worker
 typedef struct {
     int worker_id;
@@ -71,1163 +516,12090 @@ typedef struct {
     AVFormatContext *input_ctx;
     AVFormatContext *output_ctx;
     AVCodecContext *decoder_ctx;
-    AVCodecContext *encoder_ctx;
+    AVCodecContext *encoder_ctx;        // Encoder of the current job (one of the ones below)
+    AVCodecContext *profile_encoders[MAX_CODEC_PROFILES];  // Full-rate session per codec profile, opened on first use
+    AVCodecContext *timelapse_encoder;  // Open only while a time-lapse job runs
+    int encoder_slot;                   // encoder_ctx's index in profile_encoders, or MAX_CODEC_PROFILES (time-lapse)
+    unsigned encoders_fed;              // Bit per slot: sessions given frames since they were opened
+    TimelapseSpec timelapse_encoder_spec;
+    int timelapse_encoder_profile;
+    int codec_profile;                  // Current job's catalogue entry
     AVBufferRef *hw_device_ctx;
     AVFilterGraph *filter_graph;
     AVFilterContext *buffersrc_ctx;
     AVFilterContext *buffersink_ctx;
     cudaStream_t cuda_stream;
     int video_stream_idx;
+    SegmentIndex *segment_index;  // Set while muxing a consolidation group
+    int force_keyframe;           // Next encoded frame must be an IDR (segment boundary)
+    volatile int *cancel;         // Job cancellation flag, polled between packets
+    FailureKind failure;          // Classification of the current job's failure
+    char failure_reason[160];
+    FramePool pool;               // Hot-loop packets/frames, reused across files
+    const TimelapseSpec *timelapse;   // Current job's rendition (NULL = full rate)
+    int64_t timelapse_next_pts;   // Next source timestamp to keep (input time base)
+    long timelapse_skipped;       // Packets/frames dropped by decimation this job
+    int chunk_active;             // Transcoding one part of a split input
+    FailureKind chunk_failure;    // This participant's own parts (device health)
+    int chunk_started;            // The part's first keyframe was reached
+    int64_t chunk_start;          // Input byte range of the part
+    int64_t chunk_end;            // -1 = to the end of the input
+    OutputVerification verify;    // Current output, reset by open_output_file
+    struct S3Sink *s3_sink;       // Current output streams to object storage
 } TranscodeContext;
 
+// Where a job's output goes; filled by prepare_output_target()
+typedef struct {
+    OutputFormat format;
+    char name[512];          // Path relative to output_dir, reported in callbacks
+    char path[512];          // TS file or CMAF media segment (.m4s)
+    char mux_path[512];      // What the muxer opens (CMAF: scratch playlist)
+    char init_name[256];     // CMAF: per-job init segment, renamed on publish
+    char map_name[64];       // CMAF: published init segment (init_<hash>.mp4)
+    char camera_dir[512];    // CMAF: <output_dir>/hls/<camera>
+    char camera_id[256];
+    int s3;                  // Streamed to object storage instead of path
+    char s3_key[800];
+} OutputTarget;
+
+// One TS output streamed to S3-compatible storage as a multipart upload. The
+// muxer's AVIOContext fills part buffers that an uploader thread sends in
+// order. Memory stays bounded to bufferParts buffers: once all of them wait
+// on a slow endpoint, the rest of the output goes to an unlinked spool file
+// and is uploaded from there.
+typedef struct S3Sink {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    pthread_t thread;
+    char key[800];
+    char upload_id[256];
+    size_t part_size;
+    uint8_t *buffers[MAX_S3_BUFFER_PARTS];   // Ring, allocated on first use
+    size_t fill[MAX_S3_BUFFER_PARTS];
+    int nb_buffers;
+    int head;                   // Oldest part not yet uploaded
+    int ready;                  // Filled parts handed to the uploader
+    int spool_fd;               // -1 until the buffers overflow
+    int64_t spool_written;
+    int64_t spool_read;
+    int closed;                 // Muxer done: upload what is left and stop
+    int failed;
+    char error[160];
+    char (*etags)[72];          // Per uploaded part, for CompleteMultipartUpload
+    int nb_parts;
+    int64_t bytes;              // Written by the muxer
+    int64_t spooled;
+} S3Sink;
+
+// Per-camera HLS playlist (sliding window over published CMAF segments)
+typedef struct HlsPlaylist {
+    char camera_dir[512];
+    long media_sequence;     // Sequence number of entries[0]
+    long discontinuity_sequence;  // Discontinuities slid out of the window
+    int nb_entries;
+    struct {
+        char uri[256];
+        char map[64];        // Init segment the entry was encoded with
+        int discontinuity;   // Timestamps restart at this entry
+        double duration;
+    } entries[HLS_PLAYLIST_WINDOW];
+    struct HlsPlaylist *next;
+} HlsPlaylist;
+
+// Per-device load and health, as seen by the device manager
+typedef struct {
+    int id;
+    int active_sessions;        // Worker pipelines currently bound to the device
+    double ewma_ms;             // Recent per-file processing time
+    long samples;
+    long files_ok;
+    long files_failed;
+    int consecutive_errors;
+    int healthy;
+    time_t quarantined_at;
+    long migrations_in;
+    int warming;                // Pipelines being built on the device right now
+    // Simulated backend parameters
+    int sim_latency_ms;
+    double sim_failure_rate;
+    long sim_fail_after;        // Device "dies" after this many jobs (0 = never)
+    double sim_corrupt_rate;    // Share of inputs failed as corrupt (permanent failure)
+} DeviceState;
+
+// Assigns worker pipelines to the least-loaded healthy device
+typedef struct {
+    DeviceState devices[MAX_DEVICES];
+    int nb_devices;
+    int max_sessions;           // Per-device cap (0 = unlimited)
+    int simulated;              // Simulated devices: no CUDA, injected latency/failures
+    int warm_limit;             // Concurrent pipeline builds per device
+    int only_device;            // Worker process: the device its pipelines use (-1 = any)
+    time_t last_rebalance;
+    pthread_mutex_t mutex;
+    pthread_cond_t warm_slot;   // Signalled when a pipeline build finishes
+} DeviceManager;
+
+// Open consolidation groups, one per camera
+typedef struct {
+    ConsolidationGroup *open_groups;
+    ConsolidationGroup *full_groups;  // Complete groups the queue had no room for yet
+    int target_seconds;     // 0 = consolidation disabled
+    int segment_seconds;
+    pthread_mutex_t mutex;
+} Consolidator;
+
+// Per-client token bucket (clients keyed by X-Client-Id or remote address)
+typedef struct {
+    char client[64];
+    double tokens;
+    struct timespec refilled_at;
+} ClientBucket;
+
+typedef struct {
+    ClientBucket buckets[MAX_CLIENT_BUCKETS];
+    int nb_buckets;
+    long rejected_queue_full;
+    long rejected_client_rate;
+    pthread_mutex_t mutex;
+} AdmissionControl;
+
+// Job lifecycle as reported by /jobs
+typedef enum {
+    JOB_QUEUED = 0,
+    JOB_RUNNING,
+    JOB_DONE,
+    JOB_FAILED,
+    JOB_CANCELLED,
+    JOB_EXPIRED,
+    JOB_NB_STATES
+} JobState;
+
+// Job index entry; lives until JOB_RETENTION_SECONDS after it finished
+typedef struct JobRecord {
+    char id[JOB_ID_SIZE];
+    char filename[512];
+    char output[512];
+    char stage[32];             // Sub-state while running
+    JobPriority priority;
+    JobState state;
+    int worker_id;
+    int frames;
+    int attempts;
+    char error[160];            // Last failure reason
+    OutputVerification verify;  // Of the output, once the job is done
+    int verified;
+    char coalesce_key[COALESCE_KEY_SIZE];  // Duplicates wait on this job (empty = none)
+    time_t created_at;
+    time_t finished_at;
+    long long created_ms;
+    long long started_ms;
+    long long finished_ms;
+    volatile int cancel_requested;
+    struct JobRecord *next;
+} JobRecord;
+
+// Concurrent hash index of jobs by ID, with striped bucket locks
+typedef struct {
+    JobRecord *buckets[JOB_INDEX_BUCKETS];
+    pthread_mutex_t locks[JOB_INDEX_STRIPES];
+    unsigned int counter;       // ID sequence
+    pthread_mutex_t counter_mutex;
+} JobIndex;
+
+// Duplicate request waiting on a coalesced job
+typedef struct CoalesceWaiter {
+    char filename[512];
+    char callback_url[512];
+    char metadata_json[2048];
+    struct CoalesceWaiter *next;
+} CoalesceWaiter;
+
+// Outcome of a coalesced job, replayed to its duplicates
+typedef struct {
+    JobState state;
+    char output[512];
+    int frames;
+    int processing_ms;
+    char error[160];
+    OutputVerification verify;
+    int verified;
+} CoalescedResult;
+
+// Coalescing key -> the job producing that output. Lives while the job is
+// queued or running; completed jobs stay cached for cacheSeconds.
+typedef struct CoalesceEntry {
+    char key[COALESCE_KEY_SIZE];
+    char job_id[JOB_ID_SIZE];
+    CoalesceWaiter *waiters;
+    int nb_waiters;
+    int finished;
+    CoalescedResult result;
+    time_t finished_at;
+    struct CoalesceEntry *next;
+} CoalesceEntry;
+
+typedef struct {
+    CoalesceEntry *buckets[COALESCE_BUCKETS];
+    int nb_entries;
+    int nb_cached;              // Entries holding a completed job's result
+    int cache_seconds;
+    long attached;              // Duplicates merged into a queued/running job
+    long cached;                // Duplicates answered from a completed job
+    long overflow;              // Duplicates run separately (too many waiters)
+    long notified;              // Completions replayed to duplicates
+    pthread_mutex_t mutex;
+} Coalescer;
+
+// Pending retry: a copy of the failed job, due at a wheel tick
+typedef struct RetryEntry {
+    TranscodeJob job;
+    long long due_tick;
+    struct RetryEntry *next;
+} RetryEntry;
+
+// Hierarchical timer wheel holding jobs until their backoff expires.
+// Level l slots cover 64^l ticks; entries cascade down as time advances.
+typedef struct {
+    RetryEntry *slots[RETRY_WHEEL_LEVELS][1 << RETRY_WHEEL_BITS];
+    long long tick;             // Ticks processed since start
+    long long started_ms;
+    int pending;                // Jobs waiting in the wheel
+    int stopped;                // Shutdown: no new retries accepted
+    long retries_total;
+    long requeue_deferred;      // Due retries re-armed because the queue was full
+    long failures[FAILURE_NB_KINDS];  // By FailureKind (final outcomes only)
+    long exhausted_total;
+    pthread_t thread;
+    int started;
+    pthread_mutex_t mutex;
+} RetryWheel;
+
+typedef struct {
+    char filename[512];
+    char reason[160];
+    int attempts;
+    time_t at;
+} QuarantineEntry;
+
+// Permanently failed inputs with the reason, newest last (circular buffer)
+typedef struct {
+    QuarantineEntry entries[MAX_QUARANTINE];
+    long count;
+    long added_total;           // Inputs quarantined since start (metric)
+    pthread_mutex_t mutex;
+} QuarantineList;
+
+// Outcome of the MPEG-TS structure check, in the order the checks run
+typedef enum {
+    TS_OK = 0,
+    TS_EMPTY,
+    TS_UNREADABLE,
+    TS_NO_SYNC,                 // No 0x47 at a 188-byte stride
+    TS_TRUNCATED,               // Ends inside a packet (incomplete write; tolerated for inputs)
+    TS_SYNC_LOST,               // Garbage between packets
+    TS_NO_PAT,
+    TS_NO_PMT,
+    TS_NO_VIDEO,                // PMT lists no video elementary stream
+    TS_BAD_PTS,                 // Video PES without a valid PTS, or PTS discontinuity
+    TS_CC_ERRORS,               // Continuity counter errors above the threshold
+    TS_NB_VERDICTS
+} TsVerdict;
+
+static const char *ts_verdict_names[TS_NB_VERDICTS] = {
+    "ok", "empty", "unreadable", "no_sync", "truncated", "sync_lost",
+    "no_pat", "no_pmt", "no_video", "bad_pts", "cc_errors"
+};
+
+typedef struct {
+    TsVerdict verdict;
+    long long bytes;
+    long packets;
+    long sync_losses;
+    long cc_errors;
+    int video_pid;              // -1 until the PMT names one
+    long video_pes;
+    long bad_pts;               // Video PES with missing or malformed PTS
+    long pts_jumps;
+    int64_t first_pts;          // 90 kHz, -1 = none
+    int64_t last_pts;
+    char detail[160];
+} TsCheck;
+
+// Local socket protocol. Every frame is a header followed by 'length' payload
+// bytes; integers are in host byte order (both ends share the machine).
+enum {
+    LOCAL_FRAME_ENQUEUE = 1,    // Client -> server: one LocalEnqueue
+    LOCAL_FRAME_ACK = 2,        // Server -> client: 'count' LocalAck entries
+    LOCAL_FRAME_COMPLETION = 3, // Server -> client: one LocalCompletion
+};
+
+enum {
+    LOCAL_ENQUEUE_NOTIFY = 1,           // Send a completion frame on this connection
+    LOCAL_ENQUEUE_NO_CONSOLIDATE = 2,
+    LOCAL_ENQUEUE_DOWNGRADE = 4,        // onExpire "downgrade" instead of "shed"
+};
+
+enum {
+    LOCAL_ACK_QUEUED = 0,       // value = queue depth
+    LOCAL_ACK_GROUPED = 1,      // value = consolidation group size
+    LOCAL_ACK_QUEUE_FULL = 2,   // value = retry-after ms
+    LOCAL_ACK_RATE_LIMITED = 3, // value = retry-after ms
+    LOCAL_ACK_NOT_FOUND = 4,
+    LOCAL_ACK_INVALID = 5,
+    LOCAL_ACK_ERROR = 6,
+    LOCAL_ACK_CORRUPT = 7,      // value = TsVerdict (input failed the TS check)
+    LOCAL_ACK_COALESCED = 8,    // Duplicate; job_id = existing job, value = 1 if it already
+                                // completed (the completion frame follows with notify)
+};
+
+#define LOCAL_FORMAT_DEFAULT 0xff
+
+typedef struct __attribute__((packed)) {
+    uint32_t length;
+    uint8_t type;
+    uint8_t reserved;
+    uint16_t count;
+} LocalFrameHeader;
+
+// Followed by path_len bytes of input path, camera_len bytes of camera ID and
+// metadata_len bytes of metadata JSON (none NUL-terminated)
+typedef struct __attribute__((packed)) {
+    uint32_t tag;               // Chosen by the client, echoed in ack and completion
+    uint32_t deadline_ms;       // Relative to receipt (0 = none)
+    uint8_t priority;           // JobPriority
+    uint8_t output_format;      // OutputFormat or LOCAL_FORMAT_DEFAULT
+    uint8_t flags;              // LOCAL_ENQUEUE_*
+    uint8_t reserved;
+    uint16_t path_len;
+    uint16_t camera_len;
+    uint16_t metadata_len;
+    uint16_t reserved2;
+} LocalEnqueue;
+
+typedef struct __attribute__((packed)) {
+    uint32_t tag;
+    int16_t status;             // LOCAL_ACK_*
+    uint16_t reserved;
+    uint32_t value;
+    char job_id[JOB_ID_SIZE];
+} LocalAck;
+
+// Followed by output_len bytes of output path and reason_len bytes of
+// failure reason
+typedef struct __attribute__((packed)) {
+    uint32_t tag;
+    uint8_t status;             // Index into local_completion_status[]
+    uint8_t reserved;
+    uint16_t output_len;
+    uint32_t frames;
+    uint32_t processing_ms;
+    uint16_t reason_len;
+    uint16_t reserved2;
+} LocalCompletion;
+
+typedef struct {
+    int fd;                     // -1 = free slot
+    uint32_t generation;        // Bumped on close so stale completions are dropped
+    char client[64];            // Admission identity ("local:<pid>")
+    unsigned char *buffer;
+    size_t used;
+    pthread_mutex_t write_mutex;    // Acks (listener) vs completions (workers)
+} LocalConn;
+
+typedef struct {
+    int listen_fd;
+    int running;
+    LocalConn conns[LOCAL_MAX_CONNS];
+    long connections_total;
+    long requests_total;
+    long ack_frames;
+    long completions_sent;
+    long completions_dropped;
+    pthread_t thread;
+    int started;
+    pthread_mutex_t mutex;      // Counters
+} LocalServer;
+
+// Finished AMQP job, handed from a worker to the AMQP thread
+typedef struct AmqpCompletion {
+    uint64_t delivery_tag;
+    uint32_t generation;        // Connection the delivery came in on
+    int ok;                     // Publish the result, then ack; else reject
+    char *body;                 // Result message (ok only)
+    struct AmqpCompletion *next;
+} AmqpCompletion;
+
+// Result published but not yet confirmed by the broker
+typedef struct {
+    uint64_t publish_seq;
+    uint64_t delivery_tag;      // Source message acked once the result is confirmed
+} AmqpUnconfirmed;
+
+// RabbitMQ consumer/publisher. One thread owns the connection: it consumes
+// the input queue, publishes results on a confirm-mode channel and acks the
+// source message only after the broker has confirmed its result.
+typedef struct {
+    amqp_connection_state_t conn;
+    int connected;              // Written under mutex, like in_flight and nb_unconfirmed
+    uint32_t generation;        // Bumped per connection; stale completions are dropped
+    int running;
+    int draining;               // Shutdown: stop consuming, finish outstanding acks
+    int cancelled;              // Consumer cancelled on the broker
+    uint64_t publish_seq;
+    AmqpUnconfirmed unconfirmed[AMQP_MAX_PREFETCH];
+    int nb_unconfirmed;
+    TranscodeJob pending;       // Delivery waiting for queue space
+    uint64_t pending_tag;
+    int has_pending;
+    int in_flight;              // Deliveries not yet acked or rejected
+    AmqpCompletion *done_head;
+    AmqpCompletion *done_tail;
+    long consumed;
+    long acked;
+    long rejected;
+    long published;
+    long confirm_frames;
+    long broker_nacks;
+    long reconnects;
+    pthread_t thread;
+    int started;
+    pthread_mutex_t mutex;      // Completion list, counters and the gauges /metrics reads
+} AmqpBridge;
+
+// Per-class scheduling outcomes for SLO reporting
+#define SLO_BUCKETS 8
+static const double slo_bucket_seconds[SLO_BUCKETS] = { 0.5, 1, 2, 5, 10, 30, 60, 300 };
+
+typedef struct {
+    long completed;                     // Successful jobs only
+    long slo_met;
+    long failed;                        // Failed for good (after retries)
+    long expired;
+    long downgraded;
+    double latency_sum;                 // Seconds, enqueue to completion
+    long latency_buckets[SLO_BUCKETS];  // Cumulative histogram
+} ClassStats;
+
+typedef struct {
+    ClassStats classes[PRIORITY_NB_CLASSES];
+    pthread_mutex_t mutex;
+} SchedulerStats;
+
+// Learned processing cost: ms = a + b * input MB, fitted per camera and codec
+// profile from exponentially decayed least-squares sums
+typedef struct {
+    char key[320];              // "<camera>|<profile>[|timelapse|mosaic]"
+    double n;                   // Decayed sample weight
+    double sx, sy, sxx, sxy;    // x = input MB, y = processing ms
+    long samples;
+    long long last_used_ms;
+} CostModelEntry;
+
+// Accuracy buckets: actual / predicted cost
+#define COST_RATIO_BUCKETS 6
+static const double cost_ratio_bounds[COST_RATIO_BUCKETS] = { 0.5, 0.8, 1.0, 1.25, 2, 4 };
+
+typedef struct {
+    CostModelEntry entries[MAX_COST_MODEL_KEYS];
+    int count;
+    CostModelEntry global;      // Every sample pooled: the guess for unseen keys
+    // Predicted versus actual, over completions that had a prediction
+    long predictions;
+    long unpredicted;           // Completions with no model to predict from yet
+    double predicted_ms_total;
+    double actual_ms_total;
+    double abs_error_ms_total;
+    double ratio_total;
+    long ratio_buckets[COST_RATIO_BUCKETS];     // Cumulative histogram
+    pthread_mutex_t mutex;
+} CostModel;
+
+// Adaptive concurrency controller actions
+typedef enum {
+    ADAPT_INCREASE,
+    ADAPT_DECREASE,
+    ADAPT_BACKOFF,
+    ADAPT_HOLD,
+    ADAPT_IDLE,
+    ADAPT_NB_ACTIONS
+} AdaptiveAction;
+
+// Adaptive concurrency controller: hill-climbs the active worker count on
+// measured throughput, with a multiplicative backoff when latency spikes
+typedef struct {
+    int enabled;
+    int min_workers;
+    int max_workers;
+    int interval_seconds;
+    int limit;                  // Current active worker count
+    int direction;              // +1 probing up, -1 probing down
+    int hold_intervals;         // Consecutive plateau samples
+    AdaptiveAction last_action;
+    double last_throughput;     // files/sec measured at the previous limit
+    double throughput;          // Latest sample
+    double latency_ms;          // Mean per-file latency of the latest sample
+    double baseline_latency_ms; // Uncongested reference latency
+    long long latency_sum_ms;   // Accumulated since the last sample
+    int latency_count;
+    int completed_last;         // files_processed + files_failed at last sample
+    struct timespec sampled_at;
+    long decisions[ADAPT_NB_ACTIONS];
+    pthread_t thread;
+    int started;
+    pthread_mutex_t mutex;
+} AdaptiveController;
+
 // Global state
+TranscoderConfig config;
+WorkerPool worker_pool;
+AdaptiveController adaptive_controller;
 TaskQueue task_queue;
+SchedulerStats scheduler_stats;
+CostModel cost_model = { .mutex = PTHREAD_MUTEX_INITIALIZER };
+JobIndex job_index;
+Coalescer coalescer;
+RetryWheel retry_wheel;
+QuarantineList quarantine;
+AdmissionControl admission;
+LocalServer local_server;
+AmqpBridge amqp_bridge;
 ProcessedFiles processed_files;
+Consolidator consolidator;
+DeviceManager device_manager;
+HlsPlaylist *hls_playlists = NULL;
+pthread_mutex_t hls_mutex = PTHREAD_MUTEX_INITIALIZER;
+static OutputFormat default_output_format = OUTPUT_FORMAT_TS;
 volatile int processing_active = 1;
 volatile int files_processed = 0;
 volatile int files_failed = 0;
 time_t start_time;
 static int no_gpu_mode = 0;  // Phase 1 test mode: no actual transcoding
+static int software_backend = 0;  // CPU decode/scale/encode (encoderBackend "software")
+static int sjf_order = 0;         // queueOrder "sjf": shortest expected job first within a class
+static CoalesceMode coalesce_default = COALESCE_PATH;  // coalesce.key
 
 // Statistics
 pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+static long timelapse_jobs = 0;             // Time-lapse renditions written
+static long timelapse_frames_encoded = 0;
+static long timelapse_frames_skipped = 0;   // Dropped before the encoder (packets or frames)
+static long mosaic_jobs[2] = {0};           // Multiview walls written, by scaler (cuda, software)
+static long mosaic_tiles_composited = 0;
+static long mosaic_tiles_failed = 0;        // Inputs that could not be opened (black cell)
+
+// Full-rate outputs per codec profile (index into config.codec_profiles)
+typedef struct {
+    long jobs;
+    long long bytes;
+    double seconds;             // Video duration written
+} CodecStats;
+static CodecStats codec_stats[MAX_CODEC_PROFILES];
+static long chunked_jobs = 0;               // Split inputs stitched into one output
+static long chunked_parts = 0;
+static long chunked_helpers = 0;            // Helper jobs queued for split inputs
+static long ts_checks[TS_NB_VERDICTS] = {0};    // Input pre-checks by verdict
+static long long ts_check_bytes = 0;
+static double ts_check_seconds = 0;
+static long ts_output_checks[TS_NB_VERDICTS] = {0};  // Written TS outputs by verdict
+static long long output_verify_bytes = 0;       // Payload checksummed while muxing
+static const char *s3_result_names[] = { "completed", "failed", "aborted" };
+static long s3_uploads[3] = {0};                // Outputs by s3_result_names
+static long s3_parts_uploaded = 0;
+static long long s3_bytes_uploaded = 0;
+static long long s3_bytes_spooled = 0;          // Overflowed to disk while the endpoint lagged
+static long s3_spool_fallbacks = 0;             // Outputs that needed the spool
+static double s3_request_seconds = 0;
+
+// Counters of the transcode pipelines themselves. A worker process publishes
+// its own after every job; the supervisor adds them up for /metrics.
+typedef struct {
+    long timelapse_jobs;
+    long timelapse_frames_encoded;
+    long timelapse_frames_skipped;
+    long mosaic_jobs[2];
+    long mosaic_tiles_composited;
+    long mosaic_tiles_failed;
+    CodecStats codec_stats[MAX_CODEC_PROFILES];
+    long ts_output_checks[TS_NB_VERDICTS];
+    long long output_verify_bytes;
+    long s3_uploads[3];
+    long s3_parts_uploaded;
+    long long s3_bytes_uploaded;
+    long long s3_bytes_spooled;
+    long s3_spool_fallbacks;
+    double s3_request_seconds;
+    int probe_entries;
+    long probe_hits;
+    long probe_misses;
+    long probe_mismatches;
+    double probe_ms_total;
+    double probe_saved_ms_total;
+    double probe_validate_ms_total;
+} PipelineCounters;
+
+// Worker processes (workerProcesses.enabled): the daemon becomes a supervisor
+// that keeps the queue, job index, API and callbacks, and runs the pipelines
+// in child processes so a libav or driver crash takes down one child only.
+// Everything the two sides exchange lives in one shared-memory region.
+
+// Job record updates made inside a worker process, applied to the real
+// record by the supervisor. 'seq' is odd while the child writes.
+typedef struct {
+    char id[JOB_ID_SIZE];
+    volatile int cancel;        // Mirrored from the record by the supervisor
+    atomic_uint seq;
+    int state;                  // JobState the child reported (JOB_QUEUED = none yet)
+    char stage[16];
+    char output[512];
+    int frames;
+} WorkerJobId;
+
+typedef enum {
+    WORKER_SLOT_IDLE = 0,
+    WORKER_SLOT_QUEUED,         // In the job ring
+    WORKER_SLOT_RUNNING,        // Claimed by a worker process ('owner')
+    WORKER_SLOT_DONE,           // Result written (or the owner died)
+} WorkerSlotState;
+
+// One supervisor worker's job in flight. The supervisor thread writes the
+// request and waits on 'done'; the child that takes the slot from the ring
+// writes the result.
+typedef struct {
+    atomic_int state;           // WorkerSlotState
+    atomic_int owner;           // pid of the child running it
+    sem_t done;
+    TranscodeJob job;           // group/mosaic are rebased onto the copies below
+    ConsolidationGroup group;
+    MosaicJob mosaic;
+    WorkerJobId ids[MAX_GROUP_SEGMENTS];   // The job, or each segment of a group
+    int nb_ids;
+    // Result
+    int result;                 // What process_file/process_group/process_mosaic returned
+    int device;
+    int crashed;                // The owner exited before writing a result
+    OutputTarget target;
+    int frames;
+    OutputVerification verify;
+    FailureKind failure;
+    char failure_reason[160];
+    double publish_duration;    // CMAF segment left for the supervisor to publish (-1 = none)
+    char result_json[WORKER_RESULT_JSON_SIZE];  // Group segment index or mosaic description
+} WorkerJobSlot;
+
+// Bounded MPMC ring of slot indices (Vyukov): supervisor threads push,
+// worker process threads pop, no lock shared across processes
+typedef struct {
+    atomic_uint seq;
+    int slot;
+} WorkerRingCell;
 
-// API server
-struct MHD_Daemon *api_daemon = NULL;
+// Per child, written by the child
+typedef struct {
+    atomic_int warm;            // Pipelines built and waiting for jobs
+    atomic_uint counters_seq;   // Odd while 'counters' is being written
+    PipelineCounters counters;
+    atomic_int paused;          // Set by the supervisor while the device is quarantined
+    int device;                 // Set by the supervisor before the child starts
+    int workers;
+    int first_worker;           // Worker id of the child's first pipeline (log prefixes)
+} WorkerProcessShm;
 
+typedef struct {
+    atomic_uint ring_head;
+    atomic_uint ring_tail;
+    WorkerRingCell ring[WORKER_RING_SIZE];
+    sem_t ring_items;           // Posted per push; extra posts are harmless
+    atomic_int shutdown;
+    WorkerProcessShm procs[MAX_WORKERS_LIMIT];
+    WorkerJobSlot slots[MAX_WORKERS_LIMIT];    // Indexed by supervisor worker id
+} WorkerShm;
+
+// Supervisor view of one child
+typedef struct {
+    pid_t pid;                  // 0 = not running
+    long long started_ms;
+    long long restart_at_ms;    // Pending restart (0 = none)
+    int restart_delay_ms;
+    long restarts;
+    char index_arg[16];
+    char **argv;                // Prepared before fork (no allocation in the child)
+} WorkerProcess;
+
+typedef struct {
+    WorkerShm *shm;             // NULL = pipelines run in the daemon's own threads
+    int shm_fd;
+    int nb_procs;
+    int pipelines;
+    WorkerProcess procs[MAX_WORKERS_LIMIT];
+    PipelineCounters retired;   // Counters of children that exited
+    long crashes;
+    long jobs_lost;             // In flight when their process died (retried like transient failures)
+    long max_fd;                // Descriptors to close in a fresh child
+    pthread_t reaper;
+    int reaper_started;
+    pthread_mutex_t mutex;
+} WorkerProcesses;
+
+WorkerProcesses worker_processes;
+static int worker_process_index = -1;   // This process is a worker process (--worker-process N)
+static WorkerShm *worker_process_shm = NULL;    // Worker process: the supervisor's region
+static __thread WorkerJobSlot *worker_process_job = NULL;  // Worker process: the thread's current job
+
+#ifdef ALLOC_DEBUG
 // ============================================================================
-// Queue Management
+// Allocation Counter (debug builds: make bench-alloc)
 // ============================================================================
 
-void queue_init(TaskQueue *q) {
-    q->front = 0;
-    q->rear = 0;
-    q->count = 0;
-    pthread_mutex_init(&q->mutex, NULL);
-    pthread_cond_init(&q->not_empty, NULL);
-    pthread_cond_init(&q->not_full, NULL);
-}
+// The executable's malloc family interposes libc's for every shared library
+// too, so allocations made inside libavcodec/libavformat are counted as
+// well. Counts are per thread; workers sample them around the frame loop.
+#define ALLOC_WARMUP_FRAMES 8   // Frames per file before the loop counts as steady
 
-void queue_push(TaskQueue *q, const TranscodeJob *job) {
-    pthread_mutex_lock(&q->mutex);
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
 
-    while (q->count >= MAX_QUEUE_SIZE) {
-        pthread_cond_wait(&q->not_full, &q->mutex);
-    }
+static __thread unsigned long thread_allocations = 0;
+static unsigned long hot_path_allocations = 0;  // Under stats_mutex
+static unsigned long hot_path_frames = 0;
 
-    q->jobs[q->rear] = *job;
-    q->rear = (q->rear + 1) % MAX_QUEUE_SIZE;
-    q->count++;
+void *malloc(size_t size) {
+    thread_allocations++;
+    return __libc_malloc(size);
+}
 
-    pthread_cond_signal(&q->not_empty);
-    pthread_mutex_unlock(&q->mutex);
+void *calloc(size_t nmemb, size_t size) {
+    thread_allocations++;
+    return __libc_calloc(nmemb, size);
 }
 
-int queue_pop(TaskQueue *q, TranscodeJob *job) {
-    pthread_mutex_lock(&q->mutex);
+void *realloc(void *ptr, size_t size) {
+    thread_allocations++;
+    return __libc_realloc(ptr, size);
+}
 
-    while (q->count == 0 && processing_active) {
-        pthread_cond_wait(&q->not_empty, &q->mutex);
-    }
+void *memalign(size_t alignment, size_t size) {
+    thread_allocations++;
+    return __libc_memalign(alignment, size);
+}
 
-    if (q->count == 0) {
-        pthread_mutex_unlock(&q->mutex);
-        return 0;
+void *aligned_alloc(size_t alignment, size_t size) {
+    thread_allocations++;
+    return __libc_memalign(alignment, size);
+}
+
+// av_malloc goes through here on Linux
+int posix_memalign(void **ptr, size_t alignment, size_t size) {
+    thread_allocations++;
+    void *p = __libc_memalign(alignment, size);
+    if (!p) {
+        return ENOMEM;
     }
+    *ptr = p;
+    return 0;
+}
 
-    *job = q->jobs[q->front];
-    q->front = (q->front + 1) % MAX_QUEUE_SIZE;
-    q->count--;
+static void alloc_debug_record(unsigned long allocations, int frames) {
+    pthread_mutex_lock(&stats_mutex);
+    hot_path_allocations += allocations;
+    hot_path_frames += frames;
+    pthread_mutex_unlock(&stats_mutex);
+}
 
-    pthread_cond_signal(&q->not_full);
-    pthread_mutex_unlock(&q->mutex);
-    return 1;
+static void alloc_debug_report(void) {
+    pthread_mutex_lock(&stats_mutex);
+    fprintf(stderr, "Hot path allocations: %lu over %lu frames (%.3f per frame)\n",
+            hot_path_allocations, hot_path_frames,
+            hot_path_frames ? hot_path_allocations / (double)hot_path_frames : 0.0);
+    pthread_mutex_unlock(&stats_mutex);
 }
+#endif
+
+// API server
+struct MHD_Daemon *api_daemon = NULL;
 
 // ============================================================================
-// Processed Files Tracking (Circular Buffer)
+// Runtime Configuration
 // ============================================================================
 
-void processed_init(ProcessedFiles *pf) {
-    pf->count = 0;
-    pthread_mutex_init(&pf->mutex, NULL);
+void config_defaults(TranscoderConfig *cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->workers = DEFAULT_WORKERS;
+    cfg->queue_capacity = DEFAULT_QUEUE_SIZE;
+    strncpy(cfg->input_dir, DEFAULT_INPUT_DIR, sizeof(cfg->input_dir) - 1);
+    strncpy(cfg->output_dir, DEFAULT_OUTPUT_DIR, sizeof(cfg->output_dir) - 1);
+    cfg->api_port = DEFAULT_API_PORT;
+    cfg->workers_per_device = 0;
+    cfg->startup_parallel = DEFAULT_STARTUP_PARALLEL;
+    cfg->out_width = 1280;
+    cfg->out_height = 720;
+    cfg->bitrate = 1500000;
+    strncpy(cfg->preset, "p2", sizeof(cfg->preset) - 1);
+    strncpy(cfg->rc, "vbr", sizeof(cfg->rc) - 1);
+    cfg->cq = 30;
+    strncpy(cfg->profile, "main", sizeof(cfg->profile) - 1);
+    cfg->consolidate_seconds = 0;
+    cfg->segment_seconds = DEFAULT_SEGMENT_SECONDS;
+    strncpy(cfg->output_format, "ts", sizeof(cfg->output_format) - 1);
+    cfg->client_rate = 0;
+    cfg->client_burst = 0;
+    cfg->slo_ms[PRIORITY_LIVE] = DEFAULT_SLO_LIVE_MS;
+    cfg->slo_ms[PRIORITY_EXPORT] = DEFAULT_SLO_EXPORT_MS;
+    cfg->slo_ms[PRIORITY_ARCHIVE] = 0;
+    strncpy(cfg->queue_order, "deadline", sizeof(cfg->queue_order) - 1);
+    cfg->sjf_aging = DEFAULT_SJF_AGING;
+    cfg->max_retries = DEFAULT_MAX_RETRIES;
+    cfg->retry_base_ms = DEFAULT_RETRY_BASE_MS;
+    cfg->retry_max_ms = DEFAULT_RETRY_MAX_MS;
+    cfg->quarantine_ttl_hours = DEFAULT_QUARANTINE_TTL_HOURS;
+    cfg->amqp_port = DEFAULT_AMQP_PORT;
+    strncpy(cfg->amqp_user, "guest", sizeof(cfg->amqp_user) - 1);
+    strncpy(cfg->amqp_password, "guest", sizeof(cfg->amqp_password) - 1);
+    strncpy(cfg->amqp_vhost, "/", sizeof(cfg->amqp_vhost) - 1);
+    strncpy(cfg->amqp_consume_queue, "segment.raw.ready", sizeof(cfg->amqp_consume_queue) - 1);
+    strncpy(cfg->amqp_publish_queue, "segment.transcoded.ready", sizeof(cfg->amqp_publish_queue) - 1);
+    cfg->amqp_prefetch = DEFAULT_AMQP_PREFETCH;
+    cfg->probe_cache = 1;
+    cfg->chunk_mb = 0;
+    cfg->max_chunks = DEFAULT_MAX_CHUNKS;
+    cfg->ts_check = 1;
+    cfg->ts_max_cc_percent = DEFAULT_TS_MAX_CC_PERCENT;
+    cfg->ts_check_outputs = 1;
+    strncpy(cfg->coalesce_key, "path", sizeof(cfg->coalesce_key) - 1);
+    cfg->coalesce_cache_seconds = DEFAULT_COALESCE_CACHE_SECONDS;
+    cfg->affinity = 0;
+    cfg->service_cpus = DEFAULT_SERVICE_CPUS;
+    cfg->worker_processes = 0;
+    cfg->workers_per_process = 0;
+    strncpy(cfg->s3_region, "us-east-1", sizeof(cfg->s3_region) - 1);
+    cfg->s3_part_mb = DEFAULT_S3_PART_MB;
+    cfg->s3_buffer_parts = DEFAULT_S3_BUFFER_PARTS;
+    cfg->timelapse.fps = DEFAULT_TIMELAPSE_FPS;
+    cfg->timelapse.keyframes_only = 0;
+    cfg->timelapse_after_days = 0;
+    strncpy(cfg->mosaic_scaler, "cuda", sizeof(cfg->mosaic_scaler) - 1);
+    strncpy(cfg->encoder_backend, "nvenc", sizeof(cfg->encoder_backend) - 1);
+    strncpy(cfg->codec_profiles[0].name, "h264", sizeof(cfg->codec_profiles[0].name) - 1);
+    cfg->codec_profiles[0].codec = CODEC_H264;
+    cfg->nb_codec_profiles = 1;
+    cfg->adaptive = 0;
+    cfg->adaptive_min = 2;
+    cfg->adaptive_max = 0;
+    cfg->adaptive_interval = ADAPTIVE_DEFAULT_INTERVAL;
 }
 
-int is_file_processed(ProcessedFiles *pf, const char *filename) {
-    pthread_mutex_lock(&pf->mutex);
+static void config_set_int(int *dst, const cJSON *obj, const char *key) {
+    const cJSON *item = cJSON_GetObjectItem(obj, key);
+    if (item && cJSON_IsNumber(item)) *dst = item->valueint;
+}
 
-    // Check if output file exists
-    char output_path[512];
-    char base_name[256];
-    strncpy(base_name, filename, sizeof(base_name) - 1);
-    base_name[sizeof(base_name) - 1] = '\0';
+static void config_set_str(char *dst, size_t size, const cJSON *obj, const char *key) {
+    const cJSON *item = cJSON_GetObjectItem(obj, key);
+    if (item && cJSON_IsString(item)) {
+        strncpy(dst, item->valuestring, size - 1);
+        dst[size - 1] = '\0';
+    }
+}
 
-    char *ext = strstr(base_name, ".ts");
-    if (ext) *ext = '\0';
+// Load a JSON config file (see transcoder.example.json); missing keys keep
+// their current values
+int config_load_file(TranscoderConfig *cfg, const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "[Config] Cannot open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
 
-    snprintf(output_path, sizeof(output_path), "%s/%s_h264.ts", OUTPUT_DIR, base_name);
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *text = malloc(size + 1);
+    if (!text || fread(text, 1, size, f) != (size_t)size) {
+        fclose(f);
+        free(text);
+        return -1;
+    }
+    text[size] = '\0';
+    fclose(f);
 
-    struct stat st;
-    if (stat(output_path, &st) == 0) {
-        pthread_mutex_unlock(&pf->mutex);
-        return 1;
+    cJSON *json = cJSON_Parse(text);
+    free(text);
+    if (!json) {
+        fprintf(stderr, "[Config] Invalid JSON in %s\n", path);
+        return -1;
     }
 
-    // Check in-memory circular buffer
-    int start = (pf->count >= MAX_PROCESSED) ? (pf->count % MAX_PROCESSED) : 0;
-    int items = (pf->count >= MAX_PROCESSED) ? MAX_PROCESSED : pf->count;
+    config_set_int(&cfg->workers, json, "workers");
+    config_set_int(&cfg->queue_capacity, json, "queueCapacity");
+    config_set_str(cfg->input_dir, sizeof(cfg->input_dir), json, "inputDir");
+    config_set_str(cfg->output_dir, sizeof(cfg->output_dir), json, "outputDir");
+    config_set_int(&cfg->api_port, json, "apiPort");
+    config_set_int(&cfg->workers_per_device, json, "workersPerDevice");
+    config_set_int(&cfg->startup_parallel, json, "startupParallel");
+    config_set_int(&cfg->consolidate_seconds, json, "consolidateSeconds");
+    config_set_int(&cfg->segment_seconds, json, "segmentSeconds");
+    config_set_str(cfg->output_format, sizeof(cfg->output_format), json, "outputFormat");
+    config_set_str(cfg->local_socket, sizeof(cfg->local_socket), json, "localSocket");
+    const cJSON *probe_cache = cJSON_GetObjectItem(json, "probeCache");
+    if (probe_cache && cJSON_IsBool(probe_cache)) cfg->probe_cache = cJSON_IsTrue(probe_cache);
+    config_set_str(cfg->simulate_devices, sizeof(cfg->simulate_devices), json, "simulateDevices");
+
+    const cJSON *chunking = cJSON_GetObjectItem(json, "chunking");
+    if (chunking && cJSON_IsObject(chunking)) {
+        config_set_int(&cfg->chunk_mb, chunking, "chunkMb");
+        config_set_int(&cfg->max_chunks, chunking, "maxChunks");
+    }
 
-    for (int i = 0; i < items; i++) {
-        int idx = (start + i) % MAX_PROCESSED;
-        if (strcmp(pf->files[idx], filename) == 0) {
-            pthread_mutex_unlock(&pf->mutex);
-            return 1;
-        }
+    const cJSON *ts_check = cJSON_GetObjectItem(json, "tsCheck");
+    if (ts_check && cJSON_IsObject(ts_check)) {
+        const cJSON *enabled = cJSON_GetObjectItem(ts_check, "enabled");
+        if (enabled && cJSON_IsBool(enabled)) cfg->ts_check = cJSON_IsTrue(enabled);
+        config_set_int(&cfg->ts_max_cc_percent, ts_check, "maxCcErrorPercent");
+        const cJSON *outputs = cJSON_GetObjectItem(ts_check, "outputs");
+        if (outputs && cJSON_IsBool(outputs)) cfg->ts_check_outputs = cJSON_IsTrue(outputs);
     }
 
-    pthread_mutex_unlock(&pf->mutex);
-    return 0;
-}
+    const cJSON *coalesce = cJSON_GetObjectItem(json, "coalesce");
+    if (coalesce && cJSON_IsObject(coalesce)) {
+        config_set_str(cfg->coalesce_key, sizeof(cfg->coalesce_key), coalesce, "key");
+        config_set_int(&cfg->coalesce_cache_seconds, coalesce, "cacheSeconds");
+    }
 
-void mark_file_processed(ProcessedFiles *pf, const char *filename) {
-    pthread_mutex_lock(&pf->mutex);
+    const cJSON *affinity = cJSON_GetObjectItem(json, "affinity");
+    if (affinity && cJSON_IsObject(affinity)) {
+        const cJSON *enabled = cJSON_GetObjectItem(affinity, "enabled");
+        if (enabled && cJSON_IsBool(enabled)) cfg->affinity = cJSON_IsTrue(enabled);
+        config_set_int(&cfg->service_cpus, affinity, "serviceCpus");
+    }
 
-    int index = pf->count % MAX_PROCESSED;
-    strncpy(pf->files[index], filename, 255);
-    pf->files[index][255] = '\0';
-    pf->count++;
+    const cJSON *worker_processes = cJSON_GetObjectItem(json, "workerProcesses");
+    if (worker_processes && cJSON_IsObject(worker_processes)) {
+        const cJSON *enabled = cJSON_GetObjectItem(worker_processes, "enabled");
+        if (enabled && cJSON_IsBool(enabled)) cfg->worker_processes = cJSON_IsTrue(enabled);
+        config_set_int(&cfg->workers_per_process, worker_processes, "workersPerProcess");
+    }
 
-    pthread_mutex_unlock(&pf->mutex);
-}
+    const cJSON *s3 = cJSON_GetObjectItem(json, "s3");
+    if (s3 && cJSON_IsObject(s3)) {
+        config_set_str(cfg->s3_endpoint, sizeof(cfg->s3_endpoint), s3, "endpoint");
+        config_set_str(cfg->s3_bucket, sizeof(cfg->s3_bucket), s3, "bucket");
+        config_set_str(cfg->s3_region, sizeof(cfg->s3_region), s3, "region");
+        config_set_str(cfg->s3_access_key, sizeof(cfg->s3_access_key), s3, "accessKey");
+        config_set_str(cfg->s3_secret_key, sizeof(cfg->s3_secret_key), s3, "secretKey");
+        config_set_str(cfg->s3_prefix, sizeof(cfg->s3_prefix), s3, "prefix");
+        config_set_int(&cfg->s3_part_mb, s3, "partMb");
+        config_set_int(&cfg->s3_buffer_parts, s3, "bufferParts");
+        config_set_str(cfg->s3_spool_dir, sizeof(cfg->s3_spool_dir), s3, "spoolDir");
+    }
 
-// ============================================================================
-// CUDA Hardware Context Setup
-// ============================================================================
+    const cJSON *encoder = cJSON_GetObjectItem(json, "encoder");
+    if (encoder && cJSON_IsObject(encoder)) {
+        config_set_int(&cfg->out_width, encoder, "width");
+        config_set_int(&cfg->out_height, encoder, "height");
+        config_set_int(&cfg->bitrate, encoder, "bitrate");
+        config_set_str(cfg->preset, sizeof(cfg->preset), encoder, "preset");
+        config_set_str(cfg->rc, sizeof(cfg->rc), encoder, "rc");
+        config_set_int(&cfg->cq, encoder, "cq");
+        config_set_str(cfg->profile, sizeof(cfg->profile), encoder, "profile");
+    }
 
-int init_hw_device_ctx(TranscodeContext *ctx) {
-    // Create CUDA device string: "0" or "1"
-    char device_str[8];
-    snprintf(device_str, sizeof(device_str), "%d", ctx->gpu_id);
+    const cJSON *admission_cfg = cJSON_GetObjectItem(json, "admission");
+    if (admission_cfg && cJSON_IsObject(admission_cfg)) {
+        config_set_int(&cfg->client_rate, admission_cfg, "clientRate");
+        config_set_int(&cfg->client_burst, admission_cfg, "clientBurst");
+    }
 
-    int ret = av_hwdevice_ctx_create(&ctx->hw_device_ctx, AV_HWDEVICE_TYPE_CUDA,
-                                     device_str, NULL, 0);
-    if (ret < 0) {
-        fprintf(stderr, "[Worker %d GPU %d] Failed to create CUDA device context\n",
-                ctx->worker_id, ctx->gpu_id);
-        return ret;
+    const cJSON *slo = cJSON_GetObjectItem(json, "sloMs");
+    if (slo && cJSON_IsObject(slo)) {
+        config_set_int(&cfg->slo_ms[PRIORITY_LIVE], slo, "live");
+        config_set_int(&cfg->slo_ms[PRIORITY_EXPORT], slo, "export");
+        config_set_int(&cfg->slo_ms[PRIORITY_ARCHIVE], slo, "archive");
     }
 
-    fprintf(stderr, "[Worker %d] Using GPU %d\n", ctx->worker_id, ctx->gpu_id);
+    const cJSON *queue_order = cJSON_GetObjectItem(json, "queueOrder");
+    if (queue_order && cJSON_IsObject(queue_order)) {
+        config_set_str(cfg->queue_order, sizeof(cfg->queue_order), queue_order, "mode");
+        config_set_int(&cfg->sjf_aging, queue_order, "agingFactor");
+    }
 
-    // Create CUDA stream for async operations
-    cudaError_t cuda_ret = cudaStreamCreate(&ctx->cuda_stream);
-    if (cuda_ret != cudaSuccess) {
-        fprintf(stderr, "[Worker %d] CUDA stream creation failed: %s\n",
-                ctx->worker_id, cudaGetErrorString(cuda_ret));
-        return -1;
+    const cJSON *retry = cJSON_GetObjectItem(json, "retry");
+    if (retry && cJSON_IsObject(retry)) {
+        config_set_int(&cfg->max_retries, retry, "maxRetries");
+        config_set_int(&cfg->retry_base_ms, retry, "baseMs");
+        config_set_int(&cfg->retry_max_ms, retry, "maxMs");
+        config_set_int(&cfg->quarantine_ttl_hours, retry, "quarantineTtlHours");
     }
 
-    fprintf(stderr, "[Worker %d] CUDA device context and stream created\n", ctx->worker_id);
-    return 0;
-}
+    const cJSON *amqp = cJSON_GetObjectItem(json, "amqp");
+    if (amqp && cJSON_IsObject(amqp)) {
+        config_set_str(cfg->amqp_host, sizeof(cfg->amqp_host), amqp, "host");
+        config_set_int(&cfg->amqp_port, amqp, "port");
+        config_set_str(cfg->amqp_user, sizeof(cfg->amqp_user), amqp, "user");
+        config_set_str(cfg->amqp_password, sizeof(cfg->amqp_password), amqp, "password");
+        config_set_str(cfg->amqp_vhost, sizeof(cfg->amqp_vhost), amqp, "vhost");
+        config_set_str(cfg->amqp_consume_queue, sizeof(cfg->amqp_consume_queue), amqp, "consumeQueue");
+        config_set_str(cfg->amqp_publish_queue, sizeof(cfg->amqp_publish_queue), amqp, "publishQueue");
+        config_set_int(&cfg->amqp_prefetch, amqp, "prefetch");
+    }
 
-// ============================================================================
-// NVDEC Decoder Setup (h264_cuvid) - PERSISTENT VERSION
-// ============================================================================
+    const cJSON *timelapse = cJSON_GetObjectItem(json, "timelapse");
+    if (timelapse && cJSON_IsObject(timelapse)) {
+        config_set_int(&cfg->timelapse.fps, timelapse, "fps");
+        const cJSON *keyframes = cJSON_GetObjectItem(timelapse, "keyframesOnly");
+        if (keyframes && cJSON_IsBool(keyframes)) cfg->timelapse.keyframes_only = cJSON_IsTrue(keyframes);
+        config_set_int(&cfg->timelapse.width, timelapse, "width");
+        config_set_int(&cfg->timelapse.height, timelapse, "height");
+        config_set_int(&cfg->timelapse.bitrate, timelapse, "bitrate");
+        config_set_int(&cfg->timelapse_after_days, timelapse, "afterDays");
+    }
 
-// Persistent decoder: initialized once with standard camera parameters
-// All camera files are 1920x1080 H.264, so we can hardcode parameters
-int init_decoder_persistent(TranscodeContext *ctx) {
-    // GPU-ONLY: Use h264_cuvid (NVDEC) - NO CPU FALLBACK
-    const AVCodec *decoder = avcodec_find_decoder_by_name("h264_cuvid");
-    if (!decoder) {
-        fprintf(stderr, "[Worker %d] FATAL: h264_cuvid (NVDEC) not available - GPU-only pipeline required\n", ctx->worker_id);
-        exit(1);  // FAIL immediately - NO CPU fallback
+    const cJSON *mosaic = cJSON_GetObjectItem(json, "mosaic");
+    if (mosaic && cJSON_IsObject(mosaic)) {
+        config_set_str(cfg->mosaic_scaler, sizeof(cfg->mosaic_scaler), mosaic, "scaler");
     }
 
-    ctx->decoder_ctx = avcodec_alloc_context3(decoder);
-    if (!ctx->decoder_ctx) {
-        fprintf(stderr, "[Worker %d] Failed to allocate decoder context\n", ctx->worker_id);
-        return -1;
+    // "codecProfiles" replaces the built-in single h264 profile
+    config_set_str(cfg->encoder_backend, sizeof(cfg->encoder_backend), json, "encoderBackend");
+    config_set_str(cfg->default_codec_profile, sizeof(cfg->default_codec_profile), json, "defaultCodecProfile");
+    const cJSON *profiles = cJSON_GetObjectItem(json, "codecProfiles");
+    if (profiles && cJSON_IsArray(profiles)) {
+        int n = cJSON_GetArraySize(profiles);
+        if (n < 1 || n > MAX_CODEC_PROFILES) {
+            fprintf(stderr, "[Config] codecProfiles must have 1..%d entries\n", MAX_CODEC_PROFILES);
+            cJSON_Delete(json);
+            return -1;
+        }
+        memset(cfg->codec_profiles, 0, sizeof(cfg->codec_profiles));
+        cfg->nb_codec_profiles = n;
+        for (int i = 0; i < n; i++) {
+            const cJSON *item = cJSON_GetArrayItem(profiles, i);
+            CodecProfile *p = &cfg->codec_profiles[i];
+            char codec[16] = "h264";
+            config_set_str(p->name, sizeof(p->name), item, "name");
+            config_set_str(codec, sizeof(codec), item, "codec");
+            p->codec = CODEC_NB;
+            for (int c = 0; c < CODEC_NB; c++) {
+                if (strcmp(codec, codec_names[c]) == 0) p->codec = c;
+            }
+            config_set_int(&p->bitrate, item, "bitrate");
+            config_set_int(&p->cq, item, "cq");
+            config_set_str(p->preset, sizeof(p->preset), item, "preset");
+            config_set_str(p->software_preset, sizeof(p->software_preset), item, "softwarePreset");
+            config_set_str(p->profile, sizeof(p->profile), item, "profile");
+        }
     }
 
-    // Standard camera parameters (all files are identical format)
-    ctx->decoder_ctx->codec_type = AVMEDIA_TYPE_VIDEO;
-    ctx->decoder_ctx->codec_id = AV_CODEC_ID_H264;
-    ctx->decoder_ctx->width = 1920;
-    ctx->decoder_ctx->height = 1080;
-    ctx->decoder_ctx->pix_fmt = AV_PIX_FMT_CUDA;
-    ctx->decoder_ctx->time_base = (AVRational){1, 25};
+    const cJSON *adaptive = cJSON_GetObjectItem(json, "adaptive");
+    if (adaptive && cJSON_IsObject(adaptive)) {
+        const cJSON *enabled = cJSON_GetObjectItem(adaptive, "enabled");
+        if (enabled && cJSON_IsBool(enabled)) cfg->adaptive = cJSON_IsTrue(enabled);
+        config_set_int(&cfg->adaptive_min, adaptive, "minWorkers");
+        config_set_int(&cfg->adaptive_max, adaptive, "maxWorkers");
+        config_set_int(&cfg->adaptive_interval, adaptive, "intervalSeconds");
+    }
 
-    // Set hardware device context for NVDEC
-    ctx->decoder_ctx->hw_device_ctx = av_buffer_ref(ctx->hw_device_ctx);
+    cJSON_Delete(json);
+    fprintf(stderr, "[Config] Loaded %s\n", path);
+    return 0;
+}
 
-    // NVDEC options for fast decode
-    AVDictionary *opts = NULL;
-    char gpu_str[8];
-    snprintf(gpu_str, sizeof(gpu_str), "%d", ctx->gpu_id);
-    av_dict_set(&opts, "gpu", gpu_str, 0);
+static void env_int(int *dst, const char *name) {
+    const char *value = getenv(name);
+    if (value && *value) *dst = atoi(value);
+}
 
-    if (avcodec_open2(ctx->decoder_ctx, decoder, &opts) < 0) {
-        fprintf(stderr, "[Worker %d] Failed to open NVDEC decoder\n", ctx->worker_id);
-        av_dict_free(&opts);
-        return -1;
+static void env_str(char *dst, size_t size, const char *name) {
+    const char *value = getenv(name);
+    if (value && *value) {
+        strncpy(dst, value, size - 1);
+        dst[size - 1] = '\0';
     }
-
-    av_dict_free(&opts);
-    fprintf(stderr, "[Worker %d] NVDEC decoder initialized (persistent, h264_cuvid)\n", ctx->worker_id);
-    return 0;
 }
 
-// ============================================================================
-// NVENC Encoder Setup (h264_nvenc with P2+VBR+CQ28)
-// ============================================================================
+// TRANSCODER_* environment variables override the config file
+void config_apply_env(TranscoderConfig *cfg) {
+    env_int(&cfg->workers, "TRANSCODER_WORKERS");
+    env_int(&cfg->queue_capacity, "TRANSCODER_QUEUE_CAPACITY");
+    env_str(cfg->input_dir, sizeof(cfg->input_dir), "TRANSCODER_INPUT_DIR");
+    env_str(cfg->output_dir, sizeof(cfg->output_dir), "TRANSCODER_OUTPUT_DIR");
+    env_str(cfg->local_socket, sizeof(cfg->local_socket), "TRANSCODER_LOCAL_SOCKET");
+    env_int(&cfg->probe_cache, "TRANSCODER_PROBE_CACHE");
+    env_int(&cfg->api_port, "TRANSCODER_API_PORT");
+    env_int(&cfg->workers_per_device, "TRANSCODER_WORKERS_PER_DEVICE");
+    env_int(&cfg->startup_parallel, "TRANSCODER_STARTUP_PARALLEL");
+    env_int(&cfg->out_width, "TRANSCODER_ENCODER_WIDTH");
+    env_int(&cfg->out_height, "TRANSCODER_ENCODER_HEIGHT");
+    env_int(&cfg->bitrate, "TRANSCODER_ENCODER_BITRATE");
+    env_str(cfg->preset, sizeof(cfg->preset), "TRANSCODER_ENCODER_PRESET");
+    env_str(cfg->rc, sizeof(cfg->rc), "TRANSCODER_ENCODER_RC");
+    env_int(&cfg->cq, "TRANSCODER_ENCODER_CQ");
+    env_str(cfg->profile, sizeof(cfg->profile), "TRANSCODER_ENCODER_PROFILE");
+    env_int(&cfg->consolidate_seconds, "TRANSCODER_CONSOLIDATE_SECONDS");
+    env_int(&cfg->segment_seconds, "TRANSCODER_SEGMENT_SECONDS");
+    env_str(cfg->output_format, sizeof(cfg->output_format), "TRANSCODER_OUTPUT_FORMAT");
+    env_str(cfg->simulate_devices, sizeof(cfg->simulate_devices), "TRANSCODER_SIMULATE_DEVICES");
+    env_int(&cfg->chunk_mb, "TRANSCODER_CHUNK_MB");
+    env_int(&cfg->max_chunks, "TRANSCODER_MAX_CHUNKS");
+    env_int(&cfg->ts_check, "TRANSCODER_TS_CHECK");
+    env_int(&cfg->ts_max_cc_percent, "TRANSCODER_TS_MAX_CC_PERCENT");
+    env_int(&cfg->ts_check_outputs, "TRANSCODER_TS_CHECK_OUTPUTS");
+    env_str(cfg->coalesce_key, sizeof(cfg->coalesce_key), "TRANSCODER_COALESCE_KEY");
+    env_int(&cfg->coalesce_cache_seconds, "TRANSCODER_COALESCE_CACHE_SECONDS");
+    env_int(&cfg->affinity, "TRANSCODER_AFFINITY");
+    env_int(&cfg->service_cpus, "TRANSCODER_SERVICE_CPUS");
+    env_int(&cfg->worker_processes, "TRANSCODER_WORKER_PROCESSES");
+    env_int(&cfg->workers_per_process, "TRANSCODER_WORKERS_PER_PROCESS");
+    env_str(cfg->s3_endpoint, sizeof(cfg->s3_endpoint), "TRANSCODER_S3_ENDPOINT");
+    env_str(cfg->s3_bucket, sizeof(cfg->s3_bucket), "TRANSCODER_S3_BUCKET");
+    env_str(cfg->s3_region, sizeof(cfg->s3_region), "TRANSCODER_S3_REGION");
+    env_str(cfg->s3_access_key, sizeof(cfg->s3_access_key), "TRANSCODER_S3_ACCESS_KEY");
+    env_str(cfg->s3_secret_key, sizeof(cfg->s3_secret_key), "TRANSCODER_S3_SECRET_KEY");
+    env_str(cfg->s3_prefix, sizeof(cfg->s3_prefix), "TRANSCODER_S3_PREFIX");
+    env_int(&cfg->s3_part_mb, "TRANSCODER_S3_PART_MB");
+    env_int(&cfg->s3_buffer_parts, "TRANSCODER_S3_BUFFER_PARTS");
+    env_str(cfg->s3_spool_dir, sizeof(cfg->s3_spool_dir), "TRANSCODER_S3_SPOOL_DIR");
+    env_int(&cfg->client_rate, "TRANSCODER_CLIENT_RATE");
+    env_int(&cfg->client_burst, "TRANSCODER_CLIENT_BURST");
+    env_int(&cfg->slo_ms[PRIORITY_LIVE], "TRANSCODER_SLO_LIVE_MS");
+    env_int(&cfg->slo_ms[PRIORITY_EXPORT], "TRANSCODER_SLO_EXPORT_MS");
+    env_int(&cfg->slo_ms[PRIORITY_ARCHIVE], "TRANSCODER_SLO_ARCHIVE_MS");
+    env_str(cfg->queue_order, sizeof(cfg->queue_order), "TRANSCODER_QUEUE_ORDER");
+    env_int(&cfg->sjf_aging, "TRANSCODER_SJF_AGING");
+    env_int(&cfg->max_retries, "TRANSCODER_MAX_RETRIES");
+    env_int(&cfg->retry_base_ms, "TRANSCODER_RETRY_BASE_MS");
+    env_int(&cfg->retry_max_ms, "TRANSCODER_RETRY_MAX_MS");
+    env_int(&cfg->quarantine_ttl_hours, "TRANSCODER_QUARANTINE_TTL_HOURS");
+    env_str(cfg->amqp_host, sizeof(cfg->amqp_host), "TRANSCODER_AMQP_HOST");
+    env_int(&cfg->amqp_port, "TRANSCODER_AMQP_PORT");
+    env_str(cfg->amqp_user, sizeof(cfg->amqp_user), "TRANSCODER_AMQP_USER");
+    env_str(cfg->amqp_password, sizeof(cfg->amqp_password), "TRANSCODER_AMQP_PASSWORD");
+    env_str(cfg->amqp_vhost, sizeof(cfg->amqp_vhost), "TRANSCODER_AMQP_VHOST");
+    env_str(cfg->amqp_consume_queue, sizeof(cfg->amqp_consume_queue), "TRANSCODER_AMQP_CONSUME_QUEUE");
+    env_str(cfg->amqp_publish_queue, sizeof(cfg->amqp_publish_queue), "TRANSCODER_AMQP_PUBLISH_QUEUE");
+    env_int(&cfg->amqp_prefetch, "TRANSCODER_AMQP_PREFETCH");
+    env_int(&cfg->timelapse.fps, "TRANSCODER_TIMELAPSE_FPS");
+    env_int(&cfg->timelapse.keyframes_only, "TRANSCODER_TIMELAPSE_KEYFRAMES_ONLY");
+    env_int(&cfg->timelapse.width, "TRANSCODER_TIMELAPSE_WIDTH");
+    env_int(&cfg->timelapse.height, "TRANSCODER_TIMELAPSE_HEIGHT");
+    env_int(&cfg->timelapse.bitrate, "TRANSCODER_TIMELAPSE_BITRATE");
+    env_int(&cfg->timelapse_after_days, "TRANSCODER_TIMELAPSE_AFTER_DAYS");
+    env_str(cfg->mosaic_scaler, sizeof(cfg->mosaic_scaler), "TRANSCODER_MOSAIC_SCALER");
+    env_str(cfg->encoder_backend, sizeof(cfg->encoder_backend), "TRANSCODER_ENCODER_BACKEND");
+    env_str(cfg->default_codec_profile, sizeof(cfg->default_codec_profile), "TRANSCODER_DEFAULT_CODEC_PROFILE");
+    env_int(&cfg->adaptive, "TRANSCODER_ADAPTIVE");
+    env_int(&cfg->adaptive_min, "TRANSCODER_ADAPTIVE_MIN");
+    env_int(&cfg->adaptive_max, "TRANSCODER_ADAPTIVE_MAX");
+    env_int(&cfg->adaptive_interval, "TRANSCODER_ADAPTIVE_INTERVAL");
+}
 
-int init_encoder(TranscodeContext *ctx) {
-    // GPU-ONLY: Use h264_nvenc (NVENC) - NO CPU FALLBACK
-    const AVCodec *encoder = avcodec_find_encoder_by_name("h264_nvenc");
-    if (!encoder) {
-        fprintf(stderr, "[Worker %d] FATAL: h264_nvenc (NVENC) not available - GPU-only pipeline required\n", ctx->worker_id);
-        exit(1);  // FAIL immediately - NO CPU fallback
+// Why a time-lapse spec cannot be encoded, or NULL if it is usable
+static const char *timelapse_spec_error(const TimelapseSpec *t) {
+    if (t->fps < 1 || t->fps > SOURCE_FPS) {
+        return "timelapse fps must be 1..25";
+    }
+    if (t->width < 0 || t->height < 0 || (t->width == 0) != (t->height == 0) ||
+        t->width % 2 || t->height % 2) {
+        return "timelapse width/height must both be 0 or both even and positive";
     }
+    if (t->bitrate < 0) {
+        return "timelapse bitrate must be >= 0";
+    }
+    return NULL;
+}
 
-    ctx->encoder_ctx = avcodec_alloc_context3(encoder);
-    if (!ctx->encoder_ctx) {
-        fprintf(stderr, "[Worker %d] Failed to allocate encoder context\n", ctx->worker_id);
+// Check the codec catalogue, fill unset fields from encoder.* and move the
+// default profile to index 0 (the profile of jobs that do not name one)
+static int codec_profiles_validate(TranscoderConfig *cfg) {
+    int default_idx = cfg->default_codec_profile[0] ? -1 : 0;
+
+    for (int i = 0; i < cfg->nb_codec_profiles; i++) {
+        CodecProfile *p = &cfg->codec_profiles[i];
+        if (!p->name[0] || p->codec == CODEC_NB) {
+            fprintf(stderr, "[Config] codecProfiles[%d] needs a name and codec h264, hevc or av1\n", i);
+            return -1;
+        }
+        for (int j = 0; j < i; j++) {
+            if (strcmp(cfg->codec_profiles[j].name, p->name) == 0) {
+                fprintf(stderr, "[Config] Duplicate codec profile: %s\n", p->name);
+                return -1;
+            }
+        }
+        if (p->bitrate < 0 || p->cq < 0) {
+            fprintf(stderr, "[Config] Codec profile %s: bitrate and cq must be >= 0\n", p->name);
+            return -1;
+        }
+        if (p->bitrate == 0) p->bitrate = cfg->bitrate;
+        if (p->cq == 0) p->cq = cfg->cq;
+        if (!p->preset[0]) strncpy(p->preset, cfg->preset, sizeof(p->preset) - 1);
+        if (!p->profile[0]) strncpy(p->profile, cfg->profile, sizeof(p->profile) - 1);
+        if (strcmp(p->name, cfg->default_codec_profile) == 0) default_idx = i;
+    }
+
+    if (default_idx < 0) {
+        fprintf(stderr, "[Config] defaultCodecProfile %s is not in codecProfiles\n", cfg->default_codec_profile);
         return -1;
     }
+    if (default_idx > 0) {
+        CodecProfile tmp = cfg->codec_profiles[0];
+        cfg->codec_profiles[0] = cfg->codec_profiles[default_idx];
+        cfg->codec_profiles[default_idx] = tmp;
+    }
+    return 0;
+}
 
-    // Encoder settings for 720p output with CUDA frames from scale_cuda filter
-    ctx->encoder_ctx->width = 1280;
-    ctx->encoder_ctx->height = 720;
-    ctx->encoder_ctx->time_base = (AVRational){1, 25};
-    ctx->encoder_ctx->framerate = (AVRational){25, 1};
-    ctx->encoder_ctx->sample_aspect_ratio = (AVRational){1, 1};
-    ctx->encoder_ctx->pix_fmt = AV_PIX_FMT_CUDA;  // Accept CUDA frames from scale_cuda
-    ctx->encoder_ctx->bit_rate = 1500000;  // 1.5M bitrate (reduced for smaller output)
+// "path", "content" or "off" (-1 if unknown)
+int parse_coalesce_mode(const char *name) {
+    for (int i = COALESCE_OFF; i < COALESCE_NB_MODES; i++) {
+        if (strcmp(name, coalesce_mode_names[i]) == 0) return i;
+    }
+    return -1;
+}
 
-    // Create hw_frames_ctx for encoder (required when using CUDA frames)
-    AVBufferRef *hw_frames_ref = av_hwframe_ctx_alloc(ctx->hw_device_ctx);
-    AVHWFramesContext *frames_ctx = (AVHWFramesContext *)(hw_frames_ref->data);
-    frames_ctx->format    = AV_PIX_FMT_CUDA;
-    frames_ctx->sw_format = AV_PIX_FMT_NV12;
-    frames_ctx->width     = 1280;
-    frames_ctx->height    = 720;
+int config_validate(TranscoderConfig *cfg) {
+    if (cfg->workers < 1 || cfg->workers > MAX_WORKERS_LIMIT) {
+        fprintf(stderr, "[Config] workers must be 1..%d\n", MAX_WORKERS_LIMIT);
+        return -1;
+    }
+    if (cfg->queue_capacity < 1 || cfg->queue_capacity > MAX_QUEUE_LIMIT) {
+        fprintf(stderr, "[Config] queueCapacity must be 1..%d\n", MAX_QUEUE_LIMIT);
+        return -1;
+    }
+    if (cfg->startup_parallel < 1) {
+        fprintf(stderr, "[Config] startupParallel must be >= 1\n");
+        return -1;
+    }
+    if (cfg->out_width <= 0 || cfg->out_height <= 0 || cfg->bitrate <= 0) {
+        fprintf(stderr, "[Config] Invalid encoder settings\n");
+        return -1;
+    }
+    for (int i = 0; i < PRIORITY_NB_CLASSES; i++) {
+        if (cfg->slo_ms[i] < 0) {
+            fprintf(stderr, "[Config] sloMs values must be >= 0\n");
+            return -1;
+        }
+    }
+    if ((strcmp(cfg->queue_order, "deadline") != 0 && strcmp(cfg->queue_order, "sjf") != 0) ||
+        cfg->sjf_aging < 1) {
+        fprintf(stderr, "[Config] queueOrder requires mode deadline or sjf and agingFactor >= 1\n");
+        return -1;
+    }
+    if (cfg->max_retries < 0 || cfg->retry_base_ms < 1 || cfg->retry_max_ms < cfg->retry_base_ms ||
+        cfg->quarantine_ttl_hours < 0) {
+        fprintf(stderr, "[Config] retry requires maxRetries >= 0, 1 <= baseMs <= maxMs and quarantineTtlHours >= 0\n");
+        return -1;
+    }
+    if (cfg->amqp_host[0] && (cfg->amqp_prefetch < 1 || cfg->amqp_prefetch > AMQP_MAX_PREFETCH)) {
+        fprintf(stderr, "[Config] amqp.prefetch must be 1..%d\n", AMQP_MAX_PREFETCH);
+        return -1;
+    }
+    if (cfg->client_rate < 0 || cfg->client_burst < 0) {
+        fprintf(stderr, "[Config] clientRate and clientBurst must be >= 0\n");
+        return -1;
+    }
+    if (cfg->client_rate > 0 && cfg->client_burst == 0) {
+        cfg->client_burst = cfg->client_rate;
+    }
+    const char *timelapse_error = timelapse_spec_error(&cfg->timelapse);
+    if (timelapse_error || cfg->timelapse_after_days < 0) {
+        fprintf(stderr, "[Config] %s\n", timelapse_error ? timelapse_error : "timelapse afterDays must be >= 0");
+        return -1;
+    }
+    if (strcmp(cfg->mosaic_scaler, "cuda") != 0 && strcmp(cfg->mosaic_scaler, "software") != 0) {
+        fprintf(stderr, "[Config] mosaic.scaler must be cuda or software\n");
+        return -1;
+    }
+    if (strcmp(cfg->encoder_backend, "nvenc") != 0 && strcmp(cfg->encoder_backend, "software") != 0) {
+        fprintf(stderr, "[Config] encoderBackend must be nvenc or software\n");
+        return -1;
+    }
+    if (codec_profiles_validate(cfg) < 0) {
+        return -1;
+    }
+    if (cfg->chunk_mb < 0 || cfg->max_chunks < 2 || cfg->max_chunks > MAX_CHUNKS) {
+        fprintf(stderr, "[Config] chunking requires chunkMb >= 0 and maxChunks 2..%d\n", MAX_CHUNKS);
+        return -1;
+    }
+    if (cfg->ts_max_cc_percent < 0 || cfg->ts_max_cc_percent > 100) {
+        fprintf(stderr, "[Config] tsCheck requires maxCcErrorPercent 0..100\n");
+        return -1;
+    }
+    if (parse_coalesce_mode(cfg->coalesce_key) <= COALESCE_DEFAULT || cfg->coalesce_cache_seconds < 0) {
+        fprintf(stderr, "[Config] coalesce requires key path, content or off and cacheSeconds >= 0\n");
+        return -1;
+    }
+    if (cfg->service_cpus < 0) {
+        fprintf(stderr, "[Config] affinity serviceCpus must be >= 0\n");
+        return -1;
+    }
+    if (cfg->workers_per_process < 0) {
+        fprintf(stderr, "[Config] workerProcesses workersPerProcess must be >= 0\n");
+        return -1;
+    }
+    if (cfg->s3_endpoint[0] &&
+        (!cfg->s3_bucket[0] || cfg->s3_part_mb < S3_MIN_PART_MB ||
+         cfg->s3_buffer_parts < 1 || cfg->s3_buffer_parts > MAX_S3_BUFFER_PARTS)) {
+        fprintf(stderr, "[Config] s3 requires a bucket, partMb >= %d and bufferParts 1..%d\n",
+                S3_MIN_PART_MB, MAX_S3_BUFFER_PARTS);
+        return -1;
+    }
+    if (cfg->adaptive) {
+        if (cfg->adaptive_max == 0) cfg->adaptive_max = cfg->workers;
+        if (cfg->adaptive_max < 1 || cfg->adaptive_max > MAX_WORKERS_LIMIT ||
+            cfg->adaptive_min < 1 || cfg->adaptive_min > cfg->adaptive_max ||
+            cfg->adaptive_interval < 1) {
+            fprintf(stderr, "[Config] adaptive requires 1 <= minWorkers <= maxWorkers <= %d\n",
+                    MAX_WORKERS_LIMIT);
+            return -1;
+        }
+    }
+    return 0;
+}
 
-    int ret = av_hwframe_ctx_init(hw_frames_ref);
-    if (ret < 0) {
-        fprintf(stderr, "[Worker %d] Failed to init encoder hw_frames_ctx\n", ctx->worker_id);
-        av_buffer_unref(&hw_frames_ref);
+// Map a producer's inputPath onto the name jobs carry, which workers open
+// under inputDir. Relative paths are taken as they are; absolute ones must
+// lie inside inputDir and lose that prefix. Writes the job name to rel and
+// the path workers open to full (either may be NULL). Returns -1 for paths
+// outside inputDir or climbing out of it.
+int resolve_input_path(const char *input_path, char *rel, size_t rel_size,
+                       char *full, size_t full_size) {
+    const char *name = input_path;
+    if (input_path[0] == '/') {
+        size_t len = strlen(config.input_dir);
+        while (len > 1 && config.input_dir[len - 1] == '/') len--;
+        if (len == 1 && config.input_dir[0] == '/') len = 0;  // inputDir is the root
+        if (strncmp(input_path, config.input_dir, len) != 0 || input_path[len] != '/') {
+            return -1;
+        }
+        name = input_path + len;
+        while (*name == '/') name++;
+    }
+    if (!*name || strcmp(name, "..") == 0 || strncmp(name, "../", 3) == 0 || strstr(name, "/../")) {
         return -1;
     }
+    if (rel) snprintf(rel, rel_size, "%s", name);
+    if (full) snprintf(full, full_size, "%s/%s", config.input_dir, name);
+    return 0;
+}
 
-    ctx->encoder_ctx->hw_frames_ctx = hw_frames_ref;
+// ============================================================================
+// Scheduling Classes
+// ============================================================================
 
-    // NVENC optimal settings (P2 + VBR + CQ30 - optimized for smaller output)
-    av_opt_set(ctx->encoder_ctx->priv_data, "preset", "p2", 0);
-    av_opt_set(ctx->encoder_ctx->priv_data, "rc", "vbr", 0);
-    av_opt_set(ctx->encoder_ctx->priv_data, "cq", "30", 0);  // Increased for smaller file size
-    av_opt_set(ctx->encoder_ctx->priv_data, "profile", "main", 0);
-    av_opt_set(ctx->encoder_ctx->priv_data, "level", "auto", 0);
+static const char *priority_names[PRIORITY_NB_CLASSES] = { "archive", "export", "live" };
 
-    // Set GPU ID dynamically based on worker assignment
-    char gpu_str_enc[8];
-    snprintf(gpu_str_enc, sizeof(gpu_str_enc), "%d", ctx->gpu_id);
-    av_opt_set(ctx->encoder_ctx->priv_data, "gpu", gpu_str_enc, 0);
+long long monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
 
-    AVDictionary *opts = NULL;
-    ret = avcodec_open2(ctx->encoder_ctx, encoder, &opts);
-    av_dict_free(&opts);
+int parse_priority(const char *name) {
+    for (int i = 0; i < PRIORITY_NB_CLASSES; i++) {
+        if (strcmp(name, priority_names[i]) == 0) return i;
+    }
+    return -1;
+}
 
-    if (ret < 0) {
-        fprintf(stderr, "[Worker %d] FATAL: Failed to open h264_nvenc encoder\n", ctx->worker_id);
-        return -1;
+void scheduler_stats_init(SchedulerStats *st) {
+    memset(st->classes, 0, sizeof(st->classes));
+    pthread_mutex_init(&st->mutex, NULL);
+}
+
+void scheduler_note_downgrade(JobPriority priority) {
+    pthread_mutex_lock(&scheduler_stats.mutex);
+    scheduler_stats.classes[priority].downgraded++;
+    pthread_mutex_unlock(&scheduler_stats.mutex);
+}
+
+void scheduler_note_expired(JobPriority priority) {
+    pthread_mutex_lock(&scheduler_stats.mutex);
+    scheduler_stats.classes[priority].expired++;
+    pthread_mutex_unlock(&scheduler_stats.mutex);
+}
+
+// Record a finished job against its class. The SLO is met when the job
+// finished by its explicit deadline, or within the class latency target.
+// Downgraded jobs missed their deadline by definition. Failed jobs are only
+// counted: their latency says nothing about the service level.
+void scheduler_record_completion(const TranscodeJob *job, int ok) {
+    if (!ok) {
+        pthread_mutex_lock(&scheduler_stats.mutex);
+        scheduler_stats.classes[job->priority].failed++;
+        pthread_mutex_unlock(&scheduler_stats.mutex);
+        return;
     }
 
-    fprintf(stderr, "[Worker %d] NVENC encoder initialized (h264_nvenc)\n", ctx->worker_id);
-    return 0;
+    long long now = monotonic_ms();
+    double latency = (now - job->enqueued_ms) / 1000.0;
+
+    int met;
+    if (job->deadline_missed) {
+        met = 0;
+    } else if (job->deadline_ms > 0) {
+        met = now <= job->deadline_ms;
+    } else {
+        int slo_ms = config.slo_ms[job->priority];
+        met = slo_ms == 0 || latency * 1000.0 <= slo_ms;
+    }
+
+    pthread_mutex_lock(&scheduler_stats.mutex);
+    ClassStats *cs = &scheduler_stats.classes[job->priority];
+    cs->completed++;
+    cs->slo_met += met;
+    cs->latency_sum += latency;
+    for (int i = 0; i < SLO_BUCKETS; i++) {
+        if (latency <= slo_bucket_seconds[i]) cs->latency_buckets[i]++;
+    }
+    pthread_mutex_unlock(&scheduler_stats.mutex);
 }
 
-// Initialize scale_cuda filter for GPU-based scaling - PERSISTENT VERSION
-// Uses hard-coded parameters since all camera files are identical format
-int init_filter_persistent(TranscodeContext *ctx) {
-    char args[512];
-    int ret;
+// ============================================================================
+// Job Cost Model
+// ============================================================================
 
-    const AVFilter *buffersrc = avfilter_get_by_name("buffer");
-    const AVFilter *buffersink = avfilter_get_by_name("buffersink");
-    AVFilterInOut *outputs = avfilter_inout_alloc();
-    AVFilterInOut *inputs = avfilter_inout_alloc();
+void camera_key_from_path(const char *input_path, char *key, size_t key_size);
 
-    ctx->filter_graph = avfilter_graph_alloc();
-    if (!outputs || !inputs || !ctx->filter_graph) {
-        fprintf(stderr, "[Worker %d] Failed to allocate filter graph\n", ctx->worker_id);
-        return -1;
+// Cost is learned per camera and codec profile: a camera's scene and bitrate
+// set its decode/encode cost per byte. Renditions with a different pipeline
+// keep their own model.
+static void cost_model_key(const TranscodeJob *job, char *key, size_t size) {
+    char camera[256];
+    if (job->camera_id[0]) {
+        snprintf(camera, sizeof(camera), "%s", job->camera_id);
+    } else {
+        camera_key_from_path(job->filename, camera, sizeof(camera));
     }
+    snprintf(key, size, "%s|%s%s%s", camera, config.codec_profiles[job->codec_profile].name,
+             job->timelapse.fps > 0 ? "|timelapse" : "", job->mosaic ? "|mosaic" : "");
+}
 
-    // Create buffer source (NVDEC output) - standard camera parameters
-    snprintf(args, sizeof(args),
-             "video_size=%dx%d:pix_fmt=%d:time_base=%d/%d:pixel_aspect=%d/%d",
-             1920, 1080,
-             AV_PIX_FMT_CUDA,
-             1, 25,
-             1, 1);
+static long long input_file_bytes(const char *filename) {
+    char path[1024];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s/%s", config.input_dir, filename);
+    return stat(path, &st) == 0 ? (long long)st.st_size : 0;
+}
 
-    fprintf(stderr, "[Worker %d] Creating buffer source with args: %s\n", ctx->worker_id, args);
-    ret = avfilter_graph_create_filter(&ctx->buffersrc_ctx, buffersrc, "in",
-                                       args, NULL, ctx->filter_graph);
-    if (ret < 0) {
-        fprintf(stderr, "[Worker %d] Failed to create buffer source\n", ctx->worker_id);
+// Bytes the job will read: every segment of a group, every tile of a wall,
+// or one part of a split input
+static long long job_input_bytes(const TranscodeJob *job) {
+    long long bytes = 0;
+    if (job->group) {
+        for (int i = 0; i < job->group->nb_segments; i++) {
+            bytes += input_file_bytes(job->group->segments[i].filename);
+        }
+    } else if (job->mosaic) {
+        for (int i = 0; i < job->mosaic->nb_inputs; i++) {
+            if (job->mosaic->inputs[i][0]) bytes += input_file_bytes(job->mosaic->inputs[i]);
+        }
+    } else if (job->chunked) {
+        bytes = job->chunked->input_size / job->chunked->nb_chunks;
+    } else {
+        bytes = input_file_bytes(job->filename);
+    }
+    return bytes;
+}
+
+static CostModelEntry *cost_model_find(CostModel *m, const char *key) {
+    for (int i = 0; i < m->count; i++) {
+        if (strcmp(m->entries[i].key, key) == 0) return &m->entries[i];
+    }
+    return NULL;
+}
+
+// Mean cost per MB applied to an input of 'mb' (the mean job without a size),
+// or -1 before the first sample
+static double cost_entry_mean(const CostModelEntry *e, double mb) {
+    if (e->n <= 0) {
         return -1;
     }
+    double mean_x = e->sx / e->n;
+    double mean_y = e->sy / e->n;
+    return mb > 0 && mean_x > 0 ? mean_y * mb / mean_x : mean_y;
+}
 
-    // Create hw_frames_ctx for buffer source
-    fprintf(stderr, "[Worker %d] Creating hw_frames_ctx for buffer source\n", ctx->worker_id);
-    AVBufferRef *hw_frames_ref = av_hwframe_ctx_alloc(ctx->hw_device_ctx);
-    if (!hw_frames_ref) {
-        fprintf(stderr, "[Worker %d] Failed to allocate hw_frames_ctx\n", ctx->worker_id);
+// Expected ms for an input of 'mb', or -1 without enough samples. Falls back
+// from the fitted line to the mean cost per MB when the observed sizes are too
+// alike to fit a slope (or the fit says bigger inputs are cheaper).
+static double cost_entry_predict(const CostModelEntry *e, double mb) {
+    if (e->samples < COST_MODEL_MIN_SAMPLES || e->n <= 0) {
         return -1;
     }
+    double mean_x = e->sx / e->n;
+    double mean_y = e->sy / e->n;
+    double var_x = e->sxx / e->n - mean_x * mean_x;
+    if (mb > 0 && var_x > 0.01 * mean_x * mean_x) {
+        double slope = (e->sxy / e->n - mean_x * mean_y) / var_x;
+        double predicted = mean_y + slope * (mb - mean_x);
+        if (slope >= 0 && predicted > 0) return predicted;
+    }
+    return cost_entry_mean(e, mb);
+}
 
-    AVHWFramesContext *frames_ctx = (AVHWFramesContext *)(hw_frames_ref->data);
-    frames_ctx->format    = AV_PIX_FMT_CUDA;
-    frames_ctx->sw_format = AV_PIX_FMT_NV12;
-    frames_ctx->width     = ctx->decoder_ctx->width;
-    frames_ctx->height    = ctx->decoder_ctx->height;
+static void cost_entry_add(CostModelEntry *e, double mb, double ms) {
+    e->n = e->n * COST_MODEL_DECAY + 1;
+    e->sx = e->sx * COST_MODEL_DECAY + mb;
+    e->sy = e->sy * COST_MODEL_DECAY + ms;
+    e->sxx = e->sxx * COST_MODEL_DECAY + mb * mb;
+    e->sxy = e->sxy * COST_MODEL_DECAY + mb * ms;
+    e->samples++;
+}
 
-    ret = av_hwframe_ctx_init(hw_frames_ref);
-    if (ret < 0) {
-        fprintf(stderr, "[Worker %d] Failed to initialize hw_frames_ctx\n", ctx->worker_id);
-        av_buffer_unref(&hw_frames_ref);
-        return -1;
+// Fill in job->input_bytes (once) and job->predicted_ms. Called by the push
+// functions before they take the queue lock: it stats the inputs. A job no
+// model can predict yet is given the mean cost seen so far, so in sjf order
+// an unknown camera does not jump ahead of every known one with a cost of 0.
+void cost_model_estimate(CostModel *m, TranscodeJob *job) {
+    if (job->input_bytes == 0 || job->chunked) {
+        job->input_bytes = job_input_bytes(job);
     }
+    double mb = job->input_bytes / (1024.0 * 1024.0);
+    char key[320];
+    cost_model_key(job, key, sizeof(key));
+
+    pthread_mutex_lock(&m->mutex);
+    CostModelEntry *e = cost_model_find(m, key);
+    double predicted = e ? cost_entry_predict(e, mb) : -1;
+    if (predicted < 0) {
+        predicted = cost_entry_predict(&m->global, mb);
+    }
+    if (predicted < 0) {
+        predicted = cost_entry_mean(&m->global, mb);
+    }
+    pthread_mutex_unlock(&m->mutex);
 
-    AVBufferSrcParameters *par = av_buffersrc_parameters_alloc();
-    par->hw_frames_ctx = hw_frames_ref;
-    av_buffersrc_parameters_set(ctx->buffersrc_ctx, par);
-    av_free(par);
+    job->predicted_ms = predicted > 0 ? (int)(predicted + 0.5) : 0;
+}
 
-    // Create buffer sink (NVENC input)
-    ret = avfilter_graph_create_filter(&ctx->buffersink_ctx, buffersink, "out",
-                                       NULL, NULL, ctx->filter_graph);
-    if (ret < 0) {
-        fprintf(stderr, "[Worker %d] Failed to create buffer sink\n", ctx->worker_id);
-        return -1;
+// Learn from a job that ran to completion and score the prediction it was
+// queued with
+void cost_model_record(CostModel *m, const TranscodeJob *job, int actual_ms) {
+    double mb = job->input_bytes / (1024.0 * 1024.0);
+    char key[320];
+    cost_model_key(job, key, sizeof(key));
+
+    pthread_mutex_lock(&m->mutex);
+    CostModelEntry *e = cost_model_find(m, key);
+    if (!e && m->count < MAX_COST_MODEL_KEYS) {
+        e = &m->entries[m->count++];
+    } else if (!e) {
+        e = &m->entries[0];
+        for (int i = 1; i < m->count; i++) {
+            if (m->entries[i].last_used_ms < e->last_used_ms) {
+                e = &m->entries[i];
+            }
+        }
+    }
+    if (strcmp(e->key, key) != 0) {
+        memset(e, 0, sizeof(*e));
+        strncpy(e->key, key, sizeof(e->key) - 1);
+    }
+    e->last_used_ms = monotonic_ms();
+    cost_entry_add(e, mb, actual_ms);
+    cost_entry_add(&m->global, mb, actual_ms);
+
+    if (job->predicted_ms > 0) {
+        double ratio = (double)actual_ms / job->predicted_ms;
+        m->predictions++;
+        m->predicted_ms_total += job->predicted_ms;
+        m->actual_ms_total += actual_ms;
+        m->abs_error_ms_total += fabs((double)actual_ms - job->predicted_ms);
+        m->ratio_total += ratio;
+        for (int i = 0; i < COST_RATIO_BUCKETS; i++) {
+            if (ratio <= cost_ratio_bounds[i]) m->ratio_buckets[i]++;
+        }
+    } else {
+        m->unpredicted++;
     }
+    pthread_mutex_unlock(&m->mutex);
+}
 
-    // Configure outputs (from buffer source)
-    outputs->name = av_strdup("in");
-    outputs->filter_ctx = ctx->buffersrc_ctx;
-    outputs->pad_idx = 0;
-    outputs->next = NULL;
+// ============================================================================
+// Queue Management
+// ============================================================================
 
-    // Configure inputs (to buffer sink)
-    inputs->name = av_strdup("out");
-    inputs->filter_ctx = ctx->buffersink_ctx;
-    inputs->pad_idx = 0;
-    inputs->next = NULL;
+// Scheduling order: higher class first, earliest deadline within a class,
+// then arrival order
+static int entry_before(const QueueEntry *a, const QueueEntry *b) {
+    if (a->priority != b->priority) return a->priority > b->priority;
+    if (a->sort_deadline_ms != b->sort_deadline_ms) return a->sort_deadline_ms < b->sort_deadline_ms;
+    return a->seq < b->seq;
+}
 
-    // scale_cuda filter: resize 1920x1080 -> 1280:720 on GPU
-    const char *filter_descr = "scale_cuda=1280:720";
+static void heap_sift_up(QueueEntry *heap, int i) {
+    QueueEntry e = heap[i];
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!entry_before(&e, &heap[parent])) break;
+        heap[i] = heap[parent];
+        i = parent;
+    }
+    heap[i] = e;
+}
 
-    fprintf(stderr, "[Worker %d] Parsing filter graph: %s\n", ctx->worker_id, filter_descr);
-    ret = avfilter_graph_parse_ptr(ctx->filter_graph, filter_descr,
-                                   &inputs, &outputs, NULL);
-    if (ret < 0) {
-        fprintf(stderr, "[Worker %d] Failed to parse filter graph\n", ctx->worker_id);
-        return -1;
+static void heap_sift_down(QueueEntry *heap, int count, int i) {
+    QueueEntry e = heap[i];
+    while (1) {
+        int child = 2 * i + 1;
+        if (child >= count) break;
+        if (child + 1 < count && entry_before(&heap[child + 1], &heap[child])) child++;
+        if (!entry_before(&heap[child], &e)) break;
+        heap[i] = heap[child];
+        i = child;
     }
+    heap[i] = e;
+}
 
-    // Set hardware device context on filter graph
-    fprintf(stderr, "[Worker %d] Setting hw_device_ctx on %d filters\n", ctx->worker_id, ctx->filter_graph->nb_filters);
-    for (unsigned i = 0; i < ctx->filter_graph->nb_filters; i++) {
-        ctx->filter_graph->filters[i]->hw_device_ctx = av_buffer_ref(ctx->hw_device_ctx);
+static int queue_alloc(TaskQueue *q, int slots) {
+    q->jobs = calloc(slots, sizeof(TranscodeJob));
+    q->heap = calloc(slots, sizeof(QueueEntry));
+    q->free_slots = calloc(slots, sizeof(int));
+    if (!q->jobs || !q->heap || !q->free_slots) {
+        free(q->jobs);
+        free(q->heap);
+        free(q->free_slots);
+        return -1;
     }
+    q->slots = slots;
+    return 0;
+}
 
-    fprintf(stderr, "[Worker %d] Configuring filter graph...\n", ctx->worker_id);
-    ret = avfilter_graph_config(ctx->filter_graph, NULL);
-    if (ret < 0) {
-        fprintf(stderr, "[Worker %d] Failed to configure filter graph\n", ctx->worker_id);
+int queue_init(TaskQueue *q, int capacity) {
+    if (queue_alloc(q, capacity) < 0) {
         return -1;
     }
+    for (int i = 0; i < capacity; i++) {
+        q->free_slots[i] = capacity - 1 - i;
+    }
+    q->capacity = capacity;
+    q->count = 0;
+    memset(q->class_count, 0, sizeof(q->class_count));
+    q->seq = 0;
+    q->closed = 0;
+    q->popped = 0;
+    q->drain_rate = 0.0;
+    q->drain_popped = 0;
+    clock_gettime(CLOCK_MONOTONIC, &q->drain_sampled_at);
+    pthread_mutex_init(&q->mutex, NULL);
+    pthread_cond_init(&q->not_empty, NULL);
+    pthread_cond_init(&q->not_full, NULL);
+    return 0;
+}
+
+// Store a job and insert it into the heap (caller holds q->mutex and has
+// checked for space). The job arrives costed: nothing here touches the disk.
+static void queue_insert(TaskQueue *q, const TranscodeJob *job) {
+    int slot = q->free_slots[q->slots - q->count - 1];
+    TranscodeJob *stored = &q->jobs[slot];
+    *stored = *job;
+    if (stored->enqueued_ms == 0) {
+        stored->enqueued_ms = monotonic_ms();
+    }
 
-    avfilter_inout_free(&inputs);
-    avfilter_inout_free(&outputs);
+    QueueEntry *e = &q->heap[q->count];
+    e->priority = stored->priority;
+    e->seq = q->seq++;
+    e->slot = slot;
+    if (stored->deadline_ms > 0) {
+        e->sort_deadline_ms = stored->deadline_ms;
+    } else if (config.slo_ms[stored->priority] > 0) {
+        e->sort_deadline_ms = stored->enqueued_ms + config.slo_ms[stored->priority];
+    } else {
+        e->sort_deadline_ms = LLONG_MAX;
+    }
+    // Shortest expected job first, with aging: the key is arrival time plus
+    // the scaled predicted cost, so a short job overtakes a long one, but a
+    // long job is never overtaken by jobs arriving more than aging x its cost
+    // after it. Explicit deadlines still order by deadline.
+    if (sjf_order && stored->deadline_ms == 0) {
+        long long sjf_ms = stored->enqueued_ms + (long long)stored->predicted_ms * config.sjf_aging;
+        if (sjf_ms < e->sort_deadline_ms) e->sort_deadline_ms = sjf_ms;
+    }
 
-    fprintf(stderr, "[Worker %d] scale_cuda filter initialized (persistent, 1920x1080 -> 1280x720 on GPU)\n", ctx->worker_id);
-    return 0;
+    q->count++;
+    q->class_count[stored->priority]++;
+    heap_sift_up(q->heap, q->count - 1);
 }
 
-// ============================================================================
-// Persistent Pipeline Setup and Management
-// ============================================================================
+// Remove the head of the heap into *job (caller holds q->mutex, count > 0)
+static void queue_remove_head(TaskQueue *q, TranscodeJob *job) {
+    int slot = q->heap[0].slot;
+    *job = q->jobs[slot];
 
-// Initialize the persistent GPU pipeline once per worker
-// This avoids expensive per-file recreation of NVENC/NVDEC sessions
-int setup_persistent_pipeline(TranscodeContext *ctx) {
-    fprintf(stderr, "[Worker %d] Setting up persistent GPU pipeline...\n", ctx->worker_id);
+    q->count--;
+    q->class_count[job->priority]--;
+    q->free_slots[q->slots - q->count - 1] = slot;
+    if (q->count > 0) {
+        q->heap[0] = q->heap[q->count];
+        heap_sift_down(q->heap, q->count, 0);
+    }
+}
 
-    // Initialize decoder (NVDEC session - expensive to create)
-    if (init_decoder_persistent(ctx) < 0) {
-        fprintf(stderr, "[Worker %d] Failed to initialize persistent decoder\n", ctx->worker_id);
+void queue_push(TaskQueue *q, const TranscodeJob *job) {
+    TranscodeJob costed = *job;
+    cost_model_estimate(&cost_model, &costed);
+
+    pthread_mutex_lock(&q->mutex);
+
+    while (q->count >= q->capacity) {
+        pthread_cond_wait(&q->not_full, &q->mutex);
+    }
+
+    queue_insert(q, &costed);
+
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->mutex);
+}
+
+// Non-blocking push for the API: never parks an HTTP thread. Fails when
+// fewer than 'reserve' slots would remain free or the queue is closed.
+// Returns the new depth, or -1 if the job was not admitted.
+int queue_try_push(TaskQueue *q, const TranscodeJob *job, int reserve) {
+    TranscodeJob costed = *job;
+    cost_model_estimate(&cost_model, &costed);
+
+    pthread_mutex_lock(&q->mutex);
+
+    if (q->closed || q->count >= q->capacity - reserve) {
+        pthread_mutex_unlock(&q->mutex);
         return -1;
     }
 
-    // Initialize encoder (NVENC session - expensive to create)
-    if (init_encoder(ctx) < 0) {
-        fprintf(stderr, "[Worker %d] Failed to initialize persistent encoder\n", ctx->worker_id);
-        return -1;
+    queue_insert(q, &costed);
+    int depth = q->count;
+
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->mutex);
+    return depth;
+}
+
+// Blocks until a job is available. Returns 0 when the queue is closed and
+// empty, or when the pool retires or parks the calling worker's slot.
+// A job whose deadline already passed is either downgraded to archive work
+// and rescheduled, or handed out with job->expired set so the worker sheds
+// it (sends the "expired" callback instead of transcoding).
+int queue_pop(TaskQueue *q, TranscodeJob *job, const WorkerSlot *slot) {
+    pthread_mutex_lock(&q->mutex);
+
+    while (1) {
+        while (q->count == 0 && !q->closed && !(slot && (slot->retire || slot->parked))) {
+            pthread_cond_wait(&q->not_empty, &q->mutex);
+        }
+
+        if (q->count == 0 || (slot && (slot->retire || slot->parked))) {
+            pthread_mutex_unlock(&q->mutex);
+            return 0;
+        }
+
+        queue_remove_head(q, job);
+
+        if (job->deadline_ms > 0 && monotonic_ms() > job->deadline_ms) {
+            if (job->on_expire == EXPIRE_DOWNGRADE) {
+                // Same slot count as before the removal, so this cannot overflow
+                scheduler_note_downgrade(job->priority);
+                job->priority = PRIORITY_ARCHIVE;
+                job->deadline_ms = 0;
+                job->deadline_missed = 1;
+                queue_insert(q, job);
+                continue;
+            }
+            job->expired = 1;
+        }
+        break;
+    }
+
+    q->popped++;
+
+    pthread_cond_signal(&q->not_full);
+    pthread_mutex_unlock(&q->mutex);
+    return 1;
+}
+
+// Change the admission limit at runtime. Queued jobs are never dropped: when
+// shrinking below the current depth the storage keeps them and pushes block
+// until the queue drains under the new limit.
+int queue_resize(TaskQueue *q, int capacity) {
+    if (capacity < 1 || capacity > MAX_QUEUE_LIMIT) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&q->mutex);
+
+    int slots = capacity > q->count ? capacity : q->count;
+    if (slots != q->slots) {
+        TaskQueue resized;
+        if (queue_alloc(&resized, slots) < 0) {
+            pthread_mutex_unlock(&q->mutex);
+            return -1;
+        }
+        // Compact jobs into the first 'count' slots; heap order is unchanged
+        for (int i = 0; i < q->count; i++) {
+            resized.jobs[i] = q->jobs[q->heap[i].slot];
+            resized.heap[i] = q->heap[i];
+            resized.heap[i].slot = i;
+        }
+        for (int i = 0; i < slots - q->count; i++) {
+            resized.free_slots[i] = slots - 1 - i;
+        }
+        free(q->jobs);
+        free(q->heap);
+        free(q->free_slots);
+        q->jobs = resized.jobs;
+        q->heap = resized.heap;
+        q->free_slots = resized.free_slots;
+        q->slots = slots;
+    }
+    q->capacity = capacity;
+
+    pthread_cond_broadcast(&q->not_full);
+    pthread_mutex_unlock(&q->mutex);
+    return 0;
+}
+
+// Remove a queued job by ID (cancellation) and copy it to removed, for its
+// callback. Returns 0 if it was removed, -1 if it is no longer in the queue.
+int queue_cancel(TaskQueue *q, const char *job_id, TranscodeJob *removed) {
+    pthread_mutex_lock(&q->mutex);
+
+    for (int i = 0; i < q->count; i++) {
+        int slot = q->heap[i].slot;
+        // Helpers of a split input share its id but are not the job
+        if (q->jobs[slot].chunked || strcmp(q->jobs[slot].job_id, job_id) != 0) {
+            continue;
+        }
+
+        q->class_count[q->jobs[slot].priority]--;
+        free(q->jobs[slot].mosaic);
+        q->jobs[slot].mosaic = NULL;
+        *removed = q->jobs[slot];
+        q->count--;
+        q->free_slots[q->slots - q->count - 1] = slot;
+        if (i < q->count) {
+            q->heap[i] = q->heap[q->count];
+            heap_sift_down(q->heap, q->count, i);
+            heap_sift_up(q->heap, i);
+        }
+
+        pthread_cond_signal(&q->not_full);
+        pthread_mutex_unlock(&q->mutex);
+        return 0;
+    }
+
+    pthread_mutex_unlock(&q->mutex);
+    return -1;
+}
+
+// Measured rate at which workers take jobs off the queue (jobs/sec), sampled
+// lazily over windows of at least DRAIN_SAMPLE_MS. A window in which the
+// queue was empty says nothing about capacity and is skipped.
+double queue_drain_rate(TaskQueue *q) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    pthread_mutex_lock(&q->mutex);
+    long elapsed_ms = (now.tv_sec - q->drain_sampled_at.tv_sec) * 1000 +
+                      (now.tv_nsec - q->drain_sampled_at.tv_nsec) / 1000000;
+    if (elapsed_ms >= DRAIN_SAMPLE_MS) {
+        long drained = q->popped - q->drain_popped;
+        if (drained > 0 || q->count > 0) {
+            double sample = drained * 1000.0 / elapsed_ms;
+            q->drain_rate = q->drain_rate > 0 ? 0.7 * q->drain_rate + 0.3 * sample : sample;
+        }
+        q->drain_popped = q->popped;
+        q->drain_sampled_at = now;
+    }
+    double rate = q->drain_rate;
+    pthread_mutex_unlock(&q->mutex);
+
+    return rate;
+}
+
+// Stop accepting work: workers drain what is queued, then exit
+void queue_close(TaskQueue *q) {
+    pthread_mutex_lock(&q->mutex);
+    q->closed = 1;
+    pthread_cond_broadcast(&q->not_empty);
+    pthread_mutex_unlock(&q->mutex);
+}
+
+// ============================================================================
+// Job Index
+// ============================================================================
+
+static const char *job_state_names[JOB_NB_STATES] = {
+    "queued", "running", "done", "failed", "cancelled", "expired"
+};
+
+void coalescer_finish(Coalescer *c, const char *key, const char *job_id, const CoalescedResult *res);
+int send_completion_callback(const char *callback_url, const char *input_file,
+                             const char *output_file, int frame_count,
+                             int processing_time_ms, const char *metadata_json,
+                             const char *status, const cJSON *extra);
+
+// Inside a worker process the pipeline's record updates go to the job's
+// slot; the supervisor applies them to its index
+static WorkerJobId *worker_job_id(const char *id);
+static void worker_job_note(WorkerJobId *j, int state, const char *stage, const char *output, int frames);
+
+void job_index_init(JobIndex *ji) {
+    memset(ji->buckets, 0, sizeof(ji->buckets));
+    for (int i = 0; i < JOB_INDEX_STRIPES; i++) {
+        pthread_mutex_init(&ji->locks[i], NULL);
+    }
+    ji->counter = 0;
+    pthread_mutex_init(&ji->counter_mutex, NULL);
+}
+
+static unsigned int job_index_bucket(const char *id) {
+    unsigned int hash = 5381;
+    for (const char *c = id; *c; c++) hash = hash * 33 + (unsigned char)*c;
+    return hash % JOB_INDEX_BUCKETS;
+}
+
+// Caller holds the bucket's stripe lock
+static JobRecord *job_index_find(JobIndex *ji, const char *id, unsigned int bucket) {
+    JobRecord *r = ji->buckets[bucket];
+    while (r && strcmp(r->id, id) != 0) r = r->next;
+    return r;
+}
+
+// Lock the stripe of an ID and return its record (NULL if unknown, stripe
+// still locked). Pair with job_index_unlock().
+static JobRecord *job_index_lock(JobIndex *ji, const char *id) {
+    unsigned int bucket = job_index_bucket(id);
+    pthread_mutex_lock(&ji->locks[bucket % JOB_INDEX_STRIPES]);
+    return job_index_find(ji, id, bucket);
+}
+
+static void job_index_unlock(JobIndex *ji, const char *id) {
+    pthread_mutex_unlock(&ji->locks[job_index_bucket(id) % JOB_INDEX_STRIPES]);
+}
+
+// Assign the job an ID and register it as queued. IDs combine start time,
+// pid and a sequence so they stay unique across restarts.
+int job_index_create(JobIndex *ji, TranscodeJob *job) {
+    JobRecord *r = calloc(1, sizeof(JobRecord));
+    if (!r) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&ji->counter_mutex);
+    unsigned int seq = ji->counter++;
+    pthread_mutex_unlock(&ji->counter_mutex);
+
+    snprintf(r->id, sizeof(r->id), "%08lx%04x%06x",
+             (unsigned long)start_time, (unsigned int)getpid() & 0xffff, seq & 0xffffff);
+    strncpy(r->filename, job->filename, sizeof(r->filename) - 1);
+    memcpy(r->coalesce_key, job->coalesce_key, sizeof(r->coalesce_key));
+    r->priority = job->priority;
+    r->state = JOB_QUEUED;
+    r->worker_id = -1;
+    r->created_at = time(NULL);
+    r->created_ms = monotonic_ms();
+    memcpy(job->job_id, r->id, sizeof(job->job_id));
+
+    unsigned int bucket = job_index_bucket(r->id);
+    pthread_mutex_lock(&ji->locks[bucket % JOB_INDEX_STRIPES]);
+    r->next = ji->buckets[bucket];
+    ji->buckets[bucket] = r;
+    pthread_mutex_unlock(&ji->locks[bucket % JOB_INDEX_STRIPES]);
+    return 0;
+}
+
+// Forget a job that was never admitted
+void job_index_remove(JobIndex *ji, const char *id) {
+    unsigned int bucket = job_index_bucket(id);
+    pthread_mutex_lock(&ji->locks[bucket % JOB_INDEX_STRIPES]);
+    JobRecord **link = &ji->buckets[bucket];
+    while (*link && strcmp((*link)->id, id) != 0) link = &(*link)->next;
+    if (*link) {
+        JobRecord *r = *link;
+        *link = r->next;
+        free(r);
+    }
+    pthread_mutex_unlock(&ji->locks[bucket % JOB_INDEX_STRIPES]);
+}
+
+// Mark a job as picked up by a worker. Returns its cancellation flag (stable
+// while the job is not finished), or NULL for untracked jobs.
+volatile int *job_index_start(JobIndex *ji, const char *id, int worker_id) {
+    if (!id[0]) return NULL;
+    if (worker_process_job) {
+        WorkerJobId *j = worker_job_id(id);
+        if (!j) return NULL;
+        worker_job_note(j, JOB_RUNNING, "starting", NULL, 0);
+        return &j->cancel;
+    }
+
+    JobRecord *r = job_index_lock(ji, id);
+    volatile int *cancel = NULL;
+    if (r && r->state == JOB_QUEUED) {
+        r->state = JOB_RUNNING;
+        r->worker_id = worker_id;
+        if (!r->started_ms) r->started_ms = monotonic_ms();
+        strncpy(r->stage, "starting", sizeof(r->stage) - 1);
+        cancel = &r->cancel_requested;
+    }
+    job_index_unlock(ji, id);
+    return cancel;
+}
+
+void job_index_stage(JobIndex *ji, const char *id, const char *stage) {
+    if (!id[0]) return;
+    if (worker_process_job) {
+        WorkerJobId *j = worker_job_id(id);
+        if (j) worker_job_note(j, JOB_RUNNING, stage, NULL, 0);
+        return;
+    }
+
+    JobRecord *r = job_index_lock(ji, id);
+    if (r && r->state == JOB_RUNNING) {
+        strncpy(r->stage, stage, sizeof(r->stage) - 1);
+    }
+    job_index_unlock(ji, id);
+}
+
+// Remember the latest failure of a job
+void job_index_note_failure(JobIndex *ji, const char *id, const char *reason, int attempts) {
+    if (!id[0]) return;
+
+    JobRecord *r = job_index_lock(ji, id);
+    if (r) {
+        strncpy(r->error, reason, sizeof(r->error) - 1);
+        r->attempts = attempts;
+    }
+    job_index_unlock(ji, id);
+}
+
+// A running job goes back to queued while it waits for a retry
+void job_index_requeue(JobIndex *ji, const char *id) {
+    if (!id[0]) return;
+
+    JobRecord *r = job_index_lock(ji, id);
+    if (r && r->state == JOB_RUNNING) {
+        r->state = JOB_QUEUED;
+        strncpy(r->stage, "retry-wait", sizeof(r->stage) - 1);
+    }
+    job_index_unlock(ji, id);
+}
+
+// Outcome of a finished record, for the duplicates coalesced into it
+static void job_record_result(const JobRecord *r, CoalescedResult *res) {
+    res->state = r->state;
+    memcpy(res->output, r->output, sizeof(res->output));
+    res->frames = r->frames;
+    res->processing_ms = r->started_ms ? (int)(r->finished_ms - r->started_ms) : 0;
+    memcpy(res->error, r->error, sizeof(res->error));
+    res->verify = r->verify;
+    res->verified = r->verified;
+}
+
+// Move a job to a final state; already finished jobs are left untouched
+void job_index_finish(JobIndex *ji, const char *id, JobState state,
+                      const char *output, int frames) {
+    if (!id[0]) return;
+    if (worker_process_job) {
+        WorkerJobId *j = worker_job_id(id);
+        if (j) worker_job_note(j, state, "", output, frames);
+        return;
+    }
+
+    char key[COALESCE_KEY_SIZE] = "";
+    CoalescedResult result;
+    JobRecord *r = job_index_lock(ji, id);
+    if (r && (r->state == JOB_QUEUED || r->state == JOB_RUNNING)) {
+        r->state = state;
+        r->stage[0] = '\0';
+        r->frames = frames;
+        r->finished_at = time(NULL);
+        r->finished_ms = monotonic_ms();
+        if (output) strncpy(r->output, output, sizeof(r->output) - 1);
+        if (r->coalesce_key[0]) {
+            memcpy(key, r->coalesce_key, sizeof(key));
+            job_record_result(r, &result);
+        }
+    }
+    job_index_unlock(ji, id);
+
+    if (key[0]) {
+        coalescer_finish(&coalescer, key, id, &result);
+    }
+}
+
+int job_index_cancel_requested(JobIndex *ji, const char *id) {
+    if (!id[0]) return 0;
+    if (worker_process_job) {
+        WorkerJobId *j = worker_job_id(id);
+        return j && j->cancel;
+    }
+
+    JobRecord *r = job_index_lock(ji, id);
+    int cancelled = r && r->cancel_requested;
+    job_index_unlock(ji, id);
+    return cancelled;
+}
+
+// Cancel a job: queued jobs leave the queue immediately (and get their
+// "cancelled" callback here), running ones are flagged and aborted by their
+// worker between packets.
+// Returns the resulting state, or -1 if the job is unknown.
+int job_index_cancel(JobIndex *ji, const char *id) {
+    JobRecord *r = job_index_lock(ji, id);
+    if (!r) {
+        job_index_unlock(ji, id);
+        return -1;
+    }
+
+    char key[COALESCE_KEY_SIZE] = "";
+    CoalescedResult result;
+    TranscodeJob removed;
+    int dequeued = 0;
+    if (r->state == JOB_QUEUED || r->state == JOB_RUNNING) {
+        r->cancel_requested = 1;
+        // Grouped segments are not in the queue; their worker skips them
+        if (r->state == JOB_QUEUED && queue_cancel(&task_queue, id, &removed) == 0) {
+            dequeued = 1;
+            r->state = JOB_CANCELLED;
+            r->finished_at = time(NULL);
+            r->finished_ms = monotonic_ms();
+            if (r->coalesce_key[0]) {
+                memcpy(key, r->coalesce_key, sizeof(key));
+                job_record_result(r, &result);
+            }
+        }
+    }
+    int state = r->state;
+    job_index_unlock(ji, id);
+
+    if (dequeued) {
+        send_completion_callback(removed.callback_url, removed.filename, "",
+                                 0, 0, removed.metadata_json, "cancelled", NULL);
+    }
+    if (key[0]) {
+        coalescer_finish(&coalescer, key, id, &result);
+    }
+    return state;
+}
+
+// Attach what was muxed into a finished job's output to its record
+void job_index_set_verification(JobIndex *ji, const char *id, const OutputVerification *v) {
+    if (!id[0]) return;
+
+    JobRecord *r = job_index_lock(ji, id);
+    if (r) {
+        r->verify = *v;
+        r->verified = 1;
+    }
+    job_index_unlock(ji, id);
+}
+
+// Callback/status view of an output's verification data
+static cJSON *output_verification_json(const OutputVerification *v) {
+    cJSON *json = cJSON_CreateObject();
+    char checksum[16];
+
+    cJSON_AddNumberToObject(json, "frames", v->packets);
+    cJSON_AddNumberToObject(json, "keyframes", v->keyframes);
+    if (v->packets > 0) {
+        cJSON_AddNumberToObject(json, "firstPts", v->first_pts * av_q2d(v->time_base));
+        cJSON_AddNumberToObject(json, "lastPts", v->last_pts * av_q2d(v->time_base));
+    }
+    cJSON_AddNumberToObject(json, "payloadBytes", (double)v->payload_bytes);
+    snprintf(checksum, sizeof(checksum), "%08x", v->adler32);
+    cJSON_AddStringToObject(json, "payloadAdler32", checksum);
+    cJSON_AddNumberToObject(json, "fileBytes", (double)v->file_bytes);
+    cJSON_AddStringToObject(json, "tsCheck", v->ts_verdict >= 0 ? ts_verdict_names[v->ts_verdict] : "skipped");
+    return json;
+}
+
+static cJSON *job_record_json(const JobRecord *r) {
+    long long now = monotonic_ms();
+    cJSON *json = cJSON_CreateObject();
+
+    cJSON_AddStringToObject(json, "id", r->id);
+    cJSON_AddStringToObject(json, "state", job_state_names[r->state]);
+    if (r->state == JOB_RUNNING) {
+        cJSON_AddStringToObject(json, "stage", r->stage);
+        cJSON_AddNumberToObject(json, "workerId", r->worker_id);
+    } else if (r->state == JOB_QUEUED && r->stage[0]) {
+        cJSON_AddStringToObject(json, "stage", r->stage);
+    }
+    if (r->attempts > 0) {
+        cJSON_AddNumberToObject(json, "attempts", r->attempts);
+    }
+    if (r->error[0]) {
+        cJSON_AddStringToObject(json, "error", r->error);
+    }
+    if (r->cancel_requested) {
+        cJSON_AddBoolToObject(json, "cancelRequested", 1);
+    }
+    cJSON_AddStringToObject(json, "inputPath", r->filename);
+    cJSON_AddStringToObject(json, "priority", priority_names[r->priority]);
+    cJSON_AddNumberToObject(json, "createdAt", (double)r->created_at);
+
+    long long started = r->started_ms ? r->started_ms : (r->finished_ms ? r->finished_ms : now);
+    cJSON_AddNumberToObject(json, "queuedMs", (double)(started - r->created_ms));
+    if (r->started_ms) {
+        long long ended = r->finished_ms ? r->finished_ms : now;
+        cJSON_AddNumberToObject(json, "processingMs", (double)(ended - r->started_ms));
+    }
+    if (r->finished_ms) {
+        cJSON_AddNumberToObject(json, "finishedAt", (double)r->finished_at);
+    }
+    if (r->output[0]) {
+        cJSON_AddStringToObject(json, "outputFile", r->output);
+        cJSON_AddNumberToObject(json, "frameCount", r->frames);
+    }
+    if (r->verified) {
+        cJSON_AddItemToObject(json, "verification", output_verification_json(&r->verify));
+    }
+    return json;
+}
+
+// JSON for one job, NULL if unknown (caller frees)
+cJSON *job_index_get_json(JobIndex *ji, const char *id) {
+    JobRecord *r = job_index_lock(ji, id);
+    cJSON *json = r ? job_record_json(r) : NULL;
+    job_index_unlock(ji, id);
+    return json;
+}
+
+// JSON array of up to 'limit' jobs, optionally filtered by state (-1 = all)
+cJSON *job_index_list_json(JobIndex *ji, int state, int limit) {
+    cJSON *jobs = cJSON_CreateArray();
+    int n = 0;
+
+    for (int b = 0; b < JOB_INDEX_BUCKETS && n < limit; b++) {
+        pthread_mutex_lock(&ji->locks[b % JOB_INDEX_STRIPES]);
+        for (JobRecord *r = ji->buckets[b]; r && n < limit; r = r->next) {
+            if (state >= 0 && (int)r->state != state) continue;
+            cJSON_AddItemToArray(jobs, job_record_json(r));
+            n++;
+        }
+        pthread_mutex_unlock(&ji->locks[b % JOB_INDEX_STRIPES]);
+    }
+    return jobs;
+}
+
+// Jobs per state (for /metrics)
+void job_index_counts(JobIndex *ji, int counts[JOB_NB_STATES]) {
+    memset(counts, 0, sizeof(int) * JOB_NB_STATES);
+    for (int b = 0; b < JOB_INDEX_BUCKETS; b++) {
+        pthread_mutex_lock(&ji->locks[b % JOB_INDEX_STRIPES]);
+        for (JobRecord *r = ji->buckets[b]; r; r = r->next) {
+            counts[r->state]++;
+        }
+        pthread_mutex_unlock(&ji->locks[b % JOB_INDEX_STRIPES]);
+    }
+}
+
+// Drop finished jobs older than JOB_RETENTION_SECONDS
+int job_index_sweep(JobIndex *ji) {
+    time_t cutoff = time(NULL) - JOB_RETENTION_SECONDS;
+    int removed = 0;
+
+    for (int b = 0; b < JOB_INDEX_BUCKETS; b++) {
+        pthread_mutex_lock(&ji->locks[b % JOB_INDEX_STRIPES]);
+        JobRecord **link = &ji->buckets[b];
+        while (*link) {
+            JobRecord *r = *link;
+            if (r->state >= JOB_DONE && r->finished_at < cutoff) {
+                *link = r->next;
+                free(r);
+                removed++;
+            } else {
+                link = &r->next;
+            }
+        }
+        pthread_mutex_unlock(&ji->locks[b % JOB_INDEX_STRIPES]);
+    }
+    return removed;
+}
+
+// ============================================================================
+// Request Coalescing
+// ============================================================================
+
+// Bridges retry and RabbitMQ redelivers, so one input is often enqueued two
+// or three times. A duplicate of a queued or running job attaches its
+// callback to that job instead of transcoding (and overwriting) the same
+// output again; a duplicate of a job completed within cacheSeconds gets that
+// job's completion right away.
+
+void coalescer_init(Coalescer *c, int cache_seconds) {
+    memset(c->buckets, 0, sizeof(c->buckets));
+    c->nb_entries = 0;
+    c->nb_cached = 0;
+    c->cache_seconds = cache_seconds;
+    c->attached = 0;
+    c->cached = 0;
+    c->overflow = 0;
+    c->notified = 0;
+    pthread_mutex_init(&c->mutex, NULL);
+}
+
+static void sha256_hex(struct AVSHA *sha, char hex[COALESCE_KEY_SIZE]) {
+    uint8_t digest[32];
+    av_sha_final(sha, digest);
+    for (int i = 0; i < 32; i++) {
+        snprintf(hex + 2 * i, 3, "%02x", digest[i]);
+    }
+}
+
+// SHA-256 of a file's size and its first and last COALESCE_HASH_SAMPLE bytes
+// (all of it when smaller). Keys are computed on the submitting thread, so
+// the read stays bounded however long the recording is; a copy of a segment
+// still matches since its timestamps and payload differ from any other
+// recording's at both ends. Returns -1 if the file cannot be read.
+static int sha256_file(const char *path, char hex[COALESCE_KEY_SIZE]) {
+    FILE *f = fopen(path, "rb");
+    struct AVSHA *sha = av_sha_alloc();
+    uint8_t *buf = malloc(COALESCE_HASH_SAMPLE);
+    struct stat st;
+    int ret = -1;
+
+    if (f && sha && buf && fstat(fileno(f), &st) == 0 && av_sha_init(sha, 256) == 0) {
+        char size[32];
+        int len = snprintf(size, sizeof(size), "%lld\n", (long long)st.st_size);
+        av_sha_update(sha, (const uint8_t *)size, len);
+
+        size_t n = fread(buf, 1, COALESCE_HASH_SAMPLE, f);
+        av_sha_update(sha, buf, n);
+        if (st.st_size > 2 * COALESCE_HASH_SAMPLE) {
+            fseeko(f, -(off_t)COALESCE_HASH_SAMPLE, SEEK_END);
+        }
+        while ((n = fread(buf, 1, COALESCE_HASH_SAMPLE, f)) > 0) {
+            av_sha_update(sha, buf, n);
+        }
+        if (!ferror(f)) {
+            sha256_hex(sha, hex);
+            ret = 0;
+        }
+    }
+    if (f) fclose(f);
+    free(buf);
+    av_free(sha);
+    return ret;
+}
+
+// Fill job->coalesce_key: SHA-256 over the input's identity and every job
+// field that changes the output, so only requests that would write the same
+// file are merged. In "path" mode the identity is the canonical path with the
+// file's size and mtime (a rewritten recording is a new input); "content"
+// hashes the file (see sha256_file). Both look at the file the worker will
+// open, under inputDir. Mosaic jobs are never coalesced.
+static void coalesce_job_key(TranscodeJob *job) {
+    CoalesceMode mode = job->coalesce != COALESCE_DEFAULT ? job->coalesce : coalesce_default;
+    job->coalesce_key[0] = '\0';
+    if (mode == COALESCE_OFF || job->mosaic) {
+        return;
+    }
+
+    char path[1024];
+    char input[PATH_MAX + 64];
+    snprintf(path, sizeof(path), "%s/%s", config.input_dir, job->filename);
+    if (mode == COALESCE_CONTENT) {
+        if (sha256_file(path, input) < 0) {
+            fprintf(stderr, "[Coalesce] Cannot hash %s, not coalescing it\n", path);
+            return;
+        }
+    } else {
+        char canonical[PATH_MAX];
+        struct stat st = {0};
+        if (!realpath(path, canonical)) {
+            snprintf(canonical, sizeof(canonical), "%s", path);
+        }
+        stat(canonical, &st);
+        snprintf(input, sizeof(input), "%s\n%lld %lld.%09ld", canonical, (long long)st.st_size,
+                 (long long)st.st_mtim.tv_sec, st.st_mtim.tv_nsec);
+    }
+
+    char identity[PATH_MAX + 256];
+    int len = snprintf(identity, sizeof(identity), "%s\n%s\n%d %d %d %d %d %d %d",
+                       coalesce_mode_names[mode], input, job->codec_profile, job->output_format,
+                       job->timelapse.fps, job->timelapse.keyframes_only, job->timelapse.width,
+                       job->timelapse.height, job->timelapse.bitrate);
+    if (len >= (int)sizeof(identity)) len = sizeof(identity) - 1;
+
+    struct AVSHA *sha = av_sha_alloc();
+    if (sha && av_sha_init(sha, 256) == 0) {
+        av_sha_update(sha, (const uint8_t *)identity, len);
+        sha256_hex(sha, job->coalesce_key);
+    }
+    av_free(sha);
+}
+
+static unsigned int coalescer_bucket(const char *key) {
+    unsigned int hash = 5381;
+    for (const char *c = key; *c; c++) hash = hash * 33 + (unsigned char)*c;
+    return hash % COALESCE_BUCKETS;
+}
+
+// Entry of a key (caller holds c->mutex). A cached result older than
+// cacheSeconds is dropped here rather than returned.
+static CoalesceEntry *coalescer_lookup(Coalescer *c, const char *key) {
+    CoalesceEntry **link = &c->buckets[coalescer_bucket(key)];
+    while (*link && strcmp((*link)->key, key) != 0) link = &(*link)->next;
+
+    CoalesceEntry *e = *link;
+    if (e && e->finished && time(NULL) - e->finished_at >= c->cache_seconds) {
+        *link = e->next;
+        free(e);
+        c->nb_entries--;
+        c->nb_cached--;
+        return NULL;
+    }
+    return e;
+}
+
+// Attach a duplicate to the queued or running job of its key (caller holds
+// c->mutex). Returns -1 if it has to run separately.
+static int coalescer_attach(Coalescer *c, CoalesceEntry *e, const TranscodeJob *job) {
+    if (e->nb_waiters >= COALESCE_MAX_WAITERS) {
+        c->overflow++;
+        return -1;
+    }
+    if (job->callback_url[0]) {
+        CoalesceWaiter *w = calloc(1, sizeof(CoalesceWaiter));
+        if (!w) {
+            return -1;
+        }
+        strncpy(w->filename, job->filename, sizeof(w->filename) - 1);
+        strncpy(w->callback_url, job->callback_url, sizeof(w->callback_url) - 1);
+        strncpy(w->metadata_json, job->metadata_json, sizeof(w->metadata_json) - 1);
+
+        CoalesceWaiter **tail = &e->waiters;
+        while (*tail) tail = &(*tail)->next;
+        *tail = w;
+    }
+    e->nb_waiters++;
+    c->attached++;
+    return 0;
+}
+
+// Make a newly submitted job the owner of its key (caller holds c->mutex).
+// Without memory its duplicates simply run separately.
+static void coalescer_add(Coalescer *c, const TranscodeJob *job) {
+    CoalesceEntry *e = calloc(1, sizeof(CoalesceEntry));
+    if (!e) {
+        return;
+    }
+    memcpy(e->key, job->coalesce_key, sizeof(e->key));
+    memcpy(e->job_id, job->job_id, sizeof(e->job_id));
+
+    unsigned int bucket = coalescer_bucket(e->key);
+    e->next = c->buckets[bucket];
+    c->buckets[bucket] = e;
+    c->nb_entries++;
+}
+
+// Replay a coalesced job's outcome to one duplicate's callback, with the
+// job it was merged into
+static void coalesce_notify(const char *callback_url, const char *filename,
+                            const char *metadata_json, const char *job_id,
+                            const CoalescedResult *res, int cached) {
+    if (!callback_url[0]) {
+        return;
+    }
+
+    cJSON *extra = cJSON_CreateObject();
+    cJSON_AddStringToObject(extra, "coalescedWith", job_id);
+    if (cached) {
+        cJSON_AddBoolToObject(extra, "cached", 1);
+    }
+    if (res->state != JOB_DONE && res->error[0]) {
+        cJSON_AddStringToObject(extra, "reason", res->error);
+    }
+    if (res->verified) {
+        cJSON_AddItemToObject(extra, "verification", output_verification_json(&res->verify));
+    }
+    send_completion_callback(callback_url, filename, res->output, res->frames, res->processing_ms,
+                             metadata_json, res->state == JOB_DONE ? "completed" : job_state_names[res->state],
+                             extra);
+    cJSON_Delete(extra);
+
+    pthread_mutex_lock(&coalescer.mutex);
+    coalescer.notified++;
+    pthread_mutex_unlock(&coalescer.mutex);
+}
+
+// The job owning a key reached a final state: hand its outcome to the
+// duplicates attached to it and keep a completed result for later ones.
+// Failed, cancelled and expired jobs are forgotten so a resubmission runs.
+void coalescer_finish(Coalescer *c, const char *key, const char *job_id, const CoalescedResult *res) {
+    pthread_mutex_lock(&c->mutex);
+    CoalesceEntry **link = &c->buckets[coalescer_bucket(key)];
+    while (*link && strcmp((*link)->key, key) != 0) link = &(*link)->next;
+
+    CoalesceEntry *e = *link;
+    if (!e || e->finished || strcmp(e->job_id, job_id) != 0) {
+        pthread_mutex_unlock(&c->mutex);
+        return;  // An overflow duplicate that ran on its own
+    }
+
+    CoalesceWaiter *waiters = e->waiters;
+    e->waiters = NULL;
+    e->nb_waiters = 0;
+    if (res->state == JOB_DONE && c->cache_seconds > 0) {
+        e->finished = 1;
+        e->result = *res;
+        e->finished_at = time(NULL);
+        c->nb_cached++;
+    } else {
+        *link = e->next;
+        free(e);
+        c->nb_entries--;
+    }
+    pthread_mutex_unlock(&c->mutex);
+
+    while (waiters) {
+        CoalesceWaiter *w = waiters;
+        waiters = w->next;
+        coalesce_notify(w->callback_url, w->filename, w->metadata_json, job_id, res, 0);
+        free(w);
+    }
+}
+
+// Drop cached results older than cacheSeconds
+int coalescer_sweep(Coalescer *c) {
+    time_t now = time(NULL);
+    int removed = 0;
+
+    pthread_mutex_lock(&c->mutex);
+    for (int b = 0; b < COALESCE_BUCKETS; b++) {
+        CoalesceEntry **link = &c->buckets[b];
+        while (*link) {
+            CoalesceEntry *e = *link;
+            if (e->finished && now - e->finished_at >= c->cache_seconds) {
+                *link = e->next;
+                free(e);
+                c->nb_entries--;
+                c->nb_cached--;
+                removed++;
+            } else {
+                link = &e->next;
+            }
+        }
+    }
+    pthread_mutex_unlock(&c->mutex);
+    return removed;
+}
+
+// ============================================================================
+// Retry Scheduling & Quarantine
+// ============================================================================
+
+#define RETRY_WHEEL_SLOTS (1 << RETRY_WHEEL_BITS)
+#define RETRY_WHEEL_MASK (RETRY_WHEEL_SLOTS - 1)
+
+void retry_wheel_init(RetryWheel *w) {
+    memset(w, 0, sizeof(*w));
+    w->started_ms = monotonic_ms();
+    pthread_mutex_init(&w->mutex, NULL);
+}
+
+// Place an entry by the highest tick digit in which its due tick differs from
+// the current tick (caller holds w->mutex)
+static void retry_wheel_place(RetryWheel *w, RetryEntry *e) {
+    int level = 0;
+    while (level < RETRY_WHEEL_LEVELS - 1 &&
+           (e->due_tick >> (RETRY_WHEEL_BITS * (level + 1))) !=
+           (w->tick >> (RETRY_WHEEL_BITS * (level + 1)))) {
+        level++;
+    }
+    int slot = (e->due_tick >> (RETRY_WHEEL_BITS * level)) & RETRY_WHEEL_MASK;
+    e->next = w->slots[level][slot];
+    w->slots[level][slot] = e;
+}
+
+// Exponential backoff with equal jitter: half fixed, half random, so a burst
+// of failures (e.g. an NFS outage) does not come back as a burst
+static int retry_backoff_ms(int attempt) {
+    long long delay = config.retry_base_ms;
+    for (int i = 1; i < attempt && delay < config.retry_max_ms; i++) delay *= 2;
+    if (delay > config.retry_max_ms) delay = config.retry_max_ms;
+    return (int)(delay / 2 + random() % (delay / 2 + 1));
+}
+
+// Park a copy of the job in the wheel. Never blocks on the task queue.
+// Returns the delay in ms, or -1 if retries are shut down or out of memory.
+int retry_schedule(RetryWheel *w, const TranscodeJob *job, int delay_ms) {
+    RetryEntry *e = malloc(sizeof(RetryEntry));
+    if (!e) {
+        return -1;
+    }
+    e->job = *job;
+
+    pthread_mutex_lock(&w->mutex);
+    if (w->stopped) {
+        pthread_mutex_unlock(&w->mutex);
+        free(e);
+        return -1;
+    }
+
+    long long horizon = (1LL << (RETRY_WHEEL_BITS * RETRY_WHEEL_LEVELS)) - 1;
+    long long ticks = (delay_ms + RETRY_WHEEL_TICK_MS - 1) / RETRY_WHEEL_TICK_MS;
+    if (ticks < 1) ticks = 1;
+    if (ticks > horizon) ticks = horizon;
+    e->due_tick = w->tick + ticks;
+    retry_wheel_place(w, e);
+    w->pending++;
+    pthread_mutex_unlock(&w->mutex);
+
+    return delay_ms;
+}
+
+// Advance one tick: cascade higher levels whose slot came due, then detach
+// the level-0 slot of this tick (caller holds w->mutex)
+static RetryEntry *retry_wheel_advance(RetryWheel *w) {
+    w->tick++;
+
+    for (int level = 1; level < RETRY_WHEEL_LEVELS; level++) {
+        if ((w->tick & ((1LL << (RETRY_WHEEL_BITS * level)) - 1)) != 0) {
+            break;
+        }
+        int slot = (w->tick >> (RETRY_WHEEL_BITS * level)) & RETRY_WHEEL_MASK;
+        RetryEntry *e = w->slots[level][slot];
+        w->slots[level][slot] = NULL;
+        while (e) {
+            RetryEntry *next = e->next;
+            retry_wheel_place(w, e);
+            e = next;
+        }
+    }
+
+    int slot = w->tick & RETRY_WHEEL_MASK;
+    RetryEntry *due = w->slots[0][slot];
+    w->slots[0][slot] = NULL;
+    return due;
+}
+
+// Hand due jobs back to the scheduler. A full queue re-arms the entry
+// instead of blocking; a job cancelled while waiting is dropped.
+// A job cancelled while it waited for its retry is finished here instead of
+// being queued again. Returns 1 if it was.
+static int retry_entry_cancelled(RetryEntry *e) {
+    if (!job_index_cancel_requested(&job_index, e->job.job_id)) {
+        return 0;
+    }
+    job_index_finish(&job_index, e->job.job_id, JOB_CANCELLED, NULL, 0);
+    send_completion_callback(e->job.callback_url, e->job.filename, "",
+                             0, 0, e->job.metadata_json, "cancelled", NULL);
+    free(e->job.group);
+    free(e->job.mosaic);
+    return 1;
+}
+
+static void retry_wheel_release(RetryWheel *w, RetryEntry *due) {
+    while (due) {
+        RetryEntry *e = due;
+        due = e->next;
+
+        if (!retry_entry_cancelled(e)) {
+            if (queue_try_push(&task_queue, &e->job, 0) < 0) {
+                pthread_mutex_lock(&w->mutex);
+                e->due_tick = w->tick + RETRY_QUEUE_FULL_DELAY_MS / RETRY_WHEEL_TICK_MS;
+                retry_wheel_place(w, e);
+                w->requeue_deferred++;
+                pthread_mutex_unlock(&w->mutex);
+                continue;
+            }
+            fprintf(stderr, "[Retry] Re-enqueued %s (attempt %d)\n",
+                    e->job.filename, e->job.attempts + 1);
+        }
+
+        pthread_mutex_lock(&w->mutex);
+        w->pending--;
+        pthread_mutex_unlock(&w->mutex);
+        free(e);
+    }
+}
+
+void *retry_wheel_thread(void *arg) {
+    RetryWheel *w = arg;
+
+    while (1) {
+        usleep(RETRY_WHEEL_TICK_MS * 1000);
+
+        pthread_mutex_lock(&w->mutex);
+        if (w->stopped) {
+            pthread_mutex_unlock(&w->mutex);
+            break;
+        }
+
+        // Catch up on ticks missed while the thread was descheduled
+        long long target = (monotonic_ms() - w->started_ms) / RETRY_WHEEL_TICK_MS;
+        RetryEntry *due = NULL;
+        while (w->tick < target) {
+            RetryEntry *e = retry_wheel_advance(w);
+            while (e) {
+                RetryEntry *next = e->next;
+                e->next = due;
+                due = e;
+                e = next;
+            }
+        }
+        pthread_mutex_unlock(&w->mutex);
+
+        retry_wheel_release(w, due);
+    }
+    return NULL;
+}
+
+int retry_wheel_start(RetryWheel *w) {
+    if (pthread_create(&w->thread, NULL, retry_wheel_thread, w) != 0) {
+        fprintf(stderr, "[Retry] Failed to start retry timer\n");
+        return -1;
+    }
+    w->started = 1;
+    return 0;
+}
+
+// Shutdown: stop accepting retries and hand every pending job to the queue
+// right away (before queue_close) so the drain still gets to attempt them
+void retry_wheel_stop(RetryWheel *w) {
+    pthread_mutex_lock(&w->mutex);
+    w->stopped = 1;
+    pthread_mutex_unlock(&w->mutex);
+
+    if (w->started) {
+        pthread_join(w->thread, NULL);
+        w->started = 0;
+    }
+
+    int flushed = 0;
+    for (int level = 0; level < RETRY_WHEEL_LEVELS; level++) {
+        for (int slot = 0; slot < RETRY_WHEEL_SLOTS; slot++) {
+            RetryEntry *e = w->slots[level][slot];
+            w->slots[level][slot] = NULL;
+            while (e) {
+                RetryEntry *next = e->next;
+                if (!retry_entry_cancelled(e)) {
+                    queue_push(&task_queue, &e->job);
+                    flushed++;
+                }
+                free(e);
+                e = next;
+            }
+        }
+    }
+    w->pending = 0;
+
+    if (flushed > 0) {
+        fprintf(stderr, "[Retry] Flushed %d pending retries into the queue\n", flushed);
+    }
+}
+
+int retry_wheel_pending(RetryWheel *w) {
+    pthread_mutex_lock(&w->mutex);
+    int pending = w->pending;
+    pthread_mutex_unlock(&w->mutex);
+    return pending;
+}
+
+// Store an entry in the in-memory ring (caller holds ql->mutex)
+static void quarantine_store(QuarantineList *ql, const char *filename, const char *reason,
+                             int attempts, time_t at) {
+    int idx = ql->count % MAX_QUARANTINE;
+    strncpy(ql->entries[idx].filename, filename, sizeof(ql->entries[idx].filename) - 1);
+    ql->entries[idx].filename[sizeof(ql->entries[idx].filename) - 1] = '\0';
+    strncpy(ql->entries[idx].reason, reason, sizeof(ql->entries[idx].reason) - 1);
+    ql->entries[idx].reason[sizeof(ql->entries[idx].reason) - 1] = '\0';
+    ql->entries[idx].attempts = attempts;
+    ql->entries[idx].at = at;
+    ql->count++;
+}
+
+// Entries older than quarantineTtlHours no longer block their input
+static int quarantine_expired(time_t at, time_t now) {
+    return config.quarantine_ttl_hours > 0 && now - at >= (time_t)config.quarantine_ttl_hours * 3600;
+}
+
+// Rewrite <output_dir>/quarantine.jsonl from the in-memory list, oldest first,
+// dropping expired entries (caller holds ql->mutex)
+static int quarantine_save(QuarantineList *ql) {
+    char path[600];
+    char tmp_path[620];
+    time_t now = time(NULL);
+    snprintf(path, sizeof(path), "%s/quarantine.jsonl", config.output_dir);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    FILE *f = fopen(tmp_path, "w");
+    if (!f) {
+        fprintf(stderr, "[Quarantine] Failed to write %s: %s\n", tmp_path, strerror(errno));
+        return -1;
+    }
+    long items = ql->count < MAX_QUARANTINE ? ql->count : MAX_QUARANTINE;
+    for (long i = items - 1; i >= 0; i--) {
+        int idx = (ql->count - 1 - i) % MAX_QUARANTINE;
+        if (quarantine_expired(ql->entries[idx].at, now)) continue;
+
+        cJSON *entry = cJSON_CreateObject();
+        cJSON_AddStringToObject(entry, "inputFile", ql->entries[idx].filename);
+        cJSON_AddStringToObject(entry, "reason", ql->entries[idx].reason);
+        cJSON_AddNumberToObject(entry, "attempts", ql->entries[idx].attempts);
+        cJSON_AddNumberToObject(entry, "timestamp", (double)ql->entries[idx].at);
+        char *line = cJSON_PrintUnformatted(entry);
+        if (line) fprintf(f, "%s\n", line);
+        free(line);
+        cJSON_Delete(entry);
+    }
+    if (fclose(f) != 0 || rename(tmp_path, path) < 0) {
+        fprintf(stderr, "[Quarantine] Failed to replace %s\n", path);
+        unlink(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+// Reload <output_dir>/quarantine.jsonl so a restart does not retry bad inputs.
+// Expired entries are dropped and the file compacted.
+void quarantine_init(QuarantineList *ql) {
+    memset(ql, 0, sizeof(*ql));
+    pthread_mutex_init(&ql->mutex, NULL);
+
+    char path[600];
+    snprintf(path, sizeof(path), "%s/quarantine.jsonl", config.output_dir);
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return;
+    }
+
+    char line[1024];
+    long dropped = 0;
+    time_t now = time(NULL);
+    while (fgets(line, sizeof(line), f)) {
+        cJSON *entry = cJSON_Parse(line);
+        if (!entry) continue;
+        const cJSON *file = cJSON_GetObjectItem(entry, "inputFile");
+        const cJSON *reason = cJSON_GetObjectItem(entry, "reason");
+        const cJSON *attempts = cJSON_GetObjectItem(entry, "attempts");
+        const cJSON *at = cJSON_GetObjectItem(entry, "timestamp");
+        time_t entry_at = cJSON_IsNumber(at) ? (time_t)at->valuedouble : 0;
+        if (cJSON_IsString(file) && !quarantine_expired(entry_at, now)) {
+            quarantine_store(ql, file->valuestring,
+                             cJSON_IsString(reason) ? reason->valuestring : "",
+                             cJSON_IsNumber(attempts) ? attempts->valueint : 0,
+                             entry_at);
+        } else {
+            dropped++;
+        }
+        cJSON_Delete(entry);
+    }
+    fclose(f);
+
+    if (dropped > 0 || ql->count > MAX_QUARANTINE) {
+        quarantine_save(ql);
+    }
+    if (ql->count > 0 || dropped > 0) {
+        fprintf(stderr, "[Quarantine] Loaded %ld entries from %s (%ld expired)\n",
+                ql->count, path, dropped);
+    }
+}
+
+// Record a permanently failed input. Entries are also appended to
+// <output_dir>/quarantine.jsonl so the list survives restarts.
+void quarantine_add(QuarantineList *ql, const char *filename, const char *reason, int attempts) {
+    time_t now = time(NULL);
+
+    pthread_mutex_lock(&ql->mutex);
+    quarantine_store(ql, filename, reason, attempts, now);
+    ql->added_total++;
+
+    cJSON *entry = cJSON_CreateObject();
+    cJSON_AddStringToObject(entry, "inputFile", filename);
+    cJSON_AddStringToObject(entry, "reason", reason);
+    cJSON_AddNumberToObject(entry, "attempts", attempts);
+    cJSON_AddNumberToObject(entry, "timestamp", (double)now);
+    char *line = cJSON_PrintUnformatted(entry);
+
+    char path[600];
+    snprintf(path, sizeof(path), "%s/quarantine.jsonl", config.output_dir);
+    FILE *f = fopen(path, "a");
+    if (f && line) {
+        fprintf(f, "%s\n", line);
+    }
+    if (f) fclose(f);
+    free(line);
+    cJSON_Delete(entry);
+    pthread_mutex_unlock(&ql->mutex);
+
+    fprintf(stderr, "[Quarantine] %s: %s\n", filename, reason);
+}
+
+int is_file_quarantined(QuarantineList *ql, const char *filename) {
+    time_t now = time(NULL);
+    pthread_mutex_lock(&ql->mutex);
+    long items = ql->count < MAX_QUARANTINE ? ql->count : MAX_QUARANTINE;
+    for (long i = 0; i < items; i++) {
+        if (strcmp(ql->entries[i].filename, filename) == 0 &&
+            !quarantine_expired(ql->entries[i].at, now)) {
+            pthread_mutex_unlock(&ql->mutex);
+            return 1;
+        }
+    }
+    pthread_mutex_unlock(&ql->mutex);
+    return 0;
+}
+
+// Release an input from quarantine so the scanner and producers may submit it
+// again. Returns the number of entries removed.
+int quarantine_remove(QuarantineList *ql, const char *filename) {
+    pthread_mutex_lock(&ql->mutex);
+    long items = ql->count < MAX_QUARANTINE ? ql->count : MAX_QUARANTINE;
+    long kept = 0;
+    int removed = 0;
+
+    // Compact oldest first into a fresh ring starting at slot 0
+    QuarantineEntry *live = malloc(sizeof(QuarantineEntry) * (items ? items : 1));
+    if (!live) {
+        pthread_mutex_unlock(&ql->mutex);
+        return 0;
+    }
+    for (long i = items - 1; i >= 0; i--) {
+        int idx = (ql->count - 1 - i) % MAX_QUARANTINE;
+        if (strcmp(ql->entries[idx].filename, filename) == 0) {
+            removed++;
+        } else {
+            live[kept++] = ql->entries[idx];
+        }
+    }
+    if (removed > 0) {
+        memcpy(ql->entries, live, sizeof(ql->entries[0]) * kept);
+        ql->count = kept;
+        quarantine_save(ql);
+    }
+    free(live);
+    pthread_mutex_unlock(&ql->mutex);
+
+    if (removed > 0) {
+        fprintf(stderr, "[Quarantine] Released %s\n", filename);
+    }
+    return removed;
+}
+
+// Newest-first JSON array of quarantined inputs
+cJSON *quarantine_json(QuarantineList *ql, int limit) {
+    cJSON *list = cJSON_CreateArray();
+
+    pthread_mutex_lock(&ql->mutex);
+    time_t now = time(NULL);
+    long items = ql->count < MAX_QUARANTINE ? ql->count : MAX_QUARANTINE;
+    for (long i = 0, listed = 0; i < items && listed < limit; i++) {
+        int idx = (ql->count - 1 - i) % MAX_QUARANTINE;
+        if (quarantine_expired(ql->entries[idx].at, now)) continue;
+        listed++;
+        cJSON *item = cJSON_CreateObject();
+        cJSON_AddStringToObject(item, "inputFile", ql->entries[idx].filename);
+        cJSON_AddStringToObject(item, "reason", ql->entries[idx].reason);
+        cJSON_AddNumberToObject(item, "attempts", ql->entries[idx].attempts);
+        cJSON_AddNumberToObject(item, "timestamp", (double)ql->entries[idx].at);
+        cJSON_AddItemToArray(list, item);
+    }
+    pthread_mutex_unlock(&ql->mutex);
+
+    return list;
+}
+
+// ============================================================================
+// Input Integrity Check (MPEG-TS structure, before dispatch)
+// ============================================================================
+
+// A truncated or corrupt segment otherwise fails deep inside process_file,
+// after holding a worker's decoder and encoder and leaving a partial output.
+// The check reads the mapped file once at packet granularity: sync bytes at
+// a 188-byte stride, per-PID continuity counters, PAT -> PMT -> video PID,
+// and the PTS of every video PES header. No payload is decoded.
+
+static int is_video_stream_type(int stream_type) {
+    return stream_type == 0x01 || stream_type == 0x02 ||   // MPEG-1/2
+           stream_type == 0x10 || stream_type == 0x1B ||   // MPEG-4 part 2, H.264
+           stream_type == 0x24;                            // HEVC
+}
+
+// Offset of the first packet start: a sync byte followed by two more at the
+// packet stride (or by the end of the buffer). memchr does the byte search.
+static size_t ts_find_sync(const uint8_t *buf, size_t size, size_t from) {
+    while (from < size) {
+        const uint8_t *hit = memchr(buf + from, TS_SYNC_BYTE, size - from);
+        if (!hit) return size;
+        size_t at = hit - buf;
+        if ((at + TS_PACKET_SIZE >= size || buf[at + TS_PACKET_SIZE] == TS_SYNC_BYTE) &&
+            (at + 2 * TS_PACKET_SIZE >= size || buf[at + 2 * TS_PACKET_SIZE] == TS_SYNC_BYTE)) {
+            return at;
+        }
+        from = at + 1;
+    }
+    return size;
+}
+
+// PTS from a PES optional header field; -1 if the marker bits are wrong
+static int64_t ts_parse_pts(const uint8_t *p) {
+    if ((p[0] & 0x01) != 1 || (p[2] & 0x01) != 1 || (p[4] & 0x01) != 1) return -1;
+    return ((int64_t)(p[0] & 0x0E) << 29) | ((int64_t)p[1] << 22) | ((int64_t)(p[2] & 0xFE) << 14) |
+           ((int64_t)p[3] << 7) | (p[4] >> 1);
+}
+
+// Start of the section a PSI packet's pointer field points at, or NULL
+static const uint8_t *ts_psi_section(const uint8_t *payload, const uint8_t *end, int *section_length) {
+    if (payload >= end) return NULL;
+    const uint8_t *section = payload + 1 + payload[0];
+    if (section + 3 > end) return NULL;
+    *section_length = ((section[1] & 0x0F) << 8) | section[2];
+    return section;
+}
+
+static void ts_check_packets(const uint8_t *buf, size_t size, TsCheck *r) {
+    uint8_t last_cc[8192];
+    uint8_t is_pmt[8192];
+    memset(last_cc, 0xFF, sizeof(last_cc));
+    memset(is_pmt, 0, sizeof(is_pmt));
+    int have_pat = 0, have_pmt = 0;
+    int pts_reset = 0;  // A discontinuity indicator was seen: the next PTS starts over
+
+    size_t off = ts_find_sync(buf, size, 0);
+    if (off == size) {
+        r->verdict = TS_NO_SYNC;
+        return;
+    }
+    if (off > 0) r->sync_losses++;
+
+    while (off + TS_PACKET_SIZE <= size) {
+        const uint8_t *pkt = buf + off;
+        if (pkt[0] != TS_SYNC_BYTE) {
+            r->sync_losses++;
+            off = ts_find_sync(buf, size, off + 1);
+            continue;
+        }
+        off += TS_PACKET_SIZE;
+        r->packets++;
+
+        int pid = ((pkt[1] & 0x1F) << 8) | pkt[2];
+        int pusi = pkt[1] & 0x40;
+        int afc = (pkt[3] >> 4) & 0x03;
+        int cc = pkt[3] & 0x0F;
+        if (pid == 0x1FFF || afc == 0) continue;
+
+        const uint8_t *payload = pkt + 4;
+        const uint8_t *end = pkt + TS_PACKET_SIZE;
+        if (afc & 0x02) {
+            int af_len = pkt[4];
+            if (af_len > 0 && (pkt[5] & 0x80)) {
+                // Discontinuity indicator: counters and the time base (often
+                // signalled on the PCR PID) may restart
+                last_cc[pid] = 0xFF;
+                pts_reset = 1;
+            }
+            payload += 1 + af_len;
+        }
+        if (!(afc & 0x01) || payload >= end) continue;
+
+        if (last_cc[pid] != 0xFF && cc != last_cc[pid] && cc != ((last_cc[pid] + 1) & 0x0F)) {
+            r->cc_errors++;
+        }
+        last_cc[pid] = cc;
+        if (!pusi) continue;
+
+        int section_length;
+        const uint8_t *section;
+        if (pid == 0 && (section = ts_psi_section(payload, end, &section_length)) && section[0] == 0x00) {
+            const uint8_t *entries_end = section + 3 + section_length - 4;  // Before the CRC
+            if (entries_end > end) entries_end = end;
+            for (const uint8_t *e = section + 8; e + 4 <= entries_end; e += 4) {
+                int program = (e[0] << 8) | e[1];
+                if (program != 0) is_pmt[((e[2] & 0x1F) << 8) | e[3]] = 1;
+            }
+            have_pat = 1;
+        } else if (is_pmt[pid] && (section = ts_psi_section(payload, end, &section_length)) &&
+                   section[0] == 0x02) {
+            have_pmt = 1;
+            if (section + 12 > end) continue;
+            const uint8_t *entries_end = section + 3 + section_length - 4;
+            if (entries_end > end) entries_end = end;
+            int program_info_length = ((section[10] & 0x0F) << 8) | section[11];
+            for (const uint8_t *e = section + 12 + program_info_length; e + 5 <= entries_end;
+                 e += 5 + (((e[3] & 0x0F) << 8) | e[4])) {
+                if (r->video_pid < 0 && is_video_stream_type(e[0])) {
+                    r->video_pid = ((e[1] & 0x1F) << 8) | e[2];
+                }
+            }
+        } else if (pid == r->video_pid) {
+            r->video_pes++;
+            int64_t pts = -1;
+            if (payload + 14 <= end && payload[0] == 0 && payload[1] == 0 && payload[2] == 1 &&
+                (payload[7] & 0x80)) {
+                pts = ts_parse_pts(payload + 9);
+            }
+            if (pts < 0) {
+                r->bad_pts++;
+                continue;
+            }
+            if (r->last_pts >= 0 && !pts_reset) {
+                // Modulo 2^33 so the 26.5h wrap is not a jump; B-frames step back a little
+                int64_t delta = (pts - r->last_pts) & ((1LL << 33) - 1);
+                if (delta >= (1LL << 32)) delta -= 1LL << 33;
+                if (delta > TS_MAX_PTS_JUMP || delta < -TS_MAX_PTS_JUMP) r->pts_jumps++;
+            }
+            if (r->first_pts < 0) r->first_pts = pts;
+            r->last_pts = pts;
+            pts_reset = 0;
+        }
+    }
+
+    // A partial last packet is checked last, so callers that tolerate it
+    // (inputs still being flushed by the recorder) see it only when the rest
+    // of the file is sound
+    if (r->sync_losses > 0) {
+        snprintf(r->detail, sizeof(r->detail), "%ld sync losses in %ld packets", r->sync_losses, r->packets);
+        r->verdict = TS_SYNC_LOST;
+    } else if (!have_pat) {
+        r->verdict = TS_NO_PAT;
+    } else if (!have_pmt) {
+        r->verdict = TS_NO_PMT;
+    } else if (r->video_pid < 0) {
+        r->verdict = TS_NO_VIDEO;
+    } else if (r->bad_pts > 0 || r->pts_jumps > 0 || r->first_pts < 0) {
+        snprintf(r->detail, sizeof(r->detail), "%ld video PES: %ld without a valid PTS, %ld PTS jumps",
+                 r->video_pes, r->bad_pts, r->pts_jumps);
+        r->verdict = TS_BAD_PTS;
+    } else if (r->cc_errors * 100 > r->packets * (long)config.ts_max_cc_percent) {
+        snprintf(r->detail, sizeof(r->detail), "%ld continuity errors in %ld packets", r->cc_errors, r->packets);
+        r->verdict = TS_CC_ERRORS;
+    } else if (off < size) {
+        snprintf(r->detail, sizeof(r->detail), "ends %zu bytes into a packet", size - off);
+        r->verdict = TS_TRUNCATED;
+    }
+}
+
+// Map a file and check its packet structure. Returns the verdict (also in
+// r->verdict; r->detail explains it when there is more to say than its name).
+TsVerdict ts_check_file(const char *path, TsCheck *r) {
+    memset(r, 0, sizeof(*r));
+    r->video_pid = -1;
+    r->first_pts = -1;
+    r->last_pts = -1;
+
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        snprintf(r->detail, sizeof(r->detail), "%s", strerror(errno));
+        if (fd >= 0) close(fd);
+        return r->verdict = TS_UNREADABLE;
+    }
+    r->bytes = st.st_size;
+    if (st.st_size == 0) {
+        close(fd);
+        return r->verdict = TS_EMPTY;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        snprintf(r->detail, sizeof(r->detail), "mmap: %s", strerror(errno));
+        return r->verdict = TS_UNREADABLE;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    ts_check_packets(map, st.st_size, r);
+    munmap(map, st.st_size);
+    return r->verdict;
+}
+
+// Check one input before it is queued. Only MPEG-TS inputs are checked (with
+// tsCheck off every file is taken). A partial last packet is tolerated: the
+// demuxer drops it. A failing input is logged and counted; reason gets the
+// verdict and its detail.
+TsVerdict ts_precheck_input(const char *filename, char *reason, size_t reason_size) {
+    if (!config.ts_check) {
+        return TS_OK;
+    }
+    size_t name_len = strlen(filename);
+    if (name_len < 3 || strcmp(filename + name_len - 3, ".ts") != 0) {
+        return TS_OK;
+    }
+
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", config.input_dir, filename);
+    struct timespec start, end;
+    TsCheck check;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    TsVerdict verdict = ts_check_file(path, &check);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (verdict == TS_TRUNCATED) {
+        fprintf(stderr, "[TsCheck] %s %s, dropping the partial packet\n", filename, check.detail);
+        verdict = TS_OK;
+    }
+
+    pthread_mutex_lock(&stats_mutex);
+    ts_checks[verdict]++;
+    ts_check_bytes += check.bytes;
+    ts_check_seconds += (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    pthread_mutex_unlock(&stats_mutex);
+
+    if (verdict != TS_OK) {
+        snprintf(reason, reason_size, "ts check: %s%s%s", ts_verdict_names[verdict],
+                 check.detail[0] ? " - " : "", check.detail);
+        fprintf(stderr, "[TsCheck] Rejected %s: %s\n", filename, reason);
+    }
+    return verdict;
+}
+
+// ============================================================================
+// Admission Control
+// ============================================================================
+
+void admission_init(AdmissionControl *ac) {
+    memset(ac, 0, sizeof(*ac));
+    pthread_mutex_init(&ac->mutex, NULL);
+}
+
+// Slots kept free for groups dispatched by the consolidator
+static int admission_reserve(int capacity) {
+    int reserve = capacity * ADMISSION_RESERVE_PERCENT / 100;
+    // Small queues still keep one slot, unless that would be the only one
+    return reserve < 1 && capacity > 1 ? 1 : reserve;
+}
+
+// Milliseconds until the queue should have drained below the admission
+// limit, from the measured drain rate
+int admission_retry_after_ms(int depth, int capacity) {
+    double rate = queue_drain_rate(&task_queue);
+    if (rate <= 0) {
+        return RETRY_AFTER_DEFAULT * 1000;
+    }
+
+    int excess = depth - (capacity - admission_reserve(capacity)) + 1;
+    if (excess < 1) excess = 1;
+
+    int ms = (int)(excess * 1000.0 / rate);
+    if (ms < 100) ms = 100;
+    if (ms > RETRY_AFTER_MAX * 1000) ms = RETRY_AFTER_MAX * 1000;
+    return ms;
+}
+
+// Take one token from the client's bucket. Returns 0 if admitted, otherwise
+// the milliseconds until the next token is available.
+int admission_take_token(AdmissionControl *ac, const char *client) {
+    if (config.client_rate <= 0) {
+        return 0;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    pthread_mutex_lock(&ac->mutex);
+
+    ClientBucket *bucket = NULL;
+    ClientBucket *oldest = NULL;
+    for (int i = 0; i < ac->nb_buckets; i++) {
+        if (strcmp(ac->buckets[i].client, client) == 0) {
+            bucket = &ac->buckets[i];
+            break;
+        }
+        if (!oldest || ac->buckets[i].refilled_at.tv_sec < oldest->refilled_at.tv_sec) {
+            oldest = &ac->buckets[i];
+        }
+    }
+
+    if (!bucket) {
+        // New client starts with a full burst; evict the least recently seen
+        bucket = ac->nb_buckets < MAX_CLIENT_BUCKETS ? &ac->buckets[ac->nb_buckets++] : oldest;
+        strncpy(bucket->client, client, sizeof(bucket->client) - 1);
+        bucket->client[sizeof(bucket->client) - 1] = '\0';
+        bucket->tokens = config.client_burst;
+        bucket->refilled_at = now;
+    }
+
+    double elapsed = (now.tv_sec - bucket->refilled_at.tv_sec) +
+                     (now.tv_nsec - bucket->refilled_at.tv_nsec) / 1e9;
+    bucket->tokens += elapsed * config.client_rate;
+    if (bucket->tokens > config.client_burst) bucket->tokens = config.client_burst;
+    bucket->refilled_at = now;
+
+    int wait_ms = 0;
+    if (bucket->tokens >= 1.0) {
+        bucket->tokens -= 1.0;
+    } else {
+        wait_ms = (int)ceil((1.0 - bucket->tokens) * 1000.0 / config.client_rate);
+        ac->rejected_client_rate++;
+    }
+
+    pthread_mutex_unlock(&ac->mutex);
+    return wait_ms;
+}
+
+// ============================================================================
+// Processed Files Tracking (Circular Buffer)
+// ============================================================================
+
+void processed_init(ProcessedFiles *pf) {
+    pf->count = 0;
+    pthread_mutex_init(&pf->mutex, NULL);
+}
+
+int is_file_processed(ProcessedFiles *pf, const char *filename) {
+    pthread_mutex_lock(&pf->mutex);
+
+    // Check if output file exists
+    char output_path[512];
+    char base_name[256];
+    strncpy(base_name, filename, sizeof(base_name) - 1);
+    base_name[sizeof(base_name) - 1] = '\0';
+
+    char *ext = strstr(base_name, ".ts");
+    if (ext) *ext = '\0';
+
+    snprintf(output_path, sizeof(output_path), "%s/%s_h264.ts", config.output_dir, base_name);
+
+    struct stat st;
+    if (stat(output_path, &st) == 0) {
+        pthread_mutex_unlock(&pf->mutex);
+        return 1;
+    }
+
+    // Check in-memory circular buffer
+    int start = (pf->count >= MAX_PROCESSED) ? (pf->count % MAX_PROCESSED) : 0;
+    int items = (pf->count >= MAX_PROCESSED) ? MAX_PROCESSED : pf->count;
+
+    for (int i = 0; i < items; i++) {
+        int idx = (start + i) % MAX_PROCESSED;
+        if (strcmp(pf->files[idx], filename) == 0) {
+            pthread_mutex_unlock(&pf->mutex);
+            return 1;
+        }
+    }
+
+    pthread_mutex_unlock(&pf->mutex);
+    return 0;
+}
+
+void mark_file_processed(ProcessedFiles *pf, const char *filename) {
+    pthread_mutex_lock(&pf->mutex);
+
+    int index = pf->count % MAX_PROCESSED;
+    strncpy(pf->files[index], filename, 255);
+    pf->files[index][255] = '\0';
+    pf->count++;
+
+    pthread_mutex_unlock(&pf->mutex);
+}
+
+// ============================================================================
+// Segment Consolidation
+// ============================================================================
+
+void consolidator_init(Consolidator *c, int target_seconds, int segment_seconds) {
+    c->open_groups = NULL;
+    c->full_groups = NULL;
+    c->target_seconds = target_seconds;
+    c->segment_seconds = segment_seconds > 0 ? segment_seconds : DEFAULT_SEGMENT_SECONDS;
+    pthread_mutex_init(&c->mutex, NULL);
+}
+
+// Grouping key when the producer sends no cameraId: the recorder writes each
+// camera's segments into its own directory, so the parent directory is stable
+void camera_key_from_path(const char *input_path, char *key, size_t key_size) {
+    strncpy(key, input_path, key_size - 1);
+    key[key_size - 1] = '\0';
+
+    char *slash = strrchr(key, '/');
+    if (!slash) {
+        strncpy(key, ".", key_size - 1);
+    } else if (slash == key) {
+        key[1] = '\0';
+    } else {
+        *slash = '\0';
+    }
+}
+
+// Number of segments that make up one consolidated output
+static int group_capacity(const Consolidator *c) {
+    int n = c->target_seconds / c->segment_seconds;
+    if (n < 1) n = 1;
+    if (n > MAX_GROUP_SEGMENTS) n = MAX_GROUP_SEGMENTS;
+    return n;
+}
+
+// Queue a group as one job. Without 'wait' this never blocks: it returns -1
+// when the queue is full and the caller keeps the group.
+static int consolidator_dispatch(ConsolidationGroup *group, int wait) {
+    TranscodeJob job = {0};
+    strncpy(job.filename, group->segments[0].filename, sizeof(job.filename) - 1);
+    strncpy(job.callback_url, group->callback_url, sizeof(job.callback_url) - 1);
+    strncpy(job.camera_id, group->camera_id, sizeof(job.camera_id) - 1);
+    job.output_format = group->output_format;
+    job.codec_profile = group->codec_profile;
+    job.group = group;
+
+    if (wait) {
+        queue_push(&task_queue, &job);
+    } else if (queue_try_push(&task_queue, &job, 0) < 0) {
+        return -1;
+    }
+    fprintf(stderr, "[Consolidator] Dispatched %s: %d segments\n",
+            group->camera_id, group->nb_segments);
+    return 0;
+}
+
+// Park complete groups the queue could not take; the next flush retries them
+static void consolidator_hold(Consolidator *c, ConsolidationGroup *held) {
+    if (!held) {
+        return;
+    }
+    ConsolidationGroup *tail = held;
+    while (tail->next) tail = tail->next;
+
+    pthread_mutex_lock(&c->mutex);
+    tail->next = c->full_groups;
+    c->full_groups = held;
+    pthread_mutex_unlock(&c->mutex);
+}
+
+// When the segment's recording ended: the input's mtime, 0 if unknown
+static int64_t segment_end_ms(const char *filename) {
+    char path[1024];
+    struct stat st;
+
+    snprintf(path, sizeof(path), "%s/%s", config.input_dir, filename);
+    if (stat(path, &st) < 0) {
+        return 0;
+    }
+    return (int64_t)st.st_mtim.tv_sec * 1000 + st.st_mtim.tv_nsec / 1000000;
+}
+
+// Whether a segment that ended at end_ms can join the group: with it, the
+// group must still fit in one output's worth of consecutive segments (half a
+// segment of slack for recorder jitter). Segments that arrive out of order
+// leave a hole until the missing one comes in. Segments without a timestamp
+// are taken in arrival order.
+static int group_continues(const Consolidator *c, const ConsolidationGroup *group, int64_t end_ms) {
+    int64_t first = group->segments[0].end_ms;
+    int64_t last = group->segments[group->nb_segments - 1].end_ms;
+    int64_t segment_ms = c->segment_seconds * 1000LL;
+
+    if (end_ms == 0 || first == 0 || last == 0) {
+        return 1;
+    }
+    if (end_ms < first) first = end_ms;
+    if (end_ms > last) last = end_ms;
+    return last - first <= (group_capacity(c) - 1) * segment_ms + segment_ms / 2;
+}
+
+// Cut a group at every gap between adjacent segments (more than one and a
+// half segment lengths apart), so holes that were never filled split the
+// group into one output per consecutive run. Returns the runs as a list.
+static ConsolidationGroup *group_split(const Consolidator *c, ConsolidationGroup *group) {
+    int64_t slack = c->segment_seconds * 1500LL;
+
+    for (ConsolidationGroup *run = group; run; run = run->next) {
+        for (int i = 1; i < run->nb_segments; i++) {
+            int64_t prev = run->segments[i - 1].end_ms;
+            int64_t cur = run->segments[i].end_ms;
+            if (prev == 0 || cur == 0 || cur - prev <= slack) {
+                continue;
+            }
+            ConsolidationGroup *tail = malloc(sizeof(ConsolidationGroup));
+            if (!tail) {
+                break;  // Out of memory: the run goes out with its gap
+            }
+            *tail = *run;
+            tail->nb_segments = run->nb_segments - i;
+            memcpy(tail->segments, &run->segments[i], tail->nb_segments * sizeof(GroupSegment));
+            run->nb_segments = i;
+            tail->next = run->next;
+            run->next = tail;
+            fprintf(stderr, "[Consolidator] Gap in %s before %s, split into separate outputs\n",
+                    run->camera_id, tail->segments[0].filename);
+            break;
+        }
+    }
+    return group;
+}
+
+// Dispatch a group taken off the open list, split at its gaps, or park the
+// runs the queue has no room for
+static void consolidator_release(Consolidator *c, ConsolidationGroup *group) {
+    ConsolidationGroup *held = NULL;
+
+    group = group ? group_split(c, group) : NULL;
+    while (group) {
+        ConsolidationGroup *next = group->next;
+        group->next = NULL;
+        if (consolidator_dispatch(group, 0) < 0) {
+            fprintf(stderr, "[Consolidator] Queue full, %s held for the next flush\n", group->camera_id);
+            group->next = held;
+            held = group;
+        }
+        group = next;
+    }
+    consolidator_hold(c, held);
+}
+
+static void consolidator_unlink(Consolidator *c, ConsolidationGroup *group) {
+    ConsolidationGroup **link = &c->open_groups;
+    while (*link != group) link = &(*link)->next;
+    *link = group->next;
+    group->next = NULL;
+}
+
+// Insert a segment into its camera's open group, in recording order. Groups
+// are keyed on camera, codec profile, output format and callback URL, so
+// every segment's producer gets the group's completion. A segment that would
+// stretch the open group past one output's span (after a gap, or a late
+// redelivery) closes it and starts a new one; a closed group goes out split
+// at any hole that was never filled. A group is dispatched as a single job once it covers the
+// target duration; runs on the submitting thread, so a full queue parks the
+// group for the next flush instead of blocking.
+// Returns the number of segments in the group after inserting, -1 on error.
+int consolidator_add(Consolidator *c, const TranscodeJob *job) {
+    const char *camera_id = job->camera_id;
+    int64_t end_ms = segment_end_ms(job->filename);
+    ConsolidationGroup *closed = NULL;
+    ConsolidationGroup *ready = NULL;
+    int nb_segments;
+
+    pthread_mutex_lock(&c->mutex);
+
+    ConsolidationGroup *group = c->open_groups;
+    while (group && (strcmp(group->camera_id, camera_id) != 0 ||
+                     group->codec_profile != job->codec_profile ||
+                     group->output_format != job->output_format ||
+                     strcmp(group->callback_url, job->callback_url) != 0)) {
+        group = group->next;
+    }
+
+    // Unlink before dispatch: the queue is never pushed under our mutex
+    if (group && !group_continues(c, group, end_ms)) {
+        consolidator_unlink(c, group);
+        closed = group;
+        group = NULL;
+    }
+
+    if (!group) {
+        group = calloc(1, sizeof(ConsolidationGroup));
+        if (!group) {
+            pthread_mutex_unlock(&c->mutex);
+            consolidator_release(c, closed);
+            return -1;
+        }
+        strncpy(group->camera_id, camera_id, sizeof(group->camera_id) - 1);
+        strncpy(group->callback_url, job->callback_url, sizeof(group->callback_url) - 1);
+        group->output_format = job->output_format;
+        group->codec_profile = job->codec_profile;
+        group->opened_at = time(NULL);
+        group->next = c->open_groups;
+        c->open_groups = group;
+    }
+
+    int pos = group->nb_segments;
+    while (end_ms && pos > 0 && group->segments[pos - 1].end_ms > end_ms) {
+        pos--;
+    }
+    memmove(&group->segments[pos + 1], &group->segments[pos],
+            (group->nb_segments - pos) * sizeof(GroupSegment));
+    GroupSegment *seg = &group->segments[pos];
+    memset(seg, 0, sizeof(*seg));
+    strncpy(seg->filename, job->filename, sizeof(seg->filename) - 1);
+    strncpy(seg->metadata_json, job->metadata_json, sizeof(seg->metadata_json) - 1);
+    memcpy(seg->job_id, job->job_id, sizeof(seg->job_id));
+    seg->end_ms = end_ms;
+    group->nb_segments++;
+    group->last_append = time(NULL);
+    nb_segments = group->nb_segments;
+
+    if (group->nb_segments >= group_capacity(c)) {
+        consolidator_unlink(c, group);
+        ready = group;
+    }
+
+    pthread_mutex_unlock(&c->mutex);
+
+    if (closed) {
+        fprintf(stderr, "[Consolidator] %s does not continue %s, closing it at %d segments\n",
+                job->filename, closed->camera_id, closed->nb_segments);
+    }
+    consolidator_release(c, closed);
+    consolidator_release(c, ready);
+    return nb_segments;
+}
+
+// Dispatch groups whose camera stopped delivering segments (recording ended or
+// camera offline) so partial groups are not held back indefinitely (one job
+// per consecutive run), and
+// complete groups parked on a full queue. Groups that still find the queue
+// full wait for the next flush. force=1 dispatches every open group and waits
+// for room (shutdown).
+int consolidator_flush(Consolidator *c, int force) {
+    ConsolidationGroup *held = NULL;
+    time_t now = time(NULL);
+    int dispatched = 0;
+
+    pthread_mutex_lock(&c->mutex);
+    ConsolidationGroup *ready = c->full_groups;
+    c->full_groups = NULL;
+    ConsolidationGroup **link = &c->open_groups;
+    while (*link) {
+        ConsolidationGroup *group = *link;
+        if (force || now - group->last_append >= 2 * c->segment_seconds) {
+            *link = group->next;
+            group->next = ready;
+            ready = group;
+        } else {
+            link = &group->next;
+        }
+    }
+    pthread_mutex_unlock(&c->mutex);
+
+    ready = group_split(c, ready);
+    while (ready) {
+        ConsolidationGroup *next = ready->next;
+        ready->next = NULL;
+        if (consolidator_dispatch(ready, force) < 0) {
+            ready->next = held;
+            held = ready;
+        } else {
+            dispatched++;
+        }
+        ready = next;
+    }
+    consolidator_hold(c, held);
+    return dispatched;
+}
+
+// ============================================================================
+// Device Management
+// ============================================================================
+
+void device_manager_init(DeviceManager *dm, int nb_devices, int max_sessions) {
+    memset(dm->devices, 0, sizeof(dm->devices));
+    dm->nb_devices = nb_devices > MAX_DEVICES ? MAX_DEVICES : nb_devices;
+    dm->max_sessions = max_sessions;
+    dm->warm_limit = DEFAULT_STARTUP_PARALLEL;
+    dm->only_device = -1;
+    dm->last_rebalance = 0;
+    pthread_mutex_init(&dm->mutex, NULL);
+    pthread_cond_init(&dm->warm_slot, NULL);
+
+    for (int i = 0; i < dm->nb_devices; i++) {
+        dm->devices[i].id = i;
+        dm->devices[i].healthy = 1;
+        dm->devices[i].ewma_ms = 100.0;  // Neutral seed until real samples arrive
+    }
+}
+
+// Parse "--simulate-devices" spec: comma-separated
+// latency_ms[:failure_rate[:fail_after[:corrupt_rate]]]
+// e.g. "40,80:0.02,40:0:500,40:0:0:0.1" = four devices, the second slow and
+// flaky, the third failing permanently after 500 jobs, the fourth failing one
+// input in ten as corrupt
+int device_manager_init_simulated(DeviceManager *dm, const char *spec, int max_sessions) {
+    char buf[512];
+    int n = 0;
+    strncpy(buf, spec, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+
+    device_manager_init(dm, MAX_DEVICES, max_sessions);
+    dm->simulated = 1;
+
+    char *saveptr = NULL;
+    for (char *tok = strtok_r(buf, ",", &saveptr); tok && n < MAX_DEVICES;
+         tok = strtok_r(NULL, ",", &saveptr)) {
+        DeviceState *d = &dm->devices[n];
+        d->sim_latency_ms = atoi(tok);
+        char *rate = strchr(tok, ':');
+        if (rate) {
+            d->sim_failure_rate = atof(rate + 1);
+            char *after = strchr(rate + 1, ':');
+            if (after) {
+                d->sim_fail_after = atol(after + 1);
+                char *corrupt = strchr(after + 1, ':');
+                if (corrupt) d->sim_corrupt_rate = atof(corrupt + 1);
+            }
+        }
+        if (d->sim_latency_ms <= 0) d->sim_latency_ms = 40;
+        d->ewma_ms = d->sim_latency_ms;
+        n++;
+    }
+
+    dm->nb_devices = n;
+    return n;
+}
+
+// Expected completion time for one more session on the device
+static double device_score(const DeviceState *d) {
+    return (d->active_sessions + 1) * d->ewma_ms;
+}
+
+// Cooldown over: put a quarantined device back on probation
+static void device_check_cooldown(DeviceState *d, time_t now) {
+    if (!d->healthy && now - d->quarantined_at >= DEVICE_COOLDOWN_SECONDS) {
+        d->healthy = 1;
+        d->consecutive_errors = 0;
+        fprintf(stderr, "[Devices] Device %d back on probation after cooldown\n", d->id);
+    }
+}
+
+static int device_available(const DeviceManager *dm, DeviceState *d, time_t now) {
+    device_check_cooldown(d, now);
+    if (!d->healthy) return 0;
+    return dm->max_sessions <= 0 || d->active_sessions < dm->max_sessions;
+}
+
+// Healthy, or back on probation; regardless of free sessions
+int device_usable(DeviceManager *dm, int device_id) {
+    if (device_id < 0 || device_id >= dm->nb_devices) return 0;
+
+    pthread_mutex_lock(&dm->mutex);
+    DeviceState *d = &dm->devices[device_id];
+    device_check_cooldown(d, time(NULL));
+    int usable = d->healthy;
+    pthread_mutex_unlock(&dm->mutex);
+    return usable;
+}
+
+// Bind a worker to the least-loaded healthy device (optionally avoiding one).
+// Returns the device id, or -1 if no device can take another session.
+int device_acquire(DeviceManager *dm, int exclude) {
+    time_t now = time(NULL);
+    int best = -1;
+    double best_score = 0;
+
+    pthread_mutex_lock(&dm->mutex);
+    for (int i = 0; i < dm->nb_devices; i++) {
+        DeviceState *d = &dm->devices[i];
+        if (i == exclude || (dm->only_device >= 0 && i != dm->only_device) ||
+            !device_available(dm, d, now)) {
+            continue;
+        }
+        double score = device_score(d);
+        if (best < 0 || score < best_score) {
+            best = i;
+            best_score = score;
+        }
+    }
+    // Fall back to the excluded device rather than leaving the worker idle
+    if (best < 0 && exclude >= 0 && exclude < dm->nb_devices &&
+        device_available(dm, &dm->devices[exclude], now)) {
+        best = exclude;
+    }
+    if (best >= 0) {
+        dm->devices[best].active_sessions++;
+    }
+    pthread_mutex_unlock(&dm->mutex);
+
+    return best;
+}
+
+void device_release(DeviceManager *dm, int device_id) {
+    if (device_id < 0 || device_id >= dm->nb_devices) return;
+    pthread_mutex_lock(&dm->mutex);
+    if (dm->devices[device_id].active_sessions > 0) {
+        dm->devices[device_id].active_sessions--;
+    }
+    pthread_mutex_unlock(&dm->mutex);
+}
+
+// Building a pipeline opens decoder and encoder sessions and allocates frame
+// pools on the device. Bounding the builds per device lets a restart warm
+// every GPU in parallel without a burst of session opens on each driver.
+void device_warmup_begin(DeviceManager *dm, int device_id) {
+    pthread_mutex_lock(&dm->mutex);
+    while (dm->devices[device_id].warming >= dm->warm_limit) {
+        pthread_cond_wait(&dm->warm_slot, &dm->mutex);
+    }
+    dm->devices[device_id].warming++;
+    pthread_mutex_unlock(&dm->mutex);
+}
+
+void device_warmup_end(DeviceManager *dm, int device_id) {
+    pthread_mutex_lock(&dm->mutex);
+    dm->devices[device_id].warming--;
+    pthread_cond_broadcast(&dm->warm_slot);
+    pthread_mutex_unlock(&dm->mutex);
+}
+
+// Record a job outcome. Repeated failures quarantine the device.
+void device_report(DeviceManager *dm, int device_id, int ok, int processing_ms) {
+    if (device_id < 0 || device_id >= dm->nb_devices) return;
+
+    pthread_mutex_lock(&dm->mutex);
+    DeviceState *d = &dm->devices[device_id];
+    if (ok) {
+        d->files_ok++;
+        d->consecutive_errors = 0;
+        d->ewma_ms = d->samples == 0 ? processing_ms : 0.9 * d->ewma_ms + 0.1 * processing_ms;
+        d->samples++;
+    } else {
+        d->files_failed++;
+        d->consecutive_errors++;
+        if (d->healthy && d->consecutive_errors >= DEVICE_ERROR_THRESHOLD) {
+            d->healthy = 0;
+            d->quarantined_at = time(NULL);
+            fprintf(stderr, "[Devices] Device %d quarantined after %d consecutive failures\n",
+                    device_id, d->consecutive_errors);
+        }
+    }
+    pthread_mutex_unlock(&dm->mutex);
+}
+
+// Should the worker on this device move its pipeline elsewhere?
+// Yes if the device is quarantined, or if another device with spare capacity
+// would finish a file clearly sooner (rate-limited to one move per interval).
+int device_should_migrate(DeviceManager *dm, int device_id) {
+    if (device_id < 0 || device_id >= dm->nb_devices) return 0;
+
+    time_t now = time(NULL);
+    int migrate = 0;
+
+    pthread_mutex_lock(&dm->mutex);
+    DeviceState *self = &dm->devices[device_id];
+    if (!self->healthy) {
+        migrate = 1;
+    } else if (self->samples >= DEVICE_MIN_SAMPLES &&
+               now - dm->last_rebalance >= DEVICE_REBALANCE_INTERVAL) {
+        double self_score = self->active_sessions * self->ewma_ms;
+        for (int i = 0; i < dm->nb_devices; i++) {
+            DeviceState *d = &dm->devices[i];
+            if (i == device_id || d->samples < DEVICE_MIN_SAMPLES || !device_available(dm, d, now)) {
+                continue;
+            }
+            if (device_score(d) * DEVICE_REBALANCE_MARGIN < self_score) {
+                migrate = 1;
+                dm->last_rebalance = now;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&dm->mutex);
+
+    return migrate;
+}
+
+int device_healthy_count(DeviceManager *dm) {
+    int n = 0;
+    pthread_mutex_lock(&dm->mutex);
+    for (int i = 0; i < dm->nb_devices; i++) {
+        if (dm->devices[i].healthy) n++;
+    }
+    pthread_mutex_unlock(&dm->mutex);
+    return n;
+}
+
+// Simulated job: latency grows with the sessions sharing the device (like
+// NVENC/NVDEC contention) and failures are injected at the configured rates.
+// Returns 0, -1 for a device error or -2 for a corrupt input.
+int simulated_process(DeviceManager *dm, int device_id, unsigned int *seed) {
+    pthread_mutex_lock(&dm->mutex);
+    DeviceState *d = &dm->devices[device_id];
+    int latency_ms = d->sim_latency_ms;
+    int sessions = d->active_sessions;
+    double failure_rate = d->sim_failure_rate;
+    double corrupt_rate = d->sim_corrupt_rate;
+    int dead = d->sim_fail_after > 0 && d->files_ok + d->files_failed >= d->sim_fail_after;
+    pthread_mutex_unlock(&dm->mutex);
+
+    double jitter = 0.8 + 0.4 * (rand_r(seed) / (double)RAND_MAX);
+    double contention = 1.0 + 0.1 * (sessions > 1 ? sessions - 1 : 0);
+    usleep((useconds_t)(latency_ms * jitter * contention * 1000));
+
+    if (dead) return -1;
+    if (failure_rate > 0 && rand_r(seed) / (double)RAND_MAX < failure_rate) return -1;
+    if (corrupt_rate > 0 && rand_r(seed) / (double)RAND_MAX < corrupt_rate) return -2;
+    return 0;
+}
+
+// ============================================================================
+// CPU Affinity (NUMA topology from sysfs)
+// ============================================================================
+
+// Workers run on the cores local to their device: NVDEC/NVENC DMA and the
+// worker's packets and frames stay on the GPU's PCIe-attached node, and the
+// software codecs' threads (created by the worker, so they inherit its mask)
+// share those cores. A few cores on the node with the fewest devices are
+// kept for the API, scanner and control threads.
+typedef struct {
+    int enabled;
+    int nb_nodes;
+    int nb_cpus;                        // Online CPUs
+    int node_id[MAX_NUMA_NODES];        // Kernel node number (nodes may be sparse)
+    cpu_set_t node_cpus[MAX_NUMA_NODES];
+    cpu_set_t service_cpus;
+    int service_node;
+    int device_node[MAX_DEVICES];       // -1 = no PCI locality (software / simulated)
+    int worker_node[MAX_WORKERS_LIMIT]; // Node the worker is pinned to (-1 = floating), under worker_pool.mutex
+    int worker_cpus[MAX_WORKERS_LIMIT]; // Cores in its mask, under worker_pool.mutex
+} AffinityManager;
+
+AffinityManager affinity;
+
+// Parse a sysfs cpulist ("0-11,24-35") into a set. Returns the CPU count.
+static int parse_cpulist(const char *list, cpu_set_t *set) {
+    CPU_ZERO(set);
+    const char *p = list;
+    while (*p && *p != '\n') {
+        char *end;
+        long first = strtol(p, &end, 10);
+        if (end == p) break;
+        long last = first;
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+        }
+        for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+            CPU_SET(cpu, set);
+        }
+        p = *end == ',' ? end + 1 : end;
+    }
+    return CPU_COUNT(set);
+}
+
+static int read_sysfs_line(const char *path, char *buf, size_t size) {
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    int ok = fgets(buf, (int)size, f) != NULL;
+    fclose(f);
+    return ok ? 0 : -1;
+}
+
+// NUMA node of a CUDA device's PCI function, or -1 when unknown
+static int device_numa_node(int device_id) {
+    char bus_id[32];
+    if (cudaDeviceGetPCIBusId(bus_id, sizeof(bus_id), device_id) != cudaSuccess) {
+        return -1;
+    }
+    for (char *c = bus_id; *c; c++) {
+        *c = tolower((unsigned char)*c);
+    }
+
+    char path[256], line[32];
+    snprintf(path, sizeof(path), "%s/%s/numa_node", SYSFS_PCI_DIR, bus_id);
+    if (read_sysfs_line(path, line, sizeof(line)) < 0) return -1;
+    int node = atoi(line);
+    for (int i = 0; i < affinity.nb_nodes; i++) {
+        if (affinity.node_id[i] == node) return i;
+    }
+    return -1;
+}
+
+// Kernel number of a node index, for logs and metrics (-1 stays -1)
+static int affinity_node_id(const AffinityManager *am, int node) {
+    return node >= 0 ? am->node_id[node] : -1;
+}
+
+// Read the topology and pick the service cores. Returns 0 when pinning is on.
+int affinity_init(AffinityManager *am, const DeviceManager *dm, int service_cpus) {
+    memset(am, 0, sizeof(*am));
+    for (int i = 0; i < MAX_DEVICES; i++) am->device_node[i] = -1;
+    for (int i = 0; i < MAX_WORKERS_LIMIT; i++) am->worker_node[i] = -1;
+
+    // Online node numbers can have gaps (offline or hot-removed nodes), and
+    // memory-only nodes have no CPUs: keep the nodes with CPUs, densely indexed
+    char path[256], line[4096];
+    cpu_set_t online;
+    snprintf(path, sizeof(path), "%s/online", SYSFS_NODE_DIR);
+    if (read_sysfs_line(path, line, sizeof(line)) == 0 && parse_cpulist(line, &online) > 0) {
+        for (int node = 0; node < CPU_SETSIZE && am->nb_nodes < MAX_NUMA_NODES; node++) {
+            if (!CPU_ISSET(node, &online)) continue;
+            snprintf(path, sizeof(path), "%s/node%d/cpulist", SYSFS_NODE_DIR, node);
+            if (read_sysfs_line(path, line, sizeof(line)) < 0) continue;
+            cpu_set_t *cpus = &am->node_cpus[am->nb_nodes];
+            if (parse_cpulist(line, cpus) == 0) continue;  // Memory-only node
+            am->node_id[am->nb_nodes] = node;
+            am->nb_cpus += CPU_COUNT(cpus);
+            am->nb_nodes++;
+        }
+    }
+    if (am->nb_nodes == 0) {
+        // No NUMA sysfs (container without /sys, or non-NUMA kernel): one node
+        if (sched_getaffinity(0, sizeof(cpu_set_t), &am->node_cpus[0]) < 0) {
+            fprintf(stderr, "[Affinity] Cannot read the CPU topology, pinning disabled\n");
+            return -1;
+        }
+        am->nb_cpus = CPU_COUNT(&am->node_cpus[0]);
+        am->node_id[0] = 0;
+        am->nb_nodes = 1;
+    }
+
+    int devices_on_node[MAX_NUMA_NODES] = {0};
+    if (!dm->simulated && !software_backend) {
+        for (int i = 0; i < dm->nb_devices; i++) {
+            am->device_node[i] = device_numa_node(i);
+            if (am->device_node[i] >= 0) devices_on_node[am->device_node[i]]++;
+        }
+    }
+
+    // Service cores: the highest-numbered cores of the node with the fewest
+    // devices, leaving at least one core per node to the workers
+    am->service_node = 0;
+    for (int node = 1; node < am->nb_nodes; node++) {
+        if (devices_on_node[node] < devices_on_node[am->service_node]) am->service_node = node;
+    }
+    CPU_ZERO(&am->service_cpus);
+    int available = CPU_COUNT(&am->node_cpus[am->service_node]) - 1;
+    int wanted = service_cpus < available ? service_cpus : available;
+    for (int cpu = CPU_SETSIZE - 1; cpu >= 0 && CPU_COUNT(&am->service_cpus) < wanted; cpu--) {
+        if (CPU_ISSET(cpu, &am->node_cpus[am->service_node])) CPU_SET(cpu, &am->service_cpus);
+    }
+
+    am->enabled = 1;
+    fprintf(stderr, "[Affinity] %d CPUs in %d NUMA node(s); %d service core(s) on node %d\n",
+            am->nb_cpus, am->nb_nodes, CPU_COUNT(&am->service_cpus), am->node_id[am->service_node]);
+    for (int i = 0; i < dm->nb_devices && !dm->simulated && !software_backend; i++) {
+        fprintf(stderr, "[Affinity]   GPU %d: node %d\n", i, affinity_node_id(am, am->device_node[i]));
+    }
+    return 0;
+}
+
+// Confine the calling thread (and every thread it creates later) to the
+// service cores. Called from main before the API and control threads start.
+void affinity_pin_service(AffinityManager *am) {
+    if (!am->enabled || CPU_COUNT(&am->service_cpus) == 0) return;
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &am->service_cpus);
+}
+
+// Pin a worker to its device's node (software backend and simulated devices:
+// nodes round-robin by worker id) minus the service cores, and prefer that
+// node for its allocations: the pipeline it sets up next, its packet and frame
+// buffers and the codec threads' stacks all land on local memory.
+void affinity_pin_worker(AffinityManager *am, int worker_id, int device_id) {
+    if (!am->enabled || worker_id < 0 || worker_id >= MAX_WORKERS_LIMIT) return;
+
+    int node = device_id >= 0 && device_id < MAX_DEVICES ? am->device_node[device_id] : -1;
+    if (node < 0) node = worker_id % am->nb_nodes;
+
+    cpu_set_t cpus = am->node_cpus[node];
+    cpu_set_t local;            // Node cores minus the service cores
+    CPU_XOR(&local, &cpus, &am->service_cpus);
+    CPU_AND(&local, &local, &cpus);
+    if (CPU_COUNT(&local) > 0) cpus = local;
+
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus) != 0) {
+        fprintf(stderr, "[Worker %d] Could not pin to NUMA node %d\n", worker_id, am->node_id[node]);
+        return;
+    }
+    if (am->nb_nodes > 1) {
+        unsigned long nodemask = 1UL << am->node_id[node];
+        if (syscall(SYS_set_mempolicy, MPOL_PREFERRED_NODE, &nodemask, sizeof(nodemask) * 8) < 0) {
+            fprintf(stderr, "[Worker %d] set_mempolicy: %s\n", worker_id, strerror(errno));
+        }
+    }
+    pthread_mutex_lock(&worker_pool.mutex);
+    am->worker_node[worker_id] = node;
+    am->worker_cpus[worker_id] = CPU_COUNT(&cpus);
+    pthread_mutex_unlock(&worker_pool.mutex);
+}
+
+// ============================================================================
+// CUDA Hardware Context Setup
+// ============================================================================
+
+int init_hw_device_ctx(TranscodeContext *ctx) {
+    // Create CUDA device string: "0" or "1"
+    char device_str[8];
+    snprintf(device_str, sizeof(device_str), "%d", ctx->gpu_id);
+
+    int ret = av_hwdevice_ctx_create(&ctx->hw_device_ctx, AV_HWDEVICE_TYPE_CUDA,
+                                     device_str, NULL, 0);
+    if (ret < 0) {
+        fprintf(stderr, "[Worker %d GPU %d] Failed to create CUDA device context\n",
+                ctx->worker_id, ctx->gpu_id);
+        return ret;
+    }
+
+    fprintf(stderr, "[Worker %d] Using GPU %d\n", ctx->worker_id, ctx->gpu_id);
+
+    // Create CUDA stream for async operations
+    cudaError_t cuda_ret = cudaStreamCreate(&ctx->cuda_stream);
+    if (cuda_ret != cudaSuccess) {
+        fprintf(stderr, "[Worker %d] CUDA stream creation failed: %s\n",
+                ctx->worker_id, cudaGetErrorString(cuda_ret));
+        return -1;
+    }
+
+    fprintf(stderr, "[Worker %d] CUDA device context and stream created\n", ctx->worker_id);
+    return 0;
+}
+
+// ============================================================================
+// NVDEC Decoder Setup (h264_cuvid) - PERSISTENT VERSION
+// ============================================================================
+
+// Open an h264_cuvid (NVDEC) session on the worker's device
+// All camera files are 1920x1080 H.264, so we can hardcode parameters
+static AVCodecContext *open_cuvid_decoder(TranscodeContext *ctx) {
+    // GPU-ONLY: Use h264_cuvid (NVDEC) - NO CPU FALLBACK
+    const AVCodec *decoder = avcodec_find_decoder_by_name("h264_cuvid");
+    if (!decoder) {
+        fprintf(stderr, "[Worker %d] FATAL: h264_cuvid (NVDEC) not available - GPU-only pipeline required\n", ctx->worker_id);
+        exit(1);  // FAIL immediately - NO CPU fallback
+    }
+
+    AVCodecContext *dec = avcodec_alloc_context3(decoder);
+    if (!dec) {
+        fprintf(stderr, "[Worker %d] Failed to allocate decoder context\n", ctx->worker_id);
+        return NULL;
+    }
+
+    // Standard camera parameters (all files are identical format)
+    dec->codec_type = AVMEDIA_TYPE_VIDEO;
+    dec->codec_id = AV_CODEC_ID_H264;
+    dec->width = 1920;
+    dec->height = 1080;
+    dec->pix_fmt = AV_PIX_FMT_CUDA;
+    dec->time_base = (AVRational){1, 25};
+
+    // Set hardware device context for NVDEC
+    dec->hw_device_ctx = av_buffer_ref(ctx->hw_device_ctx);
+
+    // NVDEC options for fast decode
+    AVDictionary *opts = NULL;
+    char gpu_str[8];
+    snprintf(gpu_str, sizeof(gpu_str), "%d", ctx->gpu_id);
+    av_dict_set(&opts, "gpu", gpu_str, 0);
+
+    if (avcodec_open2(dec, decoder, &opts) < 0) {
+        fprintf(stderr, "[Worker %d] Failed to open NVDEC decoder\n", ctx->worker_id);
+        av_dict_free(&opts);
+        avcodec_free_context(&dec);
+        return NULL;
+    }
+
+    av_dict_free(&opts);
+    return dec;
+}
+
+// Software backend: libavcodec's H.264 decoder producing YUV420P frames
+static AVCodecContext *open_software_decoder(TranscodeContext *ctx) {
+    const AVCodec *decoder = avcodec_find_decoder(AV_CODEC_ID_H264);
+    AVCodecContext *dec = decoder ? avcodec_alloc_context3(decoder) : NULL;
+    if (!dec) {
+        fprintf(stderr, "[Worker %d] Failed to allocate software decoder\n", ctx->worker_id);
+        return NULL;
+    }
+
+    dec->width = 1920;
+    dec->height = 1080;
+    dec->time_base = (AVRational){1, SOURCE_FPS};
+
+    if (avcodec_open2(dec, decoder, NULL) < 0) {
+        fprintf(stderr, "[Worker %d] Failed to open software decoder\n", ctx->worker_id);
+        avcodec_free_context(&dec);
+        return NULL;
+    }
+    return dec;
+}
+
+// Persistent decoder: initialized once with standard camera parameters.
+// Mosaic tiles open their own sessions for the length of the job.
+int init_decoder_persistent(TranscodeContext *ctx) {
+    ctx->decoder_ctx = software_backend ? open_software_decoder(ctx) : open_cuvid_decoder(ctx);
+    if (!ctx->decoder_ctx) {
+        return -1;
+    }
+    fprintf(stderr, "[Worker %d] %s decoder initialized (persistent)\n", ctx->worker_id,
+            software_backend ? "Software h264" : "NVDEC h264_cuvid");
+    return 0;
+}
+
+// ============================================================================
+// Encoder Setup (per codec profile: NVENC, or libx264/libx265/libsvtav1)
+// ============================================================================
+
+// Open an encoder session for a codec profile. NVENC takes CUDA frames from
+// scale_cuda; the software backend takes YUV420P frames from swscale. Rates
+// and bitrate differ between the full-rate and time-lapse renditions.
+static AVCodecContext *open_encoder(TranscodeContext *ctx, const CodecProfile *profile,
+                                    int width, int height, int fps, int bitrate) {
+    const char *name = software_backend ? software_encoder_names[profile->codec]
+                                        : nvenc_encoder_names[profile->codec];
+    const AVCodec *encoder = avcodec_find_encoder_by_name(name);
+    if (!encoder) {
+        // Unlike a missing h264_nvenc, a missing HEVC/AV1 encoder only fails
+        // the jobs asking for that profile
+        fprintf(stderr, "[Worker %d] Encoder %s not available for profile %s\n",
+                ctx->worker_id, name, profile->name);
+        return NULL;
+    }
+
+    AVCodecContext *enc = avcodec_alloc_context3(encoder);
+    if (!enc) {
+        fprintf(stderr, "[Worker %d] Failed to allocate encoder context\n", ctx->worker_id);
+        return NULL;
+    }
+
+    // Encoder settings for frames from the scale filter (720p by default)
+    enc->width = width;
+    enc->height = height;
+    enc->time_base = (AVRational){1, fps};
+    enc->framerate = (AVRational){fps, 1};
+    enc->sample_aspect_ratio = (AVRational){1, 1};
+    enc->bit_rate = bitrate;  // Profile bitrate, or the scaled time-lapse rate
+
+    if (software_backend) {
+        enc->pix_fmt = AV_PIX_FMT_YUV420P;
+        if (profile->software_preset[0]) {
+            av_opt_set(enc->priv_data, "preset", profile->software_preset, 0);
+        }
+        av_opt_set_int(enc->priv_data, "crf", profile->cq, 0);
+        av_opt_set(enc->priv_data, "profile", profile->profile, 0);
+        av_opt_set(enc->priv_data, "forced-idr", "1", 0);
+    } else {
+        enc->pix_fmt = AV_PIX_FMT_CUDA;  // Accept CUDA frames from scale_cuda
+
+        // Create hw_frames_ctx for encoder (required when using CUDA frames)
+        AVBufferRef *hw_frames_ref = av_hwframe_ctx_alloc(ctx->hw_device_ctx);
+        AVHWFramesContext *frames_ctx = (AVHWFramesContext *)(hw_frames_ref->data);
+        frames_ctx->format    = AV_PIX_FMT_CUDA;
+        frames_ctx->sw_format = AV_PIX_FMT_NV12;
+        frames_ctx->width     = width;
+        frames_ctx->height    = height;
+
+        int ret = av_hwframe_ctx_init(hw_frames_ref);
+        if (ret < 0) {
+            fprintf(stderr, "[Worker %d] Failed to init encoder hw_frames_ctx\n", ctx->worker_id);
+            av_buffer_unref(&hw_frames_ref);
+            avcodec_free_context(&enc);
+            return NULL;
+        }
+
+        enc->hw_frames_ctx = hw_frames_ref;
+
+        // NVENC optimal settings (P2 + VBR + CQ30 - optimized for smaller output)
+        av_opt_set(enc->priv_data, "preset", profile->preset, 0);
+        av_opt_set(enc->priv_data, "rc", config.rc, 0);
+        av_opt_set_int(enc->priv_data, "cq", profile->cq, 0);  // Profile cq (top-level cq unless set)
+        av_opt_set(enc->priv_data, "profile", profile->profile, 0);
+        av_opt_set(enc->priv_data, "level", "auto", 0);
+        av_opt_set(enc->priv_data, "forced-idr", "1", 0);  // Segment boundaries in consolidated outputs
+
+        // Set GPU ID dynamically based on worker assignment
+        char gpu_str_enc[8];
+        snprintf(gpu_str_enc, sizeof(gpu_str_enc), "%d", ctx->gpu_id);
+        av_opt_set(enc->priv_data, "gpu", gpu_str_enc, 0);
+    }
+
+    AVDictionary *opts = NULL;
+    int ret = avcodec_open2(enc, encoder, &opts);
+    av_dict_free(&opts);
+
+    if (ret < 0) {
+        fprintf(stderr, "[Worker %d] Failed to open %s encoder (profile %s)\n",
+                ctx->worker_id, name, profile->name);
+        avcodec_free_context(&enc);
+        return NULL;
+    }
+
+    fprintf(stderr, "[Worker %d] Encoder initialized (%s %dx%d @ %d fps, profile %s)\n",
+            ctx->worker_id, name, width, height, fps, profile->name);
+    return enc;
+}
+
+// The default profile's session is opened with the pipeline; other profiles
+// open theirs on the first job that asks for them
+int init_encoder(TranscodeContext *ctx) {
+    // GPU-ONLY: Use h264_nvenc (NVENC) - NO CPU FALLBACK
+    if (!software_backend && !avcodec_find_encoder_by_name("h264_nvenc")) {
+        fprintf(stderr, "[Worker %d] FATAL: h264_nvenc (NVENC) not available - GPU-only pipeline required\n", ctx->worker_id);
+        exit(1);  // FAIL immediately - NO CPU fallback
+    }
+
+    ctx->codec_profile = 0;
+    ctx->profile_encoders[0] = open_encoder(ctx, &config.codec_profiles[0], config.out_width,
+                                            config.out_height, SOURCE_FPS, config.codec_profiles[0].bitrate);
+    ctx->encoder_ctx = ctx->profile_encoders[0];
+    ctx->encoder_slot = 0;
+    return ctx->encoder_ctx ? 0 : -1;
+}
+
+// Point encoder_ctx at the session the current job needs: its codec profile's
+// full-rate encoder (opened on first use, then kept like the default one), or
+// a time-lapse encoder for this job, closed again by cleanup_file_contexts.
+static int select_encoder(TranscodeContext *ctx) {
+    int p = ctx->codec_profile;
+    const CodecProfile *profile = &config.codec_profiles[p];
+    const TimelapseSpec *t = ctx->timelapse;
+    if (!t) {
+        if (!ctx->profile_encoders[p]) {
+            ctx->profile_encoders[p] = open_encoder(ctx, profile, config.out_width, config.out_height,
+                                                    SOURCE_FPS, profile->bitrate);
+        }
+        ctx->encoder_ctx = ctx->profile_encoders[p] ? ctx->profile_encoders[p] : ctx->profile_encoders[0];
+        ctx->encoder_slot = ctx->profile_encoders[p] ? p : 0;
+        return ctx->profile_encoders[p] ? 0 : -1;
+    }
+
+    TimelapseSpec want = *t;
+    if (want.width == 0) {
+        want.width = config.out_width;
+        want.height = config.out_height;
+    }
+    if (want.bitrate == 0) {
+        // Same bits per frame as the full-rate rendition, scaled by area
+        double scale = (double)want.fps / SOURCE_FPS *
+                       ((double)want.width * want.height) / ((double)config.out_width * config.out_height);
+        want.bitrate = (int)(profile->bitrate * scale);
+        if (want.bitrate < TIMELAPSE_MIN_BITRATE) want.bitrate = TIMELAPSE_MIN_BITRATE;
+    }
+    want.keyframes_only = 0;  // Decoder-side only, does not affect the session
+
+    if (!ctx->timelapse_encoder || ctx->timelapse_encoder_profile != p ||
+        memcmp(&want, &ctx->timelapse_encoder_spec, sizeof(want)) != 0) {
+        avcodec_free_context(&ctx->timelapse_encoder);
+        ctx->encoders_fed &= ~(1u << MAX_CODEC_PROFILES);
+        ctx->timelapse_encoder = open_encoder(ctx, profile, want.width, want.height, want.fps, want.bitrate);
+        if (!ctx->timelapse_encoder) {
+            ctx->encoder_ctx = ctx->profile_encoders[0];
+            ctx->encoder_slot = 0;
+            return -1;
+        }
+        ctx->timelapse_encoder_spec = want;
+        ctx->timelapse_encoder_profile = p;
+    }
+    ctx->encoder_ctx = ctx->timelapse_encoder;
+    ctx->encoder_slot = MAX_CODEC_PROFILES;
+    return 0;
+}
+
+// Return the current encoder to a clean state for the next output. Sessions
+// with AV_CODEC_CAP_ENCODER_FLUSH (NVENC, libx264) just drop what they hold;
+// others (libx265, libsvtav1) stay at EOF once drained and cannot be flushed,
+// so after they were fed they are reopened with the same settings.
+static int reset_encoder(TranscodeContext *ctx) {
+    unsigned bit = 1u << ctx->encoder_slot;
+    if (ctx->encoder_ctx->codec->capabilities & AV_CODEC_CAP_ENCODER_FLUSH) {
+        avcodec_flush_buffers(ctx->encoder_ctx);
+        return 0;
+    }
+    if (!(ctx->encoders_fed & bit)) {
+        return 0;
+    }
+
+    AVCodecContext **slot;
+    AVCodecContext *enc;
+    if (ctx->encoder_slot == MAX_CODEC_PROFILES) {
+        const TimelapseSpec *t = &ctx->timelapse_encoder_spec;
+        slot = &ctx->timelapse_encoder;
+        enc = open_encoder(ctx, &config.codec_profiles[ctx->timelapse_encoder_profile],
+                           t->width, t->height, t->fps, t->bitrate);
+    } else {
+        const CodecProfile *profile = &config.codec_profiles[ctx->encoder_slot];
+        slot = &ctx->profile_encoders[ctx->encoder_slot];
+        enc = open_encoder(ctx, profile, config.out_width, config.out_height, SOURCE_FPS, profile->bitrate);
+    }
+    if (!enc) {
+        return -1;
+    }
+    avcodec_free_context(slot);
+    *slot = enc;
+    ctx->encoder_ctx = enc;
+    ctx->encoders_fed &= ~bit;
+    return 0;
+}
+
+// Buffer source fed with NVDEC frames (1920x1080 NV12 on the worker's device)
+static int create_cuda_buffersrc(TranscodeContext *ctx, AVFilterGraph *graph, const char *name,
+                                 AVRational time_base, AVFilterContext **src) {
+    char args[512];
+    int ret;
+
+    snprintf(args, sizeof(args),
+             "video_size=%dx%d:pix_fmt=%d:time_base=%d/%d:pixel_aspect=%d/%d",
+             1920, 1080,
+             AV_PIX_FMT_CUDA,
+             time_base.num, time_base.den,
+             1, 1);
+
+    fprintf(stderr, "[Worker %d] Creating buffer source with args: %s\n", ctx->worker_id, args);
+    ret = avfilter_graph_create_filter(src, avfilter_get_by_name("buffer"), name,
+                                       args, NULL, graph);
+    if (ret < 0) {
+        fprintf(stderr, "[Worker %d] Failed to create buffer source\n", ctx->worker_id);
+        return -1;
+    }
+
+    // Create hw_frames_ctx for buffer source
+    AVBufferRef *hw_frames_ref = av_hwframe_ctx_alloc(ctx->hw_device_ctx);
+    if (!hw_frames_ref) {
+        fprintf(stderr, "[Worker %d] Failed to allocate hw_frames_ctx\n", ctx->worker_id);
+        return -1;
+    }
+
+    AVHWFramesContext *frames_ctx = (AVHWFramesContext *)(hw_frames_ref->data);
+    frames_ctx->format    = AV_PIX_FMT_CUDA;
+    frames_ctx->sw_format = AV_PIX_FMT_NV12;
+    frames_ctx->width     = ctx->decoder_ctx->width;
+    frames_ctx->height    = ctx->decoder_ctx->height;
+
+    ret = av_hwframe_ctx_init(hw_frames_ref);
+    if (ret < 0) {
+        fprintf(stderr, "[Worker %d] Failed to initialize hw_frames_ctx\n", ctx->worker_id);
+        av_buffer_unref(&hw_frames_ref);
+        return -1;
+    }
+
+    AVBufferSrcParameters *par = av_buffersrc_parameters_alloc();
+    par->hw_frames_ctx = hw_frames_ref;
+    av_buffersrc_parameters_set(*src, par);
+    av_free(par);
+    av_buffer_unref(&hw_frames_ref);  // The buffer source holds its own reference
+    return 0;
+}
+
+// Initialize scale_cuda filter for GPU-based scaling - PERSISTENT VERSION
+// Uses hard-coded parameters since all camera files are identical format
+int init_filter_persistent(TranscodeContext *ctx) {
+    int ret;
+
+    const AVFilter *buffersink = avfilter_get_by_name("buffersink");
+    AVFilterInOut *outputs = avfilter_inout_alloc();
+    AVFilterInOut *inputs = avfilter_inout_alloc();
+
+    ctx->filter_graph = avfilter_graph_alloc();
+    if (!outputs || !inputs || !ctx->filter_graph) {
+        fprintf(stderr, "[Worker %d] Failed to allocate filter graph\n", ctx->worker_id);
+        return -1;
+    }
+
+    // Create buffer source (NVDEC output) - standard camera parameters
+    if (software_backend) {
+        char args[256];
+        snprintf(args, sizeof(args), "video_size=%dx%d:pix_fmt=%d:time_base=1/%d:pixel_aspect=1/1",
+                 1920, 1080, AV_PIX_FMT_YUV420P, SOURCE_FPS);
+        ret = avfilter_graph_create_filter(&ctx->buffersrc_ctx, avfilter_get_by_name("buffer"), "in",
+                                           args, NULL, ctx->filter_graph);
+    } else {
+        ret = create_cuda_buffersrc(ctx, ctx->filter_graph, "in", (AVRational){1, 25}, &ctx->buffersrc_ctx);
+    }
+    if (ret < 0) {
+        return -1;
+    }
+
+    // Create buffer sink (NVENC input)
+    ret = avfilter_graph_create_filter(&ctx->buffersink_ctx, buffersink, "out",
+                                       NULL, NULL, ctx->filter_graph);
+    if (ret < 0) {
+        fprintf(stderr, "[Worker %d] Failed to create buffer sink\n", ctx->worker_id);
+        return -1;
+    }
+
+    // Configure outputs (from buffer source)
+    outputs->name = av_strdup("in");
+    outputs->filter_ctx = ctx->buffersrc_ctx;
+    outputs->pad_idx = 0;
+    outputs->next = NULL;
+
+    // Configure inputs (to buffer sink)
+    inputs->name = av_strdup("out");
+    inputs->filter_ctx = ctx->buffersink_ctx;
+    inputs->pad_idx = 0;
+    inputs->next = NULL;
+
+    // scale_cuda filter: resize 1920x1080 -> the selected encoder's size on GPU
+    // (swscale on the software backend)
+    char filter_descr[64];
+    snprintf(filter_descr, sizeof(filter_descr),
+             software_backend ? "scale=%d:%d,format=yuv420p" : "scale_cuda=%d:%d",
+             ctx->encoder_ctx->width, ctx->encoder_ctx->height);
+
+    fprintf(stderr, "[Worker %d] Parsing filter graph: %s\n", ctx->worker_id, filter_descr);
+    ret = avfilter_graph_parse_ptr(ctx->filter_graph, filter_descr,
+                                   &inputs, &outputs, NULL);
+    if (ret < 0) {
+        fprintf(stderr, "[Worker %d] Failed to parse filter graph\n", ctx->worker_id);
+        return -1;
+    }
+
+    // Set hardware device context on filter graph
+    if (ctx->hw_device_ctx) {
+        fprintf(stderr, "[Worker %d] Setting hw_device_ctx on %d filters\n", ctx->worker_id, ctx->filter_graph->nb_filters);
+        for (unsigned i = 0; i < ctx->filter_graph->nb_filters; i++) {
+            ctx->filter_graph->filters[i]->hw_device_ctx = av_buffer_ref(ctx->hw_device_ctx);
+        }
+    }
+
+    fprintf(stderr, "[Worker %d] Configuring filter graph...\n", ctx->worker_id);
+    ret = avfilter_graph_config(ctx->filter_graph, NULL);
+    if (ret < 0) {
+        fprintf(stderr, "[Worker %d] Failed to configure filter graph\n", ctx->worker_id);
+        return -1;
+    }
+
+    avfilter_inout_free(&inputs);
+    avfilter_inout_free(&outputs);
+
+    fprintf(stderr, "[Worker %d] %s filter initialized (persistent, 1920x1080 -> %dx%d)\n",
+            ctx->worker_id, software_backend ? "scale" : "scale_cuda",
+            ctx->encoder_ctx->width, ctx->encoder_ctx->height);
+    return 0;
+}
+
+// ============================================================================
+// Persistent Pipeline Setup and Management
+// ============================================================================
+
+// Allocate the worker's reusable packets and frames
+static int frame_pool_init(FramePool *pool) {
+    pool->packet = av_packet_alloc();
+    pool->enc_packet = av_packet_alloc();
+    pool->decoded_frame = av_frame_alloc();
+    pool->filtered_frame = av_frame_alloc();
+    if (!pool->packet || !pool->enc_packet || !pool->decoded_frame || !pool->filtered_frame) {
+        return -1;
+    }
+    return 0;
+}
+
+// Release them; safe on a pool that was only partly allocated
+static void frame_pool_free(FramePool *pool) {
+    av_packet_free(&pool->packet);
+    av_packet_free(&pool->enc_packet);
+    av_frame_free(&pool->decoded_frame);
+    av_frame_free(&pool->filtered_frame);
+}
+
+// Initialize the persistent GPU pipeline once per worker
+// This avoids expensive per-file recreation of NVENC/NVDEC sessions
+int setup_persistent_pipeline(TranscodeContext *ctx) {
+    fprintf(stderr, "[Worker %d] Setting up persistent GPU pipeline...\n", ctx->worker_id);
+
+    if (frame_pool_init(&ctx->pool) < 0) {
+        fprintf(stderr, "[Worker %d] Failed to allocate packet/frame pool\n", ctx->worker_id);
+        return -1;
+    }
+
+    // Initialize decoder (NVDEC session - expensive to create)
+    if (init_decoder_persistent(ctx) < 0) {
+        fprintf(stderr, "[Worker %d] Failed to initialize persistent decoder\n", ctx->worker_id);
+        return -1;
+    }
+
+    // Initialize encoder (NVENC session - expensive to create)
+    if (init_encoder(ctx) < 0) {
+        fprintf(stderr, "[Worker %d] Failed to initialize persistent encoder\n", ctx->worker_id);
+        return -1;
+    }
+
+    // Initialize filter (scale_cuda graph - expensive to configure)
+    if (init_filter_persistent(ctx) < 0) {
+        fprintf(stderr, "[Worker %d] Failed to initialize persistent filter\n", ctx->worker_id);
+        return -1;
+    }
+
+    fprintf(stderr, "[Worker %d] ✓ Persistent pipeline ready (%s)\n", ctx->worker_id,
+            software_backend ? "decode→scale→encode on CPU" : "NVDEC→scale_cuda→NVENC");
+    return 0;
+}
+
+// Flush pipeline state between files
+// This is MUCH faster than recreating contexts (~10ms vs ~300ms)
+int flush_pipeline_for_next_file(TranscodeContext *ctx) {
+    // Flush decoder and encoder buffers
+    avcodec_flush_buffers(ctx->decoder_ctx);
+    if (reset_encoder(ctx) < 0) {
+        return -1;
+    }
+
+    // Filter graph must be recreated as it enters EOF state
+    // This is still much cheaper than recreating decoder/encoder (~50ms vs ~300ms)
+    if (ctx->filter_graph) {
+        avfilter_graph_free(&ctx->filter_graph);
+        ctx->filter_graph = NULL;
+        ctx->buffersrc_ctx = NULL;
+        ctx->buffersink_ctx = NULL;
+    }
+
+    // Reinitialize filter for next file
+    init_filter_persistent(ctx);
+    return 0;
+}
+
+// ============================================================================
+// CMAF/HLS Packaging
+// ============================================================================
+
+// Directory-safe camera key: "/data/cam01/raw" -> "data_cam01_raw"
+static void camera_slug(const char *camera_id, char *slug, size_t size) {
+    size_t n = 0;
+    const char *p = camera_id;
+    while (*p == '/' || *p == '.') p++;
+
+    for (; *p && n < size - 1; p++) {
+        slug[n++] = (*p == '/' || *p == '.' || *p == ' ') ? '_' : *p;
+    }
+    if (n == 0) {
+        strncpy(slug, "default", size - 1);
+        n = strlen(slug);
+    }
+    slug[n] = '\0';
+}
+
+static int ensure_dir(const char *path) {
+    if (mkdir(path, 0755) < 0 && errno != EEXIST) {
+        fprintf(stderr, "[Output] Failed to create directory %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+// Resolve output paths for a job. base_name is the input filename without ".ts".
+// CMAF segments land in <output_dir>/hls/<camera>/ next to their init segment and
+// playlist.m3u8.
+// Outputs of non-default codec profiles are named after the profile, and get
+// their own playlist directory since their init segments differ.
+static int prepare_output_target(OutputTarget *t, OutputFormat format, int codec_profile,
+                                 const char *camera_id, const char *base_name) {
+    const CodecProfile *profile = &config.codec_profiles[codec_profile];
+    memset(t, 0, sizeof(*t));
+    t->format = format;
+
+    if (format == OUTPUT_FORMAT_TS) {
+        snprintf(t->name, sizeof(t->name), "%s_%s.ts", base_name,
+                 codec_profile == 0 ? codec_names[profile->codec] : profile->name);
+        snprintf(t->path, sizeof(t->path), "%s/%s", config.output_dir, t->name);
+        strncpy(t->mux_path, t->path, sizeof(t->mux_path) - 1);
+        if (config.s3_endpoint[0]) {
+            t->s3 = 1;
+            snprintf(t->s3_key, sizeof(t->s3_key), "%s%s", config.s3_prefix, t->name);
+        }
+        return 0;
+    }
+
+    char slug[256];
+    char hls_root[512];
+    const char *leaf = strrchr(base_name, '/');
+    leaf = leaf ? leaf + 1 : base_name;
+
+    if (codec_profile == 0) {
+        strncpy(t->camera_id, camera_id, sizeof(t->camera_id) - 1);
+    } else {
+        snprintf(t->camera_id, sizeof(t->camera_id), "%s_%s", camera_id, profile->name);
+    }
+    camera_slug(t->camera_id, slug, sizeof(slug));
+    snprintf(hls_root, sizeof(hls_root), "%s/%s", config.output_dir, HLS_DIR);
+    snprintf(t->camera_dir, sizeof(t->camera_dir), "%s/%s", hls_root, slug);
+    if (ensure_dir(hls_root) < 0 || ensure_dir(t->camera_dir) < 0) {
+        return -1;
+    }
+
+    snprintf(t->name, sizeof(t->name), "%s/%s/%s.m4s", HLS_DIR, slug, leaf);
+    snprintf(t->path, sizeof(t->path), "%s/%s.m4s", t->camera_dir, leaf);
+    // Scratch playlist/init written by the hls muxer; publish_cmaf_segment()
+    // folds them into the shared per-camera files
+    snprintf(t->mux_path, sizeof(t->mux_path), "%s/.%s.m3u8", t->camera_dir, leaf);
+    snprintf(t->init_name, sizeof(t->init_name), ".%s_init.mp4", leaf);
+    return 0;
+}
+
+// Append an entry, sliding the window once it is full. Discontinuities that
+// leave the window are counted in discontinuity_sequence (RFC 8216 6.2.2).
+static void hls_playlist_append(HlsPlaylist *pl, const char *uri, const char *map,
+                                int discontinuity, double duration) {
+    if (pl->nb_entries == HLS_PLAYLIST_WINDOW) {
+        if (pl->entries[0].discontinuity) pl->discontinuity_sequence++;
+        memmove(&pl->entries[0], &pl->entries[1], sizeof(pl->entries[0]) * (HLS_PLAYLIST_WINDOW - 1));
+        pl->nb_entries--;
+        pl->media_sequence++;
+    }
+    memset(&pl->entries[pl->nb_entries], 0, sizeof(pl->entries[0]));
+    strncpy(pl->entries[pl->nb_entries].uri, uri, sizeof(pl->entries[0].uri) - 1);
+    strncpy(pl->entries[pl->nb_entries].map, map, sizeof(pl->entries[0].map) - 1);
+    pl->entries[pl->nb_entries].discontinuity = discontinuity;
+    pl->entries[pl->nb_entries].duration = duration;
+    pl->nb_entries++;
+}
+
+// Reload a playlist left by a previous run so sequence numbers keep increasing
+static void hls_playlist_restore(HlsPlaylist *pl) {
+    char path[600];
+    char line[600];
+    char map[64] = "init.mp4";  // Playlists from before init segments were hashed
+    int pending_discontinuity = 0;
+    double pending_duration = -1;
+
+    snprintf(path, sizeof(path), "%s/playlist.m3u8", pl->camera_dir);
+    FILE *f = fopen(path, "r");
+    if (!f) return;
+
+    while (fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (strncmp(line, "#EXT-X-MEDIA-SEQUENCE:", 22) == 0) {
+            pl->media_sequence = atol(line + 22);
+        } else if (strncmp(line, "#EXT-X-DISCONTINUITY-SEQUENCE:", 30) == 0) {
+            pl->discontinuity_sequence = atol(line + 30);
+        } else if (strcmp(line, "#EXT-X-DISCONTINUITY") == 0) {
+            pending_discontinuity = 1;
+        } else if (strncmp(line, "#EXT-X-MAP:URI=\"", 16) == 0) {
+            snprintf(map, sizeof(map), "%.*s", (int)strcspn(line + 16, "\""), line + 16);
+        } else if (strncmp(line, "#EXTINF:", 8) == 0) {
+            pending_duration = atof(line + 8);
+        } else if (line[0] != '\0' && line[0] != '#' && pending_duration >= 0) {
+            hls_playlist_append(pl, line, map, pending_discontinuity, pending_duration);
+            pending_discontinuity = 0;
+            pending_duration = -1;
+        }
+    }
+    fclose(f);
+}
+
+// Rewrite playlist.m3u8 atomically (tmp + rename) so players never read a partial file
+static int hls_playlist_write(const HlsPlaylist *pl) {
+    char path[600];
+    char tmp_path[600];
+    double max_duration = 0;
+
+    for (int i = 0; i < pl->nb_entries; i++) {
+        if (pl->entries[i].duration > max_duration) max_duration = pl->entries[i].duration;
+    }
+
+    snprintf(path, sizeof(path), "%s/playlist.m3u8", pl->camera_dir);
+    snprintf(tmp_path, sizeof(tmp_path), "%s/.playlist.m3u8.tmp", pl->camera_dir);
+
+    FILE *f = fopen(tmp_path, "w");
+    if (!f) {
+        fprintf(stderr, "[HLS] Failed to write playlist: %s\n", tmp_path);
+        return -1;
+    }
+
+    fprintf(f, "#EXTM3U\n");
+    fprintf(f, "#EXT-X-VERSION:7\n");
+    fprintf(f, "#EXT-X-TARGETDURATION:%d\n", (int)(max_duration + 0.999));
+    fprintf(f, "#EXT-X-MEDIA-SEQUENCE:%ld\n", pl->media_sequence);
+    fprintf(f, "#EXT-X-DISCONTINUITY-SEQUENCE:%ld\n", pl->discontinuity_sequence);
+    fprintf(f, "#EXT-X-INDEPENDENT-SEGMENTS\n");
+    for (int i = 0; i < pl->nb_entries; i++) {
+        // Each job's segment starts its timestamps over, so every entry is a
+        // discontinuity; the map only needs repeating when the init segment
+        // changed
+        if (pl->entries[i].discontinuity) {
+            fprintf(f, "#EXT-X-DISCONTINUITY\n");
+        }
+        if (i == 0 || strcmp(pl->entries[i].map, pl->entries[i - 1].map) != 0) {
+            fprintf(f, "#EXT-X-MAP:URI=\"%s\"\n", pl->entries[i].map);
+        }
+        fprintf(f, "#EXTINF:%.3f,\n%s\n", pl->entries[i].duration, pl->entries[i].uri);
+    }
+
+    if (fclose(f) != 0 || rename(tmp_path, path) < 0) {
+        fprintf(stderr, "[HLS] Failed to publish playlist: %s\n", path);
+        unlink(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+// Content hash of an init segment (FNV-1a), used to name the published copy
+static int hls_init_hash(const char *path, uint64_t *hash) {
+    unsigned char buf[4096];
+    size_t n;
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+
+    *hash = 0xcbf29ce484222325ULL;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            *hash = (*hash ^ buf[i]) * 0x100000001b3ULL;
+        }
+    }
+    int err = ferror(f);
+    fclose(f);
+    return err ? -1 : 0;
+}
+
+// Make a finished CMAF segment visible: install its init segment under a
+// name keyed by its content and append it to the camera playlist. Sets
+// t->map_name.
+int publish_cmaf_segment(OutputTarget *t, double duration) {
+    char init_src[800];
+    char init_dst[800];
+    uint64_t hash;
+
+    // Playlists are per camera across all workers: a worker process leaves
+    // the segment to the supervisor, which owns them
+    if (worker_process_job) {
+        worker_process_job->publish_duration = duration;
+        return 0;
+    }
+
+    snprintf(init_src, sizeof(init_src), "%s/%s", t->camera_dir, t->init_name);
+    unlink(t->mux_path);
+    if (hls_init_hash(init_src, &hash) < 0) {
+        fprintf(stderr, "[HLS] Failed to read init segment %s: %s\n", init_src, strerror(errno));
+        return -1;
+    }
+    snprintf(t->map_name, sizeof(t->map_name), "init_%016llx.mp4", (unsigned long long)hash);
+    snprintf(init_dst, sizeof(init_dst), "%s/%s", t->camera_dir, t->map_name);
+
+    const char *uri = strrchr(t->path, '/');
+    uri = uri ? uri + 1 : t->path;
+
+    pthread_mutex_lock(&hls_mutex);
+
+    // Jobs with the same encoder parameters produce the same init segment and
+    // share one file; a changed one (new encoder, resolution, extradata) gets
+    // a new name, so segments still in the window keep theirs
+    if (access(init_dst, F_OK) == 0) {
+        unlink(init_src);
+    } else if (rename(init_src, init_dst) < 0) {
+        fprintf(stderr, "[HLS] Failed to install init segment %s: %s\n", init_src, strerror(errno));
+        pthread_mutex_unlock(&hls_mutex);
+        return -1;
+    }
+
+    HlsPlaylist *pl = hls_playlists;
+    while (pl && strcmp(pl->camera_dir, t->camera_dir) != 0) {
+        pl = pl->next;
+    }
+    if (!pl) {
+        pl = calloc(1, sizeof(HlsPlaylist));
+        if (!pl) {
+            pthread_mutex_unlock(&hls_mutex);
+            return -1;
+        }
+        strncpy(pl->camera_dir, t->camera_dir, sizeof(pl->camera_dir) - 1);
+        hls_playlist_restore(pl);
+        pl->next = hls_playlists;
+        hls_playlists = pl;
+    }
+
+    hls_playlist_append(pl, uri, t->map_name, 1, duration);
+    int ret = hls_playlist_write(pl);
+
+    pthread_mutex_unlock(&hls_mutex);
+    return ret;
+}
+
+// Callback fields describing where a job's output was published
+static cJSON *output_target_json(const OutputTarget *t) {
+    cJSON *extra = cJSON_CreateObject();
+
+    if (t->format == OUTPUT_FORMAT_CMAF) {
+        char slug[256];
+        char rel[600];
+        camera_slug(t->camera_id, slug, sizeof(slug));
+
+        cJSON_AddStringToObject(extra, "outputFormat", "cmaf");
+        snprintf(rel, sizeof(rel), "%s/%s/playlist.m3u8", HLS_DIR, slug);
+        cJSON_AddStringToObject(extra, "playlist", rel);
+        snprintf(rel, sizeof(rel), "%s/%s/%s", HLS_DIR, slug,
+                 t->map_name[0] ? t->map_name : "init.mp4");
+        cJSON_AddStringToObject(extra, "initSegment", rel);
+    } else {
+        cJSON_AddStringToObject(extra, "outputFormat", "ts");
+    }
+    if (t->s3) {
+        cJSON_AddStringToObject(extra, "storage", "s3");
+        cJSON_AddStringToObject(extra, "bucket", config.s3_bucket);
+        cJSON_AddStringToObject(extra, "key", t->s3_key);
+    }
+    return extra;
+}
+
+// Callback/config view of a time-lapse rendition
+static cJSON *timelapse_json(const TimelapseSpec *t) {
+    cJSON *json = cJSON_CreateObject();
+    cJSON_AddNumberToObject(json, "fps", t->fps);
+    cJSON_AddBoolToObject(json, "keyframesOnly", t->keyframes_only);
+    cJSON_AddNumberToObject(json, "width", t->width ? t->width : config.out_width);
+    cJSON_AddNumberToObject(json, "height", t->height ? t->height : config.out_height);
+    return json;
+}
+
+// "ts" / "cmaf" (or "hls") -> OutputFormat; -1 if unknown
+int parse_output_format(const char *name) {
+    if (strcmp(name, "ts") == 0 || strcmp(name, "mpegts") == 0) return OUTPUT_FORMAT_TS;
+    if (strcmp(name, "cmaf") == 0 || strcmp(name, "hls") == 0) return OUTPUT_FORMAT_CMAF;
+    return -1;
+}
+
+// ============================================================================
+// S3 Output Sink (multipart upload behind the muxer's AVIOContext)
+// ============================================================================
+
+// Answer to one S3 request: status, the start of the body, the ETag header
+typedef struct {
+    long status;
+    char body[2048];
+    size_t body_len;
+    char etag[72];
+} S3Response;
+
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    size_t pos;
+} S3Body;
+
+static size_t s3_read_body(char *ptr, size_t size, size_t nmemb, void *userp) {
+    S3Body *b = userp;
+    size_t n = size * nmemb;
+
+    if (n > b->size - b->pos) n = b->size - b->pos;
+    memcpy(ptr, b->data + b->pos, n);
+    b->pos += n;
+    return n;
+}
+
+static size_t s3_collect_body(void *contents, size_t size, size_t nmemb, void *userp) {
+    S3Response *r = userp;
+    size_t n = size * nmemb;
+    size_t room = sizeof(r->body) - 1 - r->body_len;
+    size_t copy = n < room ? n : room;
+
+    memcpy(r->body + r->body_len, contents, copy);
+    r->body_len += copy;
+    r->body[r->body_len] = '\0';
+    return n;
+}
+
+static size_t s3_collect_header(char *buffer, size_t size, size_t nitems, void *userp) {
+    S3Response *r = userp;
+    size_t n = size * nitems;
+    char line[256];
+
+    if (n > 5 && n < sizeof(line) && strncasecmp(buffer, "ETag:", 5) == 0) {
+        memcpy(line, buffer, n);
+        line[n] = '\0';
+        line[strcspn(line, "\r\n")] = '\0';
+        const char *value = line + 5;
+        while (*value == ' ') value++;
+        snprintf(r->etag, sizeof(r->etag), "%s", value);
+    }
+    return n;
+}
+
+// Text between <tag> and </tag> in an XML answer ("" if absent)
+static void s3_xml_value(const char *xml, const char *tag, char *out, size_t size) {
+    char open_tag[64];
+    snprintf(open_tag, sizeof(open_tag), "<%s>", tag);
+    out[0] = '\0';
+
+    const char *start = strstr(xml, open_tag);
+    if (!start) return;
+    start += strlen(open_tag);
+    const char *end = strchr(start, '<');
+    size_t len = end ? (size_t)(end - start) : strlen(start);
+    if (len >= size) len = size - 1;
+    memcpy(out, start, len);
+    out[len] = '\0';
+}
+
+// Percent-encode an object key (keep_slash) or a query value
+static void s3_escape(const char *in, int keep_slash, char *out, size_t size) {
+    static const char hex[] = "0123456789ABCDEF";
+    size_t n = 0;
+
+    for (const unsigned char *p = (const unsigned char *)in; *p && n + 4 < size; p++) {
+        if (isalnum(*p) || strchr("-_.~", *p) || (keep_slash && *p == '/')) {
+            out[n++] = *p;
+        } else {
+            out[n++] = '%';
+            out[n++] = hex[*p >> 4];
+            out[n++] = hex[*p & 15];
+        }
+    }
+    out[n] = '\0';
+}
+
+// One path-style request against the configured bucket, signed (SigV4) by
+// curl. PUT uploads body, POST sends it as the request body, anything else
+// goes without one. Returns 0 on a 2xx answer without an embedded <Error>
+// (S3 may report a failed CompleteMultipartUpload with 200), else -1 with
+// err describing it.
+static int s3_request(CURL *curl, const char *method, const char *key, const char *query,
+                      const uint8_t *body, size_t size, S3Response *resp, char *err, size_t err_size) {
+    char escaped[2400];
+    char url[3072];
+    char sigv4[128];
+    char userpwd[260];
+    S3Body upload = { body, size, 0 };
+    struct timespec start, end;
+
+    s3_escape(key, 1, escaped, sizeof(escaped));
+    snprintf(url, sizeof(url), "%s/%s/%s%s%s", config.s3_endpoint, config.s3_bucket, escaped,
+             query[0] ? "?" : "", query);
+    snprintf(sigv4, sizeof(sigv4), "aws:amz:%s:s3", config.s3_region);
+    snprintf(userpwd, sizeof(userpwd), "%s:%s", config.s3_access_key, config.s3_secret_key);
+    memset(resp, 0, sizeof(*resp));
+
+    curl_easy_reset(curl);
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_AWS_SIGV4, sigv4);
+    curl_easy_setopt(curl, CURLOPT_USERPWD, userpwd);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
+    // No overall timeout for multi-MB parts; a stalled transfer is cut instead
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1024L);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 30L);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, s3_collect_body);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, resp);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, s3_collect_header);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, resp);
+
+    struct curl_slist *headers = curl_slist_append(NULL, "x-amz-content-sha256: UNSIGNED-PAYLOAD");
+    if (strcmp(method, "PUT") == 0) {
+        curl_easy_setopt(curl, CURLOPT_UPLOAD, 1L);
+        curl_easy_setopt(curl, CURLOPT_READFUNCTION, s3_read_body);
+        curl_easy_setopt(curl, CURLOPT_READDATA, &upload);
+        curl_easy_setopt(curl, CURLOPT_INFILESIZE_LARGE, (curl_off_t)size);
+    } else if (strcmp(method, "POST") == 0) {
+        headers = curl_slist_append(headers, "Content-Type: application/xml");
+        curl_easy_setopt(curl, CURLOPT_POST, 1L);
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body ? (const char *)body : "");
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long)size);
+    } else {
+        curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, method);
+    }
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    CURLcode res = curl_easy_perform(curl);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &resp->status);
+    curl_slist_free_all(headers);
+
+    pthread_mutex_lock(&stats_mutex);
+    s3_request_seconds += (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    pthread_mutex_unlock(&stats_mutex);
+
+    if (res != CURLE_OK) {
+        snprintf(err, err_size, "%s: %s", method, curl_easy_strerror(res));
+        return -1;
+    }
+    if (resp->status < 200 || resp->status >= 300 || strstr(resp->body, "<Error>")) {
+        char code[64];
+        s3_xml_value(resp->body, "Code", code, sizeof(code));
+        snprintf(err, err_size, "%s: HTTP %ld%s%s", method, resp->status, code[0] ? " " : "", code);
+        return -1;
+    }
+    return 0;
+}
+
+// s3_request() with retries for what a retry can fix: transport errors,
+// throttling and server-side failures
+static int s3_request_retry(CURL *curl, const char *method, const char *key, const char *query,
+                            const uint8_t *body, size_t size, S3Response *resp, char *err, size_t err_size) {
+    for (int attempt = 0;; attempt++) {
+        if (s3_request(curl, method, key, query, body, size, resp, err, err_size) == 0) {
+            return 0;
+        }
+        int retryable = resp->status == 0 || resp->status == 429 || resp->status >= 500;
+        if (!retryable || attempt + 1 == S3_PART_ATTEMPTS) {
+            return -1;
+        }
+        usleep(200000 << attempt);
+    }
+}
+
+// Store a small object in one PUT (segment index sidecars)
+int s3_put_object(const char *key, const void *data, size_t size, char *err, size_t err_size) {
+    CURL *curl = curl_easy_init();
+    S3Response resp;
+
+    if (!curl) {
+        snprintf(err, err_size, "curl init failed");
+        return -1;
+    }
+    int ret = s3_request_retry(curl, "PUT", key, "", data, size, &resp, err, err_size);
+    curl_easy_cleanup(curl);
+    return ret;
+}
+
+// Upload one part of the sink's output: the whole object if it is the only
+// one, otherwise part_number of the multipart upload (started on demand)
+static int s3_sink_send(S3Sink *s, CURL *curl, int part_number, int single,
+                        const uint8_t *data, size_t size, char *etag, char *err, size_t err_size) {
+    S3Response resp;
+    char query[400];
+    char upload_id[300];
+
+    if (single) {
+        return s3_request_retry(curl, "PUT", s->key, "", data, size, &resp, err, err_size);
+    }
+    if (!s->upload_id[0]) {
+        if (s3_request_retry(curl, "POST", s->key, "uploads=", NULL, 0, &resp, err, err_size) < 0) {
+            return -1;
+        }
+        s3_xml_value(resp.body, "UploadId", s->upload_id, sizeof(s->upload_id));
+        if (!s->upload_id[0]) {
+            snprintf(err, err_size, "no UploadId in CreateMultipartUpload answer");
+            return -1;
+        }
+    }
+    s3_escape(s->upload_id, 0, upload_id, sizeof(upload_id));
+    snprintf(query, sizeof(query), "partNumber=%d&uploadId=%s", part_number, upload_id);
+    if (s3_request_retry(curl, "PUT", s->key, query, data, size, &resp, err, err_size) < 0) {
+        return -1;
+    }
+    snprintf(etag, 72, "%s", resp.etag);
+    return 0;
+}
+
+// Open an unlinked spool file for the rest of the output. Called with the
+// sink locked once every part buffer waits on the endpoint.
+static int s3_sink_start_spool(S3Sink *s) {
+    char path[600];
+
+    snprintf(path, sizeof(path), "%s/.s3spool.XXXXXX",
+             config.s3_spool_dir[0] ? config.s3_spool_dir : config.output_dir);
+    s->spool_fd = mkstemp(path);
+    if (s->spool_fd < 0) {
+        snprintf(s->error, sizeof(s->error), "spool file: %s", strerror(errno));
+        s->failed = 1;
+        return -1;
+    }
+    unlink(path);  // Goes away with the descriptor, even after a crash
+
+    pthread_mutex_lock(&stats_mutex);
+    s3_spool_fallbacks++;
+    pthread_mutex_unlock(&stats_mutex);
+    fprintf(stderr, "[S3] Endpoint behind on %s, spooling the rest to disk\n", s->key);
+    return 0;
+}
+
+// Uploader: sends parts in order until the sink is closed and drained (or
+// an upload failed). Memory parts go first; in spool mode the muxer only
+// appends to the file, so the ring's buffers are free to read it back into.
+static void *s3_uploader_thread(void *arg) {
+    S3Sink *s = arg;
+    CURL *curl = curl_easy_init();
+
+    pthread_mutex_lock(&s->mutex);
+    if (!curl) {
+        snprintf(s->error, sizeof(s->error), "curl init failed");
+        s->failed = 1;
+    }
+    for (;;) {
+        uint8_t *data = NULL;
+        size_t size = 0;
+        int64_t spool_offset = -1;
+        while (!s->failed) {
+            if (s->ready > 0) {
+                data = s->buffers[s->head];
+                size = s->fill[s->head];
+                break;
+            }
+            int64_t avail = s->spool_written - s->spool_read;
+            if (s->spool_fd >= 0 && (avail >= (int64_t)s->part_size || (s->closed && avail > 0))) {
+                data = s->buffers[s->head];
+                size = avail < (int64_t)s->part_size ? (size_t)avail : s->part_size;
+                spool_offset = s->spool_read;
+                break;
+            }
+            if (s->closed) break;
+            pthread_cond_wait(&s->cond, &s->mutex);
+        }
+        if (!data) break;
+
+        // The whole output in one buffer: a plain PUT, no multipart round trips
+        int last = s->closed && (spool_offset >= 0 ? s->spool_written - s->spool_read == (int64_t)size
+                                                   : s->ready == 1 && s->spool_written == 0);
+        int single = last && s->nb_parts == 0;
+        int part_number = s->nb_parts + 1;
+        pthread_mutex_unlock(&s->mutex);
+
+        char etag[72] = "";
+        char err[160] = "";
+        int ret = 0;
+        if (spool_offset >= 0 && pread(s->spool_fd, data, size, spool_offset) != (ssize_t)size) {
+            snprintf(err, sizeof(err), "spool read: %s", strerror(errno));
+            ret = -1;
+        }
+        if (ret == 0 && part_number > S3_MAX_PARTS) {
+            // Multipart uploads stop at 10000 parts: the output outgrew partMb
+            snprintf(err, sizeof(err), "output exceeds %d parts of %d MB (raise s3 partMb)",
+                     S3_MAX_PARTS, config.s3_part_mb);
+            ret = -1;
+        }
+        if (ret == 0) {
+            ret = s3_sink_send(s, curl, part_number, single, data, size, etag, err, sizeof(err));
+        }
+
+        pthread_mutex_lock(&s->mutex);
+        if (ret < 0) {
+            snprintf(s->error, sizeof(s->error), "part %d: %s", part_number, err);
+            s->failed = 1;
+            break;
+        }
+        if (s->nb_parts % 64 == 0) {
+            char (*etags)[72] = realloc(s->etags, (s->nb_parts + 64) * sizeof(*etags));
+            if (!etags) {
+                snprintf(s->error, sizeof(s->error), "out of memory");
+                s->failed = 1;
+                break;
+            }
+            s->etags = etags;
+        }
+        snprintf(s->etags[s->nb_parts], sizeof(s->etags[0]), "%s", etag);
+        s->nb_parts++;
+        if (spool_offset >= 0) {
+            s->spool_read += size;
+        } else {
+            s->fill[s->head] = 0;
+            s->head = (s->head + 1) % s->nb_buffers;
+            s->ready--;
+        }
+
+        pthread_mutex_lock(&stats_mutex);
+        s3_parts_uploaded++;
+        s3_bytes_uploaded += size;
+        pthread_mutex_unlock(&stats_mutex);
+    }
+    pthread_mutex_unlock(&s->mutex);
+    if (curl) curl_easy_cleanup(curl);
+    return NULL;
+}
+
+S3Sink *s3_sink_open(const char *key) {
+    S3Sink *s = calloc(1, sizeof(S3Sink));
+    if (!s) return NULL;
+
+    pthread_mutex_init(&s->mutex, NULL);
+    pthread_cond_init(&s->cond, NULL);
+    snprintf(s->key, sizeof(s->key), "%s", key);
+    s->part_size = (size_t)config.s3_part_mb << 20;
+    s->nb_buffers = config.s3_buffer_parts;
+    s->spool_fd = -1;
+    if (pthread_create(&s->thread, NULL, s3_uploader_thread, s) != 0) {
+        pthread_cond_destroy(&s->cond);
+        pthread_mutex_destroy(&s->mutex);
+        free(s);
+        return NULL;
+    }
+    return s;
+}
+
+// AVIOContext write callback: fill the part ring, spool once it is full.
+// Never waits on the network, so the encoder keeps its pace.
+static int s3_sink_write(void *opaque, AVIO_WRITE_BUF *buf, int size) {
+    S3Sink *s = opaque;
+    const uint8_t *p = buf;
+    size_t left = size;
+
+    pthread_mutex_lock(&s->mutex);
+    while (left > 0 && s->spool_fd < 0 && !s->failed) {
+        if (s->ready == s->nb_buffers) {
+            s3_sink_start_spool(s);
+            break;
+        }
+        int slot = (s->head + s->ready) % s->nb_buffers;
+        if (!s->buffers[slot] && !(s->buffers[slot] = malloc(s->part_size))) {
+            snprintf(s->error, sizeof(s->error), "out of memory");
+            s->failed = 1;
+            break;
+        }
+        size_t n = s->part_size - s->fill[slot];
+        if (n > left) n = left;
+        memcpy(s->buffers[slot] + s->fill[slot], p, n);
+        s->fill[slot] += n;
+        p += n;
+        left -= n;
+        if (s->fill[slot] == s->part_size) {
+            s->ready++;
+            pthread_cond_signal(&s->cond);
+        }
+    }
+    s->bytes += size - left;
+    int failed = s->failed;
+    int spool_fd = s->spool_fd;
+    pthread_mutex_unlock(&s->mutex);
+    if (failed) {
+        return AVERROR(EIO);
+    }
+    if (left == 0) {
+        return size;
+    }
+
+    // Only this thread appends; the uploader reads below spool_written
+    size_t spooled = 0;
+    while (spooled < left) {
+        ssize_t n = write(spool_fd, p + spooled, left - spooled);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        spooled += n;
+    }
+
+    pthread_mutex_lock(&s->mutex);
+    s->bytes += spooled;
+    s->spool_written += spooled;
+    s->spooled += spooled;
+    if (spooled < left) {
+        snprintf(s->error, sizeof(s->error), "spool write: %s", strerror(errno));
+        s->failed = 1;
+    }
+    pthread_cond_signal(&s->cond);
+    pthread_mutex_unlock(&s->mutex);
+
+    pthread_mutex_lock(&stats_mutex);
+    s3_bytes_spooled += spooled;
+    pthread_mutex_unlock(&stats_mutex);
+    return spooled < left ? AVERROR(EIO) : size;
+}
+
+// Close the sink after the muxer's last write. With commit the upload is
+// completed and the object size returned (-1 and err on failure); without,
+// or on failure, a started multipart upload is aborted so no parts linger.
+int64_t s3_sink_finish(S3Sink *s, int commit, char *err, size_t err_size) {
+    pthread_mutex_lock(&s->mutex);
+    int slot = (s->head + s->ready) % s->nb_buffers;
+    if (s->spool_fd < 0 && s->ready < s->nb_buffers && s->fill[slot] > 0) {
+        s->ready++;  // The partial last part
+    }
+    s->closed = 1;
+    if (!commit && !s->failed) {
+        snprintf(s->error, sizeof(s->error), "aborted");
+        s->failed = 1;
+    }
+    pthread_cond_signal(&s->cond);
+    pthread_mutex_unlock(&s->mutex);
+    pthread_join(s->thread, NULL);
+
+    // The uploader has exited: the sink is ours alone from here
+    CURL *curl = curl_easy_init();
+    S3Response resp;
+    int64_t result = -1;
+    snprintf(err, err_size, "%s", s->failed ? s->error : "curl init failed");
+
+    if (!s->failed && curl) {
+        if (s->upload_id[0]) {
+            size_t xml_size = 64 + (size_t)s->nb_parts * 128;
+            char *xml = malloc(xml_size);
+            char upload_id[300];
+            char query[320];
+            if (xml) {
+                size_t len = snprintf(xml, xml_size, "<CompleteMultipartUpload>");
+                for (int i = 0; i < s->nb_parts; i++) {
+                    len += snprintf(xml + len, xml_size - len,
+                                    "<Part><PartNumber>%d</PartNumber><ETag>%s</ETag></Part>",
+                                    i + 1, s->etags[i]);
+                }
+                len += snprintf(xml + len, xml_size - len, "</CompleteMultipartUpload>");
+                s3_escape(s->upload_id, 0, upload_id, sizeof(upload_id));
+                snprintf(query, sizeof(query), "uploadId=%s", upload_id);
+                if (s3_request_retry(curl, "POST", s->key, query, (const uint8_t *)xml, len,
+                                     &resp, err, err_size) == 0) {
+                    result = s->bytes;
+                }
+                free(xml);
+            } else {
+                snprintf(err, err_size, "out of memory");
+            }
+        } else if (s->nb_parts == 0) {
+            // Nothing was muxed: still leave an (empty) object behind
+            if (s3_request_retry(curl, "PUT", s->key, "", NULL, 0, &resp, err, err_size) == 0) {
+                result = 0;
+            }
+        } else {
+            result = s->bytes;  // Sent whole by the uploader
+        }
+    }
+    if (result < 0 && s->upload_id[0] && curl) {
+        char upload_id[300];
+        char query[320];
+        char abort_err[160];
+        s3_escape(s->upload_id, 0, upload_id, sizeof(upload_id));
+        snprintf(query, sizeof(query), "uploadId=%s", upload_id);
+        s3_request(curl, "DELETE", s->key, query, NULL, 0, &resp, abort_err, sizeof(abort_err));
+    }
+    if (curl) curl_easy_cleanup(curl);
+
+    if (result < 0 && commit) {
+        fprintf(stderr, "[S3] Upload of %s failed: %s\n", s->key, err);
+    } else if (result >= 0 && s->spooled > 0) {
+        fprintf(stderr, "[S3] %s: %lld of %lld bytes went through the spool\n",
+                s->key, (long long)s->spooled, (long long)s->bytes);
+    }
+    pthread_mutex_lock(&stats_mutex);
+    s3_uploads[result >= 0 ? 0 : commit ? 1 : 2]++;
+    pthread_mutex_unlock(&stats_mutex);
+
+    for (int i = 0; i < s->nb_buffers; i++) {
+        free(s->buffers[i]);
+    }
+    free(s->etags);
+    if (s->spool_fd >= 0) close(s->spool_fd);
+    pthread_cond_destroy(&s->cond);
+    pthread_mutex_destroy(&s->mutex);
+    free(s);
+    return result;
+}
+
+// Point the muxer at an S3 sink instead of a file
+static int s3_output_open(TranscodeContext *ctx, const OutputTarget *target) {
+    uint8_t *buffer = av_malloc(S3_AVIO_BUFFER_SIZE);
+    S3Sink *sink = buffer ? s3_sink_open(target->s3_key) : NULL;
+    char err[160];
+
+    if (!sink) {
+        av_free(buffer);
+        return -1;
+    }
+    ctx->output_ctx->pb = avio_alloc_context(buffer, S3_AVIO_BUFFER_SIZE, 1, sink,
+                                             NULL, s3_sink_write, NULL);
+    if (!ctx->output_ctx->pb) {
+        av_free(buffer);
+        s3_sink_finish(sink, 0, err, sizeof(err));
+        return -1;
+    }
+    ctx->s3_sink = sink;
+    return 0;
+}
+
+// Hand the muxer's last buffered bytes to the sink and complete (commit) or
+// abort the upload. The custom AVIOContext is freed here, so
+// cleanup_file_contexts() finds no pb to close.
+int64_t s3_output_close(TranscodeContext *ctx, int commit, char *err, size_t err_size) {
+    S3Sink *sink = ctx->s3_sink;
+    AVIOContext *pb = ctx->output_ctx ? ctx->output_ctx->pb : NULL;
+
+    if (pb) {
+        avio_flush(pb);
+        av_freep(&pb->buffer);
+        avio_context_free(&pb);
+        ctx->output_ctx->pb = NULL;
+    }
+    ctx->s3_sink = NULL;
+    return s3_sink_finish(sink, commit, err, err_size);
+}
+
+// ============================================================================
+// Stream Parameter Cache
+// ============================================================================
+
+// Every segment a camera records has the same PIDs, codecs and SPS, so the
+// layout found by avformat_find_stream_info on its first segment is reused
+// for the rest. A cached open is checked by comparing the first SPS in the
+// segment with the cached one; any difference falls back to a full probe.
+typedef struct {
+    char key[256];                  // camera_id, or the segment's directory
+    int nb_streams;
+    int stream_ids[PROBE_CACHE_MAX_STREAMS];    // MPEG-TS PIDs
+    AVCodecParameters *params[PROBE_CACHE_MAX_STREAMS];
+    AVRational time_bases[PROBE_CACHE_MAX_STREAMS];
+    int video_stream_idx;
+    uint8_t sps[PROBE_MAX_SPS];
+    int sps_len;
+    double probe_ms;                // EWMA of full probe cost for this camera
+    long long last_used_ms;
+} ProbeCacheEntry;
+
+typedef struct {
+    ProbeCacheEntry entries[MAX_PROBE_CACHE];
+    int count;
+    long hits;
+    long misses;                    // No entry for the camera yet
+    long mismatches;                // Layout or SPS changed, re-probed
+    double probe_ms_total;          // Spent in avformat_find_stream_info
+    double saved_ms_total;          // Probe cost skipped on hits
+    double validate_ms_total;       // SPS checks paid instead
+    pthread_mutex_t mutex;
+} ProbeCache;
+
+ProbeCache probe_cache = { .mutex = PTHREAD_MUTEX_INITIALIZER };
+
+static double monotonic_ms_fine(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// Locate the first SPS NAL in Annex B data (MPEG-TS carries H.264/HEVC this
+// way). Returns its length with trailing zero bytes trimmed, 0 if none.
+static int find_sps(enum AVCodecID codec_id, const uint8_t *data, int size, const uint8_t **sps) {
+    for (int i = 0; i + 3 < size; i++) {
+        if (data[i] != 0 || data[i + 1] != 0 || data[i + 2] != 1) {
+            continue;
+        }
+        int start = i + 3;
+        int type = codec_id == AV_CODEC_ID_HEVC ? (data[start] >> 1) & 0x3f : data[start] & 0x1f;
+        int is_sps = codec_id == AV_CODEC_ID_HEVC ? type == 33 : type == 7;
+        if (!is_sps) {
+            continue;
+        }
+
+        int end = start;
+        while (end + 2 < size && !(data[end] == 0 && data[end + 1] == 0 && data[end + 2] <= 1)) {
+            end++;
+        }
+        if (end + 2 >= size) {
+            end = size;
+        }
+        while (end > start && data[end - 1] == 0) {
+            end--;
+        }
+        *sps = data + start;
+        return end - start;
+    }
+    return 0;
+}
+
+static ProbeCacheEntry *probe_cache_find(ProbeCache *cache, const char *key) {
+    for (int i = 0; i < cache->count; i++) {
+        if (strcmp(cache->entries[i].key, key) == 0) {
+            return &cache->entries[i];
+        }
+    }
+    return NULL;
+}
+
+// Inject the cached layout into a freshly opened input. Fails (without
+// touching the input) when there is no entry or the demuxer found a
+// different set of streams. On success the expected SPS and probe cost are
+// copied out for validation.
+static int probe_cache_apply(ProbeCache *cache, const char *key, AVFormatContext *ic, int *video_idx,
+                             uint8_t *sps, int *sps_len, double *probe_ms) {
+    pthread_mutex_lock(&cache->mutex);
+    ProbeCacheEntry *e = probe_cache_find(cache, key);
+    if (!e) {
+        cache->misses++;
+        pthread_mutex_unlock(&cache->mutex);
+        return -1;
+    }
+
+    int match = (int)ic->nb_streams == e->nb_streams;
+    for (int i = 0; match && i < e->nb_streams; i++) {
+        match = ic->streams[i]->id == e->stream_ids[i] &&
+                ic->streams[i]->codecpar->codec_id == e->params[i]->codec_id;
+    }
+    if (!match) {
+        cache->mismatches++;
+        pthread_mutex_unlock(&cache->mutex);
+        return -1;
+    }
+
+    for (int i = 0; i < e->nb_streams; i++) {
+        avcodec_parameters_copy(ic->streams[i]->codecpar, e->params[i]);
+        ic->streams[i]->time_base = e->time_bases[i];
+    }
+    *video_idx = e->video_stream_idx;
+    memcpy(sps, e->sps, e->sps_len);
+    *sps_len = e->sps_len;
+    *probe_ms = e->probe_ms;
+    e->last_used_ms = monotonic_ms();
+    pthread_mutex_unlock(&cache->mutex);
+    return 0;
+}
+
+// Remember a fully probed layout, replacing the camera's old entry or the
+// least recently used one. Layouts without an SPS in the extradata cannot be
+// validated later and are not cached.
+static void probe_cache_store(ProbeCache *cache, const char *key, const AVFormatContext *ic,
+                              int video_idx, double probe_ms) {
+    const AVCodecParameters *video = ic->streams[video_idx]->codecpar;
+    const uint8_t *sps = NULL;
+    int sps_len = video->extradata ? find_sps(video->codec_id, video->extradata, video->extradata_size, &sps) : 0;
+    if (sps_len <= 0 || sps_len > PROBE_MAX_SPS || ic->nb_streams > PROBE_CACHE_MAX_STREAMS) {
+        return;
+    }
+
+    pthread_mutex_lock(&cache->mutex);
+    cache->probe_ms_total += probe_ms;
+
+    ProbeCacheEntry *e = probe_cache_find(cache, key);
+    double previous_ms = e ? e->probe_ms : 0;
+    if (!e && cache->count < MAX_PROBE_CACHE) {
+        e = &cache->entries[cache->count++];
+    } else if (!e) {
+        e = &cache->entries[0];
+        for (int i = 1; i < cache->count; i++) {
+            if (cache->entries[i].last_used_ms < e->last_used_ms) {
+                e = &cache->entries[i];
+            }
+        }
+    }
+    for (int i = 0; i < e->nb_streams; i++) {
+        avcodec_parameters_free(&e->params[i]);
+    }
+    memset(e, 0, sizeof(*e));
+    strncpy(e->key, key, sizeof(e->key) - 1);
+    e->nb_streams = ic->nb_streams;
+    for (int i = 0; i < e->nb_streams; i++) {
+        e->stream_ids[i] = ic->streams[i]->id;
+        e->time_bases[i] = ic->streams[i]->time_base;
+        e->params[i] = avcodec_parameters_alloc();
+        if (!e->params[i] || avcodec_parameters_copy(e->params[i], ic->streams[i]->codecpar) < 0) {
+            // Out of memory: drop the layout rather than cache half of it
+            for (int j = 0; j <= i; j++) {
+                avcodec_parameters_free(&e->params[j]);
+            }
+            memset(e, 0, sizeof(*e));
+            pthread_mutex_unlock(&cache->mutex);
+            return;
+        }
+    }
+    e->video_stream_idx = video_idx;
+    memcpy(e->sps, sps, sps_len);
+    e->sps_len = sps_len;
+    e->probe_ms = previous_ms > 0 ? 0.8 * previous_ms + 0.2 * probe_ms : probe_ms;
+    e->last_used_ms = monotonic_ms();
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+static void probe_cache_record_hit(ProbeCache *cache, double saved_ms, double validate_ms) {
+    pthread_mutex_lock(&cache->mutex);
+    cache->hits++;
+    cache->saved_ms_total += saved_ms;
+    cache->validate_ms_total += validate_ms;
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+static void probe_cache_record_mismatch(ProbeCache *cache) {
+    pthread_mutex_lock(&cache->mutex);
+    cache->mismatches++;
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+// ============================================================================
+// File Processing Pipeline
+// ============================================================================
+
+// Strip the ".ts" extension: "camera_001.ts" -> "camera_001"
+static void output_base_name(const char *input_filename, char *base_name, size_t size) {
+    strncpy(base_name, input_filename, size - 1);
+    base_name[size - 1] = '\0';
+    char *ext = strstr(base_name, ".ts");
+    if (ext) *ext = '\0';
+}
+
+// Transient I/O conditions (NFS hiccups, a file still being flushed, resource
+// pressure) are worth retrying; anything else from the demuxer/decoder means
+// the input itself is bad
+static FailureKind classify_averror(int err) {
+    switch (err) {
+    case AVERROR(EIO):
+    case AVERROR(EAGAIN):
+    case AVERROR(EBUSY):
+    case AVERROR(ETIMEDOUT):
+    case AVERROR(ESTALE):
+    case AVERROR(ENOENT):
+    case AVERROR(ENOMEM):
+    case AVERROR(ENOSPC):
+    case AVERROR(EINTR):
+        return FAILURE_TRANSIENT;
+    default:
+        return FAILURE_PERMANENT;
+    }
+}
+
+// Record why the current job failed (the first failure wins). Returns -1 so
+// callers can 'return fail_job(...)'.
+static int fail_job(TranscodeContext *ctx, FailureKind kind, int averror, const char *fmt, ...) {
+    if (ctx->failure != FAILURE_NONE) {
+        return -1;
+    }
+
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(ctx->failure_reason, sizeof(ctx->failure_reason), fmt, ap);
+    va_end(ap);
+
+    if (averror < 0) {
+        char errbuf[64];
+        av_strerror(averror, errbuf, sizeof(errbuf));
+        size_t len = strlen(ctx->failure_reason);
+        snprintf(ctx->failure_reason + len, sizeof(ctx->failure_reason) - len, ": %s", errbuf);
+    }
+    ctx->failure = kind;
+    return -1;
+}
+
+static int open_input_file(TranscodeContext *ctx, const char *input_path) {
+    AVDictionary *format_opts = NULL;
+    av_dict_set(&format_opts, "probesize", "1024", 0);
+    av_dict_set(&format_opts, "analyzeduration", "0", 0);
+    av_dict_set(&format_opts, "fflags", "+fastseek", 0);
+
+    int ret = avformat_open_input(&ctx->input_ctx, input_path, NULL, &format_opts);
+    av_dict_free(&format_opts);
+    if (ret < 0) {
+        fprintf(stderr, "[Worker %d] Failed to open input: %s\n", ctx->worker_id, input_path);
+        return fail_job(ctx, classify_averror(ret), ret, "open input");
+    }
+    return 0;
+}
+
+// Read up to the first SPS of the video stream and compare it with the
+// cached one, then rewind so decoding starts from the first packet.
+// Returns 0 when the segment matches the cached parameters.
+static int validate_cached_sps(TranscodeContext *ctx, const uint8_t *sps, int sps_len) {
+    AVPacket *packet = ctx->pool.packet;
+    enum AVCodecID codec_id = ctx->input_ctx->streams[ctx->video_stream_idx]->codecpar->codec_id;
+    int match = 0;
+
+    for (int n = 0; n < PROBE_VALIDATE_PACKETS && av_read_frame(ctx->input_ctx, packet) >= 0; n++) {
+        if (packet->stream_index != ctx->video_stream_idx) {
+            av_packet_unref(packet);
+            continue;
+        }
+        const uint8_t *found = NULL;
+        int found_len = find_sps(codec_id, packet->data, packet->size, &found);
+        av_packet_unref(packet);
+        if (found_len > 0) {
+            match = found_len == sps_len && memcmp(found, sps, sps_len) == 0;
+            break;
+        }
+    }
+
+    if (!match || av_seek_frame(ctx->input_ctx, -1, 0, AVSEEK_FLAG_BYTE) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// Open an input segment and locate its video stream. Segments from a camera
+// whose layout is cached skip avformat_find_stream_info; the rest (and any
+// segment whose SPS no longer matches) are probed and refresh the cache.
+static int open_input_segment(TranscodeContext *ctx, const char *input_path, const char *camera_id) {
+    char key[256];
+    if (camera_id && camera_id[0]) {
+        strncpy(key, camera_id, sizeof(key) - 1);
+        key[sizeof(key) - 1] = '\0';
+    } else {
+        camera_key_from_path(input_path, key, sizeof(key));
+    }
+
+    if (open_input_file(ctx, input_path) < 0) {
+        return -1;
+    }
+
+    if (config.probe_cache) {
+        uint8_t sps[PROBE_MAX_SPS];
+        int sps_len = 0;
+        double probe_ms = 0;
+        double start = monotonic_ms_fine();
+
+        if (probe_cache_apply(&probe_cache, key, ctx->input_ctx, &ctx->video_stream_idx,
+                              sps, &sps_len, &probe_ms) == 0) {
+            if (validate_cached_sps(ctx, sps, sps_len) == 0) {
+                double validate_ms = monotonic_ms_fine() - start;
+                probe_cache_record_hit(&probe_cache, probe_ms, validate_ms);
+                return 0;
+            }
+
+            // Camera reconfigured (resolution, profile, ...): probe from scratch
+            fprintf(stderr, "[Worker %d] Stream parameters changed for %s, re-probing\n",
+                    ctx->worker_id, key);
+            probe_cache_record_mismatch(&probe_cache);
+            avformat_close_input(&ctx->input_ctx);
+            if (open_input_file(ctx, input_path) < 0) {
+                return -1;
+            }
+        }
+    }
+
+    double probe_start = monotonic_ms_fine();
+    int ret = avformat_find_stream_info(ctx->input_ctx, NULL);
+    double probe_ms = monotonic_ms_fine() - probe_start;
+    if (ret < 0) {
+        fprintf(stderr, "[Worker %d] Failed to find stream info\n", ctx->worker_id);
+        return fail_job(ctx, classify_averror(ret), ret, "probe input");
+    }
+
+    // Find video stream
+    ctx->video_stream_idx = -1;
+    for (unsigned int i = 0; i < ctx->input_ctx->nb_streams; i++) {
+        if (ctx->input_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+            ctx->video_stream_idx = i;
+            break;
+        }
+    }
+
+    if (ctx->video_stream_idx == -1) {
+        fprintf(stderr, "[Worker %d] No video stream found\n", ctx->worker_id);
+        return fail_job(ctx, FAILURE_PERMANENT, 0, "no video stream");
+    }
+
+    if (config.probe_cache) {
+        probe_cache_store(&probe_cache, key, ctx->input_ctx, ctx->video_stream_idx, probe_ms);
+    }
+    return 0;
+}
+
+// Create the muxer (MPEG-TS, or hls in fMP4 mode for CMAF) and write its header
+static AVStream *open_output_file(TranscodeContext *ctx, const OutputTarget *target) {
+    const char *output_path = target->mux_path;
+    const char *muxer = target->format == OUTPUT_FORMAT_CMAF ? "hls" : "mpegts";
+
+    // Output-side failures (disk, NFS, memory) never indict the input, so
+    // they are all classified transient
+    avformat_alloc_output_context2(&ctx->output_ctx, NULL, muxer, output_path);
+    if (!ctx->output_ctx) {
+        fprintf(stderr, "[Worker %d] Failed to create output context\n", ctx->worker_id);
+        fail_job(ctx, FAILURE_TRANSIENT, 0, "create output context");
+        return NULL;
+    }
+
+    AVStream *out_stream = avformat_new_stream(ctx->output_ctx, NULL);
+    if (!out_stream) {
+        fprintf(stderr, "[Worker %d] Failed to create output stream\n", ctx->worker_id);
+        fail_job(ctx, FAILURE_TRANSIENT, 0, "create output stream");
+        return NULL;
+    }
+
+    if (avcodec_parameters_from_context(out_stream->codecpar, ctx->encoder_ctx) < 0) {
+        fprintf(stderr, "[Worker %d] Failed to copy encoder parameters\n", ctx->worker_id);
+        fail_job(ctx, FAILURE_TRANSIENT, 0, "copy encoder parameters");
+        return NULL;
+    }
+
+    out_stream->time_base = ctx->encoder_ctx->time_base;
+
+    if (target->s3) {
+        if (s3_output_open(ctx, target) < 0) {
+            fprintf(stderr, "[Worker %d] Failed to start upload: %s\n", ctx->worker_id, target->s3_key);
+            fail_job(ctx, FAILURE_TRANSIENT, 0, "start S3 upload");
+            return NULL;
+        }
+    } else if (!(ctx->output_ctx->oformat->flags & AVFMT_NOFILE)) {
+        int ret = avio_open(&ctx->output_ctx->pb, output_path, AVIO_FLAG_WRITE);
+        if (ret < 0) {
+            fprintf(stderr, "[Worker %d] Failed to open output file: %s\n", ctx->worker_id, output_path);
+            fail_job(ctx, FAILURE_TRANSIENT, ret, "open output");
+            return NULL;
+        }
+    }
+
+    AVDictionary *mux_opts = NULL;
+    if (target->format == OUTPUT_FORMAT_CMAF) {
+        av_dict_set(&mux_opts, "hls_segment_type", "fmp4", 0);
+        av_dict_set(&mux_opts, "hls_fmp4_init_filename", target->init_name, 0);
+        av_dict_set(&mux_opts, "hls_segment_filename", target->path, 0);
+        av_dict_set(&mux_opts, "hls_time", "86400", 0);  // One media segment per job
+        av_dict_set(&mux_opts, "hls_list_size", "0", 0);
+        av_dict_set(&mux_opts, "hls_flags", "independent_segments", 0);
+    }
+
+    int ret = avformat_write_header(ctx->output_ctx, &mux_opts);
+    av_dict_free(&mux_opts);
+    if (ret < 0) {
+        fprintf(stderr, "[Worker %d] Failed to write header\n", ctx->worker_id);
+        fail_job(ctx, FAILURE_TRANSIENT, ret, "write header");
+        return NULL;
+    }
+
+    // The muxer may have changed the stream time base (MPEG-TS: 90 kHz)
+    memset(&ctx->verify, 0, sizeof(ctx->verify));
+    ctx->verify.time_base = out_stream->time_base;
+    ctx->verify.adler32 = 1;
+    ctx->verify.ts_verdict = -1;
+    return out_stream;
+}
+
+// Account one packet about to be muxed (PTS in the output time base). The
+// muxer takes the packet's data, so this runs before it is written.
+static void verify_note_packet(OutputVerification *v, const AVPacket *pkt) {
+    if (pkt->pts != AV_NOPTS_VALUE) {
+        if (v->packets == 0 || pkt->pts < v->first_pts) v->first_pts = pkt->pts;
+        if (v->packets == 0 || pkt->pts > v->last_pts) v->last_pts = pkt->pts;
+    }
+    v->packets++;
+    if (pkt->flags & AV_PKT_FLAG_KEY) v->keyframes++;
+    v->payload_bytes += pkt->size;
+    v->adler32 = av_adler32_update(v->adler32, pkt->data, pkt->size);
+}
+
+// Finish the verification of a written output: its size and, for MPEG-TS,
+// a structure check of the file (fresh in the page cache, no decoding).
+// Every muxed packet must come back as one video PES. Outputs streamed to
+// S3 have their upload completed here instead and are not read back.
+// Returns -1 (job failed) if the output does not hold what was muxed into it.
+static int verify_output(TranscodeContext *ctx, const OutputTarget *target) {
+    OutputVerification *v = &ctx->verify;
+    struct stat st;
+
+    if (ctx->s3_sink) {
+        char err[160];
+        v->file_bytes = s3_output_close(ctx, 1, err, sizeof(err));
+        if (v->file_bytes < 0) {
+            return fail_job(ctx, FAILURE_TRANSIENT, 0, "upload %s: %s", target->s3_key, err);
+        }
+    } else {
+        v->file_bytes = stat(target->path, &st) == 0 ? st.st_size : -1;
+    }
+    if (target->format != OUTPUT_FORMAT_TS || target->s3 || !config.ts_check_outputs || v->packets == 0) {
+        pthread_mutex_lock(&stats_mutex);
+        output_verify_bytes += v->payload_bytes;
+        pthread_mutex_unlock(&stats_mutex);
+        return 0;
+    }
+
+    TsCheck check;
+    TsVerdict verdict = ts_check_file(target->path, &check);
+    v->ts_verdict = verdict;
+    v->ts_video_pes = check.video_pes;
+
+    pthread_mutex_lock(&stats_mutex);
+    ts_output_checks[verdict]++;
+    output_verify_bytes += v->payload_bytes;
+    pthread_mutex_unlock(&stats_mutex);
+
+    if (verdict == TS_OK && check.video_pes == v->packets) {
+        return 0;
+    }
+    // Never hand out a damaged output; the retry writes it afresh
+    unlink(target->path);
+    if (verdict != TS_OK) {
+        return fail_job(ctx, FAILURE_TRANSIENT, 0, "output failed TS check: %s%s%s",
+                        ts_verdict_names[verdict], check.detail[0] ? " - " : "", check.detail);
+    }
+    return fail_job(ctx, FAILURE_TRANSIENT, 0, "output holds %ld video PES, %d packets muxed",
+                    check.video_pes, v->packets);
+}
+
+// Mux one encoded packet. In consolidation mode the first keyframe at or after
+// a segment's start PTS marks that segment's byte offset in the output.
+static void mux_packet(TranscodeContext *ctx, AVStream *out_stream, AVPacket *enc_packet) {
+    enc_packet->stream_index = 0;
+    av_packet_rescale_ts(enc_packet, ctx->encoder_ctx->time_base, out_stream->time_base);
+
+    SegmentIndex *index = ctx->segment_index;
+    if (index && index->pending >= 0 && (enc_packet->flags & AV_PKT_FLAG_KEY) &&
+        enc_packet->pts >= index->entries[index->pending].pts_start) {
+        // The hls muxer owns its segment I/O, so CMAF groups index by PTS only
+        index->entries[index->pending].byte_offset =
+            ctx->output_ctx->pb ? avio_tell(ctx->output_ctx->pb) : -1;
+        index->pending = -1;
+    }
+
+    verify_note_packet(&ctx->verify, enc_packet);
+    av_interleaved_write_frame(ctx->output_ctx, enc_packet);
+}
+
+// Hand a filtered frame to the encoder, forcing an IDR on segment boundaries
+static int send_frame_to_encoder(TranscodeContext *ctx, AVFrame *filtered_frame) {
+    if (ctx->force_keyframe) {
+        filtered_frame->pict_type = AV_PICTURE_TYPE_I;
+        ctx->force_keyframe = 0;
+    } else {
+        filtered_frame->pict_type = AV_PICTURE_TYPE_NONE;
+    }
+    ctx->encoders_fed |= 1u << ctx->encoder_slot;
+    return avcodec_send_frame(ctx->encoder_ctx, filtered_frame);
+}
+
+// Send one filtered frame to the encoder (NULL flushes it) and mux every
+// packet it has ready. The only encode/write path: the frame loop and all
+// flushes go through here, reusing the worker's pooled packet.
+static void encode_and_drain(TranscodeContext *ctx, AVStream *out_stream, AVFrame *frame) {
+    AVPacket *enc_packet = ctx->pool.enc_packet;
+
+    int ret = frame ? send_frame_to_encoder(ctx, frame) : avcodec_send_frame(ctx->encoder_ctx, NULL);
+    if (ret < 0 && ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
+        fail_job(ctx, FAILURE_DEVICE, ret, "encode");
+    }
+    while (avcodec_receive_packet(ctx->encoder_ctx, enc_packet) == 0) {
+        mux_packet(ctx, out_stream, enc_packet);
+        av_packet_unref(enc_packet);
+    }
+}
+
+// Encode every frame the filter has ready, numbering them from *frame_count
+static void drain_filter(TranscodeContext *ctx, AVStream *out_stream, int *frame_count) {
+    AVFrame *filtered_frame = ctx->pool.filtered_frame;
+
+    while (av_buffersink_get_frame(ctx->buffersink_ctx, filtered_frame) >= 0) {
+        filtered_frame->pts = (*frame_count)++;
+        encode_and_drain(ctx, out_stream, filtered_frame);
+        av_frame_unref(filtered_frame);
+    }
+}
+
+// Time-lapse decimation: keep the first decoded frame at or after each
+// 1/fps step of source time. Steps stay on a fixed grid, so rates that do not
+// divide the source rate do not drift.
+static int timelapse_keep_frame(TranscodeContext *ctx, const AVFrame *frame) {
+    int64_t ts = frame->best_effort_timestamp != AV_NOPTS_VALUE ? frame->best_effort_timestamp : frame->pts;
+    if (ts == AV_NOPTS_VALUE) {
+        return 1;
+    }
+
+    AVRational tb = ctx->input_ctx->streams[ctx->video_stream_idx]->time_base;
+    int64_t step = av_rescale_q(1, (AVRational){1, ctx->timelapse->fps}, tb);
+    if (ctx->timelapse_next_pts == AV_NOPTS_VALUE) {
+        ctx->timelapse_next_pts = ts;
+    }
+    if (ts < ctx->timelapse_next_pts) {
+        ctx->timelapse_skipped++;
+        return 0;
+    }
+    while (ctx->timelapse_next_pts <= ts) {
+        ctx->timelapse_next_pts += step;
+    }
+    return 1;
+}
+
+static void timelapse_note_job(int frames, long skipped) {
+    pthread_mutex_lock(&stats_mutex);
+    timelapse_jobs++;
+    timelapse_frames_encoded += frames;
+    timelapse_frames_skipped += skipped;
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+// Account a finished full-rate output against its codec profile, so the
+// catalogue can be compared by bytes per second of video. The size comes
+// from verify_output(), which also knows it for outputs streamed to S3.
+static void codec_stats_note_output(TranscodeContext *ctx, int codec_profile, int frames) {
+    long long bytes = ctx->verify.file_bytes > 0 ? (long long)ctx->verify.file_bytes : 0;
+
+    pthread_mutex_lock(&stats_mutex);
+    codec_stats[codec_profile].jobs++;
+    codec_stats[codec_profile].bytes += bytes;
+    codec_stats[codec_profile].seconds += (double)frames / SOURCE_FPS;
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+// Part of a split input: it starts at the first keyframe at or after its
+// start byte and ends just before the first keyframe at or after its end
+// byte, where the next part starts. Both workers apply the same rule to the
+// same packet positions, so parts neither overlap nor leave gaps.
+// Returns 1 to transcode the packet, 0 to skip it, -1 once the part is done.
+static int chunk_packet_action(TranscodeContext *ctx, const AVPacket *packet) {
+    int boundary = (packet->flags & AV_PKT_FLAG_KEY) && packet->pos >= 0;
+
+    if (boundary && ctx->chunk_end >= 0 && packet->pos >= ctx->chunk_end) {
+        return -1;
+    }
+    if (!ctx->chunk_started) {
+        if (!boundary || packet->pos < ctx->chunk_start) {
+            return 0;
+        }
+        ctx->chunk_started = 1;
+    }
+    return 1;
+}
+
+// Decode the opened input through the filter into the encoder, numbering
+// frames from *frame_count. The decoder is drained at EOF; filter and encoder
+// stay open so further segments can follow in the same encoder session.
+static void transcode_input(TranscodeContext *ctx, AVStream *out_stream, int *frame_count) {
+    // Zero-copy GPU pipeline: NVDEC → scale_cuda → NVENC
+    AVPacket *packet = ctx->pool.packet;
+    AVFrame *decoded_frame = ctx->pool.decoded_frame;
+#ifdef ALLOC_DEBUG
+    int steady_frame = *frame_count + ALLOC_WARMUP_FRAMES;
+    int mark_frame = -1;
+    unsigned long mark_allocations = 0;
+#endif
+
+    while (!(ctx->cancel && *ctx->cancel) && av_read_frame(ctx->input_ctx, packet) >= 0) {
+        if (ctx->chunk_active && packet->stream_index == ctx->video_stream_idx) {
+            int action = chunk_packet_action(ctx, packet);
+            if (action <= 0) {
+                av_packet_unref(packet);
+                if (action < 0) break;
+                continue;
+            }
+        }
+
+        // Keyframes-only time-lapse: inter frames never reach NVDEC
+        if (packet->stream_index == ctx->video_stream_idx && ctx->timelapse &&
+            ctx->timelapse->keyframes_only && !(packet->flags & AV_PKT_FLAG_KEY)) {
+            ctx->timelapse_skipped++;
+        } else if (packet->stream_index == ctx->video_stream_idx) {
+            int ret = avcodec_send_packet(ctx->decoder_ctx, packet);
+            if (ret < 0 && ret != AVERROR(EAGAIN) && ret != AVERROR_INVALIDDATA) {
+                // A corrupt bitstream is the input's fault, anything else the decoder's
+                fail_job(ctx, FAILURE_DEVICE, ret, "decode");
+            } else if (ret == 0) {
+                while (avcodec_receive_frame(ctx->decoder_ctx, decoded_frame) == 0) {
+                    if (ctx->timelapse && !timelapse_keep_frame(ctx, decoded_frame)) {
+                        av_frame_unref(decoded_frame);
+                        continue;
+                    }
+
+                    // Send CUDA frame to scale_cuda filter
+                    ret = av_buffersrc_add_frame_flags(ctx->buffersrc_ctx, decoded_frame,
+                                                       AV_BUFFERSRC_FLAG_KEEP_REF);
+                    if (ret < 0) {
+                        fprintf(stderr, "[Worker %d] Error feeding filter\n", ctx->worker_id);
+                        fail_job(ctx, FAILURE_DEVICE, ret, "feed scaler");
+                        av_frame_unref(decoded_frame);
+                        continue;
+                    }
+
+                    // Scaled CUDA frames go straight to NVENC
+                    drain_filter(ctx, out_stream, frame_count);
+                    av_frame_unref(decoded_frame);
+                }
+            }
+        }
+        av_packet_unref(packet);
+#ifdef ALLOC_DEBUG
+        if (mark_frame < 0 && *frame_count >= steady_frame) {
+            mark_frame = *frame_count;
+            mark_allocations = thread_allocations;
+        }
+#endif
+    }
+#ifdef ALLOC_DEBUG
+    if (mark_frame >= 0) {
+        alloc_debug_record(thread_allocations - mark_allocations, *frame_count - mark_frame);
+    }
+#endif
+
+    // Flush decoder
+    avcodec_send_packet(ctx->decoder_ctx, NULL);
+    while (avcodec_receive_frame(ctx->decoder_ctx, decoded_frame) == 0) {
+        if (ctx->timelapse && !timelapse_keep_frame(ctx, decoded_frame)) {
+            av_frame_unref(decoded_frame);
+            continue;
+        }
+        av_buffersrc_add_frame_flags(ctx->buffersrc_ctx, decoded_frame, AV_BUFFERSRC_FLAG_KEEP_REF);
+        drain_filter(ctx, out_stream, frame_count);
+        av_frame_unref(decoded_frame);
+    }
+}
+
+// Flush filter and encoder, then finalize the container
+static void finish_output(TranscodeContext *ctx, AVStream *out_stream, int *frame_count) {
+    if (ctx->buffersrc_ctx) {  // Software mosaics close their tile sources as they end
+        av_buffersrc_add_frame_flags(ctx->buffersrc_ctx, NULL, 0);
+    }
+    drain_filter(ctx, out_stream, frame_count);
+    encode_and_drain(ctx, out_stream, NULL);
+
+    av_write_trailer(ctx->output_ctx);
+}
+
+int process_file(TranscodeContext *ctx, const TranscodeJob *job, OutputTarget *target) {
+    char input_path[512];
+    char base_name[256];
+
+    snprintf(input_path, sizeof(input_path), "%s/%s", config.input_dir, job->filename);
+    output_base_name(job->filename, base_name, sizeof(base_name));
+    if (job->timelapse.fps > 0) {
+        // Sits next to the full-rate output of the same segment
+        strncat(base_name, "_timelapse", sizeof(base_name) - strlen(base_name) - 1);
+    }
+    if (prepare_output_target(target, job->output_format, job->codec_profile, job->camera_id, base_name) < 0) {
+        return fail_job(ctx, FAILURE_TRANSIENT, 0, "prepare output directory");
+    }
+
+    fprintf(stderr, "[Worker %d] Processing: %s\n", ctx->worker_id, job->filename);
+
+    job_index_stage(&job_index, job->job_id, "probing");
+    if (open_input_segment(ctx, input_path, job->camera_id) < 0) {
+        return -1;
+    }
+
+    // Time-lapse jobs encode at the reduced rate/size; non-reference frames
+    // are never shown at that rate, so NVDEC may skip them outright
+    ctx->timelapse = job->timelapse.fps > 0 ? &job->timelapse : NULL;
+    ctx->timelapse_next_pts = AV_NOPTS_VALUE;
+    ctx->timelapse_skipped = 0;
+    ctx->decoder_ctx->skip_frame = ctx->timelapse ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+    ctx->codec_profile = job->codec_profile;
+    if (select_encoder(ctx) < 0) {
+        return fail_job(ctx, FAILURE_DEVICE, 0, "open %s encoder for profile %s",
+                        ctx->timelapse ? "time-lapse" : "full-rate",
+                        config.codec_profiles[job->codec_profile].name);
+    }
+
+    // Flush pipeline state from previous file (if any)
+    // This is MUCH faster than recreating contexts (~10ms vs ~300ms)
+    if (flush_pipeline_for_next_file(ctx) < 0) {
+        return fail_job(ctx, FAILURE_DEVICE, 0, "reopen encoder");
+    }
+
+    AVStream *out_stream = open_output_file(ctx, target);
+    if (!out_stream) {
+        return -1;
+    }
+
+    int frame_count = 0;
+    job_index_stage(&job_index, job->job_id, "transcoding");
+    transcode_input(ctx, out_stream, &frame_count);
+    job_index_stage(&job_index, job->job_id, "finalizing");
+    finish_output(ctx, out_stream, &frame_count);
+
+    // Cancelled mid-file: the encoder was drained above so the pipeline is
+    // clean for the next job; the partial output is discarded
+    if (ctx->cancel && *ctx->cancel) {
+        fprintf(stderr, "[Worker %d] Cancelled: %s after %d frames\n",
+                ctx->worker_id, job->filename, frame_count);
+        unlink(target->path);
+        return -1;
+    }
+
+    if (verify_output(ctx, target) < 0) {
+        return -1;
+    }
+    if (target->format == OUTPUT_FORMAT_CMAF &&
+        publish_cmaf_segment(target, frame_count * av_q2d(ctx->encoder_ctx->time_base)) < 0) {
+        return fail_job(ctx, FAILURE_TRANSIENT, 0, "publish CMAF segment");
+    }
+
+    if (ctx->timelapse) {
+        timelapse_note_job(frame_count, ctx->timelapse_skipped);
+    } else {
+        codec_stats_note_output(ctx, job->codec_profile, frame_count);
+    }
+
+    fprintf(stderr, "[Worker %d] ✓ Completed: %s (%d frames)\n",
+            ctx->worker_id, job->filename, frame_count);
+
+    return 0;
+}
+
+// Build the sidecar index of a consolidated output: one entry per source
+// segment with its byte offset and PTS range inside the merged file
+static cJSON *segment_index_to_json(const ConsolidationGroup *group, const SegmentIndex *index,
+                                    AVRational time_base) {
+    cJSON *segments = cJSON_CreateArray();
+
+    for (int i = 0; i < group->nb_segments; i++) {
+        const SegmentIndexEntry *entry = &index->entries[i];
+        cJSON *item = cJSON_CreateObject();
+
+        cJSON_AddStringToObject(item, "inputFile", group->segments[i].filename);
+        cJSON_AddNumberToObject(item, "frames", entry->frames);
+        if (entry->frames > 0) {
+            cJSON_AddNumberToObject(item, "byteOffset", (double)entry->byte_offset);
+            cJSON_AddNumberToObject(item, "ptsStart", (double)entry->pts_start);
+            cJSON_AddNumberToObject(item, "ptsEnd", (double)entry->pts_end);
+            cJSON_AddNumberToObject(item, "startSeconds", entry->pts_start * av_q2d(time_base));
+        } else {
+            cJSON_AddStringToObject(item, "status", "failed");
+        }
+
+        if (group->segments[i].metadata_json[0]) {
+            cJSON *metadata = cJSON_Parse(group->segments[i].metadata_json);
+            if (metadata) {
+                cJSON_AddItemToObject(item, "metadata", metadata);
+            }
+        }
+        cJSON_AddItemToArray(segments, item);
+    }
+
+    return segments;
+}
+
+// Transcode all segments of a group into one output within a single encoder
+// session and write "<output>.idx.json" next to it.
+// Returns the number of segments transcoded, -1 if nothing could be written.
+// On success *segments_json receives the index (caller frees).
+int process_group(TranscodeContext *ctx, const ConsolidationGroup *group,
+                  OutputTarget *target, int *frames_out, cJSON **segments_json) {
+    char input_path[512];
+    char index_path[800];
+    char first_base[256];
+    char base_name[300];
+
+    output_base_name(group->segments[0].filename, first_base, sizeof(first_base));
+    snprintf(base_name, sizeof(base_name), "%s_x%d", first_base, group->nb_segments);
+    if (prepare_output_target(target, group->output_format, group->codec_profile,
+                              group->camera_id, base_name) < 0) {
+        return fail_job(ctx, FAILURE_TRANSIENT, 0, "prepare output directory");
+    }
+
+    // "<output>.idx.json" next to the output file (or object)
+    snprintf(index_path, sizeof(index_path), "%s", target->s3 ? target->s3_key : target->path);
+    char *dot = strrchr(index_path, '.');
+    if (dot) *dot = '\0';
+    strncat(index_path, ".idx.json", sizeof(index_path) - strlen(index_path) - 1);
+
+    fprintf(stderr, "[Worker %d] Consolidating %d segments of %s\n",
+            ctx->worker_id, group->nb_segments, group->camera_id);
+
+    ctx->timelapse = NULL;
+    ctx->decoder_ctx->skip_frame = AVDISCARD_DEFAULT;
+    ctx->codec_profile = group->codec_profile;
+    if (select_encoder(ctx) < 0) {
+        return fail_job(ctx, FAILURE_DEVICE, 0, "open encoder for profile %s",
+                        config.codec_profiles[group->codec_profile].name);
+    }
+    if (flush_pipeline_for_next_file(ctx) < 0) {
+        return fail_job(ctx, FAILURE_DEVICE, 0, "reopen encoder");
+    }
+
+    AVStream *out_stream = open_output_file(ctx, target);
+    if (!out_stream) {
+        return -1;
+    }
+
+    SegmentIndex index = {0};
+    index.pending = -1;
+    ctx->segment_index = &index;
+
+    int frame_count = 0;
+    int transcoded = 0;
+
+    for (int i = 0; i < group->nb_segments; i++) {
+        SegmentIndexEntry *entry = &index.entries[i];
+        const char *job_id = group->segments[i].job_id;
+        index.nb_entries = i + 1;
+        entry->byte_offset = -1;
+
+        // Segments cancelled while waiting in the group are skipped
+        if (job_index_cancel_requested(&job_index, job_id)) {
+            job_index_finish(&job_index, job_id, JOB_CANCELLED, NULL, 0);
+            continue;
+        }
+        job_index_start(&job_index, job_id, ctx->worker_id);
+        job_index_stage(&job_index, job_id, "transcoding");
+
+        snprintf(input_path, sizeof(input_path), "%s/%s", config.input_dir, group->segments[i].filename);
+        if (open_input_segment(ctx, input_path, group->camera_id) < 0) {
+            // A missing segment leaves a gap but does not sink the whole group
+            if (ctx->input_ctx) avformat_close_input(&ctx->input_ctx);
+            job_index_finish(&job_index, job_id, JOB_FAILED, NULL, 0);
+            continue;
+        }
+
+        entry->frame_start = frame_count;
+        entry->pts_start = av_rescale_q(frame_count, ctx->encoder_ctx->time_base, out_stream->time_base);
+        index.pending = i;
+        ctx->force_keyframe = 1;
+
+        transcode_input(ctx, out_stream, &frame_count);
+
+        entry->frames = frame_count - entry->frame_start;
+        entry->pts_end = av_rescale_q(frame_count, ctx->encoder_ctx->time_base, out_stream->time_base);
+        if (entry->frames > 0) {
+            transcoded++;
+            job_index_stage(&job_index, job_id, "finalizing");
+        } else {
+            job_index_finish(&job_index, job_id, JOB_FAILED, NULL, 0);
+        }
+
+        // Reset the drained decoder for the next segment; encoder keeps running
+        avcodec_flush_buffers(ctx->decoder_ctx);
+        avformat_close_input(&ctx->input_ctx);
+    }
+
+    finish_output(ctx, out_stream, &frame_count);
+    ctx->segment_index = NULL;
+    ctx->force_keyframe = 0;
+
+    if (transcoded == 0) {
+        fprintf(stderr, "[Worker %d] No segment of %s could be transcoded\n",
+                ctx->worker_id, group->camera_id);
+        // Segments were attempted (and marked failed) individually, so the
+        // group is not retried as a whole
+        ctx->failure = FAILURE_NONE;
+        return fail_job(ctx, FAILURE_PERMANENT, 0, "no segment could be transcoded");
+    }
+    ctx->failure = FAILURE_NONE;  // Individual segment failures are in the index
+
+    if (verify_output(ctx, target) < 0) {
+        return -1;
+    }
+    if (target->format == OUTPUT_FORMAT_CMAF &&
+        publish_cmaf_segment(target, frame_count * av_q2d(ctx->encoder_ctx->time_base)) < 0) {
+        return fail_job(ctx, FAILURE_TRANSIENT, 0, "publish CMAF segment");
+    }
+    codec_stats_note_output(ctx, group->codec_profile, frame_count);
+
+    // Sidecar index
+    cJSON *segments = segment_index_to_json(group, &index, out_stream->time_base);
+    cJSON *sidecar = cJSON_CreateObject();
+    cJSON_AddStringToObject(sidecar, "outputFile", target->name);
+    cJSON_AddStringToObject(sidecar, "cameraId", group->camera_id);
+    cJSON_AddNumberToObject(sidecar, "frameCount", frame_count);
+    cJSON_AddNumberToObject(sidecar, "timeBaseNum", out_stream->time_base.num);
+    cJSON_AddNumberToObject(sidecar, "timeBaseDen", out_stream->time_base.den);
+    cJSON_AddItemToObject(sidecar, "segments", cJSON_Duplicate(segments, 1));
+
+    char *sidecar_str = cJSON_Print(sidecar);
+    if (target->s3) {
+        char err[160];
+        if (!sidecar_str || s3_put_object(index_path, sidecar_str, strlen(sidecar_str), err, sizeof(err)) < 0) {
+            fprintf(stderr, "[Worker %d] Failed to upload segment index %s: %s\n", ctx->worker_id, index_path,
+                    sidecar_str ? err : "out of memory");
+        }
+    } else {
+        FILE *f = fopen(index_path, "w");
+        if (f && sidecar_str) {
+            fputs(sidecar_str, f);
+        } else {
+            fprintf(stderr, "[Worker %d] Failed to write segment index: %s\n", ctx->worker_id, index_path);
+        }
+        if (f) fclose(f);
+    }
+    free(sidecar_str);
+    cJSON_Delete(sidecar);
+
+    for (int i = 0; i < group->nb_segments; i++) {
+        job_index_finish(&job_index, group->segments[i].job_id, JOB_DONE,
+                         target->name, index.entries[i].frames);
+    }
+
+    fprintf(stderr, "[Worker %d] ✓ Consolidated: %s (%d/%d segments, %d frames)\n",
+            ctx->worker_id, target->name, transcoded, group->nb_segments, frame_count);
+
+    *frames_out = frame_count;
+    *segments_json = segments;
+    return transcoded;
+}
+
+// ============================================================================
+// Chunked Transcoding (long inputs split across workers)
+// ============================================================================
+
+void cleanup_file_contexts(TranscodeContext *ctx);
+
+// Split a long MPEG-TS job into byte-range parts and queue helper jobs so idle
+// workers join in. Parts are claimed on demand, so a helper that never gets
+// a queue slot (or arrives late) just leaves more parts to the others.
+// Returns the shared state, or NULL when the job is transcoded in one piece.
+static ChunkedJob *chunked_job_split(TranscodeContext *ctx, TranscodeJob *job) {
+    if (config.chunk_mb <= 0 || job->group || job->mosaic || job->timelapse.fps > 0 ||
+        job->output_format != OUTPUT_FORMAT_TS) {
+        return NULL;
+    }
+
+    char input_path[512];
+    struct stat st;
+    snprintf(input_path, sizeof(input_path), "%s/%s", config.input_dir, job->filename);
+    int64_t chunk_bytes = (int64_t)config.chunk_mb * 1024 * 1024;
+    if (stat(input_path, &st) != 0 || st.st_size < 2 * chunk_bytes) {
+        return NULL;
+    }
+
+    ChunkedJob *cj = calloc(1, sizeof(ChunkedJob));
+    if (!cj) {
+        return NULL;
+    }
+    pthread_mutex_init(&cj->mutex, NULL);
+    cj->nb_chunks = st.st_size / chunk_bytes;
+    if (cj->nb_chunks > config.max_chunks) cj->nb_chunks = config.max_chunks;
+    cj->remaining = cj->nb_chunks;
+    cj->input_size = st.st_size;
+    cj->cancel = ctx->cancel;
+
+    // Helpers are untimed copies: the original job carries the deadline
+    int wanted = cj->nb_chunks - 1;
+    if (wanted > config.workers - 1) wanted = config.workers - 1;
+    cj->refs = 1 + wanted;
+    job->chunked = cj;
+
+    TranscodeJob helper = *job;
+    helper.deadline_ms = 0;
+    helper.enqueued_ms = 0;
+    int queued = 0;
+    while (queued < wanted && queue_try_push(&task_queue, &helper, 0) >= 0) {
+        queued++;
+    }
+
+    pthread_mutex_lock(&cj->mutex);
+    cj->refs -= wanted - queued;
+    pthread_mutex_unlock(&cj->mutex);
+
+    pthread_mutex_lock(&stats_mutex);
+    chunked_helpers += queued;
+    pthread_mutex_unlock(&stats_mutex);
+
+    fprintf(stderr, "[Worker %d] Splitting %s (%lld MB) into %d parts, %d helper jobs queued\n",
+            ctx->worker_id, job->filename, (long long)(st.st_size >> 20), cj->nb_chunks, queued);
+    return cj;
+}
+
+// Drop one participant's reference; the last one frees the shared state
+static void chunked_job_release(ChunkedJob *cj) {
+    pthread_mutex_lock(&cj->mutex);
+    int last = --cj->refs == 0;
+    pthread_mutex_unlock(&cj->mutex);
+
+    if (last) {
+        pthread_mutex_destroy(&cj->mutex);
+        free(cj);
+    }
+}
+
+// Take the next unclaimed part, or -1 when none is left. Once a part failed
+// or the job was cancelled, the unclaimed parts are written off instead;
+// *finished is set when that completed the job.
+static int chunked_claim(ChunkedJob *cj, int *finished) {
+    int index = -1;
+    *finished = 0;
+
+    pthread_mutex_lock(&cj->mutex);
+    if (cj->next_chunk < cj->nb_chunks) {
+        if (cj->failure == FAILURE_NONE && !(cj->cancel && *cj->cancel)) {
+            index = cj->next_chunk++;
+        } else {
+            cj->remaining -= cj->nb_chunks - cj->next_chunk;
+            cj->next_chunk = cj->nb_chunks;
+            *finished = cj->remaining == 0;
+        }
+    }
+    pthread_mutex_unlock(&cj->mutex);
+    return index;
+}
+
+// Keep the first failure of any part (cancellation is not a failure)
+static void chunked_record_failure(ChunkedJob *cj, const TranscodeContext *ctx) {
+    pthread_mutex_lock(&cj->mutex);
+    if (cj->failure == FAILURE_NONE && !(cj->cancel && *cj->cancel)) {
+        cj->failure = ctx->failure != FAILURE_NONE ? ctx->failure : FAILURE_PERMANENT;
+        snprintf(cj->failure_reason, sizeof(cj->failure_reason), "%s",
+                 ctx->failure_reason[0] ? ctx->failure_reason : "unclassified error");
+    }
+    pthread_mutex_unlock(&cj->mutex);
+}
+
+// Returns 1 when this was the last outstanding part
+static int chunked_complete(ChunkedJob *cj, int index, int frames) {
+    pthread_mutex_lock(&cj->mutex);
+    cj->frames[index] = frames;
+    int finished = --cj->remaining == 0;
+    pthread_mutex_unlock(&cj->mutex);
+    return finished;
+}
+
+// Parts are written next to the final output: "<output>.part03"
+static void chunk_part_target(const OutputTarget *target, int index, OutputTarget *part) {
+    memset(part, 0, sizeof(*part));
+    part->format = OUTPUT_FORMAT_TS;
+    snprintf(part->name, sizeof(part->name), "%s.part%02d", target->name, index);
+    snprintf(part->path, sizeof(part->path), "%s.part%02d", target->path, index);
+    strncpy(part->mux_path, part->path, sizeof(part->mux_path) - 1);
+}
+
+static void chunked_remove_parts(const ChunkedJob *cj, const OutputTarget *target) {
+    for (int i = 0; i < cj->nb_chunks; i++) {
+        OutputTarget part;
+        chunk_part_target(target, i, &part);
+        unlink(part.path);
+    }
+}
+
+// Transcode one byte range of the input into its part file. Every part
+// starts on an IDR with frame numbers from 0; the stitcher offsets them.
+static int transcode_chunk(TranscodeContext *ctx, const TranscodeJob *job, const OutputTarget *target,
+                           int index, int *frames_out) {
+    const ChunkedJob *cj = job->chunked;
+    char input_path[512];
+    OutputTarget part;
+
+    snprintf(input_path, sizeof(input_path), "%s/%s", config.input_dir, job->filename);
+    chunk_part_target(target, index, &part);
+
+    if (open_input_segment(ctx, input_path, job->camera_id) < 0) {
+        return -1;
+    }
+
+    ctx->chunk_start = cj->input_size * index / cj->nb_chunks;
+    ctx->chunk_end = index + 1 < cj->nb_chunks ? cj->input_size * (index + 1) / cj->nb_chunks : -1;
+    ctx->chunk_started = index == 0;  // The first part keeps any leading non-IDR frames, like process_file
+    if (index > 0) {
+        int ret = av_seek_frame(ctx->input_ctx, -1, ctx->chunk_start, AVSEEK_FLAG_BYTE);
+        if (ret < 0) {
+            return fail_job(ctx, FAILURE_PERMANENT, ret, "seek to part %d", index);
+        }
+    }
+
+    if (flush_pipeline_for_next_file(ctx) < 0) {
+        return fail_job(ctx, FAILURE_DEVICE, 0, "reopen encoder");
+    }
+    AVStream *out_stream = open_output_file(ctx, &part);
+    if (!out_stream) {
+        return -1;
+    }
+
+    int frame_count = 0;
+    ctx->chunk_active = 1;
+    transcode_input(ctx, out_stream, &frame_count);
+    ctx->chunk_active = 0;
+    finish_output(ctx, out_stream, &frame_count);
+
+    if (ctx->cancel && *ctx->cancel) {
+        unlink(part.path);
+        return -1;
+    }
+
+    fprintf(stderr, "[Worker %d] Part %d/%d of %s: %d frames\n",
+            ctx->worker_id, index + 1, cj->nb_chunks, job->filename, frame_count);
+    *frames_out = frame_count;
+    return 0;
+}
+
+// Remux the parts into the job's output in order. Each part's timestamps are
+// shifted to continue where the previous part's frames end, so the result is
+// one continuous stream.
+static int stitch_chunks(TranscodeContext *ctx, const ChunkedJob *cj, const OutputTarget *target,
+                         int *frames_out) {
+    AVPacket *packet = ctx->pool.packet;
+    AVStream *out_stream = open_output_file(ctx, target);
+    if (!out_stream) {
+        return -1;
+    }
+
+    int64_t frame_ticks = av_rescale_q(1, (AVRational){1, SOURCE_FPS}, out_stream->time_base);
+    int64_t next_dts = AV_NOPTS_VALUE;
+    int frames = 0;
+
+    for (int i = 0; i < cj->nb_chunks; i++) {
+        OutputTarget part;
+        chunk_part_target(target, i, &part);
+
+        int ret = avformat_open_input(&ctx->input_ctx, part.path, NULL, NULL);
+        if (ret < 0) {
+            return fail_job(ctx, FAILURE_TRANSIENT, ret, "open part %d", i);
+        }
+
+        int64_t shift = AV_NOPTS_VALUE;
+        int64_t part_dts = 0;
+        while (av_read_frame(ctx->input_ctx, packet) >= 0) {
+            AVStream *in_stream = ctx->input_ctx->streams[packet->stream_index];
+            if (in_stream->codecpar->codec_type != AVMEDIA_TYPE_VIDEO) {
+                av_packet_unref(packet);
+                continue;
+            }
+            av_packet_rescale_ts(packet, in_stream->time_base, out_stream->time_base);
+            if (packet->dts == AV_NOPTS_VALUE) packet->dts = packet->pts;
+            if (shift == AV_NOPTS_VALUE) {
+                // The first part keeps its own start
+                shift = next_dts == AV_NOPTS_VALUE ? 0 : next_dts - packet->dts;
+                part_dts = packet->dts + shift;
+            }
+            packet->pts += shift;
+            packet->dts += shift;
+            packet->pos = -1;
+            packet->stream_index = 0;
+            verify_note_packet(&ctx->verify, packet);
+            av_interleaved_write_frame(ctx->output_ctx, packet);
+        }
+        avformat_close_input(&ctx->input_ctx);
+
+        if (shift != AV_NOPTS_VALUE) {
+            next_dts = part_dts + cj->frames[i] * frame_ticks;
+        }
+        frames += cj->frames[i];
+    }
+
+    av_write_trailer(ctx->output_ctx);
+    int ret = verify_output(ctx, target);
+    cleanup_file_contexts(ctx);
+    *frames_out = frames;
+    return ret;
+}
+
+// Work on a split input until no part is left to claim. Returns
+// CHUNKED_PENDING while other participants still hold parts; the participant
+// that completes the last part stitches them and returns 0 or -1 for the
+// whole job (a failed part fails the job with that part's reason).
+int process_chunked(TranscodeContext *ctx, const TranscodeJob *job, OutputTarget *target) {
+    ChunkedJob *cj = job->chunked;
+    char base_name[256];
+    int finished = 0;
+
+    output_base_name(job->filename, base_name, sizeof(base_name));
+    int ready = 1;
+    if (prepare_output_target(target, OUTPUT_FORMAT_TS, job->codec_profile, job->camera_id, base_name) < 0) {
+        ready = fail_job(ctx, FAILURE_TRANSIENT, 0, "prepare output directory");
+    }
+    ctx->timelapse = NULL;
+    ctx->decoder_ctx->skip_frame = AVDISCARD_DEFAULT;
+    ctx->codec_profile = job->codec_profile;
+    if (ready == 1 && select_encoder(ctx) < 0) {
+        ready = fail_job(ctx, FAILURE_DEVICE, 0, "open encoder for profile %s",
+                         config.codec_profiles[job->codec_profile].name);
+    }
+    ctx->chunk_failure = FAILURE_NONE;
+    if (ready < 0) {
+        ctx->chunk_failure = ctx->failure;
+        chunked_record_failure(cj, ctx);
+    }
+
+    job_index_stage(&job_index, job->job_id, "transcoding");
+    while (!finished) {
+        int index = chunked_claim(cj, &finished);
+        if (index < 0) {
+            break;
+        }
+        int frames = 0;
+        if (transcode_chunk(ctx, job, target, index, &frames) < 0) {
+            ctx->chunk_failure = ctx->failure;
+            chunked_record_failure(cj, ctx);
+        }
+        cleanup_file_contexts(ctx);
+        finished = chunked_complete(cj, index, frames);
+    }
+    if (!finished) {
+        return CHUNKED_PENDING;
+    }
+
+    // Last participant: every part is written (or written off)
+    if (cj->cancel && *cj->cancel) {
+        chunked_remove_parts(cj, target);
+        return -1;
+    }
+    if (cj->failure != FAILURE_NONE) {
+        chunked_remove_parts(cj, target);
+        ctx->failure = cj->failure;
+        snprintf(ctx->failure_reason, sizeof(ctx->failure_reason), "%s", cj->failure_reason);
+        return -1;
+    }
+
+    job_index_stage(&job_index, job->job_id, "stitching");
+    int frame_count = 0;
+    int ret = stitch_chunks(ctx, cj, target, &frame_count);
+    chunked_remove_parts(cj, target);
+    if (ret < 0) {
+        unlink(target->path);
+        return -1;
+    }
+
+    codec_stats_note_output(ctx, job->codec_profile, frame_count);
+    pthread_mutex_lock(&stats_mutex);
+    chunked_jobs++;
+    chunked_parts += cj->nb_chunks;
+    pthread_mutex_unlock(&stats_mutex);
+
+    fprintf(stderr, "[Worker %d] ✓ Stitched: %s (%d parts, %d frames)\n",
+            ctx->worker_id, target->name, cj->nb_chunks, frame_count);
+    return 0;
+}
+
+// ============================================================================
+// Multiview Mosaic
+// ============================================================================
+
+// Each camera of a wall gets its own demuxer and NVDEC session for the length
+// of the job. Tiles are placed on a common wall clock: t=0 is the earliest
+// tile's start, and a camera whose recording began later stays black until
+// then. Tiles are fed in timestamp order (the one furthest behind goes next),
+// so the composition graph only ever buffers a frame or two per input.
+//
+//   cuda      [inN] scale_cuda -> overlay_cuda onto a black canvas that is
+//             pushed at the output rate; frames never leave the GPU
+//   software  [inN] hwdownload -> swscale -> xstack -> hwupload_cuda, for
+//             hosts where the CUDA filters are unavailable
+
+typedef struct {
+    AVFormatContext *input;     // NULL: input could not be opened (black cell)
+    AVCodecContext *decoder;
+    AVFilterContext *src;
+    int video_idx;
+    int64_t first_pts;          // Input time base; the tile's own t=0
+    int64_t offset_us;          // Tile start on the wall clock, after the earliest tile's
+    int64_t last_us;            // Wall timestamp of the last frame fed (-1 = none yet)
+    int frames;
+    int eof;
+} MosaicTile;
+
+typedef struct {
+    MosaicTile tiles[MOSAIC_MAX_INPUTS];
+    int tile_width;
+    int tile_height;
+    AVFilterContext *canvas;    // CUDA path: background source driving the output rate
+    AVFrame *canvas_frame;      // Black W x H frame, re-sent at every tick
+    int64_t canvas_next_us;
+} Mosaic;
+
+// Parse "2x2"-style layouts; 0 if it is a usable grid
+int parse_mosaic_layout(const char *text, int *cols, int *rows) {
+    char extra;
+    if (sscanf(text, "%dx%d%c", cols, rows, &extra) != 2 ||
+        *cols < 1 || *cols > MOSAIC_MAX_GRID || *rows < 1 || *rows > MOSAIC_MAX_GRID) {
+        return -1;
+    }
+    return 0;
+}
+
+// Black NV12 background for the CUDA path, uploaded once per job
+static int mosaic_create_canvas(TranscodeContext *ctx, Mosaic *m, int width, int height) {
+    char args[256];
+    snprintf(args, sizeof(args),
+             "video_size=%dx%d:pix_fmt=%d:time_base=1/%d:pixel_aspect=1/1",
+             width, height, AV_PIX_FMT_CUDA, AV_TIME_BASE);
+    if (avfilter_graph_create_filter(&m->canvas, avfilter_get_by_name("buffer"), "canvas",
+                                     args, NULL, ctx->filter_graph) < 0) {
+        return -1;
+    }
+
+    AVBufferRef *frames_ref = av_hwframe_ctx_alloc(ctx->hw_device_ctx);
+    if (!frames_ref) {
+        return -1;
+    }
+    AVHWFramesContext *frames_ctx = (AVHWFramesContext *)(frames_ref->data);
+    frames_ctx->format    = AV_PIX_FMT_CUDA;
+    frames_ctx->sw_format = AV_PIX_FMT_NV12;
+    frames_ctx->width     = width;
+    frames_ctx->height    = height;
+    if (av_hwframe_ctx_init(frames_ref) < 0) {
+        av_buffer_unref(&frames_ref);
+        return -1;
+    }
+
+    AVBufferSrcParameters *par = av_buffersrc_parameters_alloc();
+    par->hw_frames_ctx = frames_ref;
+    av_buffersrc_parameters_set(m->canvas, par);
+    av_free(par);
+
+    // Limited-range black: Y=16, interleaved UV=128
+    AVFrame *black = av_frame_alloc();
+    m->canvas_frame = av_frame_alloc();
+    int ret = -1;
+    if (black && m->canvas_frame) {
+        black->format = AV_PIX_FMT_NV12;
+        black->width = width;
+        black->height = height;
+        if (av_frame_get_buffer(black, 0) == 0) {
+            for (int y = 0; y < height; y++) {
+                memset(black->data[0] + y * black->linesize[0], 16, width);
+            }
+            for (int y = 0; y < height / 2; y++) {
+                memset(black->data[1] + y * black->linesize[1], 128, width);
+            }
+            if (av_hwframe_get_buffer(frames_ref, m->canvas_frame, 0) == 0 &&
+                av_hwframe_transfer_data(m->canvas_frame, black, 0) == 0) {
+                ret = 0;
+            }
+        }
+    }
+    av_frame_free(&black);
+    av_buffer_unref(&frames_ref);
+    return ret;
+}
+
+// Build the composition graph into ctx->filter_graph for the opened tiles.
+// Output is the main encoder's size; each tile is scaled to one grid cell.
+static int mosaic_build_graph(TranscodeContext *ctx, Mosaic *m, const MosaicJob *mj) {
+    int out_w = ctx->encoder_ctx->width;
+    int out_h = ctx->encoder_ctx->height;
+    char descr[4096];
+    char layout[256];
+    char name[16];
+    size_t len = 0;
+    size_t layout_len = 0;
+    int nb_live = 0;
+    int last = -1;
+
+    AVFilterInOut *outputs = NULL;
+    AVFilterInOut *inputs = avfilter_inout_alloc();
+    ctx->filter_graph = avfilter_graph_alloc();
+    if (!inputs || !ctx->filter_graph) {
+        avfilter_inout_free(&inputs);
+        return -1;
+    }
+
+    for (int i = 0; i < mj->nb_inputs; i++) {
+        MosaicTile *tile = &m->tiles[i];
+        if (!tile->input) continue;
+
+        snprintf(name, sizeof(name), "in%d", i);
+        if (create_cuda_buffersrc(ctx, ctx->filter_graph, name, AV_TIME_BASE_Q, &tile->src) < 0) {
+            avfilter_inout_free(&outputs);
+            avfilter_inout_free(&inputs);
+            return -1;
+        }
+        AVFilterInOut *out = avfilter_inout_alloc();
+        if (!out) {
+            avfilter_inout_free(&outputs);
+            avfilter_inout_free(&inputs);
+            return -1;
+        }
+        out->name = av_strdup(name);
+        out->filter_ctx = tile->src;
+        out->pad_idx = 0;
+        out->next = outputs;
+        outputs = out;
+
+        if (mj->software_scale) {
+            len += snprintf(descr + len, sizeof(descr) - len,
+                            "[in%d]hwdownload,format=nv12,scale=%d:%d,format=yuv420p[t%d];",
+                            i, m->tile_width, m->tile_height, i);
+            layout_len += snprintf(layout + layout_len, sizeof(layout) - layout_len, "%s%d_%d",
+                                   nb_live ? "|" : "", (i % mj->cols) * m->tile_width,
+                                   (i / mj->cols) * m->tile_height);
+        } else {
+            len += snprintf(descr + len, sizeof(descr) - len, "[in%d]scale_cuda=%d:%d[t%d];",
+                            i, m->tile_width, m->tile_height, i);
+        }
+        nb_live++;
+        last = i;
+    }
+
+    if (mj->software_scale) {
+        // xstack needs two inputs; a lone survivor is padded into its cell
+        if (nb_live == 1) {
+            len += snprintf(descr + len, sizeof(descr) - len, "[t%d]pad=%d:%d:%d:%d:color=black,",
+                            last, out_w, out_h, (last % mj->cols) * m->tile_width,
+                            (last / mj->cols) * m->tile_height);
+        } else {
+            for (int i = 0; i < mj->nb_inputs; i++) {
+                if (m->tiles[i].input) len += snprintf(descr + len, sizeof(descr) - len, "[t%d]", i);
+            }
+            len += snprintf(descr + len, sizeof(descr) - len,
+                            "xstack=inputs=%d:layout=%s:fill=black,pad=%d:%d:color=black,",
+                            nb_live, layout, out_w, out_h);
+        }
+        len += snprintf(descr + len, sizeof(descr) - len, "fps=%d,format=nv12,hwupload_cuda[out]",
+                        SOURCE_FPS);
+        ctx->buffersrc_ctx = NULL;
+    } else {
+        if (mosaic_create_canvas(ctx, m, out_w, out_h) < 0) {
+            fprintf(stderr, "[Worker %d] Failed to create mosaic canvas\n", ctx->worker_id);
+            avfilter_inout_free(&outputs);
+            avfilter_inout_free(&inputs);
+            return -1;
+        }
+        AVFilterInOut *out = avfilter_inout_alloc();
+        if (!out) {
+            avfilter_inout_free(&outputs);
+            avfilter_inout_free(&inputs);
+            return -1;
+        }
+        out->name = av_strdup("canvas");
+        out->filter_ctx = m->canvas;
+        out->pad_idx = 0;
+        out->next = outputs;
+        outputs = out;
+
+        // Chain the tiles onto the canvas: [canvas][t0] -> [c0][t1] -> ... -> [out]
+        const char *below = "canvas";
+        char label[16];
+        for (int i = 0; i < mj->nb_inputs; i++) {
+            if (!m->tiles[i].input) continue;
+            len += snprintf(descr + len, sizeof(descr) - len, "[%s][t%d]overlay_cuda=x=%d:y=%d",
+                            below, i, (i % mj->cols) * m->tile_width, (i / mj->cols) * m->tile_height);
+            if (i == last) {
+                len += snprintf(descr + len, sizeof(descr) - len, "[out]");
+            } else {
+                snprintf(label, sizeof(label), "c%d", i);
+                len += snprintf(descr + len, sizeof(descr) - len, "[%s];", label);
+                below = label;
+            }
+        }
+        // Ticks are pushed by the feeding loop; finish_output closes it
+        ctx->buffersrc_ctx = m->canvas;
+    }
+
+    int ret = avfilter_graph_create_filter(&ctx->buffersink_ctx, avfilter_get_by_name("buffersink"),
+                                           "out", NULL, NULL, ctx->filter_graph);
+    if (ret >= 0) {
+        inputs->name = av_strdup("out");
+        inputs->filter_ctx = ctx->buffersink_ctx;
+        inputs->pad_idx = 0;
+        inputs->next = NULL;
+
+        fprintf(stderr, "[Worker %d] Parsing mosaic graph: %s\n", ctx->worker_id, descr);
+        ret = avfilter_graph_parse_ptr(ctx->filter_graph, descr, &inputs, &outputs, NULL);
+    }
+    avfilter_inout_free(&inputs);
+    avfilter_inout_free(&outputs);
+    if (ret < 0) {
+        fprintf(stderr, "[Worker %d] Failed to parse mosaic graph\n", ctx->worker_id);
+        return -1;
+    }
+
+    for (unsigned i = 0; i < ctx->filter_graph->nb_filters; i++) {
+        ctx->filter_graph->filters[i]->hw_device_ctx = av_buffer_ref(ctx->hw_device_ctx);
+    }
+
+    if (avfilter_graph_config(ctx->filter_graph, NULL) < 0) {
+        fprintf(stderr, "[Worker %d] Failed to configure mosaic graph\n", ctx->worker_id);
+        return -1;
+    }
+    return 0;
+}
+
+// Decode the tile's next packet and feed its frames, stamped in microseconds
+// on the wall clock. At end of input the decoder is drained and the tile's
+// source closed.
+static void mosaic_tile_step(TranscodeContext *ctx, MosaicTile *tile) {
+    AVPacket *packet = ctx->pool.packet;
+    AVFrame *frame = ctx->pool.decoded_frame;
+
+    int ret = av_read_frame(tile->input, packet);
+    if (ret >= 0 && packet->stream_index != tile->video_idx) {
+        av_packet_unref(packet);
+        return;
+    }
+
+    avcodec_send_packet(tile->decoder, ret >= 0 ? packet : NULL);
+    av_packet_unref(packet);
+
+    AVRational tb = tile->input->streams[tile->video_idx]->time_base;
+    while (avcodec_receive_frame(tile->decoder, frame) == 0) {
+        int64_t ts = frame->best_effort_timestamp != AV_NOPTS_VALUE ? frame->best_effort_timestamp : frame->pts;
+        if (ts != AV_NOPTS_VALUE && tile->first_pts == AV_NOPTS_VALUE) {
+            tile->first_pts = ts;
+        }
+        tile->last_us = tile->offset_us +
+                        (ts != AV_NOPTS_VALUE ? av_rescale_q(ts - tile->first_pts, tb, AV_TIME_BASE_Q)
+                                              : (int64_t)tile->frames * (AV_TIME_BASE / SOURCE_FPS));
+        tile->frames++;
+
+        frame->pts = tile->last_us;
+        av_buffersrc_add_frame_flags(tile->src, frame, AV_BUFFERSRC_FLAG_KEEP_REF);
+        av_frame_unref(frame);
+    }
+
+    if (ret < 0) {
+        av_buffersrc_add_frame_flags(tile->src, NULL, 0);
+        tile->eof = 1;
+    }
+}
+
+// CUDA path: send background ticks up to until_us. Tiles are always fed
+// ahead of the canvas, so every tick finds its overlays already queued.
+static void mosaic_push_canvas(Mosaic *m, int64_t until_us) {
+    while (m->canvas_next_us <= until_us) {
+        m->canvas_frame->pts = m->canvas_next_us;
+        if (av_buffersrc_add_frame_flags(m->canvas, m->canvas_frame, AV_BUFFERSRC_FLAG_KEEP_REF) < 0) {
+            break;
+        }
+        m->canvas_next_us += AV_TIME_BASE / SOURCE_FPS;
+    }
+}
+
+// When the tile's recording started, in wall-clock microseconds: the muxer's
+// real-time start if the container carries one, else the file's mtime (the
+// recorder closes a segment when it ends) minus its duration.
+// AV_NOPTS_VALUE if neither is known.
+static int64_t mosaic_tile_start_us(const MosaicTile *tile, const char *path) {
+    struct stat st;
+    if (tile->input->start_time_realtime != AV_NOPTS_VALUE && tile->input->start_time_realtime > 0) {
+        return tile->input->start_time_realtime;
+    }
+    if (stat(path, &st) < 0 || tile->input->duration == AV_NOPTS_VALUE) {
+        return AV_NOPTS_VALUE;
+    }
+    int64_t end_us = (int64_t)st.st_mtim.tv_sec * AV_TIME_BASE + st.st_mtim.tv_nsec / 1000;
+    return end_us - tile->input->duration;
+}
+
+static void mosaic_close(TranscodeContext *ctx, Mosaic *m) {
+    for (int i = 0; i < MOSAIC_MAX_INPUTS; i++) {
+        if (m->tiles[i].input) avformat_close_input(&m->tiles[i].input);
+        avcodec_free_context(&m->tiles[i].decoder);
+    }
+    av_frame_free(&m->canvas_frame);
+
+    // The next job rebuilds the worker's scale_cuda graph
+    avfilter_graph_free(&ctx->filter_graph);
+    ctx->buffersrc_ctx = NULL;
+    ctx->buffersink_ctx = NULL;
+}
+
+// Callback view of a mosaic job: grid, scaling path and which inputs made it
+// onto the wall
+static cJSON *mosaic_json(const MosaicJob *mj, const Mosaic *m) {
+    char layout[16];
+    snprintf(layout, sizeof(layout), "%dx%d", mj->cols, mj->rows);
+
+    cJSON *json = cJSON_CreateObject();
+    cJSON_AddStringToObject(json, "layout", layout);
+    cJSON_AddStringToObject(json, "scaler", mj->software_scale ? "software" : "cuda");
+    cJSON_AddNumberToObject(json, "tileWidth", m->tile_width);
+    cJSON_AddNumberToObject(json, "tileHeight", m->tile_height);
+    cJSON *inputs = cJSON_AddArrayToObject(json, "inputs");
+    for (int i = 0; i < mj->nb_inputs; i++) {
+        cJSON *item = cJSON_CreateObject();
+        cJSON_AddStringToObject(item, "inputFile", mj->inputs[i]);
+        cJSON_AddBoolToObject(item, "composited", m->tiles[i].input != NULL);
+        cJSON_AddNumberToObject(item, "frames", m->tiles[i].frames);
+        cJSON_AddItemToArray(inputs, item);
+    }
+    return json;
+}
+
+// Composite the job's camera segments into one grid and encode it with the
+// main encoder. Inputs that cannot be opened leave a black cell; the job
+// only fails if none can.
+int process_mosaic(TranscodeContext *ctx, const TranscodeJob *job, OutputTarget *target,
+                   cJSON **mosaic_out) {
+    const MosaicJob *mj = job->mosaic;
+    char input_path[512];
+
+    if (prepare_output_target(target, job->output_format, job->codec_profile,
+                              job->camera_id, job->filename) < 0) {
+        return fail_job(ctx, FAILURE_TRANSIENT, 0, "prepare output directory");
+    }
+
+    fprintf(stderr, "[Worker %d] Mosaic %dx%d of %d cameras (%s scaling)\n", ctx->worker_id,
+            mj->cols, mj->rows, mj->nb_inputs, mj->software_scale ? "software" : "cuda");
+
+    ctx->timelapse = NULL;
+    ctx->codec_profile = job->codec_profile;
+    if (select_encoder(ctx) < 0) {
+        return fail_job(ctx, FAILURE_DEVICE, 0, "open encoder for profile %s",
+                        config.codec_profiles[job->codec_profile].name);
+    }
+
+    Mosaic m;
+    memset(&m, 0, sizeof(m));
+    m.tile_width = (ctx->encoder_ctx->width / mj->cols) & ~1;
+    m.tile_height = (ctx->encoder_ctx->height / mj->rows) & ~1;
+
+    job_index_stage(&job_index, job->job_id, "probing");
+    int nb_live = 0;
+    int64_t starts[MOSAIC_MAX_INPUTS];
+    int64_t wall_start = INT64_MAX;
+    for (int i = 0; i < mj->nb_inputs; i++) {
+        MosaicTile *tile = &m.tiles[i];
+        tile->first_pts = AV_NOPTS_VALUE;
+        tile->last_us = -1;
+
+        // Keep only the last tile's failure: it is the job's if none opens
+        ctx->failure = FAILURE_NONE;
+        snprintf(input_path, sizeof(input_path), "%s/%s", config.input_dir, mj->inputs[i]);
+        if (open_input_segment(ctx, input_path, NULL) < 0) {
+            if (ctx->input_ctx) avformat_close_input(&ctx->input_ctx);
+            fprintf(stderr, "[Worker %d] Mosaic tile %d left black: %s (%s)\n",
+                    ctx->worker_id, i, mj->inputs[i], ctx->failure_reason);
+            continue;
+        }
+        tile->decoder = open_cuvid_decoder(ctx);
+        if (!tile->decoder) {
+            avformat_close_input(&ctx->input_ctx);
+            fail_job(ctx, FAILURE_DEVICE, 0, "open tile decoder");
+            continue;
+        }
+        tile->input = ctx->input_ctx;
+        tile->video_idx = ctx->video_stream_idx;
+        ctx->input_ctx = NULL;
+        starts[i] = mosaic_tile_start_us(tile, input_path);
+        if (starts[i] != AV_NOPTS_VALUE && starts[i] < wall_start) wall_start = starts[i];
+        nb_live++;
+    }
+
+    // Tiles whose start is unknown line up with the earliest one
+    for (int i = 0; i < mj->nb_inputs; i++) {
+        MosaicTile *tile = &m.tiles[i];
+        if (!tile->input || starts[i] == AV_NOPTS_VALUE || wall_start == INT64_MAX) continue;
+        tile->offset_us = starts[i] - wall_start;
+        if (tile->offset_us > 0) {
+            fprintf(stderr, "[Worker %d] Mosaic tile %d starts %.3fs into the wall\n",
+                    ctx->worker_id, i, tile->offset_us / (double)AV_TIME_BASE);
+        }
+    }
+
+    if (nb_live == 0) {
+        mosaic_close(ctx, &m);
+        return fail_job(ctx, FAILURE_PERMANENT, 0, "no mosaic input could be opened");
+    }
+    ctx->failure = FAILURE_NONE;
+    ctx->failure_reason[0] = '\0';
+
+    // Replaces the worker's scale_cuda graph for the length of the job
+    if (reset_encoder(ctx) < 0) {
+        mosaic_close(ctx, &m);
+        return fail_job(ctx, FAILURE_DEVICE, 0, "reopen encoder");
+    }
+    avfilter_graph_free(&ctx->filter_graph);
+    if (mosaic_build_graph(ctx, &m, mj) < 0) {
+        mosaic_close(ctx, &m);
+        return fail_job(ctx, FAILURE_DEVICE, 0, "build mosaic filter graph");
+    }
+
+    AVStream *out_stream = open_output_file(ctx, target);
+    if (!out_stream) {
+        mosaic_close(ctx, &m);
+        return -1;
+    }
+
+    int frame_count = 0;
+    job_index_stage(&job_index, job->job_id, "transcoding");
+    while (!(ctx->cancel && *ctx->cancel)) {
+        // Step the live tile that is furthest behind
+        MosaicTile *next = NULL;
+        for (int i = 0; i < mj->nb_inputs; i++) {
+            MosaicTile *tile = &m.tiles[i];
+            if (tile->input && !tile->eof && (!next || tile->last_us < next->last_us)) {
+                next = tile;
+            }
+        }
+        if (!next) break;
+
+        mosaic_tile_step(ctx, next);
+
+        if (m.canvas) {
+            int64_t horizon = INT64_MAX;
+            for (int i = 0; i < mj->nb_inputs; i++) {
+                MosaicTile *tile = &m.tiles[i];
+                if (tile->input && !tile->eof && tile->last_us < horizon) horizon = tile->last_us;
+            }
+            if (horizon != INT64_MAX) mosaic_push_canvas(&m, horizon);
+        }
+        drain_filter(ctx, out_stream, &frame_count);
+    }
+
+    // Run the canvas out to the longest tile; finished tiles hold their last frame
+    if (m.canvas) {
+        int64_t end_us = 0;
+        for (int i = 0; i < mj->nb_inputs; i++) {
+            if (m.tiles[i].last_us > end_us) end_us = m.tiles[i].last_us;
+        }
+        mosaic_push_canvas(&m, end_us);
+    }
+
+    job_index_stage(&job_index, job->job_id, "finalizing");
+    finish_output(ctx, out_stream, &frame_count);
+
+    if (ctx->cancel && *ctx->cancel) {
+        fprintf(stderr, "[Worker %d] Cancelled: %s after %d frames\n",
+                ctx->worker_id, job->filename, frame_count);
+        unlink(target->path);
+        mosaic_close(ctx, &m);
+        return -1;
+    }
+
+    if (verify_output(ctx, target) < 0) {
+        mosaic_close(ctx, &m);
+        return -1;
+    }
+    if (target->format == OUTPUT_FORMAT_CMAF &&
+        publish_cmaf_segment(target, frame_count * av_q2d(ctx->encoder_ctx->time_base)) < 0) {
+        mosaic_close(ctx, &m);
+        return fail_job(ctx, FAILURE_TRANSIENT, 0, "publish CMAF segment");
+    }
+
+    codec_stats_note_output(ctx, job->codec_profile, frame_count);
+
+    pthread_mutex_lock(&stats_mutex);
+    mosaic_jobs[mj->software_scale ? 1 : 0]++;
+    mosaic_tiles_composited += nb_live;
+    mosaic_tiles_failed += mj->nb_inputs - nb_live;
+    pthread_mutex_unlock(&stats_mutex);
+
+    fprintf(stderr, "[Worker %d] ✓ Mosaic: %s (%d/%d cameras, %d frames)\n",
+            ctx->worker_id, target->name, nb_live, mj->nb_inputs, frame_count);
+
+    *mosaic_out = mosaic_json(mj, &m);
+    mosaic_close(ctx, &m);
+    return 0;
+}
+
+// ============================================================================
+// HTTP Callback Notification
+// ============================================================================
+
+// Callback for curl to discard response data
+static size_t discard_response_callback(void *contents, size_t size, size_t nmemb, void *userp) {
+    return size * nmemb;  // Discard response
+}
+
+int local_notify(const char *target, const char *output_file, int frame_count,
+                 int processing_time_ms, const char *status, const cJSON *extra);
+int amqp_notify(const char *target, const char *input_file, const char *output_file,
+                int frame_count, int processing_time_ms, const char *metadata_json,
+                const char *status, const cJSON *extra);
+
+// Send completion notification to callback URL
+// Fields of the optional extra object are copied into the payload.
+// "local:" targets are jobs submitted over the local socket that asked for a
+// completion frame on their connection; "amqp:" targets came from RabbitMQ.
+int send_completion_callback(const char *callback_url, const char *input_file,
+                             const char *output_file, int frame_count,
+                             int processing_time_ms, const char *metadata_json,
+                             const char *status, const cJSON *extra) {
+    if (!callback_url || strlen(callback_url) == 0) {
+        return 0;  // No callback URL provided, skip
+    }
+    if (strncmp(callback_url, "local:", 6) == 0) {
+        return local_notify(callback_url, output_file, frame_count, processing_time_ms, status, extra);
+    }
+    if (strncmp(callback_url, "amqp:", 5) == 0) {
+        return amqp_notify(callback_url, input_file, output_file, frame_count,
+                           processing_time_ms, metadata_json, status, extra);
+    }
+
+    CURL *curl = curl_easy_init();
+    if (!curl) {
+        fprintf(stderr, "[Callback] Failed to initialize curl\n");
+        return -1;
+    }
+
+    // Build JSON payload
+    cJSON *json = cJSON_CreateObject();
+    cJSON_AddStringToObject(json, "status", status);
+    cJSON_AddStringToObject(json, "inputFile", input_file);
+    cJSON_AddStringToObject(json, "outputFile", output_file);
+    cJSON_AddNumberToObject(json, "frameCount", frame_count);
+    cJSON_AddNumberToObject(json, "processingTimeMs", processing_time_ms);
+
+    // Add metadata if provided
+    if (metadata_json && strlen(metadata_json) > 0) {
+        cJSON *metadata = cJSON_Parse(metadata_json);
+        if (metadata) {
+            cJSON_AddItemToObject(json, "metadata", metadata);
+        }
+    }
+
+    if (extra) {
+        const cJSON *item;
+        cJSON_ArrayForEach(item, extra) {
+            cJSON_AddItemToObject(json, item->string, cJSON_Duplicate(item, 1));
+        }
+    }
+
+    char *json_str = cJSON_PrintUnformatted(json);
+
+    // Configure curl
+    curl_easy_setopt(curl, CURLOPT_URL, callback_url);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, json_str);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, discard_response_callback);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L);
+
+    struct curl_slist *headers = NULL;
+    headers = curl_slist_append(headers, "Content-Type: application/json");
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+
+    // Perform request
+    CURLcode res = curl_easy_perform(curl);
+
+    if (res != CURLE_OK) {
+        fprintf(stderr, "[Callback] Failed to send callback: %s\n", curl_easy_strerror(res));
+    } else {
+        fprintf(stderr, "[Callback] ✓ Sent to %s\n", callback_url);
+    }
+
+    // Cleanup
+    curl_slist_free_all(headers);
+    curl_easy_cleanup(curl);
+    free(json_str);
+    cJSON_Delete(json);
+
+    return (res == CURLE_OK) ? 0 : -1;
+}
+
+// ============================================================================
+// Worker Pool
+// ============================================================================
+
+void *worker_thread(void *arg);
+
+void worker_pool_init(WorkerPool *pool) {
+    memset(pool->slots, 0, sizeof(pool->slots));
+    pool->target = 0;
+    pool->active = 0;
+    pool->adaptive = 0;
+    pool->warm = 0;
+    pool->started_ms = 0;
+    pool->first_warm_ms = -1;
+    pool->all_warm_ms = -1;
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->unpark, NULL);
+}
+
+// Recompute parked flags from pool->active (caller holds pool->mutex)
+static void worker_pool_apply_active(WorkerPool *pool) {
+    if (!pool->adaptive || pool->active > pool->target) {
+        pool->active = pool->target;
+    }
+    for (int i = 0; i < MAX_WORKERS_LIMIT; i++) {
+        pool->slots[i].parked = i >= pool->active;
+    }
+    pthread_cond_broadcast(&pool->unpark);
+}
+
+// Block while the worker is parked. Its pipeline and device session stay
+// allocated, so rejoining the active set costs nothing.
+void worker_park(WorkerPool *pool, int worker_id) {
+    WorkerSlot *slot = &pool->slots[worker_id];
+
+    pthread_mutex_lock(&pool->mutex);
+    while (slot->parked && !slot->retire) {
+        pthread_cond_wait(&pool->unpark, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+// Called when queue_pop() returns without a job. The exit decision is taken
+// under the pool lock so a concurrent resize never loses a slot.
+int worker_should_exit(WorkerPool *pool, int worker_id) {
+    pthread_mutex_lock(&task_queue.mutex);
+    int closed = task_queue.closed;
+    pthread_mutex_unlock(&task_queue.mutex);
+
+    pthread_mutex_lock(&pool->mutex);
+    WorkerSlot *slot = &pool->slots[worker_id];
+    int should_exit = (closed && !slot->parked) || slot->retire;
+    if (should_exit) {
+        slot->running = 0;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    return should_exit;
+}
+
+void worker_mark_stopped(WorkerPool *pool, int worker_id) {
+    pthread_mutex_lock(&pool->mutex);
+    WorkerSlot *slot = &pool->slots[worker_id];
+    if (!slot->restarting) {
+        slot->running = 0;
+    }
+    if (slot->warm) {
+        slot->warm = 0;
+        pool->warm--;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+// A worker's pipeline became ready for jobs (or went cold while it moves to
+// another device). The first and last warm-ups are timed from the first
+// resize so restarts can be compared.
+void worker_set_warm(WorkerPool *pool, int worker_id, int warm) {
+    pthread_mutex_lock(&pool->mutex);
+    WorkerSlot *slot = &pool->slots[worker_id];
+    if (slot->warm != warm) {
+        slot->warm = warm;
+        pool->warm += warm ? 1 : -1;
+    }
+    if (warm) {
+        long long elapsed = monotonic_ms() - pool->started_ms;
+        if (pool->first_warm_ms < 0) {
+            pool->first_warm_ms = elapsed;
+        }
+        if (pool->all_warm_ms < 0 && pool->warm >= pool->target) {
+            pool->all_warm_ms = elapsed;
+            fprintf(stderr, "[Pool] All %d pipelines warm after %lldms\n", pool->warm, elapsed);
+        }
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+int worker_pool_warm(WorkerPool *pool) {
+    pthread_mutex_lock(&pool->mutex);
+    int n = pool->warm;
+    pthread_mutex_unlock(&pool->mutex);
+    return n;
+}
+
+int worker_pool_running(WorkerPool *pool) {
+    int n = 0;
+    pthread_mutex_lock(&pool->mutex);
+    for (int i = 0; i < MAX_WORKERS_LIMIT; i++) {
+        if (pool->slots[i].running && !pool->slots[i].retire) n++;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return n;
+}
+
+// Running workers currently parked by the adaptive controller
+int worker_pool_parked(WorkerPool *pool) {
+    int n = 0;
+    pthread_mutex_lock(&pool->mutex);
+    for (int i = 0; i < MAX_WORKERS_LIMIT; i++) {
+        if (pool->slots[i].running && !pool->slots[i].retire && pool->slots[i].parked) n++;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return n;
+}
+
+// Set how many workers may take jobs; the rest park with warm pipelines.
+// Returns the effective active count (clamped to 1..target).
+int worker_pool_set_active(WorkerPool *pool, int active) {
+    pthread_mutex_lock(&pool->mutex);
+    if (active > pool->target) active = pool->target;
+    if (active < 1) active = 1;
+    pool->active = active;
+    worker_pool_apply_active(pool);
+    pthread_mutex_unlock(&pool->mutex);
+
+    // Idle workers that were just parked leave queue_pop()
+    pthread_mutex_lock(&task_queue.mutex);
+    pthread_cond_broadcast(&task_queue.not_empty);
+    pthread_mutex_unlock(&task_queue.mutex);
+
+    return active;
+}
+
+// Grow or shrink the pool. New workers build their own pipelines concurrently
+// (bounded per device by device_warmup_begin); surplus workers finish their
+// in-flight job, release their device and exit. A slot left by a retired
+// worker is claimed under the lock but its thread is joined outside it: that
+// thread may still be tearing down its pipeline and takes pool->mutex on
+// its way out.
+// Returns the new target size.
+int worker_pool_resize(WorkerPool *pool, int target) {
+    if (target < 1) target = 1;
+    if (target > MAX_WORKERS_LIMIT) target = MAX_WORKERS_LIMIT;
+
+    int start[MAX_WORKERS_LIMIT];
+    pthread_t reap[MAX_WORKERS_LIMIT];
+    int reap_started[MAX_WORKERS_LIMIT];
+    int nb_start = 0;
+
+    pthread_mutex_lock(&pool->mutex);
+    if (pool->started_ms == 0) {
+        pool->started_ms = monotonic_ms();
+    }
+    pool->target = target;
+    worker_pool_apply_active(pool);
+
+    for (int i = 0; i < MAX_WORKERS_LIMIT; i++) {
+        WorkerSlot *slot = &pool->slots[i];
+
+        if (i >= target) {
+            if (slot->running) slot->retire = 1;
+            continue;
+        }
+        if (slot->running) {
+            slot->retire = 0;  // Cancel a pending retirement
+            continue;
+        }
+
+        // Claim the slot; a previously retired thread is reaped below
+        start[nb_start] = i;
+        reap[nb_start] = slot->thread;
+        reap_started[nb_start++] = slot->started;
+        slot->started = 0;
+        slot->retire = 0;
+        slot->running = 1;
+        slot->restarting = 1;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (int k = 0; k < nb_start; k++) {
+        int i = start[k];
+        WorkerSlot *slot = &pool->slots[i];
+
+        if (reap_started[k]) {
+            pthread_join(reap[k], NULL);
+        }
+
+        int *worker_id = malloc(sizeof(int));
+        *worker_id = i;
+        pthread_mutex_lock(&pool->mutex);
+        slot->restarting = 0;
+        if (pthread_create(&slot->thread, NULL, worker_thread, worker_id) != 0) {
+            fprintf(stderr, "[Pool] Failed to start worker %d\n", i);
+            slot->running = 0;
+            free(worker_id);
+        } else {
+            slot->started = 1;
+        }
+        pthread_mutex_unlock(&pool->mutex);
+    }
+
+    // Wake idle workers so the retiring ones notice
+    pthread_mutex_lock(&task_queue.mutex);
+    pthread_cond_broadcast(&task_queue.not_empty);
+    pthread_mutex_unlock(&task_queue.mutex);
+
+    fprintf(stderr, "[Pool] Worker pool resized to %d\n", target);
+    return target;
+}
+
+// Wait for every worker thread to exit (after queue_close)
+void worker_pool_join(WorkerPool *pool) {
+    for (int i = 0; i < MAX_WORKERS_LIMIT; i++) {
+        pthread_mutex_lock(&pool->mutex);
+        int started = pool->slots[i].started;
+        pthread_t thread = pool->slots[i].thread;
+        pool->slots[i].started = 0;
+        pthread_mutex_unlock(&pool->mutex);
+
+        if (started) {
+            pthread_join(thread, NULL);
+        }
+    }
+}
+
+// ============================================================================
+// Adaptive Concurrency
+// ============================================================================
+
+static const char *adaptive_action_names[ADAPT_NB_ACTIONS] = {
+    "increase", "decrease", "backoff", "hold", "idle"
+};
+
+void adaptive_init(AdaptiveController *c, const TranscoderConfig *cfg) {
+    memset(c, 0, sizeof(*c));
+    c->enabled = cfg->adaptive;
+    c->min_workers = cfg->adaptive_min;
+    c->max_workers = cfg->adaptive_max;
+    c->interval_seconds = cfg->adaptive_interval;
+    c->limit = cfg->workers;
+    if (c->limit < c->min_workers) c->limit = c->min_workers;
+    if (c->limit > c->max_workers) c->limit = c->max_workers;
+    c->direction = 1;
+    c->last_action = ADAPT_HOLD;
+    pthread_mutex_init(&c->mutex, NULL);
+}
+
+// Record one finished file's processing time for the next sample
+void adaptive_record(AdaptiveController *c, int processing_ms) {
+    if (!c->enabled) return;
+    pthread_mutex_lock(&c->mutex);
+    c->latency_sum_ms += processing_ms;
+    c->latency_count++;
+    pthread_mutex_unlock(&c->mutex);
+}
+
+// One control step. Throughput is only meaningful while there is a backlog:
+// with fewer queued jobs than active workers the rate follows demand, so the
+// controller holds. Otherwise it hill-climbs (keep direction while throughput
+// improves, reverse when it drops, step back after a fruitless probe) and
+// backs off multiplicatively when per-file latency blows past its baseline.
+static void adaptive_step(AdaptiveController *c) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    pthread_mutex_lock(&stats_mutex);
+    int completed = files_processed + files_failed;
+    pthread_mutex_unlock(&stats_mutex);
+
+    pthread_mutex_lock(&task_queue.mutex);
+    int depth = task_queue.count;
+    pthread_mutex_unlock(&task_queue.mutex);
+
+    pthread_mutex_lock(&worker_pool.mutex);
+    int ceiling = c->max_workers < worker_pool.target ? c->max_workers : worker_pool.target;
+    pthread_mutex_unlock(&worker_pool.mutex);
+
+    pthread_mutex_lock(&c->mutex);
+
+    double elapsed = (now.tv_sec - c->sampled_at.tv_sec) +
+                     (now.tv_nsec - c->sampled_at.tv_nsec) / 1e9;
+    c->throughput = elapsed > 0 ? (completed - c->completed_last) / elapsed : 0.0;
+    c->latency_ms = c->latency_count > 0 ? (double)c->latency_sum_ms / c->latency_count : 0.0;
+    c->completed_last = completed;
+    c->sampled_at = now;
+    c->latency_sum_ms = 0;
+    c->latency_count = 0;
+
+    // Baseline tracks the best latency seen, drifting up slowly so a change
+    // in input mix does not pin the controller in permanent backoff
+    if (c->latency_ms > 0) {
+        if (c->baseline_latency_ms == 0 || c->latency_ms < c->baseline_latency_ms) {
+            c->baseline_latency_ms = c->latency_ms;
+        } else {
+            c->baseline_latency_ms += (c->latency_ms - c->baseline_latency_ms) * 0.02;
+        }
+    }
+
+    int limit = c->limit;
+    AdaptiveAction action;
+
+    if (depth < limit) {
+        action = ADAPT_IDLE;
+        c->last_throughput = 0;  // Re-measure once a backlog builds up
+    } else if (c->baseline_latency_ms > 0 &&
+               c->latency_ms > c->baseline_latency_ms * ADAPTIVE_LATENCY_FACTOR &&
+               limit > c->min_workers) {
+        action = ADAPT_BACKOFF;
+        int reduced = (int)(limit * ADAPTIVE_BACKOFF);
+        limit = reduced < limit ? reduced : limit - 1;
+        c->direction = 1;  // Additive increase from here
+    } else if (c->last_throughput == 0) {
+        action = ADAPT_HOLD;  // First loaded sample: establish a reference
+    } else {
+        double gain = (c->throughput - c->last_throughput) / c->last_throughput;
+        if (gain > ADAPTIVE_GAIN_THRESHOLD) {
+            limit += c->direction;
+        } else if (gain < -ADAPTIVE_GAIN_THRESHOLD) {
+            c->direction = -c->direction;
+            limit += c->direction;
+        } else if (c->last_action == ADAPT_INCREASE) {
+            // The extra worker bought nothing: give it back
+            c->direction = -1;
+            limit -= 1;
+        } else if (++c->hold_intervals >= ADAPTIVE_PROBE_INTERVALS) {
+            c->direction = 1;
+            limit += 1;
+        }
+        action = limit > c->limit ? ADAPT_INCREASE : limit < c->limit ? ADAPT_DECREASE : ADAPT_HOLD;
+    }
+
+    if (limit < c->min_workers) limit = c->min_workers;
+    if (limit > ceiling) limit = ceiling;
+    if (limit == c->limit && (action == ADAPT_INCREASE || action == ADAPT_DECREASE)) {
+        action = ADAPT_HOLD;  // Pinned at a bound
+        c->direction = -c->direction;
+    }
+    if (action != ADAPT_HOLD) {
+        c->hold_intervals = 0;
+    }
+
+    if (action != ADAPT_IDLE && c->throughput > 0) {
+        c->last_throughput = c->throughput;
+    }
+    c->limit = limit;
+    c->last_action = action;
+    c->decisions[action]++;
+
+    double throughput = c->throughput;
+    double latency_ms = c->latency_ms;
+    pthread_mutex_unlock(&c->mutex);
+
+    worker_pool_set_active(&worker_pool, limit);
+
+    if (action != ADAPT_IDLE && action != ADAPT_HOLD) {
+        fprintf(stderr, "\n[Adaptive] %.2f files/s, %.0fms/file, queue %d: %s to %d active workers\n",
+                throughput, latency_ms, depth, adaptive_action_names[action], limit);
+    }
+}
+
+void *adaptive_thread(void *arg) {
+    AdaptiveController *c = arg;
+
+    fprintf(stderr, "[Adaptive] Controller started: %d..%d workers, %ds interval\n",
+            c->min_workers, c->max_workers, c->interval_seconds);
+
+    pthread_mutex_lock(&stats_mutex);
+    c->completed_last = files_processed + files_failed;
+    pthread_mutex_unlock(&stats_mutex);
+    clock_gettime(CLOCK_MONOTONIC, &c->sampled_at);
+
+    int waited = 0;
+    while (processing_active) {
+        sleep(1);
+        if (++waited < c->interval_seconds) continue;
+        waited = 0;
+        adaptive_step(c);
+    }
+    return NULL;
+}
+
+// Hand the pool over to the controller (before the workers start)
+int adaptive_start(AdaptiveController *c) {
+    if (!c->enabled) return 0;
+
+    pthread_mutex_lock(&worker_pool.mutex);
+    worker_pool.adaptive = 1;
+    worker_pool.active = c->limit;
+    pthread_mutex_unlock(&worker_pool.mutex);
+
+    if (pthread_create(&c->thread, NULL, adaptive_thread, c) != 0) {
+        fprintf(stderr, "[Adaptive] Failed to start controller\n");
+        return -1;
+    }
+    c->started = 1;
+    return 0;
+}
+
+// Stop the controller and unpark every worker so the queue drains at full
+// width and parked workers can observe shutdown
+void adaptive_stop(AdaptiveController *c) {
+    if (c->started) {
+        pthread_join(c->thread, NULL);
+        c->started = 0;
+    }
+
+    pthread_mutex_lock(&worker_pool.mutex);
+    worker_pool.adaptive = 0;
+    worker_pool_apply_active(&worker_pool);
+    pthread_mutex_unlock(&worker_pool.mutex);
+}
+
+// ============================================================================
+// Worker Thread
+// ============================================================================
+
+// Cleanup per-file resources (input/output contexts only)
+// Called after each file - keeps persistent pipeline alive
+void cleanup_file_contexts(TranscodeContext *ctx) {
+    if (ctx->input_ctx) {
+        avformat_close_input(&ctx->input_ctx);
+        ctx->input_ctx = NULL;
+    }
+    if (ctx->s3_sink) {
+        // Output abandoned (cancelled or failed): drop the partial upload
+        char err[160];
+        s3_output_close(ctx, 0, err, sizeof(err));
+    }
+    if (ctx->output_ctx) {
+        if (!(ctx->output_ctx->oformat->flags & AVFMT_NOFILE)) {
+            avio_closep(&ctx->output_ctx->pb);
+        }
+        avformat_free_context(ctx->output_ctx);
+        ctx->output_ctx = NULL;
+    }
+    if (ctx->timelapse_encoder) {
+        // A second NVENC session counts against the GPU's session limit:
+        // hold it for the time-lapse job only, whatever its outcome
+        if (ctx->encoder_ctx == ctx->timelapse_encoder) {
+            ctx->encoder_ctx = ctx->profile_encoders[0];
+            ctx->encoder_slot = 0;
+        }
+        avcodec_free_context(&ctx->timelapse_encoder);
+        ctx->encoders_fed &= ~(1u << MAX_CODEC_PROFILES);
+    }
+}
+
+// Cleanup persistent pipeline resources
+// Called once at worker thread exit
+void cleanup_persistent_pipeline(TranscodeContext *ctx) {
+    if (ctx->decoder_ctx) {
+        avcodec_free_context(&ctx->decoder_ctx);
+        ctx->decoder_ctx = NULL;
+    }
+    ctx->encoder_ctx = NULL;
+    for (int i = 0; i < MAX_CODEC_PROFILES; i++) {
+        avcodec_free_context(&ctx->profile_encoders[i]);
+    }
+    avcodec_free_context(&ctx->timelapse_encoder);
+    if (ctx->filter_graph) {
+        avfilter_graph_free(&ctx->filter_graph);
+        ctx->filter_graph = NULL;
+    }
+    frame_pool_free(&ctx->pool);
+}
+
+// Release the worker's pipeline and its device session
+void worker_detach_device(TranscodeContext *ctx) {
+    if (!device_manager.simulated) {
+        cleanup_persistent_pipeline(ctx);
+
+        if (ctx->cuda_stream) {
+            cudaStreamSynchronize(ctx->cuda_stream);
+            cudaStreamDestroy(ctx->cuda_stream);
+            ctx->cuda_stream = NULL;
+        }
+        if (ctx->hw_device_ctx) {
+            av_buffer_unref(&ctx->hw_device_ctx);
+        }
+    }
+
+    device_release(&device_manager, ctx->gpu_id);
+    ctx->gpu_id = -1;
+}
+
+// Bind the worker to the least-loaded healthy device and build its persistent
+// pipeline there. A device that fails pipeline setup is reported and the
+// next-best device is tried. Returns 0 once attached, -1 on shutdown.
+int worker_attach_device(TranscodeContext *ctx, int exclude) {
+    while (1) {
+        int device_id = device_acquire(&device_manager, exclude);
+        if (device_id < 0) {
+            // Every device is full or quarantined: wait for capacity
+            pthread_mutex_lock(&task_queue.mutex);
+            int closed = task_queue.closed;
+            pthread_mutex_unlock(&task_queue.mutex);
+            if (closed) return -1;
+            sleep(1);
+            continue;
+        }
+
+        ctx->gpu_id = device_id;
+        affinity_pin_worker(&affinity, ctx->worker_id, device_id);
+        if (device_manager.simulated) {
+            fprintf(stderr, "[Worker %d] Using simulated device %d\n", ctx->worker_id, device_id);
+            return 0;
+        }
+
+        int ret;
+        device_warmup_begin(&device_manager, device_id);
+        if (software_backend) {
+            ret = setup_persistent_pipeline(ctx);
+        } else {
+            cudaSetDevice(device_id);
+
+            // Initialize CUDA hardware context, then the persistent GPU pipeline
+            // (ONCE per device binding, not per file!)
+            ret = init_hw_device_ctx(ctx) == 0 ? setup_persistent_pipeline(ctx) : -1;
+        }
+        device_warmup_end(&device_manager, device_id);
+        if (ret == 0) {
+            return 0;
+        }
+
+        fprintf(stderr, "[Worker %d] Pipeline setup failed on GPU %d, trying another device\n",
+                ctx->worker_id, device_id);
+        worker_detach_device(ctx);
+        device_report(&device_manager, device_id, 0, 0);
+        exclude = device_id;
+        sleep(1);
+    }
+}
+
+// Drop a job whose deadline passed while it was queued
+static void worker_shed_job(int worker_id, const TranscodeJob *job) {
+    long long now = monotonic_ms();
+
+    fprintf(stderr, "[Worker %d] Shedding expired %s job: %s (%lldms past deadline)\n",
+            worker_id, priority_names[job->priority], job->filename, now - job->deadline_ms);
+
+    cJSON *extra = cJSON_CreateObject();
+    cJSON_AddStringToObject(extra, "priority", priority_names[job->priority]);
+    cJSON_AddNumberToObject(extra, "queuedMs", (double)(now - job->enqueued_ms));
+    cJSON_AddNumberToObject(extra, "deadlineMissedByMs", (double)(now - job->deadline_ms));
+    send_completion_callback(job->callback_url, job->filename, "", 0, 0,
+                             job->metadata_json, "expired", extra);
+    cJSON_Delete(extra);
+
+    scheduler_note_expired(job->priority);
+    job_index_finish(&job_index, job->job_id, JOB_EXPIRED, NULL, 0);
+}
+
+// Decide what happens to a failed job. Transient and device failures go back
+// through the retry wheel with backoff so the worker moves on immediately; permanent ones
+// are quarantined. Exhausted retries just fail: the input may be fine next
+// time. Returns 1 if a retry was scheduled.
+static int worker_retry_job(TranscodeContext *ctx, TranscodeJob *job) {
+    // Unclassified failures are retried; maxRetries bounds the loop
+    FailureKind kind = ctx->failure != FAILURE_NONE ? ctx->failure : FAILURE_TRANSIENT;
+    const char *reason = ctx->failure_reason[0] ? ctx->failure_reason : "unclassified error";
+    int nb_ids = job->group ? job->group->nb_segments : 1;
+
+    job->attempts++;
+    for (int i = 0; i < nb_ids; i++) {
+        const char *id = job->group ? job->group->segments[i].job_id : job->job_id;
+        job_index_note_failure(&job_index, id, reason, job->attempts);
+    }
+
+    pthread_mutex_lock(&retry_wheel.mutex);
+    retry_wheel.failures[kind]++;
+    pthread_mutex_unlock(&retry_wheel.mutex);
+
+    int retriable = kind == FAILURE_TRANSIENT || kind == FAILURE_DEVICE;
+    if (retriable && job->attempts <= config.max_retries) {
+        int delay_ms = retry_backoff_ms(job->attempts);
+        if (retry_schedule(&retry_wheel, job, delay_ms) >= 0) {
+            for (int i = 0; i < nb_ids; i++) {
+                job_index_requeue(&job_index, job->group ? job->group->segments[i].job_id : job->job_id);
+            }
+            pthread_mutex_lock(&retry_wheel.mutex);
+            retry_wheel.retries_total++;
+            pthread_mutex_unlock(&retry_wheel.mutex);
+
+            fprintf(stderr, "[Worker %d] %s failure on %s (%s), retry %d/%d in %dms\n",
+                    ctx->worker_id, kind == FAILURE_DEVICE ? "Device" : "Transient", job->filename,
+                    reason, job->attempts, config.max_retries, delay_ms);
+            return 1;
+        }
+    }
+
+    if (retriable) {
+        pthread_mutex_lock(&retry_wheel.mutex);
+        retry_wheel.exhausted_total++;
+        pthread_mutex_unlock(&retry_wheel.mutex);
+        fprintf(stderr, "[Worker %d] Giving up on %s after %d attempts (%s)\n",
+                ctx->worker_id, job->filename, job->attempts, reason);
+        return 0;
+    }
+    if (job->group) {
+        for (int i = 0; i < job->group->nb_segments; i++) {
+            quarantine_add(&quarantine, job->group->segments[i].filename, reason, job->attempts);
+        }
+    } else {
+        quarantine_add(&quarantine, job->filename, reason, job->attempts);
+    }
+    return 0;
+}
+
+// Failure details for the "failed" callback
+static cJSON *failure_json(const TranscodeContext *ctx, const TranscodeJob *job) {
+    cJSON *extra = cJSON_CreateObject();
+    FailureKind kind = ctx->failure != FAILURE_NONE ? ctx->failure : FAILURE_TRANSIENT;
+    cJSON_AddStringToObject(extra, "failureKind", failure_kind_names[kind]);
+    cJSON_AddStringToObject(extra, "reason",
+                            ctx->failure_reason[0] ? ctx->failure_reason : "unclassified error");
+    cJSON_AddNumberToObject(extra, "attempts", job->attempts);
+    return extra;
+}
+
+// Feed the job outcome to the device manager and move the pipeline when its
+// device was quarantined or another device is clearly less loaded.
+// Returns -1 if the worker could not be re-attached (shutdown).
+static int worker_report_job(TranscodeContext *ctx, int ok, int processing_ms) {
+    device_report(&device_manager, ctx->gpu_id, ok, processing_ms);
+
+    // Worker processes keep their pipelines on their own device
+    if (worker_processes.shm || !device_should_migrate(&device_manager, ctx->gpu_id)) {
+        return 0;
+    }
+
+    int old_device = ctx->gpu_id;
+    fprintf(stderr, "[Worker %d] Migrating pipeline away from device %d\n", ctx->worker_id, old_device);
+    worker_set_warm(&worker_pool, ctx->worker_id, 0);
+    worker_detach_device(ctx);
+    if (worker_attach_device(ctx, old_device) < 0) {
+        return -1;
+    }
+    worker_set_warm(&worker_pool, ctx->worker_id, 1);
+
+    pthread_mutex_lock(&device_manager.mutex);
+    device_manager.devices[ctx->gpu_id].migrations_in++;
+    pthread_mutex_unlock(&device_manager.mutex);
+    return 0;
+}
+
+int worker_processes_wait_warm(WorkerProcesses *wp, int worker_id);
+int worker_process_run(TranscodeContext *ctx, const TranscodeJob *job, OutputTarget *target,
+                       int *frames, cJSON **result_json);
+
+void *worker_thread(void *arg) {
+    int worker_id = *(int*)arg;
+    free(arg);
+
+    fprintf(stderr, "[Worker %d] Started\n", worker_id);
+
+    TranscodeContext ctx = {0};
+    ctx.worker_id = worker_id;
+    ctx.gpu_id = -1;
+    unsigned int sim_seed = (unsigned int)(time(NULL) ^ (worker_id * 2654435761u));
+
+    // In no-GPU mode, skip hardware initialization. With worker processes
+    // the pipelines live in the children; wait until one is ready for us.
+    if (worker_processes.shm) {
+        if (worker_processes_wait_warm(&worker_processes, worker_id) < 0) {
+            worker_mark_stopped(&worker_pool, worker_id);
+            return NULL;
+        }
+    } else if (!no_gpu_mode) {
+        if (worker_attach_device(&ctx, -1) < 0) {
+            fprintf(stderr, "[Worker %d] No device available\n", worker_id);
+            worker_mark_stopped(&worker_pool, worker_id);
+            return NULL;
+        }
+    }
+    worker_set_warm(&worker_pool, worker_id, 1);
+
+    TranscodeJob job;
+
+    while (1) {
+        worker_park(&worker_pool, worker_id);
+
+        if (!queue_pop(&task_queue, &job, &worker_pool.slots[worker_id])) {
+            if (worker_should_exit(&worker_pool, worker_id)) {
+                break;
+            }
+            continue;  // Parked, or retirement withdrawn by a concurrent resize
+        }
+
+        if (job.expired) {
+            worker_shed_job(worker_id, &job);
+            continue;
+        }
+
+        // Helper of a split input: the worker that split it owns the record
+        if (job.chunked) {
+            ctx.cancel = job.chunked->cancel;
+        } else {
+            ctx.cancel = job_index_start(&job_index, job.job_id, worker_id);
+        }
+
+        // Cancelled between dequeue and pickup: nothing to do
+        if (!job.chunked && ctx.cancel && *ctx.cancel) {
+            job_index_finish(&job_index, job.job_id, JOB_CANCELLED, NULL, 0);
+            send_completion_callback(job.callback_url, job.filename, "",
+                                     0, 0, job.metadata_json, "cancelled", NULL);
+            free(job.mosaic);
+            ctx.cancel = NULL;
+            continue;
+        }
+
+        int result = 0;
+        int retrying = 0;
+        ChunkedJob *chunked = NULL;
+        const char *output_name = "";
+        int output_frames = 0;
+        int processing_ms = 0;
+        struct timespec start, end;
+        ctx.failure = FAILURE_NONE;
+        ctx.failure_reason[0] = '\0';
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        if (no_gpu_mode) {
+            // Phase 1: No-GPU mode - just echo back input path
+            fprintf(stderr, "[Worker %d] ⚠️  NO-GPU mode: %s (would transcode if GPU available)\n",
+                    worker_id, job.filename);
+
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            processing_ms = (end.tv_sec - start.tv_sec) * 1000 +
+                            (end.tv_nsec - start.tv_nsec) / 1000000;
+
+            // Send callback with input path as output (Phase 1 behavior)
+            send_completion_callback(job.callback_url, job.filename, job.filename,
+                                    0, processing_ms, job.metadata_json, "completed", NULL);
+
+            fprintf(stderr, "[Worker %d] ✓ Acknowledgment sent - S3Uploader will upload raw segment\n",
+                    worker_id);
+            result = 0;
+            output_name = job.filename;
+        } else if (device_manager.simulated) {
+            // Simulated device: exercise scheduling without touching a GPU
+            result = worker_processes.shm ? worker_process_run(&ctx, &job, NULL, NULL, NULL)
+                                          : simulated_process(&device_manager, ctx.gpu_id, &sim_seed);
+
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            processing_ms = (end.tv_sec - start.tv_sec) * 1000 +
+                            (end.tv_nsec - start.tv_nsec) / 1000000;
+
+            if (result == 0) {
+                output_name = job.filename;
+                send_completion_callback(job.callback_url, job.filename, output_name,
+                                        0, processing_ms, job.metadata_json, "completed", NULL);
+            } else {
+                // Simulated device errors stand in for transient hardware faults,
+                // simulated corrupt inputs for permanent failures
+                if (ctx.failure == FAILURE_NONE) {
+                    if (result == -2) {
+                        fail_job(&ctx, FAILURE_PERMANENT, 0, "simulated corrupt input");
+                    } else {
+                        fail_job(&ctx, FAILURE_DEVICE, 0, "simulated device error");
+                    }
+                }
+                retrying = worker_retry_job(&ctx, &job);
+                if (!retrying) {
+                    cJSON *extra = failure_json(&ctx, &job);
+                    send_completion_callback(job.callback_url, job.filename, "",
+                                            0, processing_ms, job.metadata_json, "failed", extra);
+                    cJSON_Delete(extra);
+                }
+            }
+        } else if (job.group) {
+            // Consolidated group: one output, one callback for all segments
+            OutputTarget target;
+            int frame_count = 0;
+            cJSON *segments = NULL;
+            int transcoded = worker_processes.shm
+                ? worker_process_run(&ctx, &job, &target, &frame_count, &segments)
+                : process_group(&ctx, job.group, &target, &frame_count, &segments);
+
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            processing_ms = (end.tv_sec - start.tv_sec) * 1000 +
+                            (end.tv_nsec - start.tv_nsec) / 1000000;
+
+            if (transcoded <= 0) {
+                retrying = worker_retry_job(&ctx, &job);
+            }
+
+            cJSON *extra = transcoded > 0 ? output_target_json(&target) : failure_json(&ctx, &job);
+            cJSON_AddStringToObject(extra, "cameraId", job.group->camera_id);
+            cJSON_AddNumberToObject(extra, "segmentCount", job.group->nb_segments);
+            if (transcoded > 0) {
+                cJSON_AddItemToObject(extra, "segments", segments);
+                cJSON_AddItemToObject(extra, "verification", output_verification_json(&ctx.verify));
+                for (int i = 0; i < job.group->nb_segments; i++) {
+                    job_index_set_verification(&job_index, job.group->segments[i].job_id, &ctx.verify);
+                }
+                send_completion_callback(job.callback_url, job.filename, target.name,
+                                        frame_count, processing_ms, NULL, "completed", extra);
+            } else if (!retrying) {
+                send_completion_callback(job.callback_url, job.filename, "",
+                                        0, processing_ms, NULL, "failed", extra);
+                for (int i = 0; i < job.group->nb_segments; i++) {
+                    job_index_finish(&job_index, job.group->segments[i].job_id, JOB_FAILED, NULL, 0);
+                }
+            }
+            cJSON_Delete(extra);
+
+            // Account per segment so counters stay comparable with single-file mode
+            if (transcoded > 0) {
+                for (int i = 0; i < job.group->nb_segments; i++) {
+                    mark_file_processed(&processed_files, job.group->segments[i].filename);
+                }
+            }
+            pthread_mutex_lock(&stats_mutex);
+            if (transcoded > 0) {
+                files_processed += transcoded;
+                files_failed += job.group->nb_segments - transcoded;
+            } else if (!retrying) {
+                files_failed += job.group->nb_segments;
+            }
+            pthread_mutex_unlock(&stats_mutex);
+
+            // Device throughput is tracked per segment
+            result = transcoded > 0 ? 0 : -1;
+            processing_ms /= job.group->nb_segments;
+        } else {
+            // Phase 2: Normal GPU transcoding (one multiview grid encode, or
+            // parts of a long input shared with other workers)
+            OutputTarget target;
+            cJSON *mosaic = NULL;
+            if ((chunked = job.chunked ? job.chunked : chunked_job_split(&ctx, &job))) {
+                result = process_chunked(&ctx, &job, &target);
+            } else if (worker_processes.shm) {
+                result = worker_process_run(&ctx, &job, &target, NULL, &mosaic);
+            } else {
+                result = job.mosaic ? process_mosaic(&ctx, &job, &target, &mosaic)
+                                    : process_file(&ctx, &job, &target);
+            }
+            if (chunked && result != CHUNKED_PENDING) {
+                job.chunked = NULL;  // A retry splits the input afresh
+            }
+
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            processing_ms = (end.tv_sec - start.tv_sec) * 1000 +
+                            (end.tv_nsec - start.tv_nsec) / 1000000;
+
+            // In Phase 2, send callback with transcoded output path
+            if (result == CHUNKED_PENDING) {
+                // Another participant completes the job
+            } else if (result == 0) {
+                cJSON *extra = output_target_json(&target);
+                if (job.deadline_missed) {
+                    cJSON_AddBoolToObject(extra, "deadlineMissed", 1);
+                }
+                if (job.timelapse.fps > 0) {
+                    cJSON_AddItemToObject(extra, "timelapse", timelapse_json(&job.timelapse));
+                }
+                if (job.codec_profile > 0) {
+                    cJSON_AddStringToObject(extra, "codecProfile", config.codec_profiles[job.codec_profile].name);
+                }
+                if (mosaic) {
+                    cJSON_AddItemToObject(extra, "mosaic", mosaic);
+                }
+                if (chunked) {
+                    cJSON_AddNumberToObject(extra, "chunks", chunked->nb_chunks);
+                }
+                cJSON_AddItemToObject(extra, "verification", output_verification_json(&ctx.verify));
+                job_index_set_verification(&job_index, job.job_id, &ctx.verify);
+                output_frames = ctx.verify.packets;
+                send_completion_callback(job.callback_url, job.filename, target.name,
+                                        output_frames, processing_ms, job.metadata_json, "completed", extra);
+                cJSON_Delete(extra);
+                output_name = target.name;
+            } else if (ctx.cancel && *ctx.cancel) {
+                send_completion_callback(job.callback_url, job.filename, "",
+                                        0, processing_ms, job.metadata_json, "cancelled", NULL);
+            } else if (!(retrying = worker_retry_job(&ctx, &job))) {
+                cJSON *extra = failure_json(&ctx, &job);
+                send_completion_callback(job.callback_url, job.filename, "",
+                                        0, processing_ms, job.metadata_json, "failed", extra);
+                cJSON_Delete(extra);
+            }
+        }
+
+        // A cancelled job is neither a success nor a device failure. A
+        // participant that left a split job pending must not look at the
+        // flag: the job may already be finished and its record recycled.
+        int pending = result == CHUNKED_PENDING;
+        int cancelled = !pending && ctx.cancel && *ctx.cancel;
+        ctx.cancel = NULL;
+
+        // Only whole runs teach the cost model: the participant finishing a
+        // split input timed just its own parts
+        if (result == 0 && !retrying && !pending && !cancelled && !chunked) {
+            cost_model_record(&cost_model, &job,
+                              job.group ? processing_ms * job.group->nb_segments : processing_ms);
+        }
+
+        if (!retrying) {
+            free(job.mosaic);
+        }
+
+        if (chunked) {
+            chunked_job_release(chunked);
+        }
+
+        if (retrying) {
+            // The wheel owns the job (and its group or mosaic) until it is re-enqueued
+        } else if (pending) {
+            result = 0;
+        } else if (job.group) {
+            free(job.group);
+        } else if (cancelled) {
+            job_index_finish(&job_index, job.job_id, JOB_CANCELLED, NULL, 0);
+            result = 0;
+        } else if (result == 0) {
+            job_index_finish(&job_index, job.job_id, JOB_DONE, output_name, output_frames);
+            mark_file_processed(&processed_files, job.filename);
+            pthread_mutex_lock(&stats_mutex);
+            files_processed++;
+            pthread_mutex_unlock(&stats_mutex);
+        } else {
+            job_index_finish(&job_index, job.job_id, JOB_FAILED, NULL, 0);
+            pthread_mutex_lock(&stats_mutex);
+            files_failed++;
+            pthread_mutex_unlock(&stats_mutex);
+        }
+
+        adaptive_record(&adaptive_controller, processing_ms);
+        if (!cancelled && !retrying && !pending) {
+            scheduler_record_completion(&job, result == 0);
+        }
+
+        if (!no_gpu_mode) {
+            // Cleanup only per-file resources (NOT the persistent pipeline!)
+            cleanup_file_contexts(&ctx);
+
+            // Only decoder, encoder and CUDA failures are the device's fault.
+            // A participant in a split input answers for its own parts only:
+            // the finisher carries another part's failure for the whole job.
+            int ok = result == 0 || ctx.failure != FAILURE_DEVICE;
+            if (chunked) {
+                ok = ctx.chunk_failure != FAILURE_DEVICE;
+            }
+            if (worker_report_job(&ctx, ok, processing_ms) < 0) {
+                break;
+            }
+        }
+    }
+
+    // Final cleanup - destroy persistent pipeline
+    if (!no_gpu_mode && !worker_processes.shm && ctx.gpu_id >= 0) {
+        worker_detach_device(&ctx);
+    }
+
+    worker_mark_stopped(&worker_pool, worker_id);
+    fprintf(stderr, "[Worker %d] Finished\n", worker_id);
+    return NULL;
+}
+
+// ============================================================================
+// Worker Processes (crash isolation)
+// ============================================================================
+
+// Record of the current job (or group segment) with this id, NULL outside a
+// worker process job
+static WorkerJobId *worker_job_id(const char *id) {
+    WorkerJobSlot *slot = worker_process_job;
+    for (int i = 0; slot && i < slot->nb_ids; i++) {
+        if (strcmp(slot->ids[i].id, id) == 0) return &slot->ids[i];
+    }
+    return NULL;
+}
+
+// Publish a record update for the supervisor (NULL strings are left as they are)
+static void worker_job_note(WorkerJobId *j, int state, const char *stage, const char *output, int frames) {
+    atomic_fetch_add_explicit(&j->seq, 1, memory_order_acq_rel);
+    j->state = state;
+    if (stage) snprintf(j->stage, sizeof(j->stage), "%s", stage);
+    if (output) snprintf(j->output, sizeof(j->output), "%s", output);
+    j->frames = frames;
+    atomic_fetch_add_explicit(&j->seq, 1, memory_order_release);
+}
+
+static void worker_ring_init(WorkerShm *shm) {
+    atomic_init(&shm->ring_head, 0);
+    atomic_init(&shm->ring_tail, 0);
+    for (unsigned int i = 0; i < WORKER_RING_SIZE; i++) {
+        atomic_init(&shm->ring[i].seq, i);
+    }
+}
+
+// Supervisor side. Returns -1 if the ring is full.
+static int worker_ring_push(WorkerShm *shm, int slot) {
+    unsigned int pos = atomic_load_explicit(&shm->ring_head, memory_order_relaxed);
+    while (1) {
+        WorkerRingCell *cell = &shm->ring[pos % WORKER_RING_SIZE];
+        unsigned int seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        int diff = (int)(seq - pos);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&shm->ring_head, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                cell->slot = slot;
+                atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+                return 0;
+            }
+        } else if (diff < 0) {
+            return -1;
+        } else {
+            pos = atomic_load_explicit(&shm->ring_head, memory_order_relaxed);
+        }
+    }
+}
+
+// Worker process side. Returns a slot index, or -1 if the ring is empty.
+static int worker_ring_pop(WorkerShm *shm) {
+    unsigned int pos = atomic_load_explicit(&shm->ring_tail, memory_order_relaxed);
+    while (1) {
+        WorkerRingCell *cell = &shm->ring[pos % WORKER_RING_SIZE];
+        unsigned int seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        int diff = (int)(seq - (pos + 1));
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&shm->ring_tail, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                int slot = cell->slot;
+                atomic_store_explicit(&cell->seq, pos + WORKER_RING_SIZE, memory_order_release);
+                return slot;
+            }
+        } else if (diff < 0) {
+            return -1;
+        } else {
+            pos = atomic_load_explicit(&shm->ring_tail, memory_order_relaxed);
+        }
+    }
+}
+
+// Snapshot of this process's pipeline counters
+static void pipeline_counters_get(PipelineCounters *c) {
+    pthread_mutex_lock(&probe_cache.mutex);
+    c->probe_entries = probe_cache.count;
+    c->probe_hits = probe_cache.hits;
+    c->probe_misses = probe_cache.misses;
+    c->probe_mismatches = probe_cache.mismatches;
+    c->probe_ms_total = probe_cache.probe_ms_total;
+    c->probe_saved_ms_total = probe_cache.saved_ms_total;
+    c->probe_validate_ms_total = probe_cache.validate_ms_total;
+    pthread_mutex_unlock(&probe_cache.mutex);
+
+    pthread_mutex_lock(&stats_mutex);
+    c->timelapse_jobs = timelapse_jobs;
+    c->timelapse_frames_encoded = timelapse_frames_encoded;
+    c->timelapse_frames_skipped = timelapse_frames_skipped;
+    memcpy(c->mosaic_jobs, mosaic_jobs, sizeof(c->mosaic_jobs));
+    c->mosaic_tiles_composited = mosaic_tiles_composited;
+    c->mosaic_tiles_failed = mosaic_tiles_failed;
+    memcpy(c->codec_stats, codec_stats, sizeof(c->codec_stats));
+    memcpy(c->ts_output_checks, ts_output_checks, sizeof(c->ts_output_checks));
+    c->output_verify_bytes = output_verify_bytes;
+    memcpy(c->s3_uploads, s3_uploads, sizeof(c->s3_uploads));
+    c->s3_parts_uploaded = s3_parts_uploaded;
+    c->s3_bytes_uploaded = s3_bytes_uploaded;
+    c->s3_bytes_spooled = s3_bytes_spooled;
+    c->s3_spool_fallbacks = s3_spool_fallbacks;
+    c->s3_request_seconds = s3_request_seconds;
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+// Supervisor: report the children's totals. Its own pipeline counters stay at
+// zero in this mode, so they are simply overwritten.
+static void pipeline_counters_set(const PipelineCounters *c) {
+    pthread_mutex_lock(&probe_cache.mutex);
+    probe_cache.count = c->probe_entries;
+    probe_cache.hits = c->probe_hits;
+    probe_cache.misses = c->probe_misses;
+    probe_cache.mismatches = c->probe_mismatches;
+    probe_cache.probe_ms_total = c->probe_ms_total;
+    probe_cache.saved_ms_total = c->probe_saved_ms_total;
+    probe_cache.validate_ms_total = c->probe_validate_ms_total;
+    pthread_mutex_unlock(&probe_cache.mutex);
+
+    pthread_mutex_lock(&stats_mutex);
+    timelapse_jobs = c->timelapse_jobs;
+    timelapse_frames_encoded = c->timelapse_frames_encoded;
+    timelapse_frames_skipped = c->timelapse_frames_skipped;
+    memcpy(mosaic_jobs, c->mosaic_jobs, sizeof(mosaic_jobs));
+    mosaic_tiles_composited = c->mosaic_tiles_composited;
+    mosaic_tiles_failed = c->mosaic_tiles_failed;
+    memcpy(codec_stats, c->codec_stats, sizeof(codec_stats));
+    memcpy(ts_output_checks, c->ts_output_checks, sizeof(ts_output_checks));
+    output_verify_bytes = c->output_verify_bytes;
+    memcpy(s3_uploads, c->s3_uploads, sizeof(s3_uploads));
+    s3_parts_uploaded = c->s3_parts_uploaded;
+    s3_bytes_uploaded = c->s3_bytes_uploaded;
+    s3_bytes_spooled = c->s3_bytes_spooled;
+    s3_spool_fallbacks = c->s3_spool_fallbacks;
+    s3_request_seconds = c->s3_request_seconds;
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+static void pipeline_counters_add(PipelineCounters *sum, const PipelineCounters *c) {
+    sum->timelapse_jobs += c->timelapse_jobs;
+    sum->timelapse_frames_encoded += c->timelapse_frames_encoded;
+    sum->timelapse_frames_skipped += c->timelapse_frames_skipped;
+    for (int i = 0; i < 2; i++) {
+        sum->mosaic_jobs[i] += c->mosaic_jobs[i];
+    }
+    sum->mosaic_tiles_composited += c->mosaic_tiles_composited;
+    sum->mosaic_tiles_failed += c->mosaic_tiles_failed;
+    for (int i = 0; i < MAX_CODEC_PROFILES; i++) {
+        sum->codec_stats[i].jobs += c->codec_stats[i].jobs;
+        sum->codec_stats[i].bytes += c->codec_stats[i].bytes;
+        sum->codec_stats[i].seconds += c->codec_stats[i].seconds;
+    }
+    for (int i = 0; i < TS_NB_VERDICTS; i++) {
+        sum->ts_output_checks[i] += c->ts_output_checks[i];
+    }
+    sum->output_verify_bytes += c->output_verify_bytes;
+    for (int i = 0; i < 3; i++) {
+        sum->s3_uploads[i] += c->s3_uploads[i];
+    }
+    sum->s3_parts_uploaded += c->s3_parts_uploaded;
+    sum->s3_bytes_uploaded += c->s3_bytes_uploaded;
+    sum->s3_bytes_spooled += c->s3_bytes_spooled;
+    sum->s3_spool_fallbacks += c->s3_spool_fallbacks;
+    sum->s3_request_seconds += c->s3_request_seconds;
+    sum->probe_entries += c->probe_entries;
+    sum->probe_hits += c->probe_hits;
+    sum->probe_misses += c->probe_misses;
+    sum->probe_mismatches += c->probe_mismatches;
+    sum->probe_ms_total += c->probe_ms_total;
+    sum->probe_saved_ms_total += c->probe_saved_ms_total;
+    sum->probe_validate_ms_total += c->probe_validate_ms_total;
+}
+
+// Worker process: publish the counters after a job
+static void worker_process_publish_counters(WorkerProcessShm *self) {
+    static pthread_mutex_t publish_mutex = PTHREAD_MUTEX_INITIALIZER;   // One writer, newest last
+
+    pthread_mutex_lock(&publish_mutex);
+    PipelineCounters c;
+    pipeline_counters_get(&c);
+    atomic_fetch_add_explicit(&self->counters_seq, 1, memory_order_acq_rel);
+    self->counters = c;
+    atomic_fetch_add_explicit(&self->counters_seq, 1, memory_order_release);
+    pthread_mutex_unlock(&publish_mutex);
+}
+
+// Supervisor: consistent copy of a child's counters (zero if it died mid-write)
+static void worker_process_read_counters(WorkerProcessShm *p, PipelineCounters *c) {
+    for (int tries = 0; tries < 1000; tries++) {
+        unsigned int seq = atomic_load_explicit(&p->counters_seq, memory_order_acquire);
+        if (!(seq & 1)) {
+            *c = p->counters;
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(&p->counters_seq, memory_order_relaxed) == seq) return;
+        }
+        sched_yield();
+    }
+    memset(c, 0, sizeof(*c));
+}
+
+// Worker process: run one job taken from the ring and write its result
+static void worker_process_execute(TranscodeContext *ctx, WorkerJobSlot *slot, unsigned int *sim_seed) {
+    TranscodeJob *job = &slot->job;
+    job->group = job->group ? &slot->group : NULL;
+    job->mosaic = job->mosaic ? &slot->mosaic : NULL;
+    job->chunked = NULL;
+
+    slot->device = ctx->gpu_id;
+    slot->frames = 0;
+    slot->publish_duration = -1;
+    slot->result_json[0] = '\0';
+    ctx->failure = FAILURE_NONE;
+    ctx->failure_reason[0] = '\0';
+    memset(&ctx->verify, 0, sizeof(ctx->verify));
+    // Segments of a group check their own flags through job_index_cancel_requested()
+    ctx->cancel = job->group ? NULL : &slot->ids[0].cancel;
+    worker_process_job = slot;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    cJSON *result_json = NULL;
+    if (device_manager.simulated) {
+        slot->result = simulated_process(&device_manager, ctx->gpu_id, sim_seed);
+        if (slot->result == -2) {
+            fail_job(ctx, FAILURE_PERMANENT, 0, "simulated corrupt input");
+        } else if (slot->result < 0) {
+            fail_job(ctx, FAILURE_DEVICE, 0, "simulated device error");
+        }
+    } else if (job->group) {
+        slot->result = process_group(ctx, job->group, &slot->target, &slot->frames, &result_json);
+    } else if (job->mosaic) {
+        slot->result = process_mosaic(ctx, job, &slot->target, &result_json);
+    } else {
+        slot->result = process_file(ctx, job, &slot->target);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    int processing_ms = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000;
+
+    if (result_json) {
+        char *text = cJSON_PrintUnformatted(result_json);
+        if (text && strlen(text) < sizeof(slot->result_json)) {
+            memcpy(slot->result_json, text, strlen(text) + 1);
+        } else {
+            fprintf(stderr, "[Worker %d] Result description of %s does not fit its slot, dropped\n",
+                    ctx->worker_id, job->filename);
+        }
+        free(text);
+        cJSON_Delete(result_json);
+    }
+    slot->verify = ctx->verify;
+    slot->failure = ctx->failure;
+    memcpy(slot->failure_reason, ctx->failure_reason, sizeof(slot->failure_reason));
+    worker_process_job = NULL;
+    ctx->cancel = NULL;
+
+    if (!device_manager.simulated) {
+        cleanup_file_contexts(ctx);
+    }
+    // The child's own view of its device (simulated dead devices count jobs here)
+    int ok = (job->group ? slot->result > 0 : slot->result == 0) || ctx->failure != FAILURE_DEVICE;
+    device_report(&device_manager, ctx->gpu_id, ok, processing_ms);
+}
+
+// Worker process pipeline: build it once, then serve jobs from the ring
+static void *worker_process_thread(void *arg) {
+    int worker_id = *(int*)arg;
+    free(arg);
+
+    WorkerShm *shm = worker_process_shm;
+    WorkerProcessShm *self = &shm->procs[worker_process_index];
+
+    TranscodeContext ctx = {0};
+    ctx.worker_id = worker_id;
+    ctx.gpu_id = -1;
+    unsigned int sim_seed = (unsigned int)(time(NULL) ^ (worker_id * 2654435761u) ^ getpid());
+
+    if (worker_attach_device(&ctx, -1) < 0) {
+        fprintf(stderr, "[Worker %d] No device available\n", worker_id);
+        return NULL;
+    }
+    atomic_fetch_add(&self->warm, 1);
+
+    while (!atomic_load(&shm->shutdown)) {
+        // Device quarantined by the supervisor: leave the jobs to the other children
+        if (atomic_load(&self->paused)) {
+            usleep(WORKER_POLL_MS * 1000);
+            continue;
+        }
+        if (sem_wait(&shm->ring_items) < 0) {
+            continue;  // EINTR
+        }
+        if (atomic_load(&self->paused)) {
+            sem_post(&shm->ring_items);  // Hand the token back
+            continue;
+        }
+        int index = worker_ring_pop(shm);
+        if (index < 0) {
+            continue;  // Spare post: shutdown, or one left by a process that died
+        }
+
+        WorkerJobSlot *slot = &shm->slots[index];
+        atomic_store(&slot->owner, getpid());
+        int queued = WORKER_SLOT_QUEUED;
+        if (!atomic_compare_exchange_strong(&slot->state, &queued, WORKER_SLOT_RUNNING)) {
+            continue;  // Written off by the supervisor while we were between pop and claim
+        }
+
+        worker_process_execute(&ctx, slot, &sim_seed);
+        worker_process_publish_counters(self);
+
+        atomic_store(&slot->state, WORKER_SLOT_DONE);
+        sem_post(&slot->done);
+    }
+
+    atomic_fetch_sub(&self->warm, 1);
+    worker_detach_device(&ctx);
+    return NULL;
+}
+
+// Entry point of a worker process (the daemon binary re-executed by the
+// supervisor with --worker-process N and the shared region on WORKER_SHM_FD).
+// Runs until the supervisor sets the shutdown flag or dies.
+int worker_process_main(int index) {
+    // Ctrl+C reaches the whole process group: the supervisor decides when we stop
+    signal(SIGINT, SIG_IGN);
+    signal(SIGTERM, SIG_DFL);
+
+    if (index < 0 || index >= MAX_WORKERS_LIMIT) {
+        fprintf(stderr, "[WorkerProcess %d] Invalid worker process index\n", index);
+        return 1;
+    }
+    WorkerShm *shm = mmap(NULL, sizeof(WorkerShm), PROT_READ | PROT_WRITE, MAP_SHARED, WORKER_SHM_FD, 0);
+    if (shm == MAP_FAILED) {
+        fprintf(stderr, "[WorkerProcess %d] Cannot map the supervisor's shared memory: %s\n",
+                index, strerror(errno));
+        return 1;
+    }
+    close(WORKER_SHM_FD);
+    worker_process_shm = shm;
+
+    WorkerProcessShm *self = &shm->procs[index];
+    device_manager.only_device = self->device;
+    fprintf(stderr, "[WorkerProcess %d] pid %d: %d pipelines on device %d\n",
+            index, getpid(), self->workers, self->device);
+
+    pthread_t threads[MAX_WORKERS_LIMIT];
+    int started = 0;
+    for (int i = 0; i < self->workers; i++) {
+        int *worker_id = malloc(sizeof(int));
+        *worker_id = self->first_worker + i;
+        if (pthread_create(&threads[started], NULL, worker_process_thread, worker_id) != 0) {
+            fprintf(stderr, "[WorkerProcess %d] Cannot start pipeline thread %d\n", index, *worker_id);
+            free(worker_id);
+            continue;
+        }
+        started++;
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    fprintf(stderr, "[WorkerProcess %d] Finished\n", index);
+    return 0;
+}
+
+// Start child 'index': fork, hand it the shared region as WORKER_SHM_FD and
+// re-execute the daemon binary. The exec gives the child its own CUDA
+// context and none of the supervisor's threads or held locks; until then it
+// only makes async-signal-safe calls.
+static int worker_process_spawn(WorkerProcesses *wp, int index) {
+    WorkerProcess *p = &wp->procs[index];
+    WorkerProcessShm *ps = &wp->shm->procs[index];
+
+    atomic_store(&ps->warm, 0);
+    atomic_store(&ps->counters_seq, 0);
+    atomic_store(&ps->paused, !device_usable(&device_manager, ps->device));
+    memset(&ps->counters, 0, sizeof(ps->counters));
+
+    pid_t parent = getpid();
+    pid_t pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "[Supervisor] Cannot start worker process %d: %s\n", index, strerror(errno));
+        return -1;
+    }
+    if (pid == 0) {
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        if (getppid() != parent) _exit(1);
+        if (dup2(wp->shm_fd, WORKER_SHM_FD) < 0) _exit(1);
+        for (long fd = WORKER_SHM_FD + 1; fd < wp->max_fd; fd++) {
+            close((int)fd);
+        }
+        execv("/proc/self/exe", p->argv);
+        _exit(127);
+    }
+
+    pthread_mutex_lock(&wp->mutex);
+    p->pid = pid;
+    p->started_ms = monotonic_ms();
+    p->restart_at_ms = 0;
+    pthread_mutex_unlock(&wp->mutex);
+
+    fprintf(stderr, "[Supervisor] Worker process %d started (pid %d, device %d, %d pipelines)\n",
+            index, pid, ps->device, ps->workers);
+    return 0;
+}
+
+// The owner of these slots is gone: give each waiting supervisor worker a
+// transient failure so the job goes back through the retry wheel
+static void worker_process_fail_slots(WorkerProcesses *wp, int index, pid_t pid, const char *reason) {
+    for (int i = 0; i < MAX_WORKERS_LIMIT; i++) {
+        WorkerJobSlot *slot = &wp->shm->slots[i];
+        int running = WORKER_SLOT_RUNNING;
+        if (atomic_load(&slot->owner) != pid ||
+            !atomic_compare_exchange_strong(&slot->state, &running, WORKER_SLOT_DONE)) {
+            continue;
+        }
+        slot->crashed = 1;
+        slot->result = -1;
+        slot->device = wp->shm->procs[index].device;
+        slot->publish_duration = -1;
+        slot->result_json[0] = '\0';
+        slot->failure = FAILURE_TRANSIENT;
+        snprintf(slot->failure_reason, sizeof(slot->failure_reason), "%s", reason);
+
+        pthread_mutex_lock(&wp->mutex);
+        wp->jobs_lost++;
+        pthread_mutex_unlock(&wp->mutex);
+        sem_post(&slot->done);
+    }
+}
+
+// Reaper: a child exited. Fail its jobs, keep its counters and schedule a
+// restart, backing off while it keeps dying soon after starting.
+static void worker_process_exited(WorkerProcesses *wp, int index, int status) {
+    WorkerProcess *p = &wp->procs[index];
+    WorkerProcessShm *ps = &wp->shm->procs[index];
+    int shutting_down = atomic_load(&wp->shm->shutdown);
+
+    char reason[160];
+    if (WIFSIGNALED(status)) {
+        snprintf(reason, sizeof(reason), "worker process crashed (signal %d, %s)",
+                 WTERMSIG(status), strsignal(WTERMSIG(status)));
+    } else {
+        snprintf(reason, sizeof(reason), "worker process exited with status %d", WEXITSTATUS(status));
+    }
+    fprintf(stderr, "[Supervisor] Worker process %d (pid %d): %s\n", index, p->pid, reason);
+
+    worker_process_fail_slots(wp, index, p->pid, reason);
+    atomic_store(&ps->warm, 0);
+
+    // It may have taken ring tokens without popping: wake the other children
+    for (int i = 0; i < ps->workers; i++) {
+        sem_post(&wp->shm->ring_items);
+    }
+
+    PipelineCounters c;
+    worker_process_read_counters(ps, &c);
+    c.probe_entries = 0;    // Its cache is gone
+
+    long long now = monotonic_ms();
+    pthread_mutex_lock(&wp->mutex);
+    pipeline_counters_add(&wp->retired, &c);
+    p->pid = 0;
+    if (!shutting_down) {
+        wp->crashes++;
+        if (now - p->started_ms >= WORKER_STABLE_SECONDS * 1000LL) {
+            p->restart_delay_ms = WORKER_RESTART_MIN_MS;
+        } else if (p->restart_delay_ms < WORKER_RESTART_MAX_MS) {
+            p->restart_delay_ms = p->restart_delay_ms * 2 < WORKER_RESTART_MAX_MS
+                ? p->restart_delay_ms * 2 : WORKER_RESTART_MAX_MS;
+        }
+        p->restart_at_ms = now + p->restart_delay_ms;
+    }
+    pthread_mutex_unlock(&wp->mutex);
+}
+
+// Pause the children of a device the supervisor quarantined (job results
+// feed its device manager through worker_report_job) and resume them once
+// the device is back on probation
+static void worker_process_check_device(WorkerProcesses *wp, int index) {
+    WorkerProcessShm *ps = &wp->shm->procs[index];
+    int paused = !device_usable(&device_manager, ps->device);
+    if (atomic_exchange(&ps->paused, paused) != paused) {
+        fprintf(stderr, "[Supervisor] Worker process %d %s: device %d %s\n", index,
+                paused ? "paused" : "resumed", ps->device, paused ? "quarantined" : "on probation");
+    }
+}
+
+static void *worker_process_reaper(void *arg) {
+    WorkerProcesses *wp = arg;
+
+    while (!atomic_load(&wp->shm->shutdown)) {
+        for (int i = 0; i < wp->nb_procs; i++) {
+            WorkerProcess *p = &wp->procs[i];
+            worker_process_check_device(wp, i);
+            int status;
+            if (p->pid > 0 && waitpid(p->pid, &status, WNOHANG) == p->pid) {
+                worker_process_exited(wp, i, status);
+            }
+            if (p->pid == 0 && p->restart_at_ms > 0 && monotonic_ms() >= p->restart_at_ms &&
+                !atomic_load(&wp->shm->shutdown)) {
+                pthread_mutex_lock(&wp->mutex);
+                p->restarts++;
+                pthread_mutex_unlock(&wp->mutex);
+                if (worker_process_spawn(wp, i) < 0) {
+                    p->restart_at_ms = monotonic_ms() + WORKER_RESTART_MAX_MS;
+                }
+            }
+        }
+        usleep(WORKER_POLL_MS * 1000);
+    }
+    return NULL;
+}
+
+// Create the shared region and start the children: one per device, or
+// workersPerProcess pipelines each with devices assigned round-robin.
+// 'argv' is re-used for the children so they load the same configuration.
+int worker_processes_start(WorkerProcesses *wp, int argc, char **argv, int pipelines) {
+    int nb_devices = device_manager.nb_devices > 0 ? device_manager.nb_devices : 1;
+    int per_process = config.workers_per_process;
+    int nb_procs = per_process > 0 ? (pipelines + per_process - 1) / per_process
+                                   : (nb_devices < pipelines ? nb_devices : pipelines);
+    if (nb_procs < 1 || nb_procs > MAX_WORKERS_LIMIT) {
+        fprintf(stderr, "[Supervisor] Invalid worker process layout (%d pipelines)\n", pipelines);
+        return -1;
+    }
+
+    int fd = memfd_create("transcoder-workers", 0);
+    if (fd < 0 || ftruncate(fd, sizeof(WorkerShm)) < 0) {
+        fprintf(stderr, "[Supervisor] Cannot create shared memory: %s\n", strerror(errno));
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    WorkerShm *shm = mmap(NULL, sizeof(WorkerShm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (shm == MAP_FAILED) {
+        fprintf(stderr, "[Supervisor] Cannot map shared memory: %s\n", strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    // memfd pages start zeroed: only the synchronisation objects need setting up
+    worker_ring_init(shm);
+    atomic_init(&shm->shutdown, 0);
+    sem_init(&shm->ring_items, 1, 0);
+    for (int i = 0; i < MAX_WORKERS_LIMIT; i++) {
+        atomic_init(&shm->slots[i].state, WORKER_SLOT_IDLE);
+        sem_init(&shm->slots[i].done, 1, 0);
+    }
+
+    int first = 0;
+    for (int k = 0; k < nb_procs; k++) {
+        WorkerProcessShm *ps = &shm->procs[k];
+        WorkerProcess *p = &wp->procs[k];
+        ps->device = k % nb_devices;
+        ps->workers = per_process > 0
+            ? (pipelines - first < per_process ? pipelines - first : per_process)
+            : pipelines / nb_procs + (k < pipelines % nb_procs);
+        ps->first_worker = first;
+        first += ps->workers;
+
+        // The daemon's own arguments plus --worker-process k
+        p->argv = calloc(argc + 3, sizeof(char *));
+        for (int j = 0; j < argc; j++) {
+            p->argv[j] = argv[j];
+        }
+        snprintf(p->index_arg, sizeof(p->index_arg), "%d", k);
+        p->argv[argc] = "--worker-process";
+        p->argv[argc + 1] = p->index_arg;
+        p->restart_delay_ms = WORKER_RESTART_MIN_MS;
+    }
+
+    long max_fd = sysconf(_SC_OPEN_MAX);
+    wp->max_fd = max_fd > 0 && max_fd < 65536 ? max_fd : 65536;
+    wp->shm = shm;
+    wp->shm_fd = fd;
+    wp->nb_procs = nb_procs;
+    wp->pipelines = pipelines;
+    pthread_mutex_init(&wp->mutex, NULL);
+
+    fprintf(stderr, "[Supervisor] Running %d pipelines in %d worker processes\n", pipelines, nb_procs);
+    for (int k = 0; k < nb_procs; k++) {
+        if (worker_process_spawn(wp, k) < 0) {
+            return -1;
+        }
+    }
+    if (pthread_create(&wp->reaper, NULL, worker_process_reaper, wp) != 0) {
+        fprintf(stderr, "[Supervisor] Cannot start the reaper thread\n");
+        return -1;
+    }
+    wp->reaper_started = 1;
+    return 0;
+}
+
+static int worker_processes_warm(WorkerProcesses *wp) {
+    int warm = 0;
+    for (int k = 0; k < wp->nb_procs; k++) {
+        warm += atomic_load(&wp->shm->procs[k].warm);
+    }
+    return warm;
+}
+
+// Supervisor worker start-up: take jobs once the children have more warm
+// pipelines than the workers before this one, so /ready and the warm-up
+// figures reflect real pipelines. Workers beyond what the children run (a
+// resize past the configured pool) wait here. Returns -1 on shutdown or
+// retirement.
+int worker_processes_wait_warm(WorkerProcesses *wp, int worker_id) {
+    while (worker_processes_warm(wp) <= worker_id) {
+        pthread_mutex_lock(&task_queue.mutex);
+        int closed = task_queue.closed;
+        pthread_mutex_unlock(&task_queue.mutex);
+        if (closed || worker_pool.slots[worker_id].retire) {
+            return -1;
+        }
+        usleep(20000);
+    }
+    return 0;
+}
+
+// What the supervisor has already applied of one record's updates
+typedef struct {
+    unsigned int seq;
+    int state;
+} WorkerJobSeen;
+
+// Mirror cancel requests to the child and apply the record updates it made
+// since the last call. A single job's record is finished by the worker
+// thread; group segments are finished here, except that successes are held
+// back until 'publish_ok' (the group's output is published).
+static void worker_job_sync(TranscodeContext *ctx, const TranscodeJob *job, WorkerJobSlot *slot,
+                            WorkerJobSeen *seen, int publish_ok) {
+    for (int i = 0; i < slot->nb_ids; i++) {
+        WorkerJobId *j = &slot->ids[i];
+        j->cancel = job->group ? job_index_cancel_requested(&job_index, j->id)
+                               : ctx->cancel && *ctx->cancel;
+
+        unsigned int seq = atomic_load_explicit(&j->seq, memory_order_acquire);
+        if (seq == seen[i].seq || (seq & 1)) {
+            continue;
+        }
+        int state = j->state;
+        int frames = j->frames;
+        char stage[sizeof(j->stage)];
+        char output[sizeof(j->output)];
+        memcpy(stage, j->stage, sizeof(stage));
+        memcpy(output, j->output, sizeof(output));
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&j->seq, memory_order_relaxed) != seq) {
+            continue;  // Rewritten meanwhile: next round
+        }
+        stage[sizeof(stage) - 1] = '\0';
+        output[sizeof(output) - 1] = '\0';
+
+        if (state == JOB_RUNNING) {
+            if (job->group && seen[i].state == JOB_QUEUED) {
+                job_index_start(&job_index, j->id, ctx->worker_id);
+            }
+            job_index_stage(&job_index, j->id, stage);
+        } else if (job->group && state != JOB_QUEUED) {
+            if (state == JOB_DONE && !publish_ok) {
+                continue;
+            }
+            if (seen[i].state == JOB_QUEUED && state != JOB_CANCELLED) {
+                job_index_start(&job_index, j->id, ctx->worker_id);
+            }
+            job_index_finish(&job_index, j->id, (JobState)state, output, frames);
+        }
+        seen[i].seq = seq;
+        seen[i].state = state;
+    }
+}
+
+// Supervisor worker: run a job's transcode in a worker process and wait for
+// it. Fills what the in-process call would (target, group frame count,
+// segment index or mosaic description, ctx->verify and the failure) and
+// returns its return value. ctx->gpu_id becomes the child's device, so the
+// caller's worker_report_job() feeds the outcome to the supervisor's device
+// health. A job whose process dies fails as transient.
+int worker_process_run(TranscodeContext *ctx, const TranscodeJob *job, OutputTarget *target,
+                       int *frames, cJSON **result_json) {
+    WorkerProcesses *wp = &worker_processes;
+    WorkerShm *shm = wp->shm;
+    WorkerJobSlot *slot = &shm->slots[ctx->worker_id];
+    WorkerJobSeen seen[MAX_GROUP_SEGMENTS];
+
+    slot->job = *job;
+    if (job->group) slot->group = *job->group;
+    if (job->mosaic) slot->mosaic = *job->mosaic;
+    slot->nb_ids = job->group ? job->group->nb_segments : 1;
+    for (int i = 0; i < slot->nb_ids; i++) {
+        WorkerJobId *j = &slot->ids[i];
+        snprintf(j->id, sizeof(j->id), "%s", job->group ? job->group->segments[i].job_id : job->job_id);
+        j->cancel = job->group ? job_index_cancel_requested(&job_index, j->id) : ctx->cancel && *ctx->cancel;
+        atomic_store(&j->seq, 0);
+        j->state = JOB_QUEUED;
+        j->stage[0] = '\0';
+        j->output[0] = '\0';
+        seen[i].seq = 0;
+        seen[i].state = JOB_QUEUED;
+    }
+    slot->crashed = 0;
+    slot->result = -1;
+    atomic_store(&slot->owner, 0);
+    atomic_store(&slot->state, WORKER_SLOT_QUEUED);
+    if (worker_ring_push(shm, ctx->worker_id) < 0) {
+        atomic_store(&slot->state, WORKER_SLOT_IDLE);
+        return fail_job(ctx, FAILURE_TRANSIENT, 0, "worker process job ring full");
+    }
+    sem_post(&shm->ring_items);
+
+    int unclaimed = 0;
+    while (1) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += WORKER_POLL_MS * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        if (sem_timedwait(&slot->done, &deadline) == 0) {
+            break;
+        }
+        worker_job_sync(ctx, job, slot, seen, 0);
+
+        // Popped but never claimed: the child died between the two
+        if (atomic_load(&slot->state) == WORKER_SLOT_QUEUED &&
+            atomic_load(&shm->ring_head) == atomic_load(&shm->ring_tail)) {
+            int queued = WORKER_SLOT_QUEUED;
+            if (++unclaimed >= WORKER_LOST_POLLS &&
+                atomic_compare_exchange_strong(&slot->state, &queued, WORKER_SLOT_DONE)) {
+                slot->crashed = 1;
+                slot->publish_duration = -1;
+                slot->result_json[0] = '\0';
+                slot->failure = FAILURE_TRANSIENT;
+                snprintf(slot->failure_reason, sizeof(slot->failure_reason), "worker process lost the job");
+                pthread_mutex_lock(&wp->mutex);
+                wp->jobs_lost++;
+                pthread_mutex_unlock(&wp->mutex);
+                break;
+            }
+        } else {
+            unclaimed = 0;
+        }
+    }
+
+    int ret = slot->result;
+    ctx->gpu_id = slot->device;
+    if (!slot->crashed) {
+        ctx->verify = slot->verify;
+    }
+    if (slot->failure != FAILURE_NONE) {
+        ctx->failure = slot->failure;
+        memcpy(ctx->failure_reason, slot->failure_reason, sizeof(ctx->failure_reason));
+    }
+
+    // The supervisor owns the playlists
+    int ok = job->group ? ret > 0 : ret == 0;
+    if (ok && slot->publish_duration >= 0 &&
+        publish_cmaf_segment(&slot->target, slot->publish_duration) < 0) {
+        ret = job->group ? 0 : -1;
+        fail_job(ctx, FAILURE_TRANSIENT, 0, "publish CMAF segment");
+        ok = 0;
+    }
+    worker_job_sync(ctx, job, slot, seen, ok);
+
+    if (target) *target = slot->target;
+    if (frames) *frames = slot->frames;
+    if (result_json) {
+        *result_json = ok && slot->result_json[0] ? cJSON_Parse(slot->result_json) : NULL;
+    }
+    atomic_store(&slot->state, WORKER_SLOT_IDLE);
+    return ret;
+}
+
+// Once the supervisor's workers have finished: stop the children and wait
+// for them to release their devices
+void worker_processes_stop(WorkerProcesses *wp) {
+    if (!wp->shm) return;
+
+    atomic_store(&wp->shm->shutdown, 1);
+    if (wp->reaper_started) {
+        pthread_join(wp->reaper, NULL);
+        wp->reaper_started = 0;
+    }
+    for (int i = 0; i < wp->pipelines + wp->nb_procs; i++) {
+        sem_post(&wp->shm->ring_items);
+    }
+
+    long long deadline = monotonic_ms() + 10000;
+    for (int k = 0; k < wp->nb_procs; k++) {
+        WorkerProcess *p = &wp->procs[k];
+        while (p->pid > 0) {
+            int status;
+            if (waitpid(p->pid, &status, WNOHANG) == p->pid) {
+                p->pid = 0;
+            } else if (monotonic_ms() >= deadline) {
+                fprintf(stderr, "[Supervisor] Worker process %d did not stop, killing it\n", k);
+                kill(p->pid, SIGKILL);
+                waitpid(p->pid, &status, 0);
+                p->pid = 0;
+            } else {
+                usleep(WORKER_POLL_MS * 1000);
+            }
+        }
+    }
+    fprintf(stderr, "[Supervisor] Worker processes stopped\n");
+}
+
+// Refresh the pipeline counters /metrics reports from the children
+void worker_processes_collect(WorkerProcesses *wp) {
+    PipelineCounters sum;
+
+    pthread_mutex_lock(&wp->mutex);
+    sum = wp->retired;
+    for (int k = 0; k < wp->nb_procs; k++) {
+        if (wp->procs[k].pid > 0) {
+            PipelineCounters c;
+            worker_process_read_counters(&wp->shm->procs[k], &c);
+            pipeline_counters_add(&sum, &c);
+        }
+    }
+    pthread_mutex_unlock(&wp->mutex);
+
+    pipeline_counters_set(&sum);
+}
+
+cJSON *worker_processes_to_json(WorkerProcesses *wp) {
+    cJSON *arr = cJSON_CreateArray();
+    pthread_mutex_lock(&wp->mutex);
+    for (int k = 0; k < wp->nb_procs; k++) {
+        WorkerProcessShm *ps = &wp->shm->procs[k];
+        cJSON *p = cJSON_CreateObject();
+        cJSON_AddNumberToObject(p, "index", k);
+        cJSON_AddNumberToObject(p, "pid", wp->procs[k].pid);
+        cJSON_AddNumberToObject(p, "device", ps->device);
+        cJSON_AddNumberToObject(p, "pipelines", ps->workers);
+        cJSON_AddNumberToObject(p, "warm", atomic_load(&ps->warm));
+        cJSON_AddBoolToObject(p, "paused", atomic_load(&ps->paused));
+        cJSON_AddNumberToObject(p, "restarts", wp->procs[k].restarts);
+        cJSON_AddItemToArray(arr, p);
+    }
+    pthread_mutex_unlock(&wp->mutex);
+    return arr;
+}
+
+// ============================================================================
+// File Scanner Thread
+// ============================================================================
+
+// Input file last modified before 'cutoff'
+static int is_older_than(const char *filename, time_t cutoff) {
+    char path[1024];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s/%s", config.input_dir, filename);
+    return stat(path, &st) == 0 && st.st_mtime < cutoff;
+}
+
+void *scanner_thread(void *arg) {
+    fprintf(stderr, "[Scanner] Starting file discovery...\n");
+
+    DIR *dir = opendir(config.input_dir);
+    if (!dir) {
+        fprintf(stderr, "[Scanner] Failed to open directory: %s\n", config.input_dir);
+        return NULL;
+    }
+
+    struct dirent *entry;
+    int discovered = 0;
+    int quarantined = 0;
+    int rejected = 0;
+    int timelapse_queued = 0;
+    time_t timelapse_cutoff = config.timelapse_after_days > 0 ?
+                              time(NULL) - (time_t)config.timelapse_after_days * 86400 : 0;
+
+    while ((entry = readdir(dir)) != NULL) {
+        if (strstr(entry->d_name, ".ts") && !strstr(entry->d_name, "_h264.ts")) {
+            if (is_file_processed(&processed_files, entry->d_name)) {
+                continue;
+            }
+            if (is_file_quarantined(&quarantine, entry->d_name)) {
+                fprintf(stderr, "[Scanner] Skipping quarantined %s\n", entry->d_name);
+                quarantined++;
+                continue;
+            }
+            char reason[256];
+            if (ts_precheck_input(entry->d_name, reason, sizeof(reason)) != TS_OK) {
+                rejected++;
+                continue;
+            }
+            TranscodeJob job = {0};
+            strncpy(job.filename, entry->d_name, sizeof(job.filename) - 1);
+            job.output_format = default_output_format;
+            if (timelapse_cutoff && is_older_than(entry->d_name, timelapse_cutoff)) {
+                job.timelapse = config.timelapse;
+                job.output_format = OUTPUT_FORMAT_TS;
+                timelapse_queued++;
+            }
+            // No callback URL in batch mode
+            queue_push(&task_queue, &job);
+            discovered++;
+        }
+    }
+
+    closedir(dir);
+
+    fprintf(stderr, "[Scanner] Discovered %d files for processing\n", discovered);
+    if (rejected > 0) {
+        fprintf(stderr, "[Scanner] %d files failed the MPEG-TS check and were skipped\n", rejected);
+    }
+    if (quarantined > 0) {
+        fprintf(stderr, "[Scanner] %d quarantined files skipped (DELETE /quarantine/{file} releases one)\n",
+                quarantined);
+    }
+    if (timelapse_queued > 0) {
+        fprintf(stderr, "[Scanner] %d files older than %d days get the time-lapse rendition\n",
+                timelapse_queued, config.timelapse_after_days);
+    }
+    return NULL;
+}
+
+// ============================================================================
+// Signal Handling & API Server
+// ============================================================================
+
+void signal_handler(int sig) {
+    fprintf(stderr, "\n[Signal] Received signal %d (%s), shutting down gracefully...\n",
+            sig, sig == SIGINT ? "SIGINT" : "SIGTERM");
+
+    processing_active = 0;
+
+    // Workers are released by main via queue_close() once open consolidation
+    // groups have been dispatched, so no queued work is dropped
+
+    // Stop API server
+    if (api_daemon) {
+        MHD_stop_daemon(api_daemon);
+        api_daemon = NULL;
+    }
+}
+
+// Helper: Send HTTP response
+static enum MHD_Result send_response(struct MHD_Connection *connection,
+                                     int status_code,
+                                     const char *response_text) {
+    struct MHD_Response *response = MHD_create_response_from_buffer(
+        strlen(response_text),
+        (void*)response_text,
+        MHD_RESPMEM_MUST_COPY
+    );
+
+    MHD_add_response_header(response, "Content-Type", "application/json");
+    MHD_add_response_header(response, "Access-Control-Allow-Origin", "*");
+
+    enum MHD_Result ret = MHD_queue_response(connection, status_code, response);
+    MHD_destroy_response(response);
+
+    return ret;
+}
+
+// Helper: 429/503 response carrying a Retry-After header (whole seconds,
+// rounded up); the body repeats it with millisecond precision
+static enum MHD_Result send_retry_response(struct MHD_Connection *connection,
+                                           int status_code,
+                                           cJSON *body,
+                                           int retry_after_ms) {
+    char retry_after[16];
+    snprintf(retry_after, sizeof(retry_after), "%d", (retry_after_ms + 999) / 1000);
+    cJSON_AddStringToObject(body, "retry_after", retry_after);
+    cJSON_AddNumberToObject(body, "retry_after_ms", retry_after_ms);
+
+    char *body_str = cJSON_Print(body);
+    struct MHD_Response *response = MHD_create_response_from_buffer(
+        strlen(body_str),
+        (void*)body_str,
+        MHD_RESPMEM_MUST_COPY
+    );
+    free(body_str);
+
+    MHD_add_response_header(response, "Content-Type", "application/json");
+    MHD_add_response_header(response, "Access-Control-Allow-Origin", "*");
+    MHD_add_response_header(response, "Retry-After", retry_after);
+
+    enum MHD_Result ret = MHD_queue_response(connection, status_code, response);
+    MHD_destroy_response(response);
+
+    return ret;
+}
+
+// Client identity for per-client rate limiting: X-Client-Id if the producer
+// sends one (several bridges behind one address), else the remote address
+static void request_client_id(struct MHD_Connection *connection, char *client, size_t size) {
+    const char *header = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "X-Client-Id");
+    if (header && *header) {
+        snprintf(client, size, "%s", header);
+        return;
+    }
+
+    snprintf(client, size, "unknown");
+    const union MHD_ConnectionInfo *info =
+        MHD_get_connection_info(connection, MHD_CONNECTION_INFO_CLIENT_ADDRESS);
+    if (!info || !info->client_addr) {
+        return;
+    }
+    if (info->client_addr->sa_family == AF_INET) {
+        inet_ntop(AF_INET, &((struct sockaddr_in *)info->client_addr)->sin_addr, client, size);
+    } else if (info->client_addr->sa_family == AF_INET6) {
+        inet_ntop(AF_INET6, &((struct sockaddr_in6 *)info->client_addr)->sin6_addr, client, size);
+    }
+}
+
+// Reject with 429 because the queue is at its admission limit
+static enum MHD_Result send_queue_full(struct MHD_Connection *connection,
+                                       int queue_depth, int queue_capacity) {
+    pthread_mutex_lock(&admission.mutex);
+    admission.rejected_queue_full++;
+    pthread_mutex_unlock(&admission.mutex);
+
+    cJSON *full_response = cJSON_CreateObject();
+    cJSON_AddStringToObject(full_response, "error", "Queue almost full");
+    cJSON_AddNumberToObject(full_response, "queue_depth", queue_depth);
+    cJSON_AddNumberToObject(full_response, "queue_capacity", queue_capacity);
+    cJSON_AddNumberToObject(full_response, "drain_rate", queue_drain_rate(&task_queue));
+    enum MHD_Result ret = send_retry_response(connection, 429, full_response,
+                                              admission_retry_after_ms(queue_depth, queue_capacity));
+    cJSON_Delete(full_response);
+
+    return ret;
+}
+
+typedef enum {
+    SUBMIT_QUEUED,          // value = queue depth
+    SUBMIT_GROUPED,         // value = consolidation group size
+    SUBMIT_QUEUE_FULL,      // value = queue depth
+    SUBMIT_NO_RECORD,
+    SUBMIT_NO_GROUP,
+    SUBMIT_CORRUPT,         // value = TsVerdict
+    SUBMIT_COALESCED,       // value = duplicates attached; job_id = the existing job
+    SUBMIT_CACHED,          // Completed recently; job_id = that job, completion sent
+} SubmitResult;
+
+// Hand a registered job to the consolidator or the queue, without blocking.
+// A job that is not admitted loses its record.
+static SubmitResult submit_dispatch(TranscodeJob *job, int consolidate, int *value) {
+    if (consolidate) {
+        *value = consolidator_add(&consolidator, job);
+        if (*value < 0) {
+            job_index_remove(&job_index, job->job_id);
+            return SUBMIT_NO_GROUP;
+        }
+        return SUBMIT_GROUPED;
+    }
+
+    pthread_mutex_lock(&task_queue.mutex);
+    int queue_capacity = task_queue.capacity;
+    pthread_mutex_unlock(&task_queue.mutex);
+
+    *value = queue_try_push(&task_queue, job, admission_reserve(queue_capacity));
+    if (*value < 0) {
+        job_index_remove(&job_index, job->job_id);
+        pthread_mutex_lock(&task_queue.mutex);
+        *value = task_queue.count;
+        pthread_mutex_unlock(&task_queue.mutex);
+        return SUBMIT_QUEUE_FULL;
+    }
+    return SUBMIT_QUEUED;
+}
+
+static SubmitResult submit_new_job(TranscodeJob *job, int consolidate, int *value) {
+    if (job_index_create(&job_index, job) < 0) {
+        return SUBMIT_NO_RECORD;
+    }
+    return submit_dispatch(job, consolidate, value);
+}
+
+// Register a parsed job in the job index and hand it to the consolidator or
+// the queue, without blocking. Shared by POST /enqueue, the local socket and
+// the AMQP bridge. An input that fails the MPEG-TS check is refused before it
+// gets a record (mosaics open their tiles themselves). A duplicate of a
+// queued, running or recently completed job is coalesced into it instead;
+// job->job_id is then the existing job's.
+static SubmitResult submit_job(TranscodeJob *job, int consolidate, int *value) {
+    char reason[256];
+    if (!job->mosaic) {
+        TsVerdict verdict = ts_precheck_input(job->filename, reason, sizeof(reason));
+        if (verdict != TS_OK) {
+            *value = verdict;
+            return SUBMIT_CORRUPT;
+        }
+    }
+
+    coalesce_job_key(job);
+    if (!job->coalesce_key[0]) {
+        return submit_new_job(job, consolidate, value);
+    }
+
+    CoalescedResult cached;
+    SubmitResult submitted;
+    int reserved = 0;
+    pthread_mutex_lock(&coalescer.mutex);
+    CoalesceEntry *e = coalescer_lookup(&coalescer, job->coalesce_key);
+    if (e && e->finished) {
+        memcpy(job->job_id, e->job_id, sizeof(job->job_id));
+        cached = e->result;
+        coalescer.cached++;
+        *value = 0;
+        submitted = SUBMIT_CACHED;
+    } else if (e && coalescer_attach(&coalescer, e, job) == 0) {
+        memcpy(job->job_id, e->job_id, sizeof(job->job_id));
+        *value = e->nb_waiters;
+        submitted = SUBMIT_COALESCED;
+    } else if (job_index_create(&job_index, job) < 0) {
+        submitted = SUBMIT_NO_RECORD;
+    } else {
+        // Claim the key with the new job's ID before dispatching it, so a
+        // concurrent duplicate attaches to it while the dispatch runs
+        // without the lock (it may block on a full queue)
+        if (!e) {
+            coalescer_add(&coalescer, job);
+            reserved = 1;
+        }
+        submitted = SUBMIT_QUEUED;
+    }
+    pthread_mutex_unlock(&coalescer.mutex);
+
+    if (submitted == SUBMIT_QUEUED) {
+        submitted = submit_dispatch(job, consolidate, value);
+        if (reserved && submitted != SUBMIT_QUEUED && submitted != SUBMIT_GROUPED) {
+            // Release the key; duplicates that attached meanwhile are told
+            CoalescedResult rejected = { .state = JOB_FAILED };
+            snprintf(rejected.error, sizeof(rejected.error), "not admitted (%s)",
+                     submitted == SUBMIT_QUEUE_FULL ? "queue full" : "no consolidation group");
+            coalescer_finish(&coalescer, job->coalesce_key, job->job_id, &rejected);
+        }
+    }
+
+    if (submitted == SUBMIT_CACHED) {
+        coalesce_notify(job->callback_url, job->filename, job->metadata_json, job->job_id, &cached, 1);
+    }
+    return submitted;
+}
+
+// "timelapse": true for the configured rendition, or an object overriding
+// fps/keyframesOnly/width/height/bitrate. Returns NULL or the reason it is
+// unusable.
+static const char *parse_timelapse(const cJSON *item, TimelapseSpec *spec) {
+    *spec = config.timelapse;
+    if (cJSON_IsBool(item)) {
+        if (!cJSON_IsTrue(item)) spec->fps = 0;
+        return NULL;
+    }
+    if (!cJSON_IsObject(item)) {
+        return "'timelapse' must be true or an object";
+    }
+    config_set_int(&spec->fps, item, "fps");
+    const cJSON *keyframes = cJSON_GetObjectItem(item, "keyframesOnly");
+    if (keyframes && cJSON_IsBool(keyframes)) spec->keyframes_only = cJSON_IsTrue(keyframes);
+    config_set_int(&spec->width, item, "width");
+    config_set_int(&spec->height, item, "height");
+    config_set_int(&spec->bitrate, item, "bitrate");
+    return timelapse_spec_error(spec);
+}
+
+static int find_codec_profile(const char *name) {
+    for (int i = 0; i < config.nb_codec_profiles; i++) {
+        if (strcmp(config.codec_profiles[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+// "codecProfile": name from the configured catalogue. AV1 is only muxed as
+// CMAF, so an AV1 profile switches the output format unless the request
+// asked for MPEG-TS explicitly. Returns NULL or the reason it is unusable.
+static const char *parse_codec_profile(const cJSON *json, TranscodeJob *job, int format_given) {
+    const cJSON *item = cJSON_GetObjectItem(json, "codecProfile");
+    if (!item) {
+        return NULL;
+    }
+    if (!cJSON_IsString(item)) {
+        return "'codecProfile' must be a string";
+    }
+    int index = find_codec_profile(item->valuestring);
+    if (index < 0) {
+        return "Unknown 'codecProfile'";
+    }
+    if (config.codec_profiles[index].codec == CODEC_AV1 && job->output_format == OUTPUT_FORMAT_TS) {
+        if (format_given) {
+            return "AV1 codec profiles require 'outputFormat': 'cmaf'";
+        }
+        job->output_format = OUTPUT_FORMAT_CMAF;
+    }
+    job->codec_profile = index;
+    return NULL;
+}
+
+// API Endpoint: POST /enqueue - Add file to transcoding queue
+static enum MHD_Result handle_enqueue(struct MHD_Connection *connection,
+                                      const char *upload_data,
+                                      size_t upload_data_size) {
+    if (upload_data_size == 0) {
+        return send_response(connection, 400, "{\"error\":\"Empty request body\"}");
+    }
+
+    // Parse JSON
+    cJSON *json = cJSON_Parse(upload_data);
+    if (!json) {
+        return send_response(connection, 400, "{\"error\":\"Invalid JSON\"}");
+    }
+
+    // Get inputPath (full path to file)
+    cJSON *input_path_item = cJSON_GetObjectItem(json, "inputPath");
+    if (!input_path_item || !cJSON_IsString(input_path_item)) {
+        cJSON_Delete(json);
+        return send_response(connection, 400, "{\"error\":\"Missing 'inputPath' field\"}");
+    }
+
+    const char *input_path = input_path_item->valuestring;
+    char input_name[512];
+    char resolved_path[1024];
+
+    // Validate path exists where the worker will open it
+    int outside = resolve_input_path(input_path, input_name, sizeof(input_name),
+                                     resolved_path, sizeof(resolved_path)) < 0;
+    if (outside || access(resolved_path, F_OK) != 0) {
+        cJSON_Delete(json);
+
+        cJSON *error_response = cJSON_CreateObject();
+        cJSON_AddStringToObject(error_response, "error", outside ? "inputPath is outside inputDir" : "File not found");
+        cJSON_AddStringToObject(error_response, "inputPath", input_path);
+        char *error_str = cJSON_Print(error_response);
+        enum MHD_Result ret = send_response(connection, outside ? 400 : 404, error_str);
+        free(error_str);
+        cJSON_Delete(error_response);
+
+        return ret;
+    }
+
+    // Get callback URL (optional)
+    const char *callback_url = "";
+    cJSON *callback_item = cJSON_GetObjectItem(json, "callbackUrl");
+    if (callback_item && cJSON_IsString(callback_item)) {
+        callback_url = callback_item->valuestring;
+    }
+
+    // Get metadata (optional)
+    char metadata_json[2048] = {0};
+    cJSON *metadata_item = cJSON_GetObjectItem(json, "metadata");
+    if (metadata_item) {
+        char *metadata_str = cJSON_PrintUnformatted(metadata_item);
+        if (metadata_str) {
+            strncpy(metadata_json, metadata_str, sizeof(metadata_json) - 1);
+            free(metadata_str);
+        }
+    }
+
+    // Check queue capacity (consolidated segments are queued later, as a group)
+    pthread_mutex_lock(&task_queue.mutex);
+    int queue_depth = task_queue.count;
+    int queue_capacity = task_queue.capacity;
+    pthread_mutex_unlock(&task_queue.mutex);
+
+    if (queue_depth >= queue_capacity - admission_reserve(queue_capacity)) {
+        cJSON_Delete(json);
+        return send_queue_full(connection, queue_depth, queue_capacity);
+    }
+
+    // Create job
+    TranscodeJob job = {0};
+    strncpy(job.filename, input_name, sizeof(job.filename) - 1);
+    strncpy(job.callback_url, callback_url, sizeof(job.callback_url) - 1);
+    strncpy(job.metadata_json, metadata_json, sizeof(job.metadata_json) - 1);
+
+    // Camera key for consolidation groups and per-camera playlists
+    cJSON *camera_item = cJSON_GetObjectItem(json, "cameraId");
+    if (camera_item && cJSON_IsString(camera_item)) {
+        strncpy(job.camera_id, camera_item->valuestring, sizeof(job.camera_id) - 1);
+    } else {
+        camera_key_from_path(job.filename, job.camera_id, sizeof(job.camera_id));
+    }
+
+    // Output container (optional): "ts" or "cmaf"
+    job.output_format = default_output_format;
+    cJSON *format_item = cJSON_GetObjectItem(json, "outputFormat");
+    if (format_item && cJSON_IsString(format_item)) {
+        int format = parse_output_format(format_item->valuestring);
+        if (format < 0) {
+            cJSON_Delete(json);
+            return send_response(connection, 400, "{\"error\":\"Unknown 'outputFormat' (expected ts or cmaf)\"}");
+        }
+        job.output_format = format;
+    }
+
+    // Scheduling (optional): "priority" class, "deadlineMs" relative to now,
+    // "onExpire": "shed" (default) or "downgrade"
+    cJSON *priority_item = cJSON_GetObjectItem(json, "priority");
+    if (priority_item && cJSON_IsString(priority_item)) {
+        int priority = parse_priority(priority_item->valuestring);
+        if (priority < 0) {
+            cJSON_Delete(json);
+            return send_response(connection, 400, "{\"error\":\"Unknown 'priority' (expected live, export or archive)\"}");
+        }
+        job.priority = priority;
+    }
+
+    cJSON *deadline_item = cJSON_GetObjectItem(json, "deadlineMs");
+    if (deadline_item) {
+        if (!cJSON_IsNumber(deadline_item) || deadline_item->valuedouble <= 0) {
+            cJSON_Delete(json);
+            return send_response(connection, 400, "{\"error\":\"'deadlineMs' must be a positive number\"}");
+        }
+        job.deadline_ms = monotonic_ms() + (long long)deadline_item->valuedouble;
+    }
+
+    cJSON *expire_item = cJSON_GetObjectItem(json, "onExpire");
+    if (expire_item && cJSON_IsString(expire_item)) {
+        if (strcmp(expire_item->valuestring, "downgrade") == 0) {
+            job.on_expire = EXPIRE_DOWNGRADE;
+        } else if (strcmp(expire_item->valuestring, "shed") != 0) {
+            cJSON_Delete(json);
+            return send_response(connection, 400, "{\"error\":\"Unknown 'onExpire' (expected shed or downgrade)\"}");
+        }
+    }
+
+    // Duplicate detection (optional): "path", "content" or "off"
+    cJSON *coalesce_item = cJSON_GetObjectItem(json, "coalesce");
+    if (coalesce_item) {
+        int mode = cJSON_IsString(coalesce_item) ? parse_coalesce_mode(coalesce_item->valuestring) : -1;
+        if (mode < 0) {
+            cJSON_Delete(json);
+            return send_response(connection, 400, "{\"error\":\"Unknown 'coalesce' (expected path, content or off)\"}");
+        }
+        job.coalesce = mode;
+    }
+
+    const char *profile_error = parse_codec_profile(json, &job, format_item != NULL);
+    if (profile_error) {
+        cJSON *error_response = cJSON_CreateObject();
+        cJSON_AddStringToObject(error_response, "error", profile_error);
+        char *error_str = cJSON_Print(error_response);
+        enum MHD_Result ret = send_response(connection, 400, error_str);
+        free(error_str);
+        cJSON_Delete(error_response);
+        cJSON_Delete(json);
+        return ret;
+    }
+
+    // Time-lapse archive rendition (optional): a standalone MPEG-TS file
+    cJSON *timelapse_item = cJSON_GetObjectItem(json, "timelapse");
+    if (timelapse_item) {
+        const char *error = parse_timelapse(timelapse_item, &job.timelapse);
+        if (!error && job.timelapse.fps > 0 && job.output_format == OUTPUT_FORMAT_CMAF && format_item) {
+            error = "'timelapse' output is MPEG-TS only";
+        }
+        if (!error && job.timelapse.fps > 0 && config.codec_profiles[job.codec_profile].codec == CODEC_AV1) {
+            error = "'timelapse' output is MPEG-TS only, which AV1 profiles cannot use";
+        }
+        if (error) {
+            cJSON *error_response = cJSON_CreateObject();
+            cJSON_AddStringToObject(error_response, "error", error);
+            char *error_str = cJSON_Print(error_response);
+            enum MHD_Result ret = send_response(connection, 400, error_str);
+            free(error_str);
+            cJSON_Delete(error_response);
+            cJSON_Delete(json);
+            return ret;
+        }
+        if (job.timelapse.fps > 0) {
+            job.output_format = OUTPUT_FORMAT_TS;
+        }
+    }
+
+    // Consolidation mode: park the segment in its camera's group unless the
+    // producer opted out ("consolidate": false). Urgent jobs are never held
+    // back waiting for a group to fill, and time-lapse renditions are
+    // written per segment.
+    cJSON *consolidate_item = cJSON_GetObjectItem(json, "consolidate");
+    int consolidate = consolidator.target_seconds > 0 && job.timelapse.fps == 0 &&
+                      job.priority == PRIORITY_ARCHIVE && job.deadline_ms == 0 &&
+                      !(consolidate_item && cJSON_IsBool(consolidate_item) && !cJSON_IsTrue(consolidate_item));
+
+    // Per-client rate limit (optional): only well-formed requests use up a token
+    char client[64];
+    request_client_id(connection, client, sizeof(client));
+    int client_wait_ms = admission_take_token(&admission, client);
+    if (client_wait_ms > 0) {
+        cJSON *limited_response = cJSON_CreateObject();
+        cJSON_AddStringToObject(limited_response, "error", "Client rate limit exceeded");
+        cJSON_AddStringToObject(limited_response, "client", client);
+        enum MHD_Result ret = send_retry_response(connection, 429, limited_response, client_wait_ms);
+        cJSON_Delete(limited_response);
+        cJSON_Delete(json);
+        return ret;
+    }
+
+    int value = 0;
+    SubmitResult submitted = submit_job(&job, consolidate, &value);
+    if (submitted == SUBMIT_NO_RECORD) {
+        cJSON_Delete(json);
+        return send_response(connection, 500, "{\"error\":\"Failed to allocate job record\"}");
+    }
+    if (submitted == SUBMIT_NO_GROUP) {
+        cJSON_Delete(json);
+        return send_response(connection, 500, "{\"error\":\"Failed to allocate consolidation group\"}");
+    }
+    if (submitted == SUBMIT_CORRUPT) {
+        cJSON *corrupt_response = cJSON_CreateObject();
+        cJSON_AddStringToObject(corrupt_response, "error", "Input failed the MPEG-TS integrity check");
+        cJSON_AddStringToObject(corrupt_response, "reason", ts_verdict_names[value]);
+        cJSON_AddStringToObject(corrupt_response, "inputPath", input_path);
+        char *corrupt_str = cJSON_Print(corrupt_response);
+        enum MHD_Result ret = send_response(connection, 422, corrupt_str);
+        free(corrupt_str);
+        cJSON_Delete(corrupt_response);
+        cJSON_Delete(json);
+        return ret;
+    }
+
+    if (submitted == SUBMIT_COALESCED || submitted == SUBMIT_CACHED) {
+        fprintf(stderr, "[API] Coalesced: %s into job %s (%s)\n", input_path, job.job_id,
+                submitted == SUBMIT_CACHED ? "completed" : "in flight");
+
+        cJSON *coalesced_response = cJSON_CreateObject();
+        cJSON_AddStringToObject(coalesced_response, "status",
+                                submitted == SUBMIT_CACHED ? "completed" : "coalesced");
+        cJSON_AddStringToObject(coalesced_response, "jobId", job.job_id);
+        cJSON_AddStringToObject(coalesced_response, "inputPath", input_path);
+        if (submitted == SUBMIT_COALESCED) {
+            cJSON_AddNumberToObject(coalesced_response, "duplicates", value);
+        }
+        cJSON *record = job_index_get_json(&job_index, job.job_id);
+        if (record) {
+            cJSON_AddItemToObject(coalesced_response, "job", record);
+        }
+        char *coalesced_str = cJSON_Print(coalesced_response);
+
+        enum MHD_Result ret = send_response(connection, 200, coalesced_str);
+
+        free(coalesced_str);
+        cJSON_Delete(coalesced_response);
+        cJSON_Delete(json);
+
+        return ret;
+    }
+
+    if (submitted == SUBMIT_GROUPED) {
+        const char *camera_id = job.camera_id;
+        int group_size = value;
+
+        fprintf(stderr, "[API] Grouped: %s (camera %s, %d segments)\n", input_path, camera_id, group_size);
+
+        cJSON *grouped_response = cJSON_CreateObject();
+        cJSON_AddStringToObject(grouped_response, "status", "grouped");
+        cJSON_AddStringToObject(grouped_response, "jobId", job.job_id);
+        cJSON_AddStringToObject(grouped_response, "inputPath", input_path);
+        cJSON_AddStringToObject(grouped_response, "cameraId", camera_id);
+        cJSON_AddNumberToObject(grouped_response, "group_size", group_size);
+        char *grouped_str = cJSON_Print(grouped_response);
+
+        enum MHD_Result ret = send_response(connection, 200, grouped_str);
+
+        free(grouped_str);
+        cJSON_Delete(grouped_response);
+        cJSON_Delete(json);
+
+        return ret;
+    }
+
+    // A concurrent producer may have taken the last slot since the check above
+    queue_depth = value;
+    if (submitted == SUBMIT_QUEUE_FULL) {
+        cJSON_Delete(json);
+        return send_queue_full(connection, queue_depth, queue_capacity);
+    }
+
+    fprintf(stderr, "[API] Enqueued: %s (%s, queue depth: %d)\n",
+            input_path, priority_names[job.priority], queue_depth);
+
+    // Success response
+    cJSON *success_response = cJSON_CreateObject();
+    cJSON_AddStringToObject(success_response, "status", "queued");
+    cJSON_AddStringToObject(success_response, "jobId", job.job_id);
+    cJSON_AddStringToObject(success_response, "inputPath", input_path);
+    cJSON_AddStringToObject(success_response, "priority", priority_names[job.priority]);
+    cJSON_AddNumberToObject(success_response, "queue_depth", queue_depth);
+    char *success_str = cJSON_Print(success_response);
+
+    enum MHD_Result ret = send_response(connection, 200, success_str);
+
+    free(success_str);
+    cJSON_Delete(success_response);
+    cJSON_Delete(json);
+
+    return ret;
+}
+
+// API Endpoint: POST /mosaic - Composite several cameras into one grid encode
+// {"inputs": [paths...], "layout": "2x2", "scaler": "cuda"|"software",
+//  "wallId", "callbackUrl", "metadata", "priority", "outputFormat"}
+static enum MHD_Result handle_mosaic(struct MHD_Connection *connection,
+                                     const char *upload_data,
+                                     size_t upload_data_size) {
+    if (upload_data_size == 0) {
+        return send_response(connection, 400, "{\"error\":\"Empty request body\"}");
+    }
+
+    if (software_backend) {
+        return send_response(connection, 400, "{\"error\":\"Mosaic jobs need the nvenc encoder backend\"}");
+    }
+
+    cJSON *json = cJSON_Parse(upload_data);
+    if (!json) {
+        return send_response(connection, 400, "{\"error\":\"Invalid JSON\"}");
+    }
+
+    cJSON *inputs_item = cJSON_GetObjectItem(json, "inputs");
+    int nb_inputs = cJSON_IsArray(inputs_item) ? cJSON_GetArraySize(inputs_item) : 0;
+    if (nb_inputs < 1 || nb_inputs > MOSAIC_MAX_INPUTS) {
+        cJSON_Delete(json);
+        return send_response(connection, 400, "{\"error\":\"'inputs' must be an array of 1..16 paths\"}");
+    }
+
+    MosaicJob *mosaic = calloc(1, sizeof(MosaicJob));
+    if (!mosaic) {
+        cJSON_Delete(json);
+        return send_response(connection, 500, "{\"error\":\"Failed to allocate mosaic job\"}");
+    }
+    mosaic->nb_inputs = nb_inputs;
+    mosaic->software_scale = strcmp(config.mosaic_scaler, "software") == 0;
+
+    for (int i = 0; i < nb_inputs; i++) {
+        cJSON *path_item = cJSON_GetArrayItem(inputs_item, i);
+        if (!cJSON_IsString(path_item)) {
+            free(mosaic);
+            cJSON_Delete(json);
+            return send_response(connection, 400, "{\"error\":\"'inputs' entries must be strings\"}");
+        }
+        // Same resolution as POST /enqueue: workers open inputDir/<name>
+        char resolved_path[1024];
+        int outside = resolve_input_path(path_item->valuestring, mosaic->inputs[i], sizeof(mosaic->inputs[i]),
+                                         resolved_path, sizeof(resolved_path)) < 0;
+        if (outside || access(resolved_path, F_OK) != 0) {
+            cJSON *error_response = cJSON_CreateObject();
+            cJSON_AddStringToObject(error_response, "error", outside ? "inputPath is outside inputDir" : "File not found");
+            cJSON_AddStringToObject(error_response, "inputPath", path_item->valuestring);
+            char *error_str = cJSON_Print(error_response);
+            enum MHD_Result ret = send_response(connection, outside ? 400 : 404, error_str);
+            free(error_str);
+            cJSON_Delete(error_response);
+            free(mosaic);
+            cJSON_Delete(json);
+            return ret;
+        }
+    }
+
+    // Grid: explicit "CxR", else the smallest square that fits every input
+    cJSON *layout_item = cJSON_GetObjectItem(json, "layout");
+    if (layout_item && cJSON_IsString(layout_item)) {
+        if (parse_mosaic_layout(layout_item->valuestring, &mosaic->cols, &mosaic->rows) < 0 ||
+            mosaic->cols * mosaic->rows < nb_inputs) {
+            free(mosaic);
+            cJSON_Delete(json);
+            return send_response(connection, 400, "{\"error\":\"'layout' must be CxR (1..4 each) with a cell per input\"}");
+        }
+    } else {
+        mosaic->cols = 1;
+        while (mosaic->cols * mosaic->cols < nb_inputs) mosaic->cols++;
+        mosaic->rows = (nb_inputs + mosaic->cols - 1) / mosaic->cols;
+    }
+
+    cJSON *scaler_item = cJSON_GetObjectItem(json, "scaler");
+    if (scaler_item && cJSON_IsString(scaler_item)) {
+        if (strcmp(scaler_item->valuestring, "software") == 0) {
+            mosaic->software_scale = 1;
+        } else if (strcmp(scaler_item->valuestring, "cuda") == 0) {
+            mosaic->software_scale = 0;
+        } else {
+            free(mosaic);
+            cJSON_Delete(json);
+            return send_response(connection, 400, "{\"error\":\"Unknown 'scaler' (expected cuda or software)\"}");
+        }
+    }
+
+    TranscodeJob job = {0};
+    job.mosaic = mosaic;
+
+    // Per-wall playlist key in CMAF mode
+    cJSON *wall_item = cJSON_GetObjectItem(json, "wallId");
+    strncpy(job.camera_id, wall_item && cJSON_IsString(wall_item) ? wall_item->valuestring : "mosaic",
+            sizeof(job.camera_id) - 1);
+
+    // Label used for logs, quarantine and the output name:
+    // "mosaic_<wall>_2x2_<first input>" (never collides with a real segment),
+    // so two walls over the same first camera do not overwrite each other
+    const char *first = strrchr(mosaic->inputs[0], '/');
+    char first_base[256];
+    char wall_slug[128];
+    output_base_name(first ? first + 1 : mosaic->inputs[0], first_base, sizeof(first_base));
+    camera_slug(job.camera_id, wall_slug, sizeof(wall_slug));
+    snprintf(job.filename, sizeof(job.filename), "mosaic_%s_%dx%d_%s", wall_slug,
+             mosaic->cols, mosaic->rows, first_base);
+
+    cJSON *callback_item = cJSON_GetObjectItem(json, "callbackUrl");
+    if (callback_item && cJSON_IsString(callback_item)) {
+        strncpy(job.callback_url, callback_item->valuestring, sizeof(job.callback_url) - 1);
+    }
+
+    cJSON *metadata_item = cJSON_GetObjectItem(json, "metadata");
+    if (metadata_item) {
+        char *metadata_str = cJSON_PrintUnformatted(metadata_item);
+        if (metadata_str) {
+            strncpy(job.metadata_json, metadata_str, sizeof(job.metadata_json) - 1);
+            free(metadata_str);
+        }
+    }
+
+    job.output_format = default_output_format;
+    cJSON *format_item = cJSON_GetObjectItem(json, "outputFormat");
+    if (format_item && cJSON_IsString(format_item)) {
+        int format = parse_output_format(format_item->valuestring);
+        if (format < 0) {
+            free(mosaic);
+            cJSON_Delete(json);
+            return send_response(connection, 400, "{\"error\":\"Unknown 'outputFormat' (expected ts or cmaf)\"}");
+        }
+        job.output_format = format;
+    }
+
+    const char *profile_error = parse_codec_profile(json, &job, format_item != NULL);
+    if (profile_error) {
+        cJSON *error_response = cJSON_CreateObject();
+        cJSON_AddStringToObject(error_response, "error", profile_error);
+        char *error_str = cJSON_Print(error_response);
+        enum MHD_Result ret = send_response(connection, 400, error_str);
+        free(error_str);
+        cJSON_Delete(error_response);
+        free(mosaic);
+        cJSON_Delete(json);
+        return ret;
+    }
+
+    cJSON *priority_item = cJSON_GetObjectItem(json, "priority");
+    if (priority_item && cJSON_IsString(priority_item)) {
+        int priority = parse_priority(priority_item->valuestring);
+        if (priority < 0) {
+            free(mosaic);
+            cJSON_Delete(json);
+            return send_response(connection, 400, "{\"error\":\"Unknown 'priority' (expected live, export or archive)\"}");
+        }
+        job.priority = priority;
+    }
+
+    // Per-client rate limit (optional): only well-formed requests use up a token
+    char client[64];
+    request_client_id(connection, client, sizeof(client));
+    int client_wait_ms = admission_take_token(&admission, client);
+    if (client_wait_ms > 0) {
+        cJSON *limited_response = cJSON_CreateObject();
+        cJSON_AddStringToObject(limited_response, "error", "Client rate limit exceeded");
+        cJSON_AddStringToObject(limited_response, "client", client);
+        enum MHD_Result ret = send_retry_response(connection, 429, limited_response, client_wait_ms);
+        cJSON_Delete(limited_response);
+        free(mosaic);
+        cJSON_Delete(json);
+        return ret;
+    }
+
+    pthread_mutex_lock(&task_queue.mutex);
+    int queue_capacity = task_queue.capacity;
+    pthread_mutex_unlock(&task_queue.mutex);
+
+    int queue_depth = 0;
+    SubmitResult submitted = submit_job(&job, 0, &queue_depth);
+    if (submitted != SUBMIT_QUEUED) {
+        free(mosaic);
+        cJSON_Delete(json);
+        if (submitted == SUBMIT_QUEUE_FULL) {
+            return send_queue_full(connection, queue_depth, queue_capacity);
+        }
+        return send_response(connection, 500, "{\"error\":\"Failed to allocate job record\"}");
+    }
+
+    fprintf(stderr, "[API] Mosaic enqueued: %s (%d cameras, %s, queue depth: %d)\n",
+            job.filename, nb_inputs, priority_names[job.priority], queue_depth);
+
+    char layout[16];
+    snprintf(layout, sizeof(layout), "%dx%d", mosaic->cols, mosaic->rows);
+
+    cJSON *success_response = cJSON_CreateObject();
+    cJSON_AddStringToObject(success_response, "status", "queued");
+    cJSON_AddStringToObject(success_response, "jobId", job.job_id);
+    cJSON_AddStringToObject(success_response, "layout", layout);
+    cJSON_AddStringToObject(success_response, "scaler", mosaic->software_scale ? "software" : "cuda");
+    cJSON_AddNumberToObject(success_response, "inputs", nb_inputs);
+    cJSON_AddStringToObject(success_response, "priority", priority_names[job.priority]);
+    cJSON_AddNumberToObject(success_response, "queue_depth", queue_depth);
+    char *success_str = cJSON_Print(success_response);
+
+    enum MHD_Result ret = send_response(connection, 200, success_str);
+
+    free(success_str);
+    cJSON_Delete(success_response);
+    cJSON_Delete(json);
+
+    return ret;
+}
+
+// API Endpoint: GET /health - Health check
+static enum MHD_Result handle_health(struct MHD_Connection *connection) {
+    cJSON *health = cJSON_CreateObject();
+
+    pthread_mutex_lock(&stats_mutex);
+    cJSON_AddStringToObject(health, "status", "healthy");
+    cJSON_AddNumberToObject(health, "processed", files_processed);
+    cJSON_AddNumberToObject(health, "failed", files_failed);
+    cJSON_AddNumberToObject(health, "queue_depth", task_queue.count);
+    cJSON *class_depth = cJSON_AddObjectToObject(health, "queue_by_priority");
+    for (int i = 0; i < PRIORITY_NB_CLASSES; i++) {
+        cJSON_AddNumberToObject(class_depth, priority_names[i], task_queue.class_count[i]);
+    }
+    cJSON_AddNumberToObject(health, "workers", worker_pool_running(&worker_pool));
+    cJSON_AddNumberToObject(health, "workers_parked", worker_pool_parked(&worker_pool));
+    cJSON_AddNumberToObject(health, "devices", device_manager.nb_devices);
+    cJSON_AddNumberToObject(health, "devices_healthy", device_healthy_count(&device_manager));
+    cJSON_AddNumberToObject(health, "uptime_seconds", (int)(time(NULL) - start_time));
+    pthread_mutex_unlock(&stats_mutex);
+
+    char *health_str = cJSON_Print(health);
+    enum MHD_Result ret = send_response(connection, 200, health_str);
+
+    free(health_str);
+    cJSON_Delete(health);
+
+    return ret;
+}
+
+// API Endpoint: GET /ready - Readiness probe. 200 as soon as one worker
+// pipeline is warm (queued jobs start right away), 503 before that and once
+// shutdown begins, so a rolling deploy routes traffic only to warm instances.
+static enum MHD_Result handle_ready(struct MHD_Connection *connection) {
+    cJSON *ready = cJSON_CreateObject();
+
+    pthread_mutex_lock(&worker_pool.mutex);
+    int warm = worker_pool.warm;
+    int target = worker_pool.target;
+    long long first_warm_ms = worker_pool.first_warm_ms;
+    long long all_warm_ms = worker_pool.all_warm_ms;
+    pthread_mutex_unlock(&worker_pool.mutex);
+
+    int is_ready = warm > 0 && processing_active;
+    cJSON_AddBoolToObject(ready, "ready", is_ready);
+    cJSON_AddNumberToObject(ready, "warmPipelines", warm);
+    cJSON_AddNumberToObject(ready, "workers", target);
+    if (first_warm_ms >= 0) {
+        cJSON_AddNumberToObject(ready, "firstWarmMs", (double)first_warm_ms);
+    }
+    if (all_warm_ms >= 0) {
+        cJSON_AddNumberToObject(ready, "allWarmMs", (double)all_warm_ms);
+    }
+
+    cJSON *devices = cJSON_AddArrayToObject(ready, "devices");
+    pthread_mutex_lock(&device_manager.mutex);
+    for (int i = 0; i < device_manager.nb_devices; i++) {
+        DeviceState *d = &device_manager.devices[i];
+        cJSON *device = cJSON_CreateObject();
+        cJSON_AddNumberToObject(device, "id", i);
+        cJSON_AddNumberToObject(device, "sessions", d->active_sessions);
+        cJSON_AddNumberToObject(device, "warming", d->warming);
+        cJSON_AddBoolToObject(device, "healthy", d->healthy);
+        cJSON_AddItemToArray(devices, device);
+    }
+    pthread_mutex_unlock(&device_manager.mutex);
+
+    char *ready_str = cJSON_Print(ready);
+    enum MHD_Result ret = send_response(connection, is_ready ? 200 : 503, ready_str);
+
+    free(ready_str);
+    cJSON_Delete(ready);
+
+    return ret;
+}
+
+// API Endpoint: GET /metrics - Prometheus metrics
+static enum MHD_Result handle_metrics(struct MHD_Connection *connection) {
+    char metrics[65536];
+
+    // Pipeline counters live in the worker processes
+    if (worker_processes.shm) {
+        worker_processes_collect(&worker_processes);
+    }
+
+    pthread_mutex_lock(&stats_mutex);
+    snprintf(metrics, sizeof(metrics),
+        "# HELP transcoder_processed_total Total files processed\n"
+        "# TYPE transcoder_processed_total counter\n"
+        "transcoder_processed_total %d\n"
+        "\n"
+        "# HELP transcoder_failed_total Total files failed\n"
+        "# TYPE transcoder_failed_total counter\n"
+        "transcoder_failed_total %d\n"
+        "\n"
+        "# HELP transcoder_queue_depth Current queue depth\n"
+        "# TYPE transcoder_queue_depth gauge\n"
+        "transcoder_queue_depth %d\n"
+        "\n"
+        "# HELP transcoder_workers Total worker threads\n"
+        "# TYPE transcoder_workers gauge\n"
+        "transcoder_workers %d\n"
+        "\n"
+        "# HELP transcoder_uptime_seconds Uptime in seconds\n"
+        "# TYPE transcoder_uptime_seconds counter\n"
+        "transcoder_uptime_seconds %d\n",
+        files_processed, files_failed, task_queue.count, worker_pool_running(&worker_pool),
+        (int)(time(NULL) - start_time)
+    );
+    pthread_mutex_unlock(&stats_mutex);
+
+    size_t len = strlen(metrics);
+#ifdef ALLOC_DEBUG
+    pthread_mutex_lock(&stats_mutex);
+    len += snprintf(metrics + len, sizeof(metrics) - len,
+        "\n"
+        "# HELP transcoder_hot_path_allocations_total Heap allocations in the steady-state frame loop\n"
+        "# TYPE transcoder_hot_path_allocations_total counter\n"
+        "transcoder_hot_path_allocations_total %lu\n"
+        "# HELP transcoder_hot_path_frames_total Frames counted by transcoder_hot_path_allocations_total\n"
+        "# TYPE transcoder_hot_path_frames_total counter\n"
+        "transcoder_hot_path_frames_total %lu\n",
+        hot_path_allocations, hot_path_frames);
+    pthread_mutex_unlock(&stats_mutex);
+#endif
+
+    // Per-device load and health
+    len += snprintf(metrics + len, sizeof(metrics) - len,
+        "\n"
+        "# HELP transcoder_device_active_sessions Worker pipelines bound to the device\n"
+        "# TYPE transcoder_device_active_sessions gauge\n"
+        "# HELP transcoder_device_ms_per_file Recent per-file processing time (EWMA)\n"
+        "# TYPE transcoder_device_ms_per_file gauge\n"
+        "# HELP transcoder_device_healthy 1 if the device accepts pipelines\n"
+        "# TYPE transcoder_device_healthy gauge\n"
+        "# HELP transcoder_device_files_total Files processed per device and outcome\n"
+        "# TYPE transcoder_device_files_total counter\n"
+        "# HELP transcoder_device_migrations_total Pipelines moved onto the device\n"
+        "# TYPE transcoder_device_migrations_total counter\n"
+        "# HELP transcoder_device_warming Pipelines being built on the device\n"
+        "# TYPE transcoder_device_warming gauge\n");
+
+    pthread_mutex_lock(&device_manager.mutex);
+    for (int i = 0; i < device_manager.nb_devices && len < sizeof(metrics); i++) {
+        DeviceState *d = &device_manager.devices[i];
+        len += snprintf(metrics + len, sizeof(metrics) - len,
+            "transcoder_device_active_sessions{device=\"%d\"} %d\n"
+            "transcoder_device_ms_per_file{device=\"%d\"} %.1f\n"
+            "transcoder_device_healthy{device=\"%d\"} %d\n"
+            "transcoder_device_files_total{device=\"%d\",result=\"ok\"} %ld\n"
+            "transcoder_device_files_total{device=\"%d\",result=\"failed\"} %ld\n"
+            "transcoder_device_migrations_total{device=\"%d\"} %ld\n"
+            "transcoder_device_warming{device=\"%d\"} %d\n",
+            i, d->active_sessions, i, d->ewma_ms, i, d->healthy,
+            i, d->files_ok, i, d->files_failed, i, d->migrations_in, i, d->warming);
+    }
+    pthread_mutex_unlock(&device_manager.mutex);
+
+    // Pipeline warm-up after (re)start
+    pthread_mutex_lock(&worker_pool.mutex);
+    int warm = worker_pool.warm;
+    long long first_warm_ms = worker_pool.first_warm_ms;
+    long long all_warm_ms = worker_pool.all_warm_ms;
+    pthread_mutex_unlock(&worker_pool.mutex);
+    if (len < sizeof(metrics)) {
+        len += snprintf(metrics + len, sizeof(metrics) - len,
+            "\n"
+            "# HELP transcoder_pipelines_warm Worker pipelines ready for jobs\n"
+            "# TYPE transcoder_pipelines_warm gauge\n"
+            "transcoder_pipelines_warm %d\n",
+            warm);
+    }
+    if (first_warm_ms >= 0 && len < sizeof(metrics)) {
+        len += snprintf(metrics + len, sizeof(metrics) - len,
+            "# HELP transcoder_startup_first_warm_seconds Start-up time until the first pipeline was warm\n"
+            "# TYPE transcoder_startup_first_warm_seconds gauge\n"
+            "transcoder_startup_first_warm_seconds %.3f\n",
+            first_warm_ms / 1000.0);
+    }
+    if (all_warm_ms >= 0 && len < sizeof(metrics)) {
+        len += snprintf(metrics + len, sizeof(metrics) - len,
+            "# HELP transcoder_startup_all_warm_seconds Start-up time until every pipeline was warm\n"
+            "# TYPE transcoder_startup_all_warm_seconds gauge\n"
+            "transcoder_startup_all_warm_seconds %.3f\n",
+            all_warm_ms / 1000.0);
+    }
+
+    // Worker processes
+    if (worker_processes.shm && len < sizeof(metrics)) {
+        WorkerProcesses *wp = &worker_processes;
+        pthread_mutex_lock(&wp->mutex);
+        int running = 0;
+        for (int k = 0; k < wp->nb_procs; k++) {
+            if (wp->procs[k].pid > 0) running++;
+        }
+        len += snprintf(metrics + len, sizeof(metrics) - len,
+            "\n"
+            "# HELP transcoder_worker_processes Worker processes running\n"
+            "# TYPE transcoder_worker_processes gauge\n"
+            "transcoder_worker_processes %d\n"
+            "# HELP transcoder_worker_process_crashes_total Worker processes that exited outside shutdown\n"
+            "# TYPE transcoder_worker_process_crashes_total counter\n"
+            "transcoder_worker_process_crashes_total %ld\n"
+            "# HELP transcoder_worker_process_jobs_lost_total Jobs in flight when their worker process died\n"
+            "# TYPE transcoder_worker_process_jobs_lost_total counter\n"
+            "transcoder_worker_process_jobs_lost_total %ld\n"
+            "# HELP transcoder_worker_process_restarts_total Worker process restarts\n"
+            "# TYPE transcoder_worker_process_restarts_total counter\n",
+            running, wp->crashes, wp->jobs_lost);
+        for (int k = 0; k < wp->nb_procs && len < sizeof(metrics); k++) {
+            len += snprintf(metrics + len, sizeof(metrics) - len,
+                "transcoder_worker_process_restarts_total{process=\"%d\"} %ld\n", k, wp->procs[k].restarts);
+        }
+        if (len < sizeof(metrics)) {
+            len += snprintf(metrics + len, sizeof(metrics) - len,
+                "# HELP transcoder_worker_process_pipelines_warm Warm pipelines per worker process\n"
+                "# TYPE transcoder_worker_process_pipelines_warm gauge\n");
+        }
+        for (int k = 0; k < wp->nb_procs && len < sizeof(metrics); k++) {
+            len += snprintf(metrics + len, sizeof(metrics) - len,
+                "transcoder_worker_process_pipelines_warm{process=\"%d\",device=\"%d\"} %d\n",
+                k, wp->shm->procs[k].device, atomic_load(&wp->shm->procs[k].warm));
+        }
+        pthread_mutex_unlock(&wp->mutex);
+    }
+
+    // Thread placement
+    if (affinity.enabled && len < sizeof(metrics)) {
+        len += snprintf(metrics + len, sizeof(metrics) - len,
+            "\n"
+            "# HELP transcoder_numa_nodes NUMA nodes with CPUs\n"
+            "# TYPE transcoder_numa_nodes gauge\n"
+            "transcoder_numa_nodes %d\n"
+            "# HELP transcoder_service_cpus Cores reserved for API and control threads\n"
+            "# TYPE transcoder_service_cpus gauge\n"
+            "transcoder_service_cpus %d\n"
+            "# HELP transcoder_device_numa_node NUMA node of the device's PCIe slot (-1 = unknown)\n"
+            "# TYPE transcoder_device_numa_node gauge\n"
+            "# HELP transcoder_worker_cpus Cores in the worker's affinity mask, by node\n"
+            "# TYPE transcoder_worker_cpus gauge\n",
+            affinity.nb_nodes, CPU_COUNT(&affinity.service_cpus));
+        for (int i = 0; i < device_manager.nb_devices && len < sizeof(metrics); i++) {
+            len += snprintf(metrics + len, sizeof(metrics) - len,
+                "transcoder_device_numa_node{device=\"%d\"} %d\n",
+                i, affinity_node_id(&affinity, affinity.device_node[i]));
+        }
+        pthread_mutex_lock(&worker_pool.mutex);
+        for (int i = 0; i < MAX_WORKERS_LIMIT && len < sizeof(metrics); i++) {
+            if (affinity.worker_node[i] < 0) continue;
+            len += snprintf(metrics + len, sizeof(metrics) - len,
+                "transcoder_worker_cpus{worker=\"%d\",node=\"%d\"} %d\n",
+                i, affinity_node_id(&affinity, affinity.worker_node[i]), affinity.worker_cpus[i]);
+        }
+        pthread_mutex_unlock(&worker_pool.mutex);
+    }
+
+    // Scheduling classes: queue depth, outcomes and latency vs SLO
+    int class_depth[PRIORITY_NB_CLASSES];
+    pthread_mutex_lock(&task_queue.mutex);
+    memcpy(class_depth, task_queue.class_count, sizeof(class_depth));
+    pthread_mutex_unlock(&task_queue.mutex);
+
+    if (len < sizeof(metrics)) {
+        len += snprintf(metrics + len, sizeof(metrics) - len,
+            "\n"
+            "# HELP transcoder_class_queue_depth Queued jobs per priority class\n"
+            "# TYPE transcoder_class_queue_depth gauge\n"
+            "# HELP transcoder_class_slo_seconds Latency target per priority class (0 = none)\n"
+            "# TYPE transcoder_class_slo_seconds gauge\n"
+            "# HELP transcoder_class_jobs_total Jobs per priority class and outcome\n"
+            "# TYPE transcoder_class_jobs_total counter\n"
+            "# HELP transcoder_class_latency_seconds Enqueue-to-completion latency per priority class\n"
+            "# TYPE transcoder_class_latency_seconds histogram\n");
+    }
+
+    pthread_mutex_lock(&scheduler_stats.mutex);
+    for (int i = 0; i < PRIORITY_NB_CLASSES && len < sizeof(metrics); i++) {
+        const char *name = priority_names[i];
+        ClassStats *cs = &scheduler_stats.classes[i];
+        len += snprintf(metrics + len, sizeof(metrics) - len,
+            "transcoder_class_queue_depth{class=\"%s\"} %d\n"
+            "transcoder_class_slo_seconds{class=\"%s\"} %.3f\n"
+            "transcoder_class_jobs_total{class=\"%s\",outcome=\"slo_met\"} %ld\n"
+            "transcoder_class_jobs_total{class=\"%s\",outcome=\"slo_missed\"} %ld\n"
+            "transcoder_class_jobs_total{class=\"%s\",outcome=\"failed\"} %ld\n"
+            "transcoder_class_jobs_total{class=\"%s\",outcome=\"expired\"} %ld\n"
+            "transcoder_class_jobs_total{class=\"%s\",outcome=\"downgraded\"} %ld\n",
+            name, class_depth[i], name, config.slo_ms[i] / 1000.0,
+            name, cs->slo_met, name, cs->completed - cs->slo_met, name, cs->failed,
+            name, cs->expired, name, cs->downgraded);
+        for (int b = 0; b < SLO_BUCKETS && len < sizeof(metrics); b++) {
+            len += snprintf(metrics + len, sizeof(metrics) - len,
+                "transcoder_class_latency_seconds_bucket{class=\"%s\",le=\"%g\"} %ld\n",
+                name, slo_bucket_seconds[b], cs->latency_buckets[b]);
+        }
+        if (len < sizeof(metrics)) {
+            len += snprintf(metrics + len, sizeof(metrics) - len,
+                "transcoder_class_latency_seconds_bucket{class=\"%s\",le=\"+Inf\"} %ld\n"
+                "transcoder_class_latency_seconds_sum{class=\"%s\"} %.3f\n"
+                "transcoder_class_latency_seconds_count{class=\"%s\"} %ld\n",
+                name, cs->completed, name, cs->latency_sum, name, cs->completed);
+        }
+    }
+    pthread_mutex_unlock(&scheduler_stats.mutex);
+
+    // Cost model: predicted versus actual processing time
+    pthread_mutex_lock(&cost_model.mutex);
+    if (len < sizeof(metrics)) {
+        len += snprintf(metrics + len, sizeof(metrics) - len,
+            "\n"
+            "# HELP transcoder_cost_model_keys Camera/profile pairs with a learned cost model\n"
+            "# TYPE transcoder_cost_model_keys gauge\n"
+            "transcoder_cost_model_keys %d\n"
+            "# HELP transcoder_cost_model_unpredicted_total Completions queued before any model could predict them\n"
+            "# TYPE transcoder_cost_model_unpredicted_total counter\n"
+            "transcoder_cost_model_unpredicted_total %ld\n"
+            "# HELP transcoder_cost_model_predicted_seconds_total Predicted processing time of completed jobs\n"
+            "# TYPE transcoder_cost_model_predicted_seconds_total counter\n"
+            "transcoder_cost_model_predicted_seconds_total %.3f\n"
+            "# HELP transcoder_cost_model_actual_seconds_total Actual processing time of the same jobs\n"
+            "# TYPE transcoder_cost_model_actual_seconds_total counter\n"
+            "transcoder_cost_model_actual_seconds_total %.3f\n"
+            "# HELP transcoder_cost_model_abs_error_seconds_total Sum of |actual - predicted|\n"
+            "# TYPE transcoder_cost_model_abs_error_seconds_total counter\n"
+            "transcoder_cost_model_abs_error_seconds_total %.3f\n"
+            "# HELP transcoder_cost_model_ratio Actual / predicted processing time per completed job\n"
+            "# TYPE transcoder_cost_model_ratio histogram\n",
+            cost_model.count, cost_model.unpredicted,
+            cost_model.predicted_ms_total / 1000.0, cost_model.actual_ms_total / 1000.0,
+            cost_model.abs_error_ms_total / 1000.0);
+    }
+    for (int b = 0; b < COST_RATIO_BUCKETS && len < sizeof(metrics); b++) {
+        len += snprintf(metrics + len, sizeof(metrics) - len,
+            "transcoder_cost_model_ratio_bucket{le=\"%g\"} %ld\n",
+            cost_ratio_bounds[b], cost_model.ratio_buckets[b]);
+    }
+    if (len < sizeof(metrics)) {
+        len += snprintf(metrics + len, sizeof(metrics) - len,
+            "transcoder_cost_model_ratio_bucket{le=\"+Inf\"} %ld\n"
+            "transcoder_cost_model_ratio_sum %.3f\n"
+            "transcoder_cost_model_ratio_count %ld\n",
+            cost_model.predictions, cost_model.ratio_total, cost_model.predictions);
+    }
+    pthread_mutex_unlock(&cost_model.mutex);
+
+    // Job index
+    int job_counts[JOB_NB_STATES];
+    job_index_counts(&job_index, job_counts);
+    if (len < sizeof(metrics)) {
+        len += snprintf(metrics + len, sizeof(metrics) - len,
+            "\n"
+            "# HELP transcoder_jobs Jobs in the job index by state\n"
+            "# TYPE transcoder_jobs gauge\n");
+    }
+    for (int i = 0; i < JOB_NB_STATES && len < sizeof(metrics); i++) {
+        len += snprintf(metrics + len, sizeof(metrics) - len,
+            "transcoder_jobs{state=\"%s\"} %d\n", job_state_names[i], job_counts[i]);
     }
 
-    // Initialize filter (scale_cuda graph - expensive to configure)
-    if (init_filter_persistent(ctx) < 0) {
-        fprintf(stderr, "[Worker %d] Failed to initialize persistent filter\n", ctx->worker_id);
-        return -1;
+    // Request coalescing
+    if (len < sizeof(metrics)) {
+        pthread_mutex_lock(&coalescer.mutex);
+        len += snprintf(metrics + len, sizeof(metrics) - len,
+            "\n"
+            "# HELP transcoder_coalesced_total Duplicate enqueues merged into an existing job\n"
+            "# TYPE transcoder_coalesced_total counter\n"
+            "transcoder_coalesced_total{result=\"attached\"} %ld\n"
+            "transcoder_coalesced_total{result=\"cached\"} %ld\n"
+            "# HELP transcoder_coalesce_overflow_total Duplicates run separately (waiter limit reached)\n"
+            "# TYPE transcoder_coalesce_overflow_total counter\n"
+            "transcoder_coalesce_overflow_total %ld\n"
+            "# HELP transcoder_coalesce_callbacks_total Completions replayed to duplicate requests\n"
+            "# TYPE transcoder_coalesce_callbacks_total counter\n"
+            "transcoder_coalesce_callbacks_total %ld\n"
+            "# HELP transcoder_coalesce_keys Coalescing keys tracked\n"
+            "# TYPE transcoder_coalesce_keys gauge\n"
+            "transcoder_coalesce_keys{state=\"in_flight\"} %d\n"
+            "transcoder_coalesce_keys{state=\"cached\"} %d\n",
+            coalescer.attached, coalescer.cached, coalescer.overflow, coalescer.notified,
+            coalescer.nb_entries - coalescer.nb_cached, coalescer.nb_cached);
+        pthread_mutex_unlock(&coalescer.mutex);
     }
 
-    fprintf(stderr, "[Worker %d] ✓ Persistent pipeline ready (NVDEC→scale_cuda→NVENC)\n", ctx->worker_id);
-    return 0;
-}
+    // Admission control
+    if (len < sizeof(metrics)) {
+        double drain_rate = queue_drain_rate(&task_queue);
+        pthread_mutex_lock(&admission.mutex);
+        len += snprintf(metrics + len, sizeof(metrics) - len,
+            "\n"
+            "# HELP transcoder_queue_drain_rate Jobs/sec taken off the queue by workers\n"
+            "# TYPE transcoder_queue_drain_rate gauge\n"
+            "transcoder_queue_drain_rate %.3f\n"
+            "# HELP transcoder_admission_rejected_total Enqueue requests answered with 429\n"
+            "# TYPE transcoder_admission_rejected_total counter\n"
+            "transcoder_admission_rejected_total{reason=\"queue_full\"} %ld\n"
+            "transcoder_admission_rejected_total{reason=\"client_rate\"} %ld\n",
+            drain_rate, admission.rejected_queue_full, admission.rejected_client_rate);
+        pthread_mutex_unlock(&admission.mutex);
+    }
 
-// Flush pipeline state between files
-// This is MUCH faster than recreating contexts (~10ms vs ~300ms)
-void flush_pipeline_for_next_file(TranscodeContext *ctx) {
-    // Flush decoder and encoder buffers
-    avcodec_flush_buffers(ctx->decoder_ctx);
-    avcodec_flush_buffers(ctx->encoder_ctx);
+    // Retries and quarantine
+    if (len < sizeof(metrics)) {
+        pthread_mutex_lock(&quarantine.mutex);
+        long quarantined = quarantine.added_total;
+        pthread_mutex_unlock(&quarantine.mutex);
+
+        pthread_mutex_lock(&retry_wheel.mutex);
+        len += snprintf(metrics + len, sizeof(metrics) - len,
+            "\n"
+            "# HELP transcoder_failures_total Failed attempts by classification\n"
+            "# TYPE transcoder_failures_total counter\n"
+            "transcoder_failures_total{kind=\"transient\"} %ld\n"
+            "transcoder_failures_total{kind=\"permanent\"} %ld\n"
+            "transcoder_failures_total{kind=\"device\"} %ld\n"
+            "# HELP transcoder_retries_total Jobs scheduled for another attempt\n"
+            "# TYPE transcoder_retries_total counter\n"
+            "transcoder_retries_total %ld\n"
+            "# HELP transcoder_retry_exhausted_total Transient failures that ran out of retries\n"
+            "# TYPE transcoder_retry_exhausted_total counter\n"
+            "transcoder_retry_exhausted_total %ld\n"
+            "# HELP transcoder_retry_queue_depth Jobs waiting out their backoff\n"
+            "# TYPE transcoder_retry_queue_depth gauge\n"
+            "transcoder_retry_queue_depth %d\n"
+            "# HELP transcoder_retry_deferred_total Due retries re-armed because the queue was full\n"
+            "# TYPE transcoder_retry_deferred_total counter\n"
+            "transcoder_retry_deferred_total %ld\n"
+            "# HELP transcoder_quarantined_total Inputs quarantined after a permanent failure\n"
+            "# TYPE transcoder_quarantined_total counter\n"
+            "transcoder_quarantined_total %ld\n",
+            retry_wheel.failures[FAILURE_TRANSIENT], retry_wheel.failures[FAILURE_PERMANENT],
+            retry_wheel.failures[FAILURE_DEVICE],
+            retry_wheel.retries_total, retry_wheel.exhausted_total, retry_wheel.pending,
+            retry_wheel.requeue_deferred, quarantined);
+        pthread_mutex_unlock(&retry_wheel.mutex);
+    }
 
-    // Filter graph must be recreated as it enters EOF state
-    // This is still much cheaper than recreating decoder/encoder (~50ms vs ~300ms)
-    if (ctx->filter_graph) {
-        avfilter_graph_free(&ctx->filter_graph);
-        ctx->filter_graph = NULL;
-        ctx->buffersrc_ctx = NULL;
-        ctx->buffersink_ctx = NULL;
+    // Time-lapse renditions
+    if (len < sizeof(metrics)) {
+        pthread_mutex_lock(&stats_mutex);
+        len += snprintf(metrics + len, sizeof(metrics) - len,
+            "\n"
+            "# HELP transcoder_timelapse_jobs_total Time-lapse archive renditions written\n"
+            "# TYPE transcoder_timelapse_jobs_total counter\n"
+            "transcoder_timelapse_jobs_total %ld\n"
+            "# HELP transcoder_timelapse_frames_total Source frames of time-lapse jobs by outcome\n"
+            "# TYPE transcoder_timelapse_frames_total counter\n"
+            "transcoder_timelapse_frames_total{result=\"encoded\"} %ld\n"
+            "transcoder_timelapse_frames_total{result=\"skipped\"} %ld\n",
+            timelapse_jobs, timelapse_frames_encoded, timelapse_frames_skipped);
+        pthread_mutex_unlock(&stats_mutex);
     }
 
-    // Reinitialize filter for next file
-    init_filter_persistent(ctx);
-}
+    // Multiview mosaics
+    if (len < sizeof(metrics)) {
+        pthread_mutex_lock(&stats_mutex);
+        len += snprintf(metrics + len, sizeof(metrics) - len,
+            "\n"
+            "# HELP transcoder_mosaic_jobs_total Multiview grid outputs written by scaling path\n"
+            "# TYPE transcoder_mosaic_jobs_total counter\n"
+            "transcoder_mosaic_jobs_total{scaler=\"cuda\"} %ld\n"
+            "transcoder_mosaic_jobs_total{scaler=\"software\"} %ld\n"
+            "# HELP transcoder_mosaic_tiles_total Mosaic inputs by outcome\n"
+            "# TYPE transcoder_mosaic_tiles_total counter\n"
+            "transcoder_mosaic_tiles_total{result=\"composited\"} %ld\n"
+            "transcoder_mosaic_tiles_total{result=\"failed\"} %ld\n",
+            mosaic_jobs[0], mosaic_jobs[1], mosaic_tiles_composited, mosaic_tiles_failed);
+        pthread_mutex_unlock(&stats_mutex);
+    }
 
-// ============================================================================
-// File Processing Pipeline
-// ============================================================================
+    // Long inputs split across workers
+    if (len < sizeof(metrics)) {
+        pthread_mutex_lock(&stats_mutex);
+        len += snprintf(metrics + len, sizeof(metrics) - len,
+            "\n"
+            "# HELP transcoder_chunked_jobs_total Long inputs transcoded in parallel parts and stitched\n"
+            "# TYPE transcoder_chunked_jobs_total counter\n"
+            "transcoder_chunked_jobs_total %ld\n"
+            "# HELP transcoder_chunked_parts_total Parts of stitched inputs\n"
+            "# TYPE transcoder_chunked_parts_total counter\n"
+            "transcoder_chunked_parts_total %ld\n"
+            "# HELP transcoder_chunked_helpers_total Helper jobs queued so idle workers join a split input\n"
+            "# TYPE transcoder_chunked_helpers_total counter\n"
+            "transcoder_chunked_helpers_total %ld\n",
+            chunked_jobs, chunked_parts, chunked_helpers);
+        pthread_mutex_unlock(&stats_mutex);
+    }
 
-int process_file(TranscodeContext *ctx, const char *input_filename) {
-    char input_path[512];
-    char output_path[512];
-    char base_name[256];
+    // MPEG-TS pre-dispatch check
+    if (config.ts_check && len < sizeof(metrics)) {
+        pthread_mutex_lock(&stats_mutex);
+        len += snprintf(metrics + len, sizeof(metrics) - len,
+            "\n"
+            "# HELP transcoder_ts_check_total Inputs checked before dispatch, by verdict\n"
+            "# TYPE transcoder_ts_check_total counter\n");
+        for (int v = 0; v < TS_NB_VERDICTS && len < sizeof(metrics); v++) {
+            len += snprintf(metrics + len, sizeof(metrics) - len,
+                "transcoder_ts_check_total{result=\"%s\"} %ld\n", ts_verdict_names[v], ts_checks[v]);
+        }
+        if (len < sizeof(metrics)) {
+            len += snprintf(metrics + len, sizeof(metrics) - len,
+                "# HELP transcoder_ts_check_bytes_total Input bytes scanned by the check\n"
+                "# TYPE transcoder_ts_check_bytes_total counter\n"
+                "transcoder_ts_check_bytes_total %lld\n"
+                "# HELP transcoder_ts_check_seconds_total Time spent checking inputs\n"
+                "# TYPE transcoder_ts_check_seconds_total counter\n"
+                "transcoder_ts_check_seconds_total %.6f\n",
+                ts_check_bytes, ts_check_seconds);
+        }
+        pthread_mutex_unlock(&stats_mutex);
+    }
 
-    snprintf(input_path, sizeof(input_path), "%s/%s", INPUT_DIR, input_filename);
+    // S3 output sink
+    if (config.s3_endpoint[0] && len < sizeof(metrics)) {
+        pthread_mutex_lock(&stats_mutex);
+        len += snprintf(metrics + len, sizeof(metrics) - len,
+            "\n"
+            "# HELP transcoder_s3_uploads_total Outputs streamed to S3, by result\n"
+            "# TYPE transcoder_s3_uploads_total counter\n");
+        for (int r = 0; r < 3 && len < sizeof(metrics); r++) {
+            len += snprintf(metrics + len, sizeof(metrics) - len,
+                "transcoder_s3_uploads_total{result=\"%s\"} %ld\n", s3_result_names[r], s3_uploads[r]);
+        }
+        if (len < sizeof(metrics)) {
+            len += snprintf(metrics + len, sizeof(metrics) - len,
+                "# HELP transcoder_s3_parts_total Parts uploaded (whole objects count as one)\n"
+                "# TYPE transcoder_s3_parts_total counter\n"
+                "transcoder_s3_parts_total %ld\n"
+                "# HELP transcoder_s3_bytes_total Bytes uploaded\n"
+                "# TYPE transcoder_s3_bytes_total counter\n"
+                "transcoder_s3_bytes_total %lld\n"
+                "# HELP transcoder_s3_spooled_bytes_total Bytes spooled to disk while the endpoint lagged\n"
+                "# TYPE transcoder_s3_spooled_bytes_total counter\n"
+                "transcoder_s3_spooled_bytes_total %lld\n"
+                "# HELP transcoder_s3_spool_fallbacks_total Outputs that overflowed their memory buffers\n"
+                "# TYPE transcoder_s3_spool_fallbacks_total counter\n"
+                "transcoder_s3_spool_fallbacks_total %ld\n"
+                "# HELP transcoder_s3_request_seconds_total Time spent in S3 requests\n"
+                "# TYPE transcoder_s3_request_seconds_total counter\n"
+                "transcoder_s3_request_seconds_total %.3f\n",
+                s3_parts_uploaded, s3_bytes_uploaded, s3_bytes_spooled, s3_spool_fallbacks,
+                s3_request_seconds);
+        }
+        pthread_mutex_unlock(&stats_mutex);
+    }
 
-    strncpy(base_name, input_filename, sizeof(base_name) - 1);
-    base_name[sizeof(base_name) - 1] = '\0';
-    char *ext = strstr(base_name, ".ts");
-    if (ext) *ext = '\0';
+    // Output verification (collected while muxing, TS structure of the file)
+    if (len < sizeof(metrics)) {
+        pthread_mutex_lock(&stats_mutex);
+        len += snprintf(metrics + len, sizeof(metrics) - len,
+            "\n"
+            "# HELP transcoder_output_verified_bytes_total Encoded payload checksummed while muxing\n"
+            "# TYPE transcoder_output_verified_bytes_total counter\n"
+            "transcoder_output_verified_bytes_total %lld\n",
+            output_verify_bytes);
+        if (config.ts_check_outputs && len < sizeof(metrics)) {
+            len += snprintf(metrics + len, sizeof(metrics) - len,
+                "# HELP transcoder_output_ts_check_total Written TS outputs checked, by verdict\n"
+                "# TYPE transcoder_output_ts_check_total counter\n");
+            for (int v = 0; v < TS_NB_VERDICTS && len < sizeof(metrics); v++) {
+                len += snprintf(metrics + len, sizeof(metrics) - len,
+                    "transcoder_output_ts_check_total{result=\"%s\"} %ld\n",
+                    ts_verdict_names[v], ts_output_checks[v]);
+            }
+        }
+        pthread_mutex_unlock(&stats_mutex);
+    }
 
-    snprintf(output_path, sizeof(output_path), "%s/%s_h264.ts", OUTPUT_DIR, base_name);
+    // Codec profiles: output size per second of video
+    if (len < sizeof(metrics)) {
+        len += snprintf(metrics + len, sizeof(metrics) - len,
+            "\n"
+            "# HELP transcoder_codec_jobs_total Full-rate outputs written by codec profile\n"
+            "# TYPE transcoder_codec_jobs_total counter\n"
+            "# HELP transcoder_codec_output_bytes_total Output bytes by codec profile\n"
+            "# TYPE transcoder_codec_output_bytes_total counter\n"
+            "# HELP transcoder_codec_video_seconds_total Video seconds encoded by codec profile\n"
+            "# TYPE transcoder_codec_video_seconds_total counter\n"
+            "# HELP transcoder_codec_bytes_per_second Average output bytes per second of video\n"
+            "# TYPE transcoder_codec_bytes_per_second gauge\n");
+        pthread_mutex_lock(&stats_mutex);
+        for (int i = 0; i < config.nb_codec_profiles && len < sizeof(metrics); i++) {
+            const CodecProfile *p = &config.codec_profiles[i];
+            const CodecStats *cs = &codec_stats[i];
+            len += snprintf(metrics + len, sizeof(metrics) - len,
+                "transcoder_codec_jobs_total{profile=\"%s\",codec=\"%s\"} %ld\n"
+                "transcoder_codec_output_bytes_total{profile=\"%s\",codec=\"%s\"} %lld\n"
+                "transcoder_codec_video_seconds_total{profile=\"%s\",codec=\"%s\"} %.3f\n"
+                "transcoder_codec_bytes_per_second{profile=\"%s\",codec=\"%s\"} %.1f\n",
+                p->name, codec_names[p->codec], cs->jobs,
+                p->name, codec_names[p->codec], cs->bytes,
+                p->name, codec_names[p->codec], cs->seconds,
+                p->name, codec_names[p->codec], cs->seconds > 0 ? cs->bytes / cs->seconds : 0.0);
+        }
+        pthread_mutex_unlock(&stats_mutex);
+    }
 
-    fprintf(stderr, "[Worker %d] Processing: %s\n", ctx->worker_id, input_filename);
+    // Stream parameter cache
+    if (config.probe_cache && len < sizeof(metrics)) {
+        pthread_mutex_lock(&probe_cache.mutex);
+        len += snprintf(metrics + len, sizeof(metrics) - len,
+            "\n"
+            "# HELP transcoder_probe_cache_lookups_total Segment opens by stream parameter cache outcome\n"
+            "# TYPE transcoder_probe_cache_lookups_total counter\n"
+            "transcoder_probe_cache_lookups_total{result=\"hit\"} %ld\n"
+            "transcoder_probe_cache_lookups_total{result=\"miss\"} %ld\n"
+            "transcoder_probe_cache_lookups_total{result=\"mismatch\"} %ld\n"
+            "# HELP transcoder_probe_cache_entries Cameras with cached stream parameters\n"
+            "# TYPE transcoder_probe_cache_entries gauge\n"
+            "transcoder_probe_cache_entries %d\n"
+            "# HELP transcoder_probe_seconds_total Time spent in full stream probes\n"
+            "# TYPE transcoder_probe_seconds_total counter\n"
+            "transcoder_probe_seconds_total %.6f\n"
+            "# HELP transcoder_probe_saved_seconds_total Estimated probe time skipped on cache hits\n"
+            "# TYPE transcoder_probe_saved_seconds_total counter\n"
+            "transcoder_probe_saved_seconds_total %.6f\n"
+            "# HELP transcoder_probe_validate_seconds_total Time spent checking the SPS on cache hits\n"
+            "# TYPE transcoder_probe_validate_seconds_total counter\n"
+            "transcoder_probe_validate_seconds_total %.6f\n",
+            probe_cache.hits, probe_cache.misses, probe_cache.mismatches, probe_cache.count,
+            probe_cache.probe_ms_total / 1000.0, probe_cache.saved_ms_total / 1000.0,
+            probe_cache.validate_ms_total / 1000.0);
+        pthread_mutex_unlock(&probe_cache.mutex);
+    }
 
-    // Open input file with fast probing
-    AVDictionary *format_opts = NULL;
-    av_dict_set(&format_opts, "probesize", "1024", 0);
-    av_dict_set(&format_opts, "analyzeduration", "0", 0);
-    av_dict_set(&format_opts, "fflags", "+fastseek", 0);
+    // Local socket protocol
+    if (config.local_socket[0] && len < sizeof(metrics)) {
+        int connections = 0;
+        for (int i = 0; i < LOCAL_MAX_CONNS; i++) {
+            if (local_server.conns[i].fd >= 0) connections++;
+        }
 
-    if (avformat_open_input(&ctx->input_ctx, input_path, NULL, &format_opts) < 0) {
-        fprintf(stderr, "[Worker %d] Failed to open input: %s\n", ctx->worker_id, input_path);
-        av_dict_free(&format_opts);
-        return -1;
+        pthread_mutex_lock(&local_server.mutex);
+        len += snprintf(metrics + len, sizeof(metrics) - len,
+            "\n"
+            "# HELP transcoder_local_connections Open local socket connections\n"
+            "# TYPE transcoder_local_connections gauge\n"
+            "transcoder_local_connections %d\n"
+            "# HELP transcoder_local_requests_total Enqueue frames received on the local socket\n"
+            "# TYPE transcoder_local_requests_total counter\n"
+            "transcoder_local_requests_total %ld\n"
+            "# HELP transcoder_local_ack_frames_total Batched ACK frames sent\n"
+            "# TYPE transcoder_local_ack_frames_total counter\n"
+            "transcoder_local_ack_frames_total %ld\n"
+            "# HELP transcoder_local_completions_total Completion frames by outcome\n"
+            "# TYPE transcoder_local_completions_total counter\n"
+            "transcoder_local_completions_total{result=\"sent\"} %ld\n"
+            "transcoder_local_completions_total{result=\"dropped\"} %ld\n",
+            connections, local_server.requests_total, local_server.ack_frames,
+            local_server.completions_sent, local_server.completions_dropped);
+        pthread_mutex_unlock(&local_server.mutex);
     }
-    av_dict_free(&format_opts);
 
-    if (avformat_find_stream_info(ctx->input_ctx, NULL) < 0) {
-        fprintf(stderr, "[Worker %d] Failed to find stream info\n", ctx->worker_id);
-        return -1;
+    // RabbitMQ consumer
+    if (config.amqp_host[0] && len < sizeof(metrics)) {
+        AmqpBridge *b = &amqp_bridge;
+        pthread_mutex_lock(&b->mutex);
+        len += snprintf(metrics + len, sizeof(metrics) - len,
+            "\n"
+            "# HELP transcoder_amqp_connected Broker connection is up\n"
+            "# TYPE transcoder_amqp_connected gauge\n"
+            "transcoder_amqp_connected %d\n"
+            "# HELP transcoder_amqp_in_flight Deliveries consumed but not yet acked or rejected\n"
+            "# TYPE transcoder_amqp_in_flight gauge\n"
+            "transcoder_amqp_in_flight %d\n"
+            "# HELP transcoder_amqp_unconfirmed Results published but not yet confirmed\n"
+            "# TYPE transcoder_amqp_unconfirmed gauge\n"
+            "transcoder_amqp_unconfirmed %d\n"
+            "# HELP transcoder_amqp_messages_total Deliveries by outcome\n"
+            "# TYPE transcoder_amqp_messages_total counter\n"
+            "transcoder_amqp_messages_total{outcome=\"consumed\"} %ld\n"
+            "transcoder_amqp_messages_total{outcome=\"acked\"} %ld\n"
+            "transcoder_amqp_messages_total{outcome=\"rejected\"} %ld\n"
+            "transcoder_amqp_messages_total{outcome=\"broker_nacked\"} %ld\n"
+            "# HELP transcoder_amqp_published_total Results published to the output queue\n"
+            "# TYPE transcoder_amqp_published_total counter\n"
+            "transcoder_amqp_published_total %ld\n"
+            "# HELP transcoder_amqp_confirm_frames_total Publisher confirm frames received\n"
+            "# TYPE transcoder_amqp_confirm_frames_total counter\n"
+            "transcoder_amqp_confirm_frames_total %ld\n"
+            "# HELP transcoder_amqp_reconnects_total Broker connections lost\n"
+            "# TYPE transcoder_amqp_reconnects_total counter\n"
+            "transcoder_amqp_reconnects_total %ld\n",
+            b->connected, b->in_flight, b->nb_unconfirmed,
+            b->consumed, b->acked, b->rejected, b->broker_nacks,
+            b->published, b->confirm_frames, b->reconnects);
+        pthread_mutex_unlock(&b->mutex);
     }
 
-    // Find video stream
-    ctx->video_stream_idx = -1;
-    for (unsigned int i = 0; i < ctx->input_ctx->nb_streams; i++) {
-        if (ctx->input_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
-            ctx->video_stream_idx = i;
-            break;
+    // Adaptive concurrency controller
+    if (adaptive_controller.enabled && len < sizeof(metrics)) {
+        int parked = worker_pool_parked(&worker_pool);
+        AdaptiveController *c = &adaptive_controller;
+
+        pthread_mutex_lock(&c->mutex);
+        len += snprintf(metrics + len, sizeof(metrics) - len,
+            "\n"
+            "# HELP transcoder_adaptive_active_workers Workers allowed to take jobs\n"
+            "# TYPE transcoder_adaptive_active_workers gauge\n"
+            "transcoder_adaptive_active_workers %d\n"
+            "# HELP transcoder_adaptive_parked_workers Workers parked with warm pipelines\n"
+            "# TYPE transcoder_adaptive_parked_workers gauge\n"
+            "transcoder_adaptive_parked_workers %d\n"
+            "# HELP transcoder_adaptive_throughput Files/sec in the last controller sample\n"
+            "# TYPE transcoder_adaptive_throughput gauge\n"
+            "transcoder_adaptive_throughput %.3f\n"
+            "# HELP transcoder_adaptive_latency_ms Mean per-file time in the last sample\n"
+            "# TYPE transcoder_adaptive_latency_ms gauge\n"
+            "transcoder_adaptive_latency_ms %.1f\n"
+            "# HELP transcoder_adaptive_baseline_latency_ms Uncongested latency reference\n"
+            "# TYPE transcoder_adaptive_baseline_latency_ms gauge\n"
+            "transcoder_adaptive_baseline_latency_ms %.1f\n"
+            "# HELP transcoder_adaptive_decisions_total Controller decisions by action\n"
+            "# TYPE transcoder_adaptive_decisions_total counter\n",
+            c->limit, parked, c->throughput, c->latency_ms, c->baseline_latency_ms);
+        for (int i = 0; i < ADAPT_NB_ACTIONS && len < sizeof(metrics); i++) {
+            len += snprintf(metrics + len, sizeof(metrics) - len,
+                "transcoder_adaptive_decisions_total{action=\"%s\"} %ld\n",
+                adaptive_action_names[i], c->decisions[i]);
         }
+        pthread_mutex_unlock(&c->mutex);
     }
 
-    if (ctx->video_stream_idx == -1) {
-        fprintf(stderr, "[Worker %d] No video stream found\n", ctx->worker_id);
-        return -1;
-    }
+    struct MHD_Response *response = MHD_create_response_from_buffer(
+        strlen(metrics), (void*)metrics, MHD_RESPMEM_MUST_COPY
+    );
+    MHD_add_response_header(response, "Content-Type", "text/plain; version=0.0.4");
 
-    AVStream *in_stream = ctx->input_ctx->streams[ctx->video_stream_idx];
+    enum MHD_Result ret = MHD_queue_response(connection, 200, response);
+    MHD_destroy_response(response);
 
-    // Flush pipeline state from previous file (if any)
-    // This is MUCH faster than recreating contexts (~10ms vs ~300ms)
-    flush_pipeline_for_next_file(ctx);
+    return ret;
+}
 
-    // Create output context
-    avformat_alloc_output_context2(&ctx->output_ctx, NULL, "mpegts", output_path);
-    if (!ctx->output_ctx) {
-        fprintf(stderr, "[Worker %d] Failed to create output context\n", ctx->worker_id);
-        return -1;
+// Current runtime configuration as JSON (GET/POST /admin/config response)
+static cJSON *config_to_json(void) {
+    cJSON *json = cJSON_CreateObject();
+
+    pthread_mutex_lock(&worker_pool.mutex);
+    int target = worker_pool.target;
+    pthread_mutex_unlock(&worker_pool.mutex);
+
+    pthread_mutex_lock(&task_queue.mutex);
+    int capacity = task_queue.capacity;
+    int depth = task_queue.count;
+    pthread_mutex_unlock(&task_queue.mutex);
+
+    cJSON_AddNumberToObject(json, "workers", target);
+    cJSON_AddNumberToObject(json, "workersRunning", worker_pool_running(&worker_pool));
+    cJSON_AddNumberToObject(json, "queueCapacity", capacity);
+    cJSON_AddNumberToObject(json, "queueDepth", depth);
+    cJSON_AddStringToObject(json, "inputDir", config.input_dir);
+    cJSON_AddStringToObject(json, "outputDir", config.output_dir);
+    cJSON_AddNumberToObject(json, "apiPort", config.api_port);
+    cJSON_AddNumberToObject(json, "workersPerDevice", config.workers_per_device);
+    cJSON_AddNumberToObject(json, "startupParallel", config.startup_parallel);
+    cJSON_AddStringToObject(json, "outputFormat", config.output_format);
+    cJSON_AddNumberToObject(json, "consolidateSeconds", consolidator.target_seconds);
+    cJSON_AddStringToObject(json, "localSocket", config.local_socket);
+    cJSON_AddBoolToObject(json, "probeCache", config.probe_cache);
+    cJSON *ts_check_json = cJSON_AddObjectToObject(json, "tsCheck");
+    cJSON_AddBoolToObject(ts_check_json, "enabled", config.ts_check);
+    cJSON_AddNumberToObject(ts_check_json, "maxCcErrorPercent", config.ts_max_cc_percent);
+    cJSON_AddBoolToObject(ts_check_json, "outputs", config.ts_check_outputs);
+
+    cJSON *coalesce_json = cJSON_AddObjectToObject(json, "coalesce");
+    cJSON_AddStringToObject(coalesce_json, "key", config.coalesce_key);
+    cJSON_AddNumberToObject(coalesce_json, "cacheSeconds", config.coalesce_cache_seconds);
+
+    cJSON *worker_processes_json = cJSON_AddObjectToObject(json, "workerProcesses");
+    cJSON_AddBoolToObject(worker_processes_json, "enabled", config.worker_processes);
+    cJSON_AddNumberToObject(worker_processes_json, "workersPerProcess", config.workers_per_process);
+    if (worker_processes.shm) {
+        cJSON_AddItemToObject(worker_processes_json, "processes", worker_processes_to_json(&worker_processes));
     }
 
-    AVStream *out_stream = avformat_new_stream(ctx->output_ctx, NULL);
-    if (!out_stream) {
-        fprintf(stderr, "[Worker %d] Failed to create output stream\n", ctx->worker_id);
-        return -1;
+    cJSON *affinity_json = cJSON_AddObjectToObject(json, "affinity");
+    cJSON_AddBoolToObject(affinity_json, "enabled", config.affinity);
+    cJSON_AddNumberToObject(affinity_json, "serviceCpus", config.service_cpus);
+    if (affinity.enabled) {
+        cJSON_AddNumberToObject(affinity_json, "numaNodes", affinity.nb_nodes);
+        cJSON *nodes = cJSON_AddArrayToObject(affinity_json, "deviceNodes");
+        for (int i = 0; i < device_manager.nb_devices; i++) {
+            cJSON_AddItemToArray(nodes, cJSON_CreateNumber(affinity_node_id(&affinity, affinity.device_node[i])));
+        }
     }
 
-    if (avcodec_parameters_from_context(out_stream->codecpar, ctx->encoder_ctx) < 0) {
-        fprintf(stderr, "[Worker %d] Failed to copy encoder parameters\n", ctx->worker_id);
-        return -1;
+    cJSON *chunking = cJSON_AddObjectToObject(json, "chunking");
+    cJSON_AddNumberToObject(chunking, "chunkMb", config.chunk_mb);
+    cJSON_AddNumberToObject(chunking, "maxChunks", config.max_chunks);
+    cJSON *timelapse = timelapse_json(&config.timelapse);
+    cJSON_AddNumberToObject(timelapse, "afterDays", config.timelapse_after_days);
+    cJSON_AddItemToObject(json, "timelapse", timelapse);
+    cJSON *mosaic = cJSON_AddObjectToObject(json, "mosaic");
+    cJSON_AddStringToObject(mosaic, "scaler", config.mosaic_scaler);
+    cJSON_AddStringToObject(json, "encoderBackend", config.encoder_backend);
+    cJSON_AddStringToObject(json, "defaultCodecProfile", config.codec_profiles[0].name);
+    cJSON *profiles = cJSON_AddArrayToObject(json, "codecProfiles");
+    for (int i = 0; i < config.nb_codec_profiles; i++) {
+        const CodecProfile *p = &config.codec_profiles[i];
+        cJSON *item = cJSON_CreateObject();
+        cJSON_AddStringToObject(item, "name", p->name);
+        cJSON_AddStringToObject(item, "codec", codec_names[p->codec]);
+        cJSON_AddNumberToObject(item, "bitrate", p->bitrate);
+        cJSON_AddNumberToObject(item, "cq", p->cq);
+        cJSON_AddStringToObject(item, "preset", p->preset);
+        if (p->software_preset[0]) cJSON_AddStringToObject(item, "softwarePreset", p->software_preset);
+        cJSON_AddStringToObject(item, "profile", p->profile);
+        cJSON_AddItemToArray(profiles, item);
     }
 
-    out_stream->time_base = ctx->encoder_ctx->time_base;
+    if (config.amqp_host[0]) {
+        cJSON *amqp = cJSON_AddObjectToObject(json, "amqp");
+        cJSON_AddStringToObject(amqp, "host", config.amqp_host);
+        cJSON_AddNumberToObject(amqp, "port", config.amqp_port);
+        cJSON_AddStringToObject(amqp, "vhost", config.amqp_vhost);
+        cJSON_AddStringToObject(amqp, "consumeQueue", config.amqp_consume_queue);
+        cJSON_AddStringToObject(amqp, "publishQueue", config.amqp_publish_queue);
+        cJSON_AddNumberToObject(amqp, "prefetch", config.amqp_prefetch);
+        pthread_mutex_lock(&amqp_bridge.mutex);
+        int connected = amqp_bridge.connected;
+        pthread_mutex_unlock(&amqp_bridge.mutex);
+        cJSON_AddBoolToObject(amqp, "connected", connected);
+    }
 
-    if (!(ctx->output_ctx->oformat->flags & AVFMT_NOFILE)) {
-        if (avio_open(&ctx->output_ctx->pb, output_path, AVIO_FLAG_WRITE) < 0) {
-            fprintf(stderr, "[Worker %d] Failed to open output file: %s\n", ctx->worker_id, output_path);
-            return -1;
-        }
+    if (config.s3_endpoint[0]) {
+        cJSON *s3 = cJSON_AddObjectToObject(json, "s3");
+        cJSON_AddStringToObject(s3, "endpoint", config.s3_endpoint);
+        cJSON_AddStringToObject(s3, "bucket", config.s3_bucket);
+        cJSON_AddStringToObject(s3, "region", config.s3_region);
+        cJSON_AddStringToObject(s3, "prefix", config.s3_prefix);
+        cJSON_AddNumberToObject(s3, "partMb", config.s3_part_mb);
+        cJSON_AddNumberToObject(s3, "bufferParts", config.s3_buffer_parts);
+        cJSON_AddStringToObject(s3, "spoolDir", config.s3_spool_dir);
     }
 
-    if (avformat_write_header(ctx->output_ctx, NULL) < 0) {
-        fprintf(stderr, "[Worker %d] Failed to write header\n", ctx->worker_id);
-        return -1;
+    cJSON *slo = cJSON_AddObjectToObject(json, "sloMs");
+    for (int i = 0; i < PRIORITY_NB_CLASSES; i++) {
+        cJSON_AddNumberToObject(slo, priority_names[i], config.slo_ms[i]);
     }
 
-    // Zero-copy GPU pipeline: NVDEC → scale_cuda → NVENC
-    AVPacket *packet = av_packet_alloc();
-    AVFrame *decoded_frame = av_frame_alloc();
-    AVFrame *filtered_frame = av_frame_alloc();
+    cJSON *queue_order = cJSON_AddObjectToObject(json, "queueOrder");
+    cJSON_AddStringToObject(queue_order, "mode", config.queue_order);
+    cJSON_AddNumberToObject(queue_order, "agingFactor", config.sjf_aging);
+
+    cJSON *admission_json = cJSON_AddObjectToObject(json, "admission");
+    cJSON_AddNumberToObject(admission_json, "clientRate", config.client_rate);
+    cJSON_AddNumberToObject(admission_json, "clientBurst", config.client_burst);
+    cJSON_AddNumberToObject(admission_json, "drainRate", queue_drain_rate(&task_queue));
+
+    cJSON *retry = cJSON_AddObjectToObject(json, "retry");
+    cJSON_AddNumberToObject(retry, "maxRetries", config.max_retries);
+    cJSON_AddNumberToObject(retry, "baseMs", config.retry_base_ms);
+    cJSON_AddNumberToObject(retry, "maxMs", config.retry_max_ms);
+    cJSON_AddNumberToObject(retry, "quarantineTtlHours", config.quarantine_ttl_hours);
+    cJSON_AddNumberToObject(retry, "pending", retry_wheel_pending(&retry_wheel));
+
+    cJSON *adaptive = cJSON_AddObjectToObject(json, "adaptive");
+    pthread_mutex_lock(&adaptive_controller.mutex);
+    cJSON_AddBoolToObject(adaptive, "enabled", adaptive_controller.enabled);
+    cJSON_AddNumberToObject(adaptive, "minWorkers", adaptive_controller.min_workers);
+    cJSON_AddNumberToObject(adaptive, "maxWorkers", adaptive_controller.max_workers);
+    cJSON_AddNumberToObject(adaptive, "intervalSeconds", adaptive_controller.interval_seconds);
+    cJSON_AddNumberToObject(adaptive, "activeWorkers", adaptive_controller.limit);
+    cJSON_AddStringToObject(adaptive, "lastAction", adaptive_action_names[adaptive_controller.last_action]);
+    pthread_mutex_unlock(&adaptive_controller.mutex);
+
+    cJSON *encoder = cJSON_AddObjectToObject(json, "encoder");
+    cJSON_AddNumberToObject(encoder, "width", config.out_width);
+    cJSON_AddNumberToObject(encoder, "height", config.out_height);
+    cJSON_AddNumberToObject(encoder, "bitrate", config.bitrate);
+    cJSON_AddStringToObject(encoder, "preset", config.preset);
+    cJSON_AddStringToObject(encoder, "rc", config.rc);
+    cJSON_AddNumberToObject(encoder, "cq", config.cq);
+    cJSON_AddStringToObject(encoder, "profile", config.profile);
+
+    return json;
+}
 
-    int frame_count = 0;
+// API Endpoint: GET/POST /admin/config - Inspect config, resize pool and queue
+// POST body: {"workers": N, "queueCapacity": N} (both optional)
+static enum MHD_Result handle_admin_config(struct MHD_Connection *connection,
+                                           const char *method,
+                                           const char *upload_data,
+                                           size_t upload_data_size) {
+    if (strcmp(method, "POST") == 0) {
+        if (upload_data_size == 0) {
+            return send_response(connection, 400, "{\"error\":\"Empty request body\"}");
+        }
 
-    while (av_read_frame(ctx->input_ctx, packet) >= 0) {
-        if (packet->stream_index == ctx->video_stream_idx) {
-            if (avcodec_send_packet(ctx->decoder_ctx, packet) == 0) {
-                while (avcodec_receive_frame(ctx->decoder_ctx, decoded_frame) == 0) {
-                    // Send CUDA frame to scale_cuda filter
-                    if (av_buffersrc_add_frame_flags(ctx->buffersrc_ctx, decoded_frame,
-                                                     AV_BUFFERSRC_FLAG_KEEP_REF) < 0) {
-                        fprintf(stderr, "[Worker %d] Error feeding filter\n", ctx->worker_id);
-                        av_frame_unref(decoded_frame);
-                        continue;
-                    }
+        cJSON *json = cJSON_Parse(upload_data);
+        if (!json) {
+            return send_response(connection, 400, "{\"error\":\"Invalid JSON\"}");
+        }
 
-                    // Get scaled CUDA frame from filter
-                    while (av_buffersink_get_frame(ctx->buffersink_ctx, filtered_frame) >= 0) {
-                        filtered_frame->pts = frame_count++;
-
-                        // Send scaled CUDA frame to NVENC encoder
-                        if (avcodec_send_frame(ctx->encoder_ctx, filtered_frame) == 0) {
-                            AVPacket *enc_packet = av_packet_alloc();
-                            while (avcodec_receive_packet(ctx->encoder_ctx, enc_packet) == 0) {
-                                enc_packet->stream_index = 0;
-                                av_packet_rescale_ts(enc_packet, ctx->encoder_ctx->time_base,
-                                                    out_stream->time_base);
-                                av_interleaved_write_frame(ctx->output_ctx, enc_packet);
-                                av_packet_unref(enc_packet);
-                            }
-                            av_packet_free(&enc_packet);
-                        }
-                        av_frame_unref(filtered_frame);
-                    }
-                    av_frame_unref(decoded_frame);
-                }
+        cJSON *workers_item = cJSON_GetObjectItem(json, "workers");
+        cJSON *capacity_item = cJSON_GetObjectItem(json, "queueCapacity");
+
+        if ((workers_item && (!cJSON_IsNumber(workers_item) || workers_item->valueint < 1 ||
+                              workers_item->valueint > MAX_WORKERS_LIMIT)) ||
+            (capacity_item && (!cJSON_IsNumber(capacity_item) || capacity_item->valueint < 1 ||
+                               capacity_item->valueint > MAX_QUEUE_LIMIT))) {
+            cJSON_Delete(json);
+            return send_response(connection, 400, "{\"error\":\"'workers' or 'queueCapacity' out of range\"}");
+        }
+
+        if (capacity_item) {
+            if (queue_resize(&task_queue, capacity_item->valueint) < 0) {
+                cJSON_Delete(json);
+                return send_response(connection, 500, "{\"error\":\"Failed to resize queue\"}");
             }
+            config.queue_capacity = capacity_item->valueint;
+            fprintf(stderr, "[API] Queue capacity set to %d\n", config.queue_capacity);
         }
-        av_packet_unref(packet);
+
+        if (workers_item) {
+            config.workers = worker_pool_resize(&worker_pool, workers_item->valueint);
+        }
+
+        cJSON_Delete(json);
     }
 
-    // Flush decoder
-    avcodec_send_packet(ctx->decoder_ctx, NULL);
-    while (avcodec_receive_frame(ctx->decoder_ctx, decoded_frame) == 0) {
-        av_buffersrc_add_frame_flags(ctx->buffersrc_ctx, decoded_frame, AV_BUFFERSRC_FLAG_KEEP_REF);
+    cJSON *response = config_to_json();
+    char *response_str = cJSON_Print(response);
+    enum MHD_Result ret = send_response(connection, 200, response_str);
+    free(response_str);
+    cJSON_Delete(response);
 
-        while (av_buffersink_get_frame(ctx->buffersink_ctx, filtered_frame) >= 0) {
-            filtered_frame->pts = frame_count++;
-            avcodec_send_frame(ctx->encoder_ctx, filtered_frame);
+    return ret;
+}
 
-            AVPacket *enc_packet = av_packet_alloc();
-            while (avcodec_receive_packet(ctx->encoder_ctx, enc_packet) == 0) {
-                enc_packet->stream_index = 0;
-                av_packet_rescale_ts(enc_packet, ctx->encoder_ctx->time_base, out_stream->time_base);
-                av_interleaved_write_frame(ctx->output_ctx, enc_packet);
-                av_packet_unref(enc_packet);
+// API Endpoint: GET /jobs/{id} - Job state and timings
+//               DELETE /jobs/{id} - Cancel a queued or running job
+static enum MHD_Result handle_job(struct MHD_Connection *connection, const char *method,
+                                  const char *job_id) {
+    if (strcmp(method, "DELETE") == 0) {
+        int state = job_index_cancel(&job_index, job_id);
+        if (state < 0) {
+            return send_response(connection, 404, "{\"error\":\"Unknown job\"}");
+        }
+        if (state != JOB_CANCELLED && state != JOB_RUNNING && state != JOB_QUEUED) {
+            cJSON *done = job_index_get_json(&job_index, job_id);
+            if (!done) {
+                return send_response(connection, 404, "{\"error\":\"Unknown job\"}");
             }
-            av_packet_free(&enc_packet);
-            av_frame_unref(filtered_frame);
+            cJSON_AddStringToObject(done, "error", "Job already finished");
+            char *done_str = cJSON_Print(done);
+            enum MHD_Result ret = send_response(connection, 409, done_str);
+            free(done_str);
+            cJSON_Delete(done);
+            return ret;
         }
-        av_frame_unref(decoded_frame);
+        fprintf(stderr, "[API] Cancel %s (%s)\n", job_id, job_state_names[state]);
     }
 
-    // Flush filter
-    av_buffersrc_add_frame_flags(ctx->buffersrc_ctx, NULL, 0);
-    while (av_buffersink_get_frame(ctx->buffersink_ctx, filtered_frame) >= 0) {
-        filtered_frame->pts = frame_count++;
-        avcodec_send_frame(ctx->encoder_ctx, filtered_frame);
+    cJSON *job = job_index_get_json(&job_index, job_id);
+    if (!job) {
+        return send_response(connection, 404, "{\"error\":\"Unknown job\"}");
+    }
 
-        AVPacket *enc_packet = av_packet_alloc();
-        while (avcodec_receive_packet(ctx->encoder_ctx, enc_packet) == 0) {
-            enc_packet->stream_index = 0;
-            av_packet_rescale_ts(enc_packet, ctx->encoder_ctx->time_base, out_stream->time_base);
-            av_interleaved_write_frame(ctx->output_ctx, enc_packet);
-            av_packet_unref(enc_packet);
-        }
-        av_packet_free(&enc_packet);
-        av_frame_unref(filtered_frame);
+    // A running job is aborted asynchronously at the next packet boundary
+    int status = 200;
+    if (strcmp(method, "DELETE") == 0 && cJSON_GetObjectItem(job, "cancelRequested") &&
+        strcmp(cJSON_GetObjectItem(job, "state")->valuestring, "cancelled") != 0) {
+        status = 202;
     }
 
-    // Flush encoder
-    avcodec_send_frame(ctx->encoder_ctx, NULL);
-    AVPacket *enc_packet = av_packet_alloc();
-    while (avcodec_receive_packet(ctx->encoder_ctx, enc_packet) == 0) {
-        enc_packet->stream_index = 0;
-        av_packet_rescale_ts(enc_packet, ctx->encoder_ctx->time_base, out_stream->time_base);
-        av_interleaved_write_frame(ctx->output_ctx, enc_packet);
-        av_packet_unref(enc_packet);
+    char *job_str = cJSON_Print(job);
+    enum MHD_Result ret = send_response(connection, status, job_str);
+    free(job_str);
+    cJSON_Delete(job);
+
+    return ret;
+}
+
+// API Endpoint: GET /jobs?state=<state>&limit=<n> - List tracked jobs
+static enum MHD_Result handle_job_list(struct MHD_Connection *connection) {
+    int state = -1;
+    const char *state_arg = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "state");
+    if (state_arg && *state_arg) {
+        for (int i = 0; i < JOB_NB_STATES; i++) {
+            if (strcmp(state_arg, job_state_names[i]) == 0) state = i;
+        }
+        if (state < 0) {
+            return send_response(connection, 400,
+                "{\"error\":\"Unknown 'state' (expected queued, running, done, failed, cancelled or expired)\"}");
+        }
     }
-    av_packet_free(&enc_packet);
 
-    av_write_trailer(ctx->output_ctx);
+    int limit = 100;
+    const char *limit_arg = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "limit");
+    if (limit_arg && *limit_arg) {
+        limit = atoi(limit_arg);
+        if (limit < 1) limit = 1;
+        if (limit > JOB_LIST_LIMIT) limit = JOB_LIST_LIMIT;
+    }
 
-    av_frame_free(&filtered_frame);
-    av_frame_free(&decoded_frame);
-    av_packet_free(&packet);
+    cJSON *response = cJSON_CreateObject();
+    cJSON *jobs = job_index_list_json(&job_index, state, limit);
+    cJSON_AddNumberToObject(response, "count", cJSON_GetArraySize(jobs));
+    cJSON_AddItemToObject(response, "jobs", jobs);
 
-    fprintf(stderr, "[Worker %d] ✓ Completed: %s (%d frames)\n",
-            ctx->worker_id, input_filename, frame_count);
+    char *response_str = cJSON_Print(response);
+    enum MHD_Result ret = send_response(connection, 200, response_str);
+    free(response_str);
+    cJSON_Delete(response);
 
-    return 0;
+    return ret;
 }
 
-// ============================================================================
-// HTTP Callback Notification
-// ============================================================================
+// API Endpoint: DELETE /quarantine/{inputFile} - Release an input so it is
+// submitted again
+static enum MHD_Result handle_quarantine_release(struct MHD_Connection *connection,
+                                                 const char *filename) {
+    int removed = quarantine_remove(&quarantine, filename);
+    if (removed == 0) {
+        return send_response(connection, 404, "{\"error\":\"Input not quarantined\"}");
+    }
 
-// Callback for curl to discard response data
-static size_t discard_response_callback(void *contents, size_t size, size_t nmemb, void *userp) {
-    return size * nmemb;  // Discard response
+    cJSON *response = cJSON_CreateObject();
+    cJSON_AddStringToObject(response, "inputFile", filename);
+    cJSON_AddNumberToObject(response, "released", removed);
+    char *response_str = cJSON_Print(response);
+    enum MHD_Result ret = send_response(connection, 200, response_str);
+    free(response_str);
+    cJSON_Delete(response);
+
+    return ret;
 }
 
-// Send completion notification to callback URL
-int send_completion_callback(const char *callback_url, const char *input_file,
-                             const char *output_file, int frame_count,
-                             int processing_time_ms, const char *metadata_json,
-                             const char *status) {
-    if (!callback_url || strlen(callback_url) == 0) {
-        return 0;  // No callback URL provided, skip
-    }
+// API Endpoint: GET /quarantine - Inputs that failed permanently, newest first
+static enum MHD_Result handle_quarantine(struct MHD_Connection *connection) {
+    cJSON *response = cJSON_CreateObject();
 
-    CURL *curl = curl_easy_init();
-    if (!curl) {
-        fprintf(stderr, "[Callback] Failed to initialize curl\n");
-        return -1;
-    }
+    pthread_mutex_lock(&quarantine.mutex);
+    cJSON_AddNumberToObject(response, "total", quarantine.count);
+    pthread_mutex_unlock(&quarantine.mutex);
+    cJSON_AddItemToObject(response, "entries", quarantine_json(&quarantine, JOB_LIST_LIMIT));
 
-    // Build JSON payload
-    cJSON *json = cJSON_CreateObject();
-    cJSON_AddStringToObject(json, "status", status);
-    cJSON_AddStringToObject(json, "inputFile", input_file);
-    cJSON_AddStringToObject(json, "outputFile", output_file);
-    cJSON_AddNumberToObject(json, "frameCount", frame_count);
-    cJSON_AddNumberToObject(json, "processingTimeMs", processing_time_ms);
+    char *response_str = cJSON_Print(response);
+    enum MHD_Result ret = send_response(connection, 200, response_str);
+    free(response_str);
+    cJSON_Delete(response);
 
-    // Add metadata if provided
-    if (metadata_json && strlen(metadata_json) > 0) {
-        cJSON *metadata = cJSON_Parse(metadata_json);
-        if (metadata) {
-            cJSON_AddItemToObject(json, "metadata", metadata);
-        }
-    }
+    return ret;
+}
 
-    char *json_str = cJSON_PrintUnformatted(json);
+// HTTP request router
+struct connection_info {
+    char *upload_data_buffer;
+    size_t upload_data_size;
+};
 
-    // Configure curl
-    curl_easy_setopt(curl, CURLOPT_URL, callback_url);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, json_str);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, discard_response_callback);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L);
+static enum MHD_Result http_handler(void *cls,
+                                    struct MHD_Connection *connection,
+                                    const char *url,
+                                    const char *method,
+                                    const char *version,
+                                    const char *upload_data,
+                                    size_t *upload_data_size,
+                                    void **con_cls) {
+    // First call - setup
+    if (*con_cls == NULL) {
+        struct connection_info *con_info = malloc(sizeof(struct connection_info));
+        con_info->upload_data_buffer = NULL;
+        con_info->upload_data_size = 0;
+        *con_cls = con_info;
+        return MHD_YES;
+    }
 
-    struct curl_slist *headers = NULL;
-    headers = curl_slist_append(headers, "Content-Type: application/json");
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    struct connection_info *con_info = *con_cls;
 
-    // Perform request
-    CURLcode res = curl_easy_perform(curl);
+    // Accumulate POST data
+    if (*upload_data_size != 0) {
+        con_info->upload_data_buffer = realloc(con_info->upload_data_buffer,
+                                               con_info->upload_data_size + *upload_data_size + 1);
+        memcpy(con_info->upload_data_buffer + con_info->upload_data_size,
+               upload_data, *upload_data_size);
+        con_info->upload_data_size += *upload_data_size;
+        con_info->upload_data_buffer[con_info->upload_data_size] = '\0';
+        *upload_data_size = 0;
+        return MHD_YES;
+    }
 
-    if (res != CURLE_OK) {
-        fprintf(stderr, "[Callback] Failed to send callback: %s\n", curl_easy_strerror(res));
-    } else {
-        fprintf(stderr, "[Callback] ✓ Sent to %s\n", callback_url);
+    // Route handling
+    enum MHD_Result result;
+
+    if (strcmp(url, "/enqueue") == 0 && strcmp(method, "POST") == 0) {
+        result = handle_enqueue(connection, con_info->upload_data_buffer,
+                               con_info->upload_data_size);
+    }
+    else if (strcmp(url, "/mosaic") == 0 && strcmp(method, "POST") == 0) {
+        result = handle_mosaic(connection, con_info->upload_data_buffer,
+                               con_info->upload_data_size);
+    }
+    else if (strcmp(url, "/health") == 0 && strcmp(method, "GET") == 0) {
+        result = handle_health(connection);
+    }
+    else if (strcmp(url, "/ready") == 0 && strcmp(method, "GET") == 0) {
+        result = handle_ready(connection);
+    }
+    else if (strcmp(url, "/metrics") == 0 && strcmp(method, "GET") == 0) {
+        result = handle_metrics(connection);
+    }
+    else if (strcmp(url, "/admin/config") == 0 &&
+             (strcmp(method, "GET") == 0 || strcmp(method, "POST") == 0)) {
+        result = handle_admin_config(connection, method, con_info->upload_data_buffer,
+                                     con_info->upload_data_size);
+    }
+    else if (strcmp(url, "/jobs") == 0 && strcmp(method, "GET") == 0) {
+        result = handle_job_list(connection);
+    }
+    else if (strncmp(url, "/jobs/", 6) == 0 && url[6] &&
+             (strcmp(method, "GET") == 0 || strcmp(method, "DELETE") == 0)) {
+        result = handle_job(connection, method, url + 6);
+    }
+    else if (strcmp(url, "/quarantine") == 0 && strcmp(method, "GET") == 0) {
+        result = handle_quarantine(connection);
+    }
+    else if (strncmp(url, "/quarantine/", 12) == 0 && url[12] && strcmp(method, "DELETE") == 0) {
+        result = handle_quarantine_release(connection, url + 12);
+    }
+    else {
+        result = send_response(connection, 404,
+            "{\"error\":\"Not found\",\"available_endpoints\":[\"/enqueue (POST)\",\"/mosaic (POST)\",\"/health (GET)\",\"/ready (GET)\",\"/metrics (GET)\",\"/admin/config (GET, POST)\",\"/jobs (GET)\",\"/jobs/{id} (GET, DELETE)\",\"/quarantine (GET)\",\"/quarantine/{inputFile} (DELETE)\"]}");
     }
 
     // Cleanup
-    curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
-    free(json_str);
-    cJSON_Delete(json);
+    if (con_info->upload_data_buffer) {
+        free(con_info->upload_data_buffer);
+    }
+    free(con_info);
+    *con_cls = NULL;
 
-    return (res == CURLE_OK) ? 0 : -1;
+    return result;
 }
 
 // ============================================================================
-// Worker Thread
+// Local Socket Protocol
 // ============================================================================
 
-// Cleanup per-file resources (input/output contexts only)
-// Called after each file - keeps persistent pipeline alive
-void cleanup_file_contexts(TranscodeContext *ctx) {
-    if (ctx->input_ctx) {
-        avformat_close_input(&ctx->input_ctx);
-        ctx->input_ctx = NULL;
-    }
-    if (ctx->output_ctx) {
-        if (!(ctx->output_ctx->oformat->flags & AVFMT_NOFILE)) {
-            avio_closep(&ctx->output_ctx->pb);
-        }
-        avformat_free_context(ctx->output_ctx);
-        ctx->output_ctx = NULL;
+// Co-located producers skip HTTP and JSON: requests are pipelined binary
+// frames, every read() worth of requests is answered with one batched ACK
+// frame, and completions can come back on the same connection.
+
+static const char *local_completion_status[] = { "completed", "failed", "cancelled", "expired" };
+#define LOCAL_NB_COMPLETION_STATUS (int)(sizeof(local_completion_status) / sizeof(local_completion_status[0]))
+
+void local_server_init(LocalServer *ls) {
+    memset(ls, 0, sizeof(*ls));
+    ls->listen_fd = -1;
+    for (int i = 0; i < LOCAL_MAX_CONNS; i++) {
+        ls->conns[i].fd = -1;
+        pthread_mutex_init(&ls->conns[i].write_mutex, NULL);
     }
+    pthread_mutex_init(&ls->mutex, NULL);
 }
 
-// Cleanup persistent pipeline resources
-// Called once at worker thread exit
-void cleanup_persistent_pipeline(TranscodeContext *ctx) {
-    if (ctx->decoder_ctx) {
-        avcodec_free_context(&ctx->decoder_ctx);
-        ctx->decoder_ctx = NULL;
-    }
-    if (ctx->encoder_ctx) {
-        avcodec_free_context(&ctx->encoder_ctx);
-        ctx->encoder_ctx = NULL;
-    }
-    if (ctx->filter_graph) {
-        avfilter_graph_free(&ctx->filter_graph);
-        ctx->filter_graph = NULL;
+// Write a whole frame (caller holds conn->write_mutex)
+static int local_write_frame(LocalConn *conn, uint8_t type, uint16_t count,
+                             const void *payload, size_t length) {
+    LocalFrameHeader header = { .length = (uint32_t)length, .type = type, .count = count };
+    struct iovec iov[2] = {
+        { .iov_base = &header, .iov_len = sizeof(header) },
+        { .iov_base = (void *)payload, .iov_len = length },
+    };
+    struct msghdr msg = { .msg_iov = iov, .msg_iovlen = 2 };
+
+    size_t remaining = sizeof(header) + length;
+    while (remaining > 0) {
+        ssize_t n = sendmsg(conn->fd, &msg, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;  // Peer gone or stalled past SO_SNDTIMEO
+        }
+        remaining -= n;
+        while (n > 0 && msg.msg_iovlen > 0) {
+            if ((size_t)n >= msg.msg_iov->iov_len) {
+                n -= msg.msg_iov->iov_len;
+                msg.msg_iov++;
+                msg.msg_iovlen--;
+            } else {
+                msg.msg_iov->iov_base = (char *)msg.msg_iov->iov_base + n;
+                msg.msg_iov->iov_len -= n;
+                n = 0;
+            }
+        }
     }
+    return 0;
 }
 
-void *worker_thread(void *arg) {
-    int worker_id = *(int*)arg;
-    free(arg);
+static void local_close(LocalServer *ls, LocalConn *conn) {
+    pthread_mutex_lock(&conn->write_mutex);
+    close(conn->fd);
+    conn->fd = -1;
+    conn->generation++;
+    pthread_mutex_unlock(&conn->write_mutex);
 
-    fprintf(stderr, "[Worker %d] Started\n", worker_id);
+    free(conn->buffer);
+    conn->buffer = NULL;
+    conn->used = 0;
+}
 
-    TranscodeContext ctx = {0};
-    ctx.worker_id = worker_id;
-    ctx.gpu_id = worker_id / 7;  // Workers 0-6 → GPU 0, Workers 7-13 → GPU 1 (7 per GPU)
+// Completion frame for a job enqueued with LOCAL_ENQUEUE_NOTIFY. The target
+// is "local:<slot>:<generation>:<tag>"; a closed or reused connection drops it.
+int local_notify(const char *target, const char *output_file, int frame_count,
+                 int processing_time_ms, const char *status, const cJSON *extra) {
+    int slot;
+    unsigned int generation, tag;
+    if (sscanf(target, "local:%d:%u:%u", &slot, &generation, &tag) != 3 ||
+        slot < 0 || slot >= LOCAL_MAX_CONNS) {
+        return -1;
+    }
 
-    // In no-GPU mode, skip hardware initialization
-    if (!no_gpu_mode) {
-        // Initialize CUDA hardware context
-        if (init_hw_device_ctx(&ctx) < 0) {
-            fprintf(stderr, "[Worker %d] Failed to initialize hardware context\n", worker_id);
-            return NULL;
-        }
+    LocalCompletion completion = {0};
+    completion.tag = tag;
+    completion.status = 1;
+    for (int i = 0; i < LOCAL_NB_COMPLETION_STATUS; i++) {
+        if (strcmp(status, local_completion_status[i]) == 0) completion.status = i;
+    }
+    completion.frames = frame_count;
+    completion.processing_ms = processing_time_ms;
+
+    const cJSON *reason_item = extra ? cJSON_GetObjectItem(extra, "reason") : NULL;
+    const char *reason = cJSON_IsString(reason_item) ? reason_item->valuestring : "";
+    size_t output_len = strlen(output_file);
+    size_t reason_len = strlen(reason);
+    completion.output_len = output_len;
+    completion.reason_len = reason_len;
+
+    unsigned char payload[sizeof(LocalCompletion) + 1024 + 256];
+    if (output_len > 1024 || reason_len > 256) {
+        return -1;
+    }
+    memcpy(payload, &completion, sizeof(completion));
+    memcpy(payload + sizeof(completion), output_file, output_len);
+    memcpy(payload + sizeof(completion) + output_len, reason, reason_len);
+
+    LocalConn *conn = &local_server.conns[slot];
+    int ret = -1;
+    pthread_mutex_lock(&conn->write_mutex);
+    if (conn->fd >= 0 && conn->generation == generation) {
+        ret = local_write_frame(conn, LOCAL_FRAME_COMPLETION, 1, payload,
+                                sizeof(completion) + output_len + reason_len);
+    }
+    pthread_mutex_unlock(&conn->write_mutex);
 
-        // Initialize persistent GPU pipeline (ONCE per worker, not per file!)
-        // This is the key optimization: avoid expensive NVENC/NVDEC session recreation
-        if (setup_persistent_pipeline(&ctx) < 0) {
-            fprintf(stderr, "[Worker %d] Failed to setup persistent pipeline\n", worker_id);
-            return NULL;
-        }
+    pthread_mutex_lock(&local_server.mutex);
+    if (ret == 0) {
+        local_server.completions_sent++;
+    } else {
+        local_server.completions_dropped++;
     }
+    pthread_mutex_unlock(&local_server.mutex);
 
-    TranscodeJob job;
+    return ret;
+}
 
-    while (1) {
-        if (!queue_pop(&task_queue, &job)) {
-            break;
-        }
+// Validate and submit one ENQUEUE payload, filling in its ack
+static void local_enqueue(LocalConn *conn, int slot, const unsigned char *payload,
+                          size_t length, LocalAck *ack) {
+    LocalEnqueue req;
+    memset(ack, 0, sizeof(*ack));
+    if (length < sizeof(req)) {
+        ack->status = LOCAL_ACK_INVALID;
+        return;
+    }
+    memcpy(&req, payload, sizeof(req));
+    ack->tag = req.tag;
 
-        int result = 0;
-        struct timespec start, end;
-        clock_gettime(CLOCK_MONOTONIC, &start);
+    const char *strings = (const char *)payload + sizeof(req);
+    TranscodeJob job = {0};
+    if (sizeof(req) + req.path_len + req.camera_len + req.metadata_len != length ||
+        req.path_len == 0 || req.path_len >= sizeof(job.filename) ||
+        req.camera_len >= sizeof(job.camera_id) ||
+        req.metadata_len >= sizeof(job.metadata_json) ||
+        req.priority >= PRIORITY_NB_CLASSES ||
+        (req.output_format != LOCAL_FORMAT_DEFAULT && req.output_format > OUTPUT_FORMAT_CMAF)) {
+        ack->status = LOCAL_ACK_INVALID;
+        return;
+    }
 
-        if (no_gpu_mode) {
-            // Phase 1: No-GPU mode - just echo back input path
-            fprintf(stderr, "[Worker %d] ⚠️  NO-GPU mode: %s (would transcode if GPU available)\n",
-                    worker_id, job.filename);
+    char path[sizeof(job.filename)] = {0};
+    char resolved_path[1024];
+    memcpy(path, strings, req.path_len);
+    if (resolve_input_path(path, job.filename, sizeof(job.filename),
+                           resolved_path, sizeof(resolved_path)) < 0) {
+        ack->status = LOCAL_ACK_INVALID;
+        return;
+    }
+    if (access(resolved_path, F_OK) != 0) {
+        ack->status = LOCAL_ACK_NOT_FOUND;
+        return;
+    }
 
-            clock_gettime(CLOCK_MONOTONIC, &end);
-            int processing_ms = (end.tv_sec - start.tv_sec) * 1000 +
-                               (end.tv_nsec - start.tv_nsec) / 1000000;
+    if (req.camera_len > 0) {
+        memcpy(job.camera_id, strings + req.path_len, req.camera_len);
+    } else {
+        camera_key_from_path(job.filename, job.camera_id, sizeof(job.camera_id));
+    }
+    memcpy(job.metadata_json, strings + req.path_len + req.camera_len, req.metadata_len);
 
-            // Send callback with input path as output (Phase 1 behavior)
-            send_completion_callback(job.callback_url, job.filename, job.filename,
-                                    0, processing_ms, job.metadata_json, "completed");
+    job.output_format = req.output_format == LOCAL_FORMAT_DEFAULT ? default_output_format
+                                                                  : (OutputFormat)req.output_format;
+    job.priority = req.priority;
+    if (req.deadline_ms > 0) {
+        job.deadline_ms = monotonic_ms() + req.deadline_ms;
+    }
+    if (req.flags & LOCAL_ENQUEUE_DOWNGRADE) {
+        job.on_expire = EXPIRE_DOWNGRADE;
+    }
+    if (req.flags & LOCAL_ENQUEUE_NOTIFY) {
+        snprintf(job.callback_url, sizeof(job.callback_url), "local:%d:%u:%u",
+                 slot, conn->generation, req.tag);
+    }
 
-            fprintf(stderr, "[Worker %d] ✓ Acknowledgment sent - S3Uploader will upload raw segment\n",
-                    worker_id);
-            result = 0;
-        } else {
-            // Phase 2: Normal GPU transcoding
-            result = process_file(&ctx, job.filename);
+    int consolidate = consolidator.target_seconds > 0 &&
+                      job.priority == PRIORITY_ARCHIVE && job.deadline_ms == 0 &&
+                      !(req.flags & LOCAL_ENQUEUE_NO_CONSOLIDATE);
 
-            clock_gettime(CLOCK_MONOTONIC, &end);
-            int processing_ms = (end.tv_sec - start.tv_sec) * 1000 +
-                               (end.tv_nsec - start.tv_nsec) / 1000000;
+    // Only well-formed requests use up a token
+    int client_wait_ms = admission_take_token(&admission, conn->client);
+    if (client_wait_ms > 0) {
+        ack->status = LOCAL_ACK_RATE_LIMITED;
+        ack->value = client_wait_ms;
+        return;
+    }
 
-            // In Phase 2, send callback with transcoded output path
-            if (result == 0) {
-                char output_path[512];
-                char base_name[256];
-                strncpy(base_name, job.filename, sizeof(base_name) - 1);
-                char *ext = strstr(base_name, ".ts");
-                if (ext) *ext = '\0';
-                snprintf(output_path, sizeof(output_path), "%s_h264.ts", base_name);
-
-                send_completion_callback(job.callback_url, job.filename, output_path,
-                                        0, processing_ms, job.metadata_json, "completed");
-            } else {
-                send_completion_callback(job.callback_url, job.filename, "",
-                                        0, processing_ms, job.metadata_json, "failed");
-            }
-        }
+    int value = 0;
+    switch (submit_job(&job, consolidate, &value)) {
+    case SUBMIT_QUEUED:
+        ack->status = LOCAL_ACK_QUEUED;
+        ack->value = value;
+        break;
+    case SUBMIT_GROUPED:
+        ack->status = LOCAL_ACK_GROUPED;
+        ack->value = value;
+        break;
+    case SUBMIT_COALESCED:
+        ack->status = LOCAL_ACK_COALESCED;
+        ack->value = 0;
+        break;
+    case SUBMIT_CACHED:
+        ack->status = LOCAL_ACK_COALESCED;
+        ack->value = 1;
+        break;
+    case SUBMIT_CORRUPT:
+        ack->status = LOCAL_ACK_CORRUPT;
+        ack->value = value;
+        return;
+    case SUBMIT_QUEUE_FULL:
+        pthread_mutex_lock(&admission.mutex);
+        admission.rejected_queue_full++;
+        pthread_mutex_unlock(&admission.mutex);
+        ack->status = LOCAL_ACK_QUEUE_FULL;
+        pthread_mutex_lock(&task_queue.mutex);
+        int capacity = task_queue.capacity;
+        pthread_mutex_unlock(&task_queue.mutex);
+        ack->value = admission_retry_after_ms(value, capacity);
+        return;
+    default:
+        ack->status = LOCAL_ACK_ERROR;
+        return;
+    }
+    memcpy(ack->job_id, job.job_id, JOB_ID_SIZE);
+}
 
-        if (result == 0) {
-            mark_file_processed(&processed_files, job.filename);
-            pthread_mutex_lock(&stats_mutex);
-            files_processed++;
-            pthread_mutex_unlock(&stats_mutex);
-        } else {
-            pthread_mutex_lock(&stats_mutex);
-            files_failed++;
-            pthread_mutex_unlock(&stats_mutex);
+// Handle every complete frame in the connection buffer and answer them with
+// batched ACK frames. Returns -1 on a protocol error or a dead peer.
+static int local_process(LocalServer *ls, int slot) {
+    LocalConn *conn = &ls->conns[slot];
+    LocalAck acks[LOCAL_MAX_ACKS];
+    int nb_acks = 0;
+    size_t offset = 0;
+    int ret = 0;
+
+    while (conn->used - offset >= sizeof(LocalFrameHeader)) {
+        LocalFrameHeader header;
+        memcpy(&header, conn->buffer + offset, sizeof(header));
+        if (header.type != LOCAL_FRAME_ENQUEUE || header.length > LOCAL_MAX_FRAME) {
+            fprintf(stderr, "[Local] Protocol error from %s (frame type %u, %u bytes)\n",
+                    conn->client, header.type, header.length);
+            ret = -1;
+            break;
+        }
+        if (conn->used - offset < sizeof(header) + header.length) {
+            break;  // Partial frame, wait for more data
         }
 
-        // Cleanup only per-file resources (NOT the persistent pipeline!)
-        if (!no_gpu_mode) {
-            cleanup_file_contexts(&ctx);
+        local_enqueue(conn, slot, conn->buffer + offset + sizeof(header), header.length, &acks[nb_acks++]);
+        offset += sizeof(header) + header.length;
+
+        if (nb_acks == LOCAL_MAX_ACKS) {
+            pthread_mutex_lock(&conn->write_mutex);
+            ret = local_write_frame(conn, LOCAL_FRAME_ACK, nb_acks, acks, nb_acks * sizeof(LocalAck));
+            pthread_mutex_unlock(&conn->write_mutex);
+            if (ret < 0) break;
+            pthread_mutex_lock(&ls->mutex);
+            ls->requests_total += nb_acks;
+            ls->ack_frames++;
+            pthread_mutex_unlock(&ls->mutex);
+            nb_acks = 0;
         }
     }
 
-    // Final cleanup - destroy persistent pipeline
-    if (!no_gpu_mode) {
-        cleanup_persistent_pipeline(&ctx);
-
-        if (ctx.cuda_stream) {
-            cudaStreamSynchronize(ctx.cuda_stream);
-            cudaStreamDestroy(ctx.cuda_stream);
-        }
-        if (ctx.hw_device_ctx) {
-            av_buffer_unref(&ctx.hw_device_ctx);
-        }
+    if (ret == 0 && nb_acks > 0) {
+        pthread_mutex_lock(&conn->write_mutex);
+        ret = local_write_frame(conn, LOCAL_FRAME_ACK, nb_acks, acks, nb_acks * sizeof(LocalAck));
+        pthread_mutex_unlock(&conn->write_mutex);
+        pthread_mutex_lock(&ls->mutex);
+        ls->requests_total += nb_acks;
+        ls->ack_frames++;
+        pthread_mutex_unlock(&ls->mutex);
     }
 
-    fprintf(stderr, "[Worker %d] Finished\n", worker_id);
-    return NULL;
+    memmove(conn->buffer, conn->buffer + offset, conn->used - offset);
+    conn->used -= offset;
+    return ret;
 }
 
-// ============================================================================
-// File Scanner Thread
-// ============================================================================
-
-void *scanner_thread(void *arg) {
-    fprintf(stderr, "[Scanner] Starting file discovery...\n");
-
-    DIR *dir = opendir(INPUT_DIR);
-    if (!dir) {
-        fprintf(stderr, "[Scanner] Failed to open directory: %s\n", INPUT_DIR);
-        return NULL;
+static void local_accept(LocalServer *ls) {
+    int fd = accept(ls->listen_fd, NULL, NULL);
+    if (fd < 0) {
+        return;
     }
 
-    struct dirent *entry;
-    int discovered = 0;
-
-    while ((entry = readdir(dir)) != NULL) {
-        if (strstr(entry->d_name, ".ts") && !strstr(entry->d_name, "_h264.ts")) {
-            if (!is_file_processed(&processed_files, entry->d_name)) {
-                TranscodeJob job = {0};
-                strncpy(job.filename, entry->d_name, sizeof(job.filename) - 1);
-                // No callback URL in batch mode
-                queue_push(&task_queue, &job);
-                discovered++;
-            }
+    int slot = -1;
+    for (int i = 0; i < LOCAL_MAX_CONNS; i++) {
+        if (ls->conns[i].fd < 0) {
+            slot = i;
+            break;
         }
     }
+    unsigned char *buffer = slot >= 0 ? malloc(LOCAL_READ_BUFFER) : NULL;
+    if (!buffer) {
+        fprintf(stderr, "[Local] Rejecting connection: %s\n", slot < 0 ? "too many clients" : "out of memory");
+        close(fd);
+        return;
+    }
 
-    closedir(dir);
+    // Workers write completions synchronously; a client that stops reading
+    // costs them at most the send timeout
+    struct timeval timeout = { .tv_sec = LOCAL_SEND_TIMEOUT_MS / 1000,
+                               .tv_usec = (LOCAL_SEND_TIMEOUT_MS % 1000) * 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    LocalConn *conn = &ls->conns[slot];
+    struct ucred cred;
+    socklen_t cred_len = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) == 0) {
+        snprintf(conn->client, sizeof(conn->client), "local:%d", (int)cred.pid);
+    } else {
+        snprintf(conn->client, sizeof(conn->client), "local");
+    }
+    conn->buffer = buffer;
+    conn->used = 0;
 
-    fprintf(stderr, "[Scanner] Discovered %d files for processing\n", discovered);
-    return NULL;
+    pthread_mutex_lock(&conn->write_mutex);
+    conn->fd = fd;
+    pthread_mutex_unlock(&conn->write_mutex);
+
+    pthread_mutex_lock(&ls->mutex);
+    ls->connections_total++;
+    pthread_mutex_unlock(&ls->mutex);
 }
 
-// ============================================================================
-// Signal Handling & API Server
-// ============================================================================
+void *local_server_thread(void *arg) {
+    LocalServer *ls = arg;
+    struct pollfd fds[LOCAL_MAX_CONNS + 1];
+    int slots[LOCAL_MAX_CONNS + 1];
+
+    while (ls->running) {
+        int n = 0;
+        fds[n].fd = ls->listen_fd;
+        fds[n].events = POLLIN;
+        slots[n++] = -1;
+        for (int i = 0; i < LOCAL_MAX_CONNS; i++) {
+            if (ls->conns[i].fd >= 0) {
+                fds[n].fd = ls->conns[i].fd;
+                fds[n].events = POLLIN;
+                slots[n++] = i;
+            }
+        }
 
-void signal_handler(int sig) {
-    fprintf(stderr, "\n[Signal] Received signal %d (%s), shutting down gracefully...\n",
-            sig, sig == SIGINT ? "SIGINT" : "SIGTERM");
+        if (poll(fds, n, 500) <= 0) {
+            continue;
+        }
 
-    processing_active = 0;
+        for (int i = 1; i < n; i++) {
+            if (!fds[i].revents) continue;
 
-    // Wake up all threads
-    pthread_cond_broadcast(&task_queue.not_empty);
+            LocalConn *conn = &ls->conns[slots[i]];
+            ssize_t got = read(conn->fd, conn->buffer + conn->used, LOCAL_READ_BUFFER - conn->used);
+            if (got <= 0 || local_process(ls, slots[i]) < 0) {
+                local_close(ls, conn);
+            }
+        }
 
-    // Stop API server
-    if (api_daemon) {
-        MHD_stop_daemon(api_daemon);
-        api_daemon = NULL;
+        if (fds[0].revents & POLLIN) {
+            local_accept(ls);
+        }
     }
+    return NULL;
 }
 
-// Helper: Send HTTP response
-static enum MHD_Result send_response(struct MHD_Connection *connection,
-                                     int status_code,
-                                     const char *response_text) {
-    struct MHD_Response *response = MHD_create_response_from_buffer(
-        strlen(response_text),
-        (void*)response_text,
-        MHD_RESPMEM_MUST_COPY
-    );
+int local_server_start(LocalServer *ls, const char *path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "[Local] Socket path too long: %s\n", path);
+        return -1;
+    }
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
 
-    MHD_add_response_header(response, "Content-Type", "application/json");
-    MHD_add_response_header(response, "Access-Control-Allow-Origin", "*");
+    ls->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (ls->listen_fd < 0) {
+        fprintf(stderr, "[Local] socket: %s\n", strerror(errno));
+        return -1;
+    }
 
-    enum MHD_Result ret = MHD_queue_response(connection, status_code, response);
-    MHD_destroy_response(response);
+    unlink(path);  // Stale socket from a previous run
+    if (bind(ls->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(ls->listen_fd, LOCAL_MAX_CONNS) < 0) {
+        fprintf(stderr, "[Local] Failed to listen on %s: %s\n", path, strerror(errno));
+        close(ls->listen_fd);
+        ls->listen_fd = -1;
+        return -1;
+    }
 
-    return ret;
+    ls->running = 1;
+    if (pthread_create(&ls->thread, NULL, local_server_thread, ls) != 0) {
+        fprintf(stderr, "[Local] Failed to start listener thread\n");
+        close(ls->listen_fd);
+        ls->listen_fd = -1;
+        ls->running = 0;
+        return -1;
+    }
+    ls->started = 1;
+    return 0;
 }
 
-// API Endpoint: POST /enqueue - Add file to transcoding queue
-static enum MHD_Result handle_enqueue(struct MHD_Connection *connection,
-                                      const char *upload_data,
-                                      size_t upload_data_size) {
-    if (upload_data_size == 0) {
-        return send_response(connection, 400, "{\"error\":\"Empty request body\"}");
+// Stop taking requests. Connections stay open so jobs still draining can
+// deliver their completion frames; local_server_close() drops them after.
+void local_server_stop(LocalServer *ls) {
+    if (!ls->started) {
+        return;
     }
+    ls->running = 0;
+    pthread_join(ls->thread, NULL);
+    ls->started = 0;
 
-    // Parse JSON
-    cJSON *json = cJSON_Parse(upload_data);
-    if (!json) {
-        return send_response(connection, 400, "{\"error\":\"Invalid JSON\"}");
-    }
+    close(ls->listen_fd);
+    ls->listen_fd = -1;
+    unlink(config.local_socket);
+}
 
-    // Get inputPath (full path to file)
-    cJSON *input_path_item = cJSON_GetObjectItem(json, "inputPath");
-    if (!input_path_item || !cJSON_IsString(input_path_item)) {
-        cJSON_Delete(json);
-        return send_response(connection, 400, "{\"error\":\"Missing 'inputPath' field\"}");
+void local_server_close(LocalServer *ls) {
+    for (int i = 0; i < LOCAL_MAX_CONNS; i++) {
+        if (ls->conns[i].fd >= 0) {
+            local_close(ls, &ls->conns[i]);
+        }
     }
+}
 
-    const char *input_path = input_path_item->valuestring;
+// ============================================================================
+// RabbitMQ Consumer
+// ============================================================================
 
-    // Validate path exists
-    if (access(input_path, F_OK) != 0) {
-        cJSON_Delete(json);
+// Consumes segment.raw.ready directly (no bridge, no webhook). Deliveries stay
+// unacked while they are queued, retried or transcoding; prefetch bounds how
+// many are in flight. A finished job's result is published on a confirm-mode
+// channel and the source is acked once the broker confirms the result, so a
+// crash at any point leads to redelivery rather than a lost segment.
 
-        cJSON *error_response = cJSON_CreateObject();
-        cJSON_AddStringToObject(error_response, "error", "File not found");
-        cJSON_AddStringToObject(error_response, "inputPath", input_path);
-        char *error_str = cJSON_Print(error_response);
-        enum MHD_Result ret = send_response(connection, 404, error_str);
-        free(error_str);
-        cJSON_Delete(error_response);
+void amqp_bridge_init(AmqpBridge *b) {
+    memset(b, 0, sizeof(*b));
+    pthread_mutex_init(&b->mutex, NULL);
+}
 
-        return ret;
+// Check the reply of the last synchronous AMQP call
+static int amqp_check(AmqpBridge *b, const char *what) {
+    amqp_rpc_reply_t reply = amqp_get_rpc_reply(b->conn);
+    if (reply.reply_type == AMQP_RESPONSE_NORMAL) {
+        return 0;
+    }
+    if (reply.reply_type == AMQP_RESPONSE_LIBRARY_EXCEPTION) {
+        fprintf(stderr, "[AMQP] %s: %s\n", what, amqp_error_string2(reply.library_error));
+    } else {
+        fprintf(stderr, "[AMQP] %s: rejected by broker (method 0x%08x)\n", what, reply.reply.id);
     }
+    return -1;
+}
 
-    // Get callback URL (optional)
-    const char *callback_url = "";
-    cJSON *callback_item = cJSON_GetObjectItem(json, "callbackUrl");
-    if (callback_item && cJSON_IsString(callback_item)) {
-        callback_url = callback_item->valuestring;
+static int amqp_connect(AmqpBridge *b) {
+    b->conn = amqp_new_connection();
+    amqp_socket_t *socket = amqp_tcp_socket_new(b->conn);
+    struct timeval timeout = { .tv_sec = AMQP_RECONNECT_SECONDS };
+
+    if (!socket || amqp_socket_open_noblock(socket, config.amqp_host, config.amqp_port, &timeout) != 0) {
+        fprintf(stderr, "[AMQP] Cannot reach %s:%d\n", config.amqp_host, config.amqp_port);
+        amqp_destroy_connection(b->conn);
+        return -1;
     }
 
-    // Get metadata (optional)
-    char metadata_json[2048] = {0};
-    cJSON *metadata_item = cJSON_GetObjectItem(json, "metadata");
-    if (metadata_item) {
-        char *metadata_str = cJSON_PrintUnformatted(metadata_item);
-        if (metadata_str) {
-            strncpy(metadata_json, metadata_str, sizeof(metadata_json) - 1);
-            free(metadata_str);
-        }
+    amqp_rpc_reply_t reply = amqp_login(b->conn, config.amqp_vhost, 0, 131072, AMQP_HEARTBEAT_SECONDS,
+                                        AMQP_SASL_METHOD_PLAIN, config.amqp_user, config.amqp_password);
+    if (reply.reply_type != AMQP_RESPONSE_NORMAL) {
+        fprintf(stderr, "[AMQP] Login to %s as %s failed\n", config.amqp_vhost, config.amqp_user);
+        amqp_destroy_connection(b->conn);
+        return -1;
     }
 
-    // Check queue capacity
-    pthread_mutex_lock(&task_queue.mutex);
-    int queue_depth = task_queue.count;
-    int queue_capacity = MAX_QUEUE_SIZE;
-    pthread_mutex_unlock(&task_queue.mutex);
+    amqp_bytes_t consume_queue = amqp_cstring_bytes(config.amqp_consume_queue);
+    amqp_bytes_t publish_queue = amqp_cstring_bytes(config.amqp_publish_queue);
+
+    // Durable queues on the default exchange, as the .NET services declare them
+    amqp_channel_open(b->conn, AMQP_CONSUME_CHANNEL);
+    if (amqp_check(b, "open consume channel") < 0) goto fail;
+    amqp_channel_open(b->conn, AMQP_PUBLISH_CHANNEL);
+    if (amqp_check(b, "open publish channel") < 0) goto fail;
+    amqp_queue_declare(b->conn, AMQP_CONSUME_CHANNEL, consume_queue, 0, 1, 0, 0, amqp_empty_table);
+    if (amqp_check(b, "declare consume queue") < 0) goto fail;
+    amqp_queue_declare(b->conn, AMQP_PUBLISH_CHANNEL, publish_queue, 0, 1, 0, 0, amqp_empty_table);
+    if (amqp_check(b, "declare publish queue") < 0) goto fail;
+    amqp_confirm_select(b->conn, AMQP_PUBLISH_CHANNEL);
+    if (amqp_check(b, "enable publisher confirms") < 0) goto fail;
+    amqp_basic_qos(b->conn, AMQP_CONSUME_CHANNEL, 0, config.amqp_prefetch, 0);
+    if (amqp_check(b, "set prefetch") < 0) goto fail;
+    amqp_basic_consume(b->conn, AMQP_CONSUME_CHANNEL, consume_queue, amqp_cstring_bytes("transcoder"),
+                       0, 0, 0, amqp_empty_table);
+    if (amqp_check(b, "start consumer") < 0) goto fail;
+
+    b->generation++;
+    b->cancelled = 0;
+    b->publish_seq = 0;
+    pthread_mutex_lock(&b->mutex);
+    b->connected = 1;
+    b->nb_unconfirmed = 0;
+    b->in_flight = 0;
+    pthread_mutex_unlock(&b->mutex);
+
+    fprintf(stderr, "[AMQP] Consuming %s on %s:%d%s (prefetch %d), results to %s\n",
+            config.amqp_consume_queue, config.amqp_host, config.amqp_port, config.amqp_vhost,
+            config.amqp_prefetch, config.amqp_publish_queue);
+    return 0;
+
+fail:
+    amqp_connection_close(b->conn, AMQP_REPLY_SUCCESS);
+    amqp_destroy_connection(b->conn);
+    return -1;
+}
 
-    if (queue_depth >= (queue_capacity * 0.95)) {
-        cJSON_Delete(json);
+// Drop the connection. The broker requeues every unacked delivery, so jobs
+// still in flight will be redelivered; their completions are discarded.
+static void amqp_disconnect(AmqpBridge *b, const char *why) {
+    fprintf(stderr, "[AMQP] Connection lost (%s), %d deliveries will be redelivered\n",
+            why, b->in_flight);
+
+    amqp_connection_close(b->conn, AMQP_REPLY_SUCCESS);
+    amqp_destroy_connection(b->conn);
+    b->has_pending = 0;
+
+    pthread_mutex_lock(&b->mutex);
+    b->connected = 0;
+    b->nb_unconfirmed = 0;
+    b->in_flight = 0;
+    b->reconnects++;
+    pthread_mutex_unlock(&b->mutex);
+}
 
-        cJSON *full_response = cJSON_CreateObject();
-        cJSON_AddStringToObject(full_response, "error", "Queue almost full");
-        cJSON_AddNumberToObject(full_response, "queue_depth", queue_depth);
-        cJSON_AddNumberToObject(full_response, "queue_capacity", queue_capacity);
-        cJSON_AddStringToObject(full_response, "retry_after", "60");
-        char *full_str = cJSON_Print(full_response);
-        enum MHD_Result ret = send_response(connection, 503, full_str);
-        free(full_str);
-        cJSON_Delete(full_response);
+// n deliveries left the in-flight window with the given outcome
+static void amqp_settle(AmqpBridge *b, long *outcome, long n) {
+    pthread_mutex_lock(&b->mutex);
+    b->in_flight -= n;
+    *outcome += n;
+    pthread_mutex_unlock(&b->mutex);
+}
 
-        return ret;
-    }
+// Reject a delivery: requeue for shutdown/backpressure, dead-letter otherwise
+static void amqp_reject(AmqpBridge *b, uint64_t delivery_tag, int requeue) {
+    amqp_basic_reject(b->conn, AMQP_CONSUME_CHANNEL, delivery_tag, requeue);
+    amqp_settle(b, &b->rejected, 1);
+}
 
-    // Create job
-    TranscodeJob job = {0};
-    strncpy(job.filename, input_path, sizeof(job.filename) - 1);
-    strncpy(job.callback_url, callback_url, sizeof(job.callback_url) - 1);
-    strncpy(job.metadata_json, metadata_json, sizeof(job.metadata_json) - 1);
+// Hand the pending delivery to the scheduler; 0 once it is taken. A full
+// queue or job index holds it back (amqp_poll retries every AMQP_POLL_MS
+// without reading more) rather than bouncing it off the broker in a loop.
+static int amqp_submit_pending(AmqpBridge *b) {
+    int value = 0;
+    SubmitResult submitted = submit_job(&b->pending, 0, &value);
+    if (submitted == SUBMIT_QUEUE_FULL || submitted == SUBMIT_NO_RECORD) {
+        return -1;  // Keep it and stop consuming until workers catch up
+    }
 
-    // Add to queue
-    queue_push(&task_queue, &job);
+    b->has_pending = 0;
+    if (submitted == SUBMIT_CORRUPT) {
+        fprintf(stderr, "[AMQP] %s failed the MPEG-TS check (%s), dead-lettering it\n",
+                b->pending.filename, ts_verdict_names[value]);
+        amqp_reject(b, b->pending_tag, 0);
+    } else if (submitted != SUBMIT_QUEUED && submitted != SUBMIT_COALESCED && submitted != SUBMIT_CACHED) {
+        fprintf(stderr, "[AMQP] Could not submit %s, dead-lettering it\n", b->pending.filename);
+        amqp_reject(b, b->pending_tag, 0);
+    }
+    // A coalesced redelivery is acked with the result of the job it joined
+    return 0;
+}
 
-    fprintf(stderr, "[API] Enqueued: %s (queue depth: %d)\n", input_path, queue_depth + 1);
+// Turn a RawSegmentReadyMessage into a job
+static void amqp_handle_delivery(AmqpBridge *b, const amqp_envelope_t *envelope) {
+    pthread_mutex_lock(&b->mutex);
+    b->in_flight++;
+    b->consumed++;
+    pthread_mutex_unlock(&b->mutex);
 
-    // Success response
-    cJSON *success_response = cJSON_CreateObject();
-    cJSON_AddStringToObject(success_response, "status", "queued");
-    cJSON_AddStringToObject(success_response, "inputPath", input_path);
-    cJSON_AddNumberToObject(success_response, "queue_depth", queue_depth + 1);
-    char *success_str = cJSON_Print(success_response);
+    if (b->draining) {
+        amqp_reject(b, envelope->delivery_tag, 1);
+        return;
+    }
 
-    enum MHD_Result ret = send_response(connection, 200, success_str);
+    const amqp_bytes_t *body = &envelope->message.body;
+    cJSON *json = cJSON_ParseWithLength(body->bytes, body->len);
+    const cJSON *path_item = json ? cJSON_GetObjectItem(json, "FilePath") : NULL;
+    if (!cJSON_IsString(path_item) || !path_item->valuestring[0]) {
+        fprintf(stderr, "[AMQP] Rejecting malformed message (delivery %llu)\n",
+                (unsigned long long)envelope->delivery_tag);
+        cJSON_Delete(json);
+        amqp_reject(b, envelope->delivery_tag, 0);
+        return;
+    }
 
-    free(success_str);
-    cJSON_Delete(success_response);
+    // The source message is echoed into the result, so it must fit whole;
+    // FilePath is absolute under inputDir (or relative to it) like inputPath
+    TranscodeJob *job = &b->pending;
+    memset(job, 0, sizeof(*job));
+    char *compact = cJSON_PrintUnformatted(json);
+    const char *problem = NULL;
+    if (resolve_input_path(path_item->valuestring, job->filename, sizeof(job->filename), NULL, 0) < 0) {
+        problem = "FilePath outside the input directory";
+    } else if (!compact || strlen(compact) >= sizeof(job->metadata_json)) {
+        problem = "message too large to echo into the result";
+    } else {
+        strcpy(job->metadata_json, compact);
+    }
+    free(compact);
+    if (problem) {
+        fprintf(stderr, "[AMQP] Rejecting %s (delivery %llu): %s\n", path_item->valuestring,
+                (unsigned long long)envelope->delivery_tag, problem);
+        cJSON_Delete(json);
+        amqp_reject(b, envelope->delivery_tag, 0);
+        return;
+    }
     cJSON_Delete(json);
 
-    return ret;
+    camera_key_from_path(job->filename, job->camera_id, sizeof(job->camera_id));
+    job->output_format = default_output_format;
+    snprintf(job->callback_url, sizeof(job->callback_url), "amqp:%u:%" PRIu64,
+             b->generation, envelope->delivery_tag);
+
+    b->pending_tag = envelope->delivery_tag;
+    b->has_pending = 1;
+    amqp_submit_pending(b);
 }
 
-// API Endpoint: GET /health - Health check
-static enum MHD_Result handle_health(struct MHD_Connection *connection) {
-    cJSON *health = cJSON_CreateObject();
+// Broker confirmed (or refused) results up to publish_seq
+static void amqp_handle_confirm(AmqpBridge *b, uint64_t publish_seq, int multiple, int positive) {
+    int kept = 0;
+    long settled = 0;
 
-    pthread_mutex_lock(&stats_mutex);
-    cJSON_AddStringToObject(health, "status", "healthy");
-    cJSON_AddNumberToObject(health, "processed", files_processed);
-    cJSON_AddNumberToObject(health, "failed", files_failed);
-    cJSON_AddNumberToObject(health, "queue_depth", task_queue.count);
-    cJSON_AddNumberToObject(health, "workers", MAX_WORKERS);
-    cJSON_AddNumberToObject(health, "uptime_seconds", (int)(time(NULL) - start_time));
-    pthread_mutex_unlock(&stats_mutex);
+    for (int i = 0; i < b->nb_unconfirmed; i++) {
+        AmqpUnconfirmed *u = &b->unconfirmed[i];
+        if (u->publish_seq == publish_seq || (multiple && u->publish_seq < publish_seq)) {
+            if (positive) {
+                amqp_basic_ack(b->conn, AMQP_CONSUME_CHANNEL, u->delivery_tag, 0);
+            } else {
+                // Result lost by the broker: let the segment come around again
+                amqp_basic_nack(b->conn, AMQP_CONSUME_CHANNEL, u->delivery_tag, 0, 1);
+            }
+            settled++;
+        } else {
+            b->unconfirmed[kept++] = *u;
+        }
+    }
 
-    char *health_str = cJSON_Print(health);
-    enum MHD_Result ret = send_response(connection, 200, health_str);
+    pthread_mutex_lock(&b->mutex);
+    b->nb_unconfirmed = kept;
+    b->in_flight -= settled;
+    b->confirm_frames++;
+    if (positive) {
+        b->acked += settled;
+    } else {
+        b->broker_nacks += settled;
+    }
+    pthread_mutex_unlock(&b->mutex);
+}
 
-    free(health_str);
-    cJSON_Delete(health);
+// Non-delivery frame (confirms, channel/connection close); -1 if fatal
+static int amqp_handle_frame(AmqpBridge *b) {
+    amqp_frame_t frame;
+    struct timeval no_wait = {0};
+    if (amqp_simple_wait_frame_noblock(b->conn, &frame, &no_wait) != 0) {
+        return 0;
+    }
+    if (frame.frame_type != AMQP_FRAME_METHOD) {
+        return 0;
+    }
+
+    switch (frame.payload.method.id) {
+    case AMQP_BASIC_ACK_METHOD: {
+        amqp_basic_ack_t *ack = frame.payload.method.decoded;
+        amqp_handle_confirm(b, ack->delivery_tag, ack->multiple, 1);
+        return 0;
+    }
+    case AMQP_BASIC_NACK_METHOD: {
+        amqp_basic_nack_t *nack = frame.payload.method.decoded;
+        amqp_handle_confirm(b, nack->delivery_tag, nack->multiple, 0);
+        return 0;
+    }
+    case AMQP_CHANNEL_CLOSE_METHOD:
+    case AMQP_CONNECTION_CLOSE_METHOD:
+        return -1;
+    default:
+        return 0;
+    }
+}
+
+// Publish results and reject failures handed over by workers. All results
+// of a pass go out back to back; the broker confirms them as a batch.
+static int amqp_flush_completions(AmqpBridge *b) {
+    pthread_mutex_lock(&b->mutex);
+    AmqpCompletion *c = b->done_head;
+    b->done_head = b->done_tail = NULL;
+    pthread_mutex_unlock(&b->mutex);
+
+    amqp_basic_properties_t props;
+    props._flags = AMQP_BASIC_CONTENT_TYPE_FLAG | AMQP_BASIC_DELIVERY_MODE_FLAG;
+    props.content_type = amqp_cstring_bytes("application/json");
+    props.delivery_mode = 2;  // Persistent
+
+    int ret = 0;
+    while (c) {
+        AmqpCompletion *next = c->next;
+
+        // Completions from an earlier connection: the broker already requeued them
+        if (ret == 0 && c->generation == b->generation) {
+            if (!c->ok) {
+                amqp_reject(b, c->delivery_tag, 0);
+            } else if (amqp_basic_publish(b->conn, AMQP_PUBLISH_CHANNEL, amqp_empty_bytes,
+                                          amqp_cstring_bytes(config.amqp_publish_queue),
+                                          0, 0, &props, amqp_cstring_bytes(c->body)) != 0) {
+                ret = -1;  // Connection is gone; redelivery takes over
+            } else {
+                b->unconfirmed[b->nb_unconfirmed].publish_seq = ++b->publish_seq;
+                b->unconfirmed[b->nb_unconfirmed].delivery_tag = c->delivery_tag;
+                pthread_mutex_lock(&b->mutex);
+                b->nb_unconfirmed++;
+                b->published++;
+                pthread_mutex_unlock(&b->mutex);
+            }
+        }
 
+        free(c->body);
+        free(c);
+        c = next;
+    }
     return ret;
 }
 
-// API Endpoint: GET /metrics - Prometheus metrics
-static enum MHD_Result handle_metrics(struct MHD_Connection *connection) {
-    char metrics[4096];
+// Wait briefly for a delivery or a broker frame; -1 if the connection died
+static int amqp_poll(AmqpBridge *b) {
+    if (b->has_pending && b->draining) {
+        b->has_pending = 0;
+        amqp_reject(b, b->pending_tag, 1);
+    }
 
-    pthread_mutex_lock(&stats_mutex);
-    snprintf(metrics, sizeof(metrics),
-        "# HELP transcoder_processed_total Total files processed\n"
-        "# TYPE transcoder_processed_total counter\n"
-        "transcoder_processed_total %d\n"
-        "\n"
-        "# HELP transcoder_failed_total Total files failed\n"
-        "# TYPE transcoder_failed_total counter\n"
-        "transcoder_failed_total %d\n"
-        "\n"
-        "# HELP transcoder_queue_depth Current queue depth\n"
-        "# TYPE transcoder_queue_depth gauge\n"
-        "transcoder_queue_depth %d\n"
-        "\n"
-        "# HELP transcoder_workers Total worker threads\n"
-        "# TYPE transcoder_workers gauge\n"
-        "transcoder_workers %d\n"
-        "\n"
-        "# HELP transcoder_uptime_seconds Uptime in seconds\n"
-        "# TYPE transcoder_uptime_seconds counter\n"
-        "transcoder_uptime_seconds %d\n",
-        files_processed, files_failed, task_queue.count, MAX_WORKERS,
-        (int)(time(NULL) - start_time)
-    );
-    pthread_mutex_unlock(&stats_mutex);
+    // Queue full: hold the delivery back instead of reading more
+    if (b->has_pending && amqp_submit_pending(b) < 0) {
+        usleep(AMQP_POLL_MS * 1000);
+        return 0;
+    }
 
-    struct MHD_Response *response = MHD_create_response_from_buffer(
-        strlen(metrics), (void*)metrics, MHD_RESPMEM_MUST_COPY
-    );
-    MHD_add_response_header(response, "Content-Type", "text/plain; version=0.0.4");
+    if (b->draining && !b->cancelled) {
+        amqp_basic_cancel(b->conn, AMQP_CONSUME_CHANNEL, amqp_cstring_bytes("transcoder"));
+        b->cancelled = 1;
+        if (amqp_check(b, "cancel consumer") < 0) {
+            return -1;
+        }
+    }
 
-    enum MHD_Result ret = MHD_queue_response(connection, 200, response);
-    MHD_destroy_response(response);
+    amqp_envelope_t envelope;
+    struct timeval timeout = { .tv_usec = AMQP_POLL_MS * 1000 };
+    amqp_maybe_release_buffers(b->conn);
+    amqp_rpc_reply_t reply = amqp_consume_message(b->conn, &envelope, &timeout, 0);
 
-    return ret;
+    if (reply.reply_type == AMQP_RESPONSE_NORMAL) {
+        amqp_handle_delivery(b, &envelope);
+        amqp_destroy_envelope(&envelope);
+        return 0;
+    }
+    if (reply.reply_type == AMQP_RESPONSE_LIBRARY_EXCEPTION) {
+        if (reply.library_error == AMQP_STATUS_TIMEOUT) {
+            return 0;
+        }
+        if (reply.library_error == AMQP_STATUS_UNEXPECTED_STATE) {
+            return amqp_handle_frame(b);  // Publisher confirm, most likely
+        }
+    }
+    return -1;
 }
 
-// HTTP request router
-struct connection_info {
-    char *upload_data_buffer;
-    size_t upload_data_size;
-};
+void *amqp_thread(void *arg) {
+    AmqpBridge *b = arg;
+    long long stop_deadline = 0;
 
-static enum MHD_Result http_handler(void *cls,
-                                    struct MHD_Connection *connection,
-                                    const char *url,
-                                    const char *method,
-                                    const char *version,
-                                    const char *upload_data,
-                                    size_t *upload_data_size,
-                                    void **con_cls) {
-    // First call - setup
-    if (*con_cls == NULL) {
-        struct connection_info *con_info = malloc(sizeof(struct connection_info));
-        con_info->upload_data_buffer = NULL;
-        con_info->upload_data_size = 0;
-        *con_cls = con_info;
-        return MHD_YES;
-    }
+    while (b->running) {
+        if (!b->connected) {
+            if (b->draining) break;  // Nothing left to settle
+            if (amqp_connect(b) < 0) {
+                sleep(AMQP_RECONNECT_SECONDS);
+            }
+            continue;
+        }
 
-    struct connection_info *con_info = *con_cls;
+        if (amqp_flush_completions(b) < 0) {
+            amqp_disconnect(b, "publish failed");
+            continue;
+        }
+        if (amqp_poll(b) < 0) {
+            amqp_disconnect(b, "broker closed the channel");
+            continue;
+        }
 
-    // Accumulate POST data
-    if (*upload_data_size != 0) {
-        con_info->upload_data_buffer = realloc(con_info->upload_data_buffer,
-                                               con_info->upload_data_size + *upload_data_size + 1);
-        memcpy(con_info->upload_data_buffer + con_info->upload_data_size,
-               upload_data, *upload_data_size);
-        con_info->upload_data_size += *upload_data_size;
-        con_info->upload_data_buffer[con_info->upload_data_size] = '\0';
-        *upload_data_size = 0;
-        return MHD_YES;
+        // Shutdown: leave once every result is confirmed and acked
+        if (b->draining) {
+            if (!stop_deadline) stop_deadline = monotonic_ms() + AMQP_STOP_TIMEOUT_MS;
+            pthread_mutex_lock(&b->mutex);
+            int idle = b->done_head == NULL;
+            pthread_mutex_unlock(&b->mutex);
+            if ((idle && b->nb_unconfirmed == 0) || monotonic_ms() > stop_deadline) {
+                break;
+            }
+        }
     }
 
-    // Route handling
-    enum MHD_Result result;
+    if (b->connected) {
+        amqp_channel_close(b->conn, AMQP_PUBLISH_CHANNEL, AMQP_REPLY_SUCCESS);
+        amqp_channel_close(b->conn, AMQP_CONSUME_CHANNEL, AMQP_REPLY_SUCCESS);
+        amqp_connection_close(b->conn, AMQP_REPLY_SUCCESS);
+        amqp_destroy_connection(b->conn);
+        pthread_mutex_lock(&b->mutex);
+        b->connected = 0;
+        pthread_mutex_unlock(&b->mutex);
+    }
+    return NULL;
+}
 
-    if (strcmp(url, "/enqueue") == 0 && strcmp(method, "POST") == 0) {
-        result = handle_enqueue(connection, con_info->upload_data_buffer,
-                               con_info->upload_data_size);
+// Called by the worker through send_completion_callback(). Makes the output
+// durable before the result is published; the AMQP thread does the rest.
+// Outputs streamed to S3 are durable once their upload completed, and are
+// published by bucket and key.
+int amqp_notify(const char *target, const char *input_file, const char *output_file,
+                int frame_count, int processing_time_ms, const char *metadata_json,
+                const char *status, const cJSON *extra) {
+    unsigned int generation;
+    uint64_t delivery_tag;
+    if (sscanf(target, "amqp:%u:%" SCNu64, &generation, &delivery_tag) != 2) {
+        return -1;
     }
-    else if (strcmp(url, "/health") == 0 && strcmp(method, "GET") == 0) {
-        result = handle_health(connection);
+
+    AmqpCompletion *c = calloc(1, sizeof(AmqpCompletion));
+    if (!c) {
+        return -1;  // Delivery stays unacked until the connection is recycled
     }
-    else if (strcmp(url, "/metrics") == 0 && strcmp(method, "GET") == 0) {
-        result = handle_metrics(connection);
+    c->generation = generation;
+    c->delivery_tag = delivery_tag;
+
+    if (strcmp(status, "completed") == 0) {
+        char path[1024];
+        double file_size = 0;
+        const cJSON *storage = extra ? cJSON_GetObjectItem(extra, "storage") : NULL;
+        const cJSON *key = extra ? cJSON_GetObjectItem(extra, "key") : NULL;
+        int in_s3 = cJSON_IsString(storage) && strcmp(storage->valuestring, "s3") == 0 && cJSON_IsString(key);
+        if (in_s3) {
+            const cJSON *verification = cJSON_GetObjectItem(extra, "verification");
+            const cJSON *bytes = verification ? cJSON_GetObjectItem(verification, "fileBytes") : NULL;
+            snprintf(path, sizeof(path), "s3://%s/%s", config.s3_bucket, key->valuestring);
+            file_size = cJSON_IsNumber(bytes) ? bytes->valuedouble : 0;
+            c->ok = 1;
+        } else {
+            if (output_file[0] == '/') {
+                snprintf(path, sizeof(path), "%s", output_file);
+            } else {
+                snprintf(path, sizeof(path), "%s/%s", config.output_dir, output_file);
+            }
+
+            struct stat st;
+            int fd = open(path, O_RDONLY);
+            if (fd >= 0 && fsync(fd) == 0 && fstat(fd, &st) == 0) {
+                file_size = (double)st.st_size;
+                c->ok = 1;
+            } else {
+                fprintf(stderr, "[AMQP] Output not durable, rejecting %s: %s\n", path, strerror(errno));
+            }
+            if (fd >= 0) close(fd);
+        }
+
+        if (c->ok) {
+            // TranscodedSegmentReadyMessage: the source message with the output
+            cJSON *json = metadata_json && metadata_json[0] ? cJSON_Parse(metadata_json) : NULL;
+            if (!json) json = cJSON_CreateObject();
+            const char *leaf = strrchr(path, '/');
+
+            cJSON_DeleteItemFromObject(json, "FilePath");
+            cJSON_DeleteItemFromObject(json, "FileName");
+            cJSON_DeleteItemFromObject(json, "FileSize");
+            cJSON_AddStringToObject(json, "FilePath", path);
+            cJSON_AddStringToObject(json, "FileName", leaf ? leaf + 1 : path);
+            cJSON_AddNumberToObject(json, "FileSize", file_size);
+            if (in_s3) {
+                cJSON_DeleteItemFromObject(json, "Bucket");
+                cJSON_DeleteItemFromObject(json, "Key");
+                cJSON_AddStringToObject(json, "Bucket", config.s3_bucket);
+                cJSON_AddStringToObject(json, "Key", key->valuestring);
+            }
+            cJSON_AddStringToObject(json, "SourceFilePath", input_file);
+            cJSON_AddNumberToObject(json, "FrameCount", frame_count);
+            cJSON_AddNumberToObject(json, "ProcessingTimeMs", processing_time_ms);
+            c->body = cJSON_PrintUnformatted(json);
+            cJSON_Delete(json);
+            c->ok = c->body != NULL;
+        }
     }
-    else {
-        result = send_response(connection, 404,
-            "{\"error\":\"Not found\",\"available_endpoints\":[\"/enqueue (POST)\",\"/health (GET)\",\"/metrics (GET)\"]}");
+
+    pthread_mutex_lock(&amqp_bridge.mutex);
+    if (amqp_bridge.done_tail) {
+        amqp_bridge.done_tail->next = c;
+    } else {
+        amqp_bridge.done_head = c;
     }
+    amqp_bridge.done_tail = c;
+    pthread_mutex_unlock(&amqp_bridge.mutex);
 
-    // Cleanup
-    if (con_info->upload_data_buffer) {
-        free(con_info->upload_data_buffer);
+    return c->ok ? 0 : -1;
+}
+
+int amqp_bridge_start(AmqpBridge *b) {
+    b->running = 1;
+    if (pthread_create(&b->thread, NULL, amqp_thread, b) != 0) {
+        fprintf(stderr, "[AMQP] Failed to start consumer thread\n");
+        b->running = 0;
+        return -1;
     }
-    free(con_info);
-    *con_cls = NULL;
+    b->started = 1;
+    return 0;
+}
 
-    return result;
+// Stop consuming; queued deliveries are returned to the broker
+void amqp_bridge_drain(AmqpBridge *b) {
+    b->draining = 1;
+}
+
+// After the workers are done: wait for the last results to be confirmed
+void amqp_bridge_stop(AmqpBridge *b) {
+    if (!b->started) {
+        return;
+    }
+    b->draining = 1;
+    pthread_join(b->thread, NULL);
+    b->started = 0;
+    b->running = 0;
 }
 
 // ============================================================================
@@ -1235,9 +12607,16 @@ static enum MHD_Result http_handler(void *cls,
 // ============================================================================
 
 int main(int argc, char **argv) {
+    // Started by a supervisor to run pipelines (see worker_processes_start)
+    for (int i = 1; i < argc - 1; i++) {
+        if (strcmp(argv[i], "--worker-process") == 0) worker_process_index = atoi(argv[i + 1]);
+    }
+
     // Check for no-GPU mode (Phase 1 testing)
     int arg_start = 1;
-    if (argc > 1 && strcmp(argv[1], "--no-gpu") == 0) {
+    if (worker_process_index >= 0) {
+        // Quiet start: the supervisor already printed the banner
+    } else if (argc > 1 && strcmp(argv[1], "--no-gpu") == 0) {
         no_gpu_mode = 1;
         arg_start = 2;
         fprintf(stderr, "=======================================================\n");
@@ -1252,6 +12631,107 @@ int main(int argc, char **argv) {
         fprintf(stderr, "=======================================================\n\n");
     }
 
+    // Configuration: defaults < config file < environment < command line
+    config_defaults(&config);
+    const char *config_path = getenv("TRANSCODER_CONFIG");
+    for (int i = arg_start; i < argc - 1; i++) {
+        if (strcmp(argv[i], "--config") == 0) config_path = argv[i + 1];
+    }
+    if (config_path && config_load_file(&config, config_path) < 0) {
+        return 1;
+    }
+    config_apply_env(&config);
+
+    // Check if running in batch mode or daemon mode
+    int daemon_mode = 1;
+    for (int i = arg_start; i < argc; i++) {
+        if (strcmp(argv[i], "--batch") == 0) {
+            daemon_mode = 0;
+        } else if ((strcmp(argv[i], "--config") == 0 || strcmp(argv[i], "--worker-process") == 0) &&
+                   i + 1 < argc) {
+            i++;  // Already handled
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            config.workers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--queue-capacity") == 0 && i + 1 < argc) {
+            config.queue_capacity = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--consolidate") == 0 && i + 1 < argc) {
+            config.consolidate_seconds = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--segment-seconds") == 0 && i + 1 < argc) {
+            config.segment_seconds = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--output-format") == 0 && i + 1 < argc) {
+            strncpy(config.output_format, argv[++i], sizeof(config.output_format) - 1);
+        } else if (strcmp(argv[i], "--simulate-devices") == 0 && i + 1 < argc) {
+            strncpy(config.simulate_devices, argv[++i], sizeof(config.simulate_devices) - 1);
+        } else if (strcmp(argv[i], "--device-sessions") == 0 && i + 1 < argc) {
+            config.workers_per_device = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--coalesce") == 0 && i + 1 < argc) {
+            strncpy(config.coalesce_key, argv[++i], sizeof(config.coalesce_key) - 1);
+        } else if (strcmp(argv[i], "--startup-parallel") == 0 && i + 1 < argc) {
+            config.startup_parallel = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--client-rate") == 0 && i + 1 < argc) {
+            config.client_rate = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--client-burst") == 0 && i + 1 < argc) {
+            config.client_burst = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--adaptive") == 0) {
+            config.adaptive = 1;
+        } else if (strcmp(argv[i], "--adaptive-min") == 0 && i + 1 < argc) {
+            config.adaptive_min = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--adaptive-max") == 0 && i + 1 < argc) {
+            config.adaptive_max = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--adaptive-interval") == 0 && i + 1 < argc) {
+            config.adaptive_interval = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--max-retries") == 0 && i + 1 < argc) {
+            config.max_retries = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--quarantine-ttl-hours") == 0 && i + 1 < argc) {
+            config.quarantine_ttl_hours = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--encoder-backend") == 0 && i + 1 < argc) {
+            strncpy(config.encoder_backend, argv[++i], sizeof(config.encoder_backend) - 1);
+        } else if (strcmp(argv[i], "--default-codec-profile") == 0 && i + 1 < argc) {
+            strncpy(config.default_codec_profile, argv[++i], sizeof(config.default_codec_profile) - 1);
+        } else if (strcmp(argv[i], "--chunk-mb") == 0 && i + 1 < argc) {
+            config.chunk_mb = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--no-ts-check") == 0) {
+            config.ts_check = 0;
+        } else if (strcmp(argv[i], "--affinity") == 0) {
+            config.affinity = 1;
+        } else if (strcmp(argv[i], "--queue-order") == 0 && i + 1 < argc) {
+            strncpy(config.queue_order, argv[++i], sizeof(config.queue_order) - 1);
+        } else if (strcmp(argv[i], "--no-probe-cache") == 0) {
+            config.probe_cache = 0;
+        } else if (strcmp(argv[i], "--local-socket") == 0 && i + 1 < argc) {
+            strncpy(config.local_socket, argv[++i], sizeof(config.local_socket) - 1);
+        } else if (strcmp(argv[i], "--amqp-host") == 0 && i + 1 < argc) {
+            strncpy(config.amqp_host, argv[++i], sizeof(config.amqp_host) - 1);
+        } else if (strcmp(argv[i], "--amqp-prefetch") == 0 && i + 1 < argc) {
+            config.amqp_prefetch = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--worker-processes") == 0) {
+            config.worker_processes = 1;
+        } else if (strcmp(argv[i], "--workers-per-process") == 0 && i + 1 < argc) {
+            config.workers_per_process = atoi(argv[++i]);
+        }
+    }
+
+    if (config_validate(&config) < 0) {
+        return 1;
+    }
+
+    int format = parse_output_format(config.output_format);
+    if (format < 0) {
+        fprintf(stderr, "[ERROR] Unknown output format: %s (expected ts or cmaf)\n", config.output_format);
+        return 1;
+    }
+    default_output_format = format;
+
+    // MPEG-TS carries H.264/HEVC only; AV1 goes out as CMAF
+    if (config.codec_profiles[0].codec == CODEC_AV1 &&
+        (format != OUTPUT_FORMAT_CMAF || config.timelapse_after_days > 0)) {
+        fprintf(stderr, "[ERROR] An AV1 default codec profile requires outputFormat cmaf and no timelapse afterDays\n");
+        return 1;
+    }
+    software_backend = strcmp(config.encoder_backend, "software") == 0;
+    sjf_order = strcmp(config.queue_order, "sjf") == 0;
+    coalesce_default = parse_coalesce_mode(config.coalesce_key);
+
     // Record start time
     start_time = time(NULL);
 
@@ -1260,16 +12740,116 @@ int main(int argc, char **argv) {
     signal(SIGTERM, signal_handler);
 
     // Create output directory
-    mkdir(OUTPUT_DIR, 0755);
+    mkdir(config.output_dir, 0755);
 
     // Initialize systems
-    queue_init(&task_queue);
+    if (queue_init(&task_queue, config.queue_capacity) < 0) {
+        fprintf(stderr, "[ERROR] Failed to allocate queue of %d jobs\n", config.queue_capacity);
+        return 1;
+    }
     processed_init(&processed_files);
+    scheduler_stats_init(&scheduler_stats);
+    job_index_init(&job_index);
+    coalescer_init(&coalescer, config.coalesce_cache_seconds);
+    retry_wheel_init(&retry_wheel);
+    quarantine_init(&quarantine);
+    admission_init(&admission);
+    local_server_init(&local_server);
+    amqp_bridge_init(&amqp_bridge);
+    worker_pool_init(&worker_pool);
+    adaptive_init(&adaptive_controller, &config);
+
+    // With the controller enabled the pool is sized for the upper bound and
+    // workers beyond the active limit park with warm pipelines
+    int pool_size = config.adaptive ? config.adaptive_max : config.workers;
+
+    // Device manager: real GPUs, or simulated devices for scheduling tests
+    if (config.simulate_devices[0]) {
+        if (device_manager_init_simulated(&device_manager, config.simulate_devices,
+                                          config.workers_per_device) <= 0) {
+            fprintf(stderr, "[ERROR] Invalid --simulate-devices spec: %s\n", config.simulate_devices);
+            return 1;
+        }
+        no_gpu_mode = 0;
+        fprintf(stderr, "[Main] Simulated device backend: %d devices\n", device_manager.nb_devices);
+        for (int i = 0; i < device_manager.nb_devices; i++) {
+            DeviceState *d = &device_manager.devices[i];
+            fprintf(stderr, "[Main]   Device %d: %dms/file, failure rate %.3f, corrupt rate %.3f%s\n",
+                    i, d->sim_latency_ms, d->sim_failure_rate, d->sim_corrupt_rate,
+                    d->sim_fail_after > 0 ? " (fails permanently)" : "");
+        }
+    } else if (software_backend && !no_gpu_mode) {
+        // CPU pipeline: one pseudo-device keeps session caps and health tracking
+        device_manager_init(&device_manager, 1, config.workers_per_device);
+        fprintf(stderr, "[Main] Software encoder backend (libx264/libx265/libsvtav1), %d codec profile(s)\n",
+                config.nb_codec_profiles);
+    } else if (!no_gpu_mode) {
+        int gpu_count = 0;
+        if (cudaGetDeviceCount(&gpu_count) != cudaSuccess || gpu_count <= 0) {
+            fprintf(stderr, "[ERROR] No CUDA devices found - GPU-only pipeline required\n");
+            return 1;
+        }
+        device_manager_init(&device_manager, gpu_count, config.workers_per_device);
+        fprintf(stderr, "[Main] Found %d GPU(s), sessions per device: %s\n", device_manager.nb_devices,
+                config.workers_per_device > 0 ? "capped" : "unlimited");
+    } else {
+        device_manager_init(&device_manager, 0, 0);
+    }
+    device_manager.warm_limit = config.startup_parallel;
+    if (!no_gpu_mode && !device_manager.simulated) {
+        fprintf(stderr, "[Main] Start-up: up to %d pipelines built concurrently per device\n",
+                config.startup_parallel);
+    }
 
-    // Check if running in batch mode or daemon mode
-    int daemon_mode = 1;
-    if (argc > arg_start && strcmp(argv[arg_start], "--batch") == 0) {
-        daemon_mode = 0;
+    // Consolidation merges API-fed segments per camera (daemon + GPU only)
+    int consolidate_seconds = config.consolidate_seconds;
+    if (consolidate_seconds > 0 && (no_gpu_mode || device_manager.simulated || !daemon_mode)) {
+        fprintf(stderr, "[Main] --consolidate ignored (requires daemon mode with GPU)\n");
+        consolidate_seconds = 0;
+    }
+    consolidator_init(&consolidator, consolidate_seconds, config.segment_seconds);
+    if (consolidate_seconds > 0) {
+        fprintf(stderr, "[Main] Consolidation: %ds outputs from %ds segments (%d per file)\n",
+                consolidate_seconds, consolidator.segment_seconds, group_capacity(&consolidator));
+    }
+    // Topology-aware placement: every thread started from here on inherits
+    // the service cores; workers re-pin to their device's node on attach
+    if (config.affinity && !no_gpu_mode && affinity_init(&affinity, &device_manager, config.service_cpus) == 0) {
+        affinity_pin_service(&affinity);
+    }
+    if (sjf_order) {
+        fprintf(stderr, "[Main] Queue order: shortest expected job first (aging x%d)\n", config.sjf_aging);
+    }
+    if (config.worker_processes && no_gpu_mode) {
+        fprintf(stderr, "[Main] workerProcesses ignored (no pipelines in no-GPU mode)\n");
+        config.worker_processes = 0;
+    }
+    // Parts of a split input share state across workers in one process
+    if (config.worker_processes && config.chunk_mb > 0) {
+        fprintf(stderr, "[Main] chunkMb ignored with workerProcesses\n");
+        config.chunk_mb = 0;
+    }
+    if (config.chunk_mb > 0 && !no_gpu_mode && !device_manager.simulated) {
+        fprintf(stderr, "[Main] Chunking: MPEG-TS inputs of %d MB or more split into parts of ~%d MB (max %d)\n",
+                2 * config.chunk_mb, config.chunk_mb, config.max_chunks);
+    }
+    // Uploaders, callbacks and the AMQP bridge all use curl from their own
+    // threads; initialise it once before any of them starts
+    curl_global_init(CURL_GLOBAL_ALL);
+    if (worker_process_index >= 0) {
+        return worker_process_main(worker_process_index);
+    }
+    if (config.s3_endpoint[0]) {
+        fprintf(stderr, "[Main] S3 output: TS files streamed to %s/%s/%s (%d MB parts, %d in memory, spool %s)\n",
+                config.s3_endpoint, config.s3_bucket, config.s3_prefix, config.s3_part_mb,
+                config.s3_buffer_parts, config.s3_spool_dir[0] ? config.s3_spool_dir : config.output_dir);
+    }
+
+    // Pipelines in child processes: a crash in libav or the driver costs one
+    // child and its jobs in flight, which go back through the retry wheel
+    if (config.worker_processes &&
+        worker_processes_start(&worker_processes, argc, argv, pool_size) < 0) {
+        return 1;
     }
 
     if (daemon_mode) {
@@ -1277,43 +12857,73 @@ int main(int argc, char **argv) {
         // DAEMON MODE: API-based continuous queue feeding
         // ============================================================================
 
-        fprintf(stderr, "[Main] Starting API server on port %d...\n", API_PORT);
+        fprintf(stderr, "[Main] Starting API server on port %d...\n", config.api_port);
 
         // Start API server
         api_daemon = MHD_start_daemon(
             MHD_USE_THREAD_PER_CONNECTION,
-            API_PORT,
+            config.api_port,
             NULL, NULL,
             &http_handler, NULL,
             MHD_OPTION_END
         );
 
         if (api_daemon == NULL) {
-            fprintf(stderr, "[ERROR] Failed to start API server on port %d\n", API_PORT);
-            fprintf(stderr, "[ERROR] Port may be in use. Check with: netstat -tuln | grep %d\n", API_PORT);
+            fprintf(stderr, "[ERROR] Failed to start API server on port %d\n", config.api_port);
+            fprintf(stderr, "[ERROR] Port may be in use. Check with: netstat -tuln | grep %d\n", config.api_port);
             return 1;
         }
 
-        fprintf(stderr, "[Main] ✓ API server listening on http://0.0.0.0:%d\n", API_PORT);
+        fprintf(stderr, "[Main] ✓ API server listening on http://0.0.0.0:%d\n", config.api_port);
         fprintf(stderr, "[Main]   Endpoints:\n");
         fprintf(stderr, "[Main]     POST /enqueue  - Add file to queue\n");
+        fprintf(stderr, "[Main]     POST /mosaic   - Composite cameras into one grid\n");
         fprintf(stderr, "[Main]     GET  /health   - Health check\n");
-        fprintf(stderr, "[Main]     GET  /metrics  - Prometheus metrics\n\n");
+        fprintf(stderr, "[Main]     GET  /ready    - Readiness (a worker pipeline is warm)\n");
+        fprintf(stderr, "[Main]     GET  /metrics  - Prometheus metrics\n");
+        fprintf(stderr, "[Main]     GET|POST /admin/config - Runtime config, resize workers/queue\n");
+        fprintf(stderr, "[Main]     GET  /jobs?state= - List jobs\n");
+        fprintf(stderr, "[Main]     GET|DELETE /jobs/{id} - Job status / cancel\n");
+        fprintf(stderr, "[Main]     GET  /quarantine - Permanently failed inputs\n");
+        fprintf(stderr, "[Main]     DELETE /quarantine/{file} - Release a quarantined input\n\n");
+
+        // Binary enqueue protocol for producers on the same host
+        if (config.local_socket[0]) {
+            if (local_server_start(&local_server, config.local_socket) < 0) {
+                return 1;
+            }
+            fprintf(stderr, "[Main] ✓ Local enqueue socket: %s\n\n", config.local_socket);
+        }
 
-        fprintf(stderr, "[Main] Starting %d worker threads...\n", MAX_WORKERS);
+        fprintf(stderr, "[Main] Starting %d worker threads...\n", pool_size);
 
-        // Start workers
-        pthread_t workers[MAX_WORKERS];
-        for (int i = 0; i < MAX_WORKERS; i++) {
-            int *worker_id = malloc(sizeof(int));
-            *worker_id = i;
-            pthread_create(&workers[i], NULL, worker_thread, worker_id);
-            usleep(50000);  // 50ms delay between thread creation for stability
+        // Start workers; their pipelines build concurrently in the background
+        if (adaptive_start(&adaptive_controller) < 0 || retry_wheel_start(&retry_wheel) < 0) {
+            return 1;
+        }
+        worker_pool_resize(&worker_pool, pool_size);
+
+        // Take traffic as soon as one pipeline is warm; the rest join the
+        // pool as they finish (/ready flips to 200 at the same point)
+        while (processing_active && worker_pool_warm(&worker_pool) == 0) {
+            usleep(20000);
+        }
+        pthread_mutex_lock(&worker_pool.mutex);
+        long long first_warm_ms = worker_pool.first_warm_ms;
+        pthread_mutex_unlock(&worker_pool.mutex);
+        if (first_warm_ms >= 0) {
+            fprintf(stderr, "[Main] ✓ First pipeline warm after %lldms, accepting jobs (%d/%d warm)\n",
+                    first_warm_ms, worker_pool_warm(&worker_pool), pool_size);
         }
 
-        fprintf(stderr, "[Main] ✓ All %d workers ready and waiting for jobs\n\n", MAX_WORKERS);
+        // RabbitMQ consumer (reconnects in the background if the broker is down).
+        // Started once a worker can take its deliveries.
+        if (processing_active && config.amqp_host[0] && amqp_bridge_start(&amqp_bridge) < 0) {
+            return 1;
+        }
+        fprintf(stderr, "\n");
         fprintf(stderr, "[Main] Daemon running. Press Ctrl+C to stop.\n");
-        fprintf(stderr, "[Main] Example: curl -X POST http://localhost:%d/enqueue -H 'Content-Type: application/json' -d '{\"filename\":\"camera_001.ts\"}'\n\n", API_PORT);
+        fprintf(stderr, "[Main] Example: curl -X POST http://localhost:%d/enqueue -H 'Content-Type: application/json' -d '{\"filename\":\"camera_001.ts\"}'\n\n", config.api_port);
 
         // Stats loop - print stats every 5 seconds
         int last_processed = 0;
@@ -1323,6 +12933,13 @@ int main(int argc, char **argv) {
         while (processing_active) {
             sleep(5);
 
+            // Dispatch groups of cameras that stopped sending segments
+            consolidator_flush(&consolidator, 0);
+
+            // Forget finished jobs past their retention window
+            job_index_sweep(&job_index);
+            coalescer_sweep(&coalescer);
+
             time_t now = time(NULL);
             int elapsed = (int)(now - last_stats_time);
 
@@ -1357,19 +12974,36 @@ int main(int argc, char **argv) {
             MHD_stop_daemon(api_daemon);
             api_daemon = NULL;
         }
+        local_server_stop(&local_server);
+        amqp_bridge_drain(&amqp_bridge);
+
+        // Dispatch partially filled groups, then let workers drain the queue
+        int flushed = consolidator_flush(&consolidator, 1);
+        if (flushed > 0) {
+            fprintf(stderr, "[Main] Dispatched %d open consolidation groups\n", flushed);
+        }
+        // Pending retries get one last attempt during the drain; failures
+        // from here on are final
+        retry_wheel_stop(&retry_wheel);
+        queue_close(&task_queue);
+        adaptive_stop(&adaptive_controller);
 
         fprintf(stderr, "[Main] Waiting for workers to finish current jobs...\n");
 
         // Wait for workers to exit
-        for (int i = 0; i < MAX_WORKERS; i++) {
-            pthread_join(workers[i], NULL);
-        }
+        worker_pool_join(&worker_pool);
+        worker_processes_stop(&worker_processes);
+        local_server_close(&local_server);
+        amqp_bridge_stop(&amqp_bridge);
 
         fprintf(stderr, "\n===========================================\n");
         fprintf(stderr, "Daemon Shutdown Complete\n");
         fprintf(stderr, "Files Processed: %d\n", files_processed);
         fprintf(stderr, "Files Failed: %d\n", files_failed);
         fprintf(stderr, "Uptime: %d seconds\n", (int)(time(NULL) - start_time));
+#ifdef ALLOC_DEBUG
+        alloc_debug_report();
+#endif
         fprintf(stderr, "===========================================\n");
 
     } else {
@@ -1377,50 +13011,49 @@ int main(int argc, char **argv) {
         // BATCH MODE: File system scanning (legacy mode)
         // ============================================================================
 
-        fprintf(stderr, "[Main] Running in BATCH mode (scanning %s)\n\n", INPUT_DIR);
+        fprintf(stderr, "[Main] Running in BATCH mode (scanning %s)\n\n", config.input_dir);
 
         // Start scanner
         pthread_t scanner;
         pthread_create(&scanner, NULL, scanner_thread, NULL);
         pthread_join(scanner, NULL);
 
-        fprintf(stderr, "\n[Main] Starting %d worker threads...\n\n", MAX_WORKERS);
+        fprintf(stderr, "\n[Main] Starting %d worker threads...\n\n", pool_size);
 
         // Start workers
-        pthread_t workers[MAX_WORKERS];
-        for (int i = 0; i < MAX_WORKERS; i++) {
-            int *worker_id = malloc(sizeof(int));
-            *worker_id = i;
-            pthread_create(&workers[i], NULL, worker_thread, worker_id);
-            usleep(50000);
+        if (adaptive_start(&adaptive_controller) < 0 || retry_wheel_start(&retry_wheel) < 0) {
+            return 1;
         }
+        worker_pool_resize(&worker_pool, pool_size);
 
-        // Wait for queue to be empty (all files processed)
+        // Wait for queue to be empty (all files processed) and no retry pending
         while (1) {
             pthread_mutex_lock(&task_queue.mutex);
             int count = task_queue.count;
             pthread_mutex_unlock(&task_queue.mutex);
-            if (count == 0) break;
+            if (count == 0 && retry_wheel_pending(&retry_wheel) == 0) break;
             sleep(1);
         }
 
         // Signal workers that no more files are coming
-        pthread_mutex_lock(&task_queue.mutex);
         processing_active = 0;
-        pthread_cond_broadcast(&task_queue.not_empty);
-        pthread_mutex_unlock(&task_queue.mutex);
+        retry_wheel_stop(&retry_wheel);
+        queue_close(&task_queue);
+        adaptive_stop(&adaptive_controller);
 
         fprintf(stderr, "\n[Main] All files processed, waiting for workers to finish...\n");
 
         // Wait for workers to exit
-        for (int i = 0; i < MAX_WORKERS; i++) {
-            pthread_join(workers[i], NULL);
-        }
+        worker_pool_join(&worker_pool);
+        worker_processes_stop(&worker_processes);
 
         fprintf(stderr, "\n===========================================\n");
         fprintf(stderr, "Batch Processing Complete\n");
         fprintf(stderr, "Files Processed: %d\n", files_processed);
         fprintf(stderr, "Files Failed: %d\n", files_failed);
+#ifdef ALLOC_DEBUG
+        alloc_debug_report();
+#endif
         fprintf(stderr, "===========================================\n");
     }
 